@@ -0,0 +1,480 @@
+#include "matrix.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <omp.h>
+
+/*
+ * Standalone benchmark for the kernels in matrix.c. Every (kernel, shape, thread count) case is
+ * warmed up, then sampled repeatedly; the median and 95th percentile times are reported along
+ * with GFLOP/s and effective GB/s as JSON, one result per line. Given a baseline file written by
+ * an earlier run, cases whose median got slower than the threshold are flagged as regressions.
+ *
+ * Usage: ./bench_matrix [--quick] [--samples N] [--threads 1,2,4] [--kernels add,mul,...]
+ *                       [--sizes 1,64,1024] [--out results.json] [--baseline baseline.json]
+ *                       [--threshold 0.10]
+ *
+ * --sizes replaces the sweep with square cases of the given sizes only; bench/run.py uses it to
+ * get kernel times for exactly the sizes it measures from Python.
+ */
+
+#define MAX_CASES 512
+#define MAX_THREADS 16
+#define MAX_SIZES 32
+#define POW_EXPONENT 13
+#define KERNEL_NAME 16
+
+typedef struct bench_case {
+    char kernel[KERNEL_NAME];
+    int rows;       // rows of the result
+    int cols;       // cols of the result
+    int inner;      // shared dimension of mul, the exponent of pow, 0 otherwise
+} bench_case;
+
+typedef struct bench_result {
+    bench_case bc;
+    int threads;
+    int samples;
+    double median_ns;
+    double p95_ns;
+    double gflops;
+    double gbps;
+    double baseline_ns;     // 0 when there is no matching baseline entry
+    int regression;
+} bench_result;
+
+typedef struct bench_options {
+    int quick;
+    int samples;
+    double budget;          // seconds of sampling per case
+    int threads[MAX_THREADS];
+    int num_threads;
+    int sizes[MAX_SIZES];
+    int num_sizes;          // 0 for the default sweep
+    const char *kernels;
+    const char *out;
+    const char *baseline;
+    double threshold;
+} bench_options;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Number of matrix multiplications pow_matrix does for exponent `pow`, following its
+ * square-and-multiply loop.
+ */
+static int pow_multiplies(int pow) {
+    if (pow < 2) {
+        return 0;
+    }
+    if (pow == 2) {
+        return 1;
+    }
+    int count = 0;
+    for (pow >>= 1; pow != 0; pow >>= 1) {
+        count += 1 + (pow & 1);
+    }
+    return count;
+}
+
+/*
+ * Floating point operations and compulsory memory traffic of one run of a case.
+ */
+static void case_work(const bench_case *bc, double *flops, double *bytes) {
+    double n = (double) bc->rows * bc->cols;
+    if (strcmp(bc->kernel, "mul") == 0) {
+        *flops = 2.0 * bc->rows * bc->cols * bc->inner;
+        *bytes = 8.0 * ((double) bc->rows * bc->inner + (double) bc->inner * bc->cols + n);
+    } else if (strcmp(bc->kernel, "pow") == 0) {
+        int muls = pow_multiplies(bc->inner);
+        *flops = 2.0 * n * bc->rows * muls;
+        *bytes = 8.0 * 3 * n * (muls > 0 ? muls : 1);
+    } else if (strcmp(bc->kernel, "add") == 0 || strcmp(bc->kernel, "sub") == 0) {
+        *flops = n;
+        *bytes = 8.0 * 3 * n;
+    } else if (strcmp(bc->kernel, "fill") == 0 || strcmp(bc->kernel, "rand") == 0) {
+        *flops = 0;
+        *bytes = 8.0 * n;
+    } else {
+        *flops = n;
+        *bytes = 8.0 * 2 * n;
+    }
+}
+
+static void run_kernel(const bench_case *bc, matrix *result, matrix *a, matrix *b) {
+    if (strcmp(bc->kernel, "add") == 0) {
+        add_matrix(result, a, b);
+    } else if (strcmp(bc->kernel, "sub") == 0) {
+        sub_matrix(result, a, b);
+    } else if (strcmp(bc->kernel, "mul") == 0) {
+        mul_matrix(result, a, b);
+    } else if (strcmp(bc->kernel, "pow") == 0) {
+        pow_matrix(result, a, bc->inner);
+    } else if (strcmp(bc->kernel, "neg") == 0) {
+        neg_matrix(result, a);
+    } else if (strcmp(bc->kernel, "abs") == 0) {
+        abs_matrix(result, a);
+    } else if (strcmp(bc->kernel, "rand") == 0) {
+        rand_matrix(result, 7, 0, 1);
+    } else if (strcmp(bc->kernel, "exp") == 0) {
+        exp_matrix(result, a);
+    } else if (strcmp(bc->kernel, "log") == 0) {
+        log_matrix(result, a);
+    } else if (strcmp(bc->kernel, "sqrt") == 0) {
+        sqrt_matrix(result, a);
+    } else if (strcmp(bc->kernel, "tanh") == 0) {
+        tanh_matrix(result, a);
+    } else if (strcmp(bc->kernel, "sigmoid") == 0) {
+        sigmoid_matrix(result, a);
+    } else {
+        fill_matrix(result, 1.5);
+    }
+}
+
+/*
+ * mul_matrix and pow_matrix accumulate into `result`, so it is zeroed (outside the timed region)
+ * before every sample to match a freshly allocated Python result.
+ */
+static int needs_reset(const bench_case *bc) {
+    return strcmp(bc->kernel, "mul") == 0 || strcmp(bc->kernel, "pow") == 0;
+}
+
+static int run_case(const bench_case *bc, int threads, const bench_options *opts, bench_result *res) {
+    matrix *a = NULL;
+    matrix *b = NULL;
+    matrix *result = NULL;
+    int aRows = bc->rows;
+    int aCols = strcmp(bc->kernel, "mul") == 0 ? bc->inner : bc->cols;
+    int bRows = aCols;
+    int bCols = bc->cols;
+    if (allocate_matrix(&a, aRows, aCols) || allocate_matrix(&b, bRows, bCols) ||
+            allocate_matrix(&result, bc->rows, bc->cols)) {
+        fprintf(stderr, "bench: cannot allocate %s %dx%d\n", bc->kernel, bc->rows, bc->cols);
+        deallocate_matrix(a);
+        deallocate_matrix(b);
+        return -1;
+    }
+    /* Keep pow bounded: entries in [0, 1/n) have a spectral radius below 1 */
+    double high = strcmp(bc->kernel, "pow") == 0 ? 1.0 / bc->rows : 1.0;
+    rand_matrix(a, 1, -high, high);
+    rand_matrix(b, 2, -high, high);
+    omp_set_num_threads(threads);
+
+    /* Warm up caches, page tables and the OpenMP team, and size the sample count from it */
+    double warm = 0;
+    for (int i = 0; i < 3; i++) {
+        if (needs_reset(bc)) {
+            fill_matrix(result, 0);
+        }
+        double start = now_ns();
+        run_kernel(bc, result, a, b);
+        warm = now_ns() - start;
+    }
+    int samples = opts->samples;
+    if (warm * samples > opts->budget * 1e9) {
+        samples = (int) (opts->budget * 1e9 / (warm > 1 ? warm : 1));
+    }
+    if (samples < 5) {
+        samples = 5;
+    }
+
+    double *times = malloc(samples * sizeof(double));
+    for (int i = 0; i < samples; i++) {
+        if (needs_reset(bc)) {
+            fill_matrix(result, 0);
+        }
+        double start = now_ns();
+        run_kernel(bc, result, a, b);
+        times[i] = now_ns() - start;
+    }
+    qsort(times, samples, sizeof(double), compare_doubles);
+
+    double flops, bytes;
+    case_work(bc, &flops, &bytes);
+    res->bc = *bc;
+    res->threads = threads;
+    res->samples = samples;
+    res->median_ns = samples % 2 ? times[samples / 2] : (times[samples / 2 - 1] + times[samples / 2]) / 2;
+    res->p95_ns = times[(int) (0.95 * (samples - 1))];
+    res->gflops = flops / res->median_ns;
+    res->gbps = bytes / res->median_ns;
+    res->baseline_ns = 0;
+    res->regression = 0;
+
+    free(times);
+    deallocate_matrix(a);
+    deallocate_matrix(b);
+    deallocate_matrix(result);
+    return 0;
+}
+
+static void add_case(bench_case *cases, int *count, const char *kernel, int rows, int cols, int inner) {
+    if (*count >= MAX_CASES) {
+        return;
+    }
+    bench_case *bc = &cases[(*count)++];
+    snprintf(bc->kernel, KERNEL_NAME, "%s", kernel);
+    bc->rows = rows;
+    bc->cols = cols;
+    bc->inner = inner;
+}
+
+static int kernel_selected(const char *kernel, const bench_options *opts) {
+    if (opts->kernels == NULL) {
+        return 1;
+    }
+    size_t len = strlen(kernel);
+    for (const char *p = opts->kernels; (p = strstr(p, kernel)) != NULL; p += len) {
+        if ((p == opts->kernels || p[-1] == ',') && (p[len] == ',' || p[len] == '\0')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * The size and shape sweep. Square sizes cover the serial cutoffs, cache-resident and
+ * memory-bound regimes; the odd shapes cover vectors, tall-skinny and ragged SIMD tails.
+ */
+static int build_cases(bench_case *cases, const bench_options *opts) {
+    static const char *elementwise[] = {"add", "sub", "neg", "abs", "fill", "rand", "exp", "log",
+                                        "sqrt", "tanh", "sigmoid"};
+    int numElementwise = sizeof(elementwise) / sizeof(elementwise[0]);
+    int squares[] = {4, 16, 64, 256, 1024, 2048};
+    int mulSquares[] = {4, 16, 64, 256, 512, 1024};
+    int numSquares = opts->quick ? 4 : 6;
+    int count = 0;
+
+    if (opts->num_sizes > 0) {
+        for (int e = 0; e < numElementwise; e++) {
+            for (int s = 0; s < opts->num_sizes && kernel_selected(elementwise[e], opts); s++) {
+                add_case(cases, &count, elementwise[e], opts->sizes[s], opts->sizes[s], 0);
+            }
+        }
+        for (int s = 0; s < opts->num_sizes && kernel_selected("mul", opts); s++) {
+            add_case(cases, &count, "mul", opts->sizes[s], opts->sizes[s], opts->sizes[s]);
+        }
+        for (int s = 0; s < opts->num_sizes && kernel_selected("pow", opts); s++) {
+            add_case(cases, &count, "pow", opts->sizes[s], opts->sizes[s], POW_EXPONENT);
+        }
+        return count;
+    }
+
+    for (int e = 0; e < numElementwise; e++) {
+        if (!kernel_selected(elementwise[e], opts)) {
+            continue;
+        }
+        for (int s = 0; s < numSquares; s++) {
+            add_case(cases, &count, elementwise[e], squares[s], squares[s], 0);
+        }
+        add_case(cases, &count, elementwise[e], 1, opts->quick ? 1 << 16 : 1 << 22, 0);
+        add_case(cases, &count, elementwise[e], opts->quick ? 1 << 12 : 1 << 16, 7, 0);
+        add_case(cases, &count, elementwise[e], 333, 333, 0);
+    }
+    if (kernel_selected("mul", opts)) {
+        for (int s = 0; s < numSquares; s++) {
+            add_case(cases, &count, "mul", mulSquares[s], mulSquares[s], mulSquares[s]);
+        }
+        int big = opts->quick ? 256 : 1024;
+        add_case(cases, &count, "mul", big, 1, big);           // matrix-vector
+        add_case(cases, &count, "mul", 1, big, big);           // vector-matrix
+        add_case(cases, &count, "mul", big, big, 16);          // rank-16 update
+        add_case(cases, &count, "mul", 16, 16, big * 4);       // tall-skinny inner product
+        add_case(cases, &count, "mul", 7, 9, 5);
+    }
+    if (kernel_selected("pow", opts)) {
+        add_case(cases, &count, "pow", 6, 6, POW_EXPONENT);
+        add_case(cases, &count, "pow", 64, 64, POW_EXPONENT);
+        add_case(cases, &count, "pow", opts->quick ? 128 : 256, opts->quick ? 128 : 256, POW_EXPONENT);
+    }
+    return count;
+}
+
+/*
+ * Read the results of an earlier run. Only the fields that identify a case and its median are
+ * needed; the file is the line-per-result JSON that write_results produces.
+ */
+static int read_baseline(const char *path, bench_result *base, int max) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[1024];
+    int count = 0;
+    while (count < max && fgets(line, sizeof(line), f) != NULL) {
+        bench_result *r = &base[count];
+        if (sscanf(line, " {\"kernel\": \"%15[^\"]\", \"rows\": %d, \"cols\": %d, \"inner\": %d, "
+                   "\"threads\": %d, \"samples\": %d, \"median_ns\": %lf",
+                   r->bc.kernel, &r->bc.rows, &r->bc.cols, &r->bc.inner, &r->threads,
+                   &r->samples, &r->median_ns) == 7) {
+            count++;
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+static void compare_baseline(bench_result *results, int count, const bench_result *base,
+                             int baseCount, double threshold) {
+    for (int i = 0; i < count; i++) {
+        bench_result *r = &results[i];
+        for (int j = 0; j < baseCount; j++) {
+            const bench_result *b = &base[j];
+            if (strcmp(b->bc.kernel, r->bc.kernel) == 0 && b->bc.rows == r->bc.rows &&
+                    b->bc.cols == r->bc.cols && b->bc.inner == r->bc.inner && b->threads == r->threads) {
+                r->baseline_ns = b->median_ns;
+                r->regression = r->median_ns > b->median_ns * (1 + threshold);
+                break;
+            }
+        }
+    }
+}
+
+static void write_results(FILE *f, const bench_result *results, int count, const bench_options *opts) {
+    fprintf(f, "{\n\"meta\": {\"max_threads\": %d, \"samples\": %d, \"budget_s\": %g, \"threshold\": %g},\n",
+            omp_get_num_procs(), opts->samples, opts->budget, opts->threshold);
+    fprintf(f, "\"results\": [\n");
+    for (int i = 0; i < count; i++) {
+        const bench_result *r = &results[i];
+        fprintf(f, "  {\"kernel\": \"%s\", \"rows\": %d, \"cols\": %d, \"inner\": %d, \"threads\": %d, "
+                "\"samples\": %d, \"median_ns\": %.1f, \"p95_ns\": %.1f, \"gflops\": %.4f, \"gbps\": %.4f",
+                r->bc.kernel, r->bc.rows, r->bc.cols, r->bc.inner, r->threads, r->samples,
+                r->median_ns, r->p95_ns, r->gflops, r->gbps);
+        if (r->baseline_ns > 0) {
+            fprintf(f, ", \"baseline_ns\": %.1f, \"change\": %.4f, \"regression\": %s", r->baseline_ns,
+                    r->median_ns / r->baseline_ns - 1, r->regression ? "true" : "false");
+        }
+        fprintf(f, "}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(f, "]\n}\n");
+}
+
+/*
+ * Parse a comma separated list of positive integers into `values`; return how many were read.
+ */
+static int parse_list(const char *arg, int *values, int max) {
+    int count = 0;
+    char *end;
+    for (const char *p = arg; *p != '\0' && count < max; p = *end ? end + 1 : end) {
+        long v = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        if (v > 0) {
+            values[count++] = (int) v;
+        }
+    }
+    return count;
+}
+
+/*
+ * Default thread sweep: 1, 2, 4, ... up to the number of processors, and the processor count
+ * itself if it is not a power of two.
+ */
+static void default_threads(bench_options *opts) {
+    int procs = omp_get_num_procs();
+    opts->num_threads = 0;
+    for (int t = 1; t < procs && opts->num_threads < MAX_THREADS - 1; t *= 2) {
+        opts->threads[opts->num_threads++] = t;
+    }
+    opts->threads[opts->num_threads++] = procs;
+}
+
+int main(int argc, char **argv) {
+    Py_Initialize();  // matrix.c reports errors through the Python error state
+    bench_options opts = {0, 30, 0.5, {0}, 0, {0}, 0, NULL, NULL, NULL, 0.10};
+    default_threads(&opts);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            opts.quick = 1;
+            opts.samples = 10;
+            opts.budget = 0.1;
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            opts.samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            opts.budget = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            opts.num_threads = parse_list(argv[++i], opts.threads, MAX_THREADS);
+        } else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            opts.num_sizes = parse_list(argv[++i], opts.sizes, MAX_SIZES);
+        } else if (strcmp(argv[i], "--kernels") == 0 && i + 1 < argc) {
+            opts.kernels = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            opts.out = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            opts.baseline = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            opts.threshold = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--samples N] [--budget SECONDS] [--threads 1,2,4] "
+                    "[--kernels add,sub,mul,pow,neg,abs,fill,rand,exp,log,sqrt,tanh,sigmoid] [--sizes 1,64,1024] [--out FILE] [--baseline FILE] "
+                    "[--threshold FRACTION]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (opts.samples < 1 || opts.num_threads == 0) {
+        fprintf(stderr, "bench: need at least one sample and one thread count\n");
+        return 2;
+    }
+
+    bench_case *cases = malloc(MAX_CASES * sizeof(bench_case));
+    int numCases = build_cases(cases, &opts);
+    bench_result *results = malloc((size_t) numCases * opts.num_threads * sizeof(bench_result));
+    int count = 0;
+    for (int c = 0; c < numCases; c++) {
+        for (int t = 0; t < opts.num_threads; t++) {
+            if (run_case(&cases[c], opts.threads[t], &opts, &results[count]) == 0) {
+                bench_result *r = &results[count++];
+                fprintf(stderr, "%-5s %5dx%-8d k=%-5d t=%-3d median %12.0f ns  p95 %12.0f ns  %8.3f GFLOP/s  %8.3f GB/s\n",
+                        r->bc.kernel, r->bc.rows, r->bc.cols, r->bc.inner, r->threads,
+                        r->median_ns, r->p95_ns, r->gflops, r->gbps);
+            }
+        }
+    }
+
+    int regressions = 0;
+    if (opts.baseline != NULL) {
+        bench_result *base = malloc(MAX_CASES * MAX_THREADS * sizeof(bench_result));
+        int baseCount = read_baseline(opts.baseline, base, MAX_CASES * MAX_THREADS);
+        if (baseCount < 0) {
+            return 2;
+        }
+        compare_baseline(results, count, base, baseCount, opts.threshold);
+        for (int i = 0; i < count; i++) {
+            if (results[i].regression) {
+                regressions++;
+                fprintf(stderr, "REGRESSION %s %dx%d k=%d t=%d: %.0f ns -> %.0f ns (%+.1f%%)\n",
+                        results[i].bc.kernel, results[i].bc.rows, results[i].bc.cols,
+                        results[i].bc.inner, results[i].threads, results[i].baseline_ns,
+                        results[i].median_ns, 100 * (results[i].median_ns / results[i].baseline_ns - 1));
+            }
+        }
+        fprintf(stderr, "%d regression(s) against %s\n", regressions, opts.baseline);
+        free(base);
+    }
+
+    FILE *out = stdout;
+    if (opts.out != NULL && (out = fopen(opts.out, "w")) == NULL) {
+        perror(opts.out);
+        return 2;
+    }
+    write_results(out, results, count, &opts);
+    if (out != stdout) {
+        fclose(out);
+    }
+    free(cases);
+    free(results);
+    return regressions > 0;
+}
@@ -0,0 +1,117 @@
+"""
+Cases for the Python-level benchmark suite (see run.py).
+
+Each case turns a matrix size n into a zero-argument callable that makes exactly one numc call on
+an n x n matrix, with all operands and Python-side inputs built beforehand. `kernel` names the
+matrix.c kernel the call ends up in, as bench_matrix calls it, so the runner can subtract the
+kernel time and attribute the rest to the wrapper code in numc.c. Cases without a kernel are pure
+wrapper cost.
+"""
+import pickle
+
+import numc as nc
+
+SIZES = [1, 4, 16, 64, 256, 1024, 4096]
+
+# Cubic kernels take seconds per call past this size, so they are left to bench_matrix
+CUBIC_MAX = 1024
+
+# Exponent for the pow case; bench_matrix times pow_matrix with the same one
+POW_EXPONENT = 13
+
+# Side of the block used by the 2D slice and setitem cases. It is fixed so that those cases
+# measure per-call overhead rather than the size of the copied region.
+BLOCK = 8
+
+
+class Case:
+    def __init__(self, name, setup, kernel=None, min_size=1, max_size=None):
+        self.name = name
+        self.setup = setup
+        self.kernel = kernel
+        self.min_size = min_size
+        self.max_size = max_size
+
+    def applies(self, n):
+        return n >= self.min_size and (self.max_size is None or n <= self.max_size)
+
+
+def matrix(n, seed=1):
+    return nc.Matrix(n, n, rand=True, seed=seed)
+
+
+def binary(op):
+    def setup(n):
+        a, b = matrix(n, 1), matrix(n, 2)
+        return lambda: op(a, b)
+    return setup
+
+
+def unary(op):
+    def setup(n):
+        a = matrix(n)
+        return lambda: op(a)
+    return setup
+
+
+def block(n):
+    return min(n, BLOCK)
+
+
+# Matrices with a single row or column are 1D and only take a single index, so the tuple
+# subscripts start at 2.
+CASES = [
+    # Operators
+    Case("add", binary(lambda a, b: a + b), kernel="add"),
+    Case("sub", binary(lambda a, b: a - b), kernel="sub"),
+    Case("mul", binary(lambda a, b: a * b), kernel="mul", max_size=CUBIC_MAX),
+    Case("pow", unary(lambda a: a ** POW_EXPONENT), kernel="pow", max_size=CUBIC_MAX),
+    Case("neg", unary(lambda a: -a), kernel="neg"),
+    Case("abs", unary(lambda a: abs(a)), kernel="abs"),
+    Case("exp", unary(lambda a: nc.exp(a)), kernel="exp"),
+    Case("log", unary(lambda a: nc.log(a)), kernel="log"),
+    Case("sqrt", unary(lambda a: nc.sqrt(a)), kernel="sqrt"),
+    Case("tanh", unary(lambda a: nc.tanh(a)), kernel="tanh"),
+    Case("sigmoid", unary(lambda a: nc.sigmoid(a)), kernel="sigmoid"),
+    Case("lt_scalar", unary(lambda a: a < 0.5)),
+    Case("eq", binary(lambda a, b: a == b)),
+    Case("where", binary(lambda a, b: nc.where(a, a, b))),
+    Case("allclose", binary(lambda a, b: nc.allclose(a, a))),
+
+    # Construction
+    Case("new_zeros", lambda n: lambda: nc.Matrix(n, n)),
+    Case("new_fill", lambda n: lambda: nc.Matrix(n, n, 1.5), kernel="fill"),
+    Case("new_rand", lambda n: lambda: nc.Matrix(n, n, rand=True, seed=3), kernel="rand"),
+
+    # Attribute and element access
+    Case("shape", unary(lambda a: a.shape)),
+    Case("get", unary(lambda a: a.get(0, 0))),
+    Case("set", unary(lambda a: a.set(0, 0, 2.5))),
+
+    # Subscripts
+    Case("getitem_int", unary(lambda a: a[0])),
+    Case("getitem_slice", lambda n: (lambda a, k: lambda: a[0:k])(matrix(n), block(n))),
+    Case("getitem_int_int", unary(lambda a: a[0, 1]), min_size=2),
+    Case("getitem_slice_slice", lambda n: (lambda a, k: lambda: a[0:k, 0:k])(matrix(n), block(n)), min_size=2),
+    Case("getitem_slice_int", lambda n: (lambda a, k: lambda: a[0:k, 1])(matrix(n), block(n)), min_size=2),
+    Case("getitem_int_slice", lambda n: (lambda a, k: lambda: a[1, 0:k])(matrix(n), block(n)), min_size=2),
+
+    # Setitem
+    Case("setitem_row", lambda n: (lambda a, row: lambda: a.__setitem__(0, row))(
+        matrix(n), [0.5] * n if n > 1 else 0.5)),
+    Case("setitem_int_int", unary(lambda a: a.__setitem__((0, 1), 0.5)), min_size=2),
+    Case("setitem_slice_slice", lambda n: (lambda a, k, v: lambda: a.__setitem__((slice(0, k), slice(0, k)), v))(
+        matrix(n), block(n), [[0.5] * block(n) for _ in range(block(n))]), min_size=2),
+    Case("setitem_int_slice", lambda n: (lambda a, k, v: lambda: a.__setitem__((1, slice(0, k)), v))(
+        matrix(n), block(n), [0.5] * block(n)), min_size=2),
+    Case("setitem_slice_int", lambda n: (lambda a, k, v: lambda: a.__setitem__((slice(0, k), 1), v))(
+        matrix(n), block(n), [0.5] * block(n)), min_size=2),
+    Case("setitem_matrix", binary(lambda a, b: a.__setitem__((slice(None), slice(None)), b)), min_size=2),
+    Case("setitem_fill", unary(lambda a: a.__setitem__((slice(None), slice(None)), 0.5)), kernel="fill",
+         min_size=2),
+    Case("setitem_shift", unary(lambda a: a.__setitem__(slice(1, None), a[:-1])), min_size=2),
+
+    # Pickling
+    Case("pickle", unary(lambda a: pickle.dumps(a, protocol=5, buffer_callback=lambda buf: None))),
+    Case("unpickle", lambda n: (lambda s: lambda: pickle.loads(s))(pickle.dumps(matrix(n), protocol=5))),
+]
@@ -0,0 +1,129 @@
+"""
+Python-level benchmark suite for numc.
+
+Times every case in cases.py at each size, from one numc call per iteration, and splits the median
+per-call time into the matrix.c kernel time (measured by bench_matrix for the same kernel, size and
+thread count) and the remainder, which is the numc.c wrapper: argument parsing, type checks,
+Matrix61c_new, allocate_matrix, get_shape and so on. Results are printed as a table and written as
+JSON.
+
+Usage: python3 bench/run.py [--quick] [--sizes 1,4,16] [--cases add,getitem_int] [--bench ./bench_matrix]
+                            [--c-results bench_results.json] [--threads N] [--out bench_python.json]
+"""
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import cases as bench_cases  # noqa: E402
+
+
+def time_call(fn, repeats, target_ns):
+    """Median nanoseconds per call of fn, over `repeats` timed loops of roughly target_ns each."""
+    start = time.perf_counter_ns()
+    fn()
+    single = max(time.perf_counter_ns() - start, 1)
+    loops = max(1, min(100000, target_ns // single))
+    samples = []
+    for _ in range(repeats):
+        start = time.perf_counter_ns()
+        for _ in range(loops):
+            fn()
+        samples.append((time.perf_counter_ns() - start) / loops)
+    return statistics.median(samples), loops
+
+
+def kernel_times(args, selected, sizes):
+    """Map (kernel, n) to bench_matrix's median nanoseconds for an n x n case."""
+    path = args.c_results
+    if path is None:
+        if args.bench is None or not os.path.exists(args.bench):
+            return {}
+        kernels = sorted({c.kernel for c in selected if c.kernel})
+        path = tempfile.mktemp(suffix=".json")
+        cubic = [n for n in sizes if n <= bench_cases.CUBIC_MAX]
+        runs = [([k for k in kernels if k not in ("mul", "pow")], sizes),
+                ([k for k in kernels if k in ("mul", "pow")], cubic)]
+        results = []
+        for run_kernels, run_sizes in runs:
+            if not run_kernels or not run_sizes:
+                continue
+            subprocess.run([args.bench, "--threads", str(args.threads), "--samples", "15",
+                            "--budget", "0.2" if args.quick else "1",
+                            "--kernels", ",".join(run_kernels),
+                            "--sizes", ",".join(map(str, run_sizes)), "--out", path],
+                           check=True, stderr=subprocess.DEVNULL)
+            with open(path) as f:
+                results += json.load(f)["results"]
+        os.unlink(path)
+    else:
+        with open(path) as f:
+            results = json.load(f)["results"]
+    times = {}
+    for r in results:
+        if r["rows"] == r["cols"] and r["threads"] == args.threads:
+            if r["kernel"] != "pow" or r["inner"] == bench_cases.POW_EXPONENT:
+                times[(r["kernel"], r["rows"])] = r["median_ns"]
+    return times
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--quick", action="store_true", help="fewer repeats and sizes up to 1024")
+    parser.add_argument("--sizes", help="comma separated matrix sizes (default 1,4,...,4096)")
+    parser.add_argument("--cases", help="comma separated case names (default all)")
+    parser.add_argument("--bench", default="./bench_matrix", help="bench_matrix binary used for kernel times")
+    parser.add_argument("--c-results", help="use an existing bench_matrix JSON file instead of running it")
+    parser.add_argument("--threads", type=int, default=os.cpu_count(),
+                        help="OpenMP threads numc uses (set OMP_NUM_THREADS to match)")
+    parser.add_argument("--out", help="write the results as JSON to this file")
+    args = parser.parse_args()
+
+    sizes = [int(s) for s in args.sizes.split(",")] if args.sizes else \
+        [n for n in bench_cases.SIZES if not args.quick or n <= 1024]
+    names = set(args.cases.split(",")) if args.cases else None
+    selected = [c for c in bench_cases.CASES if names is None or c.name in names]
+    repeats = 3 if args.quick else 7
+    target_ns = 2_000_000 if args.quick else 20_000_000
+
+    kernels = kernel_times(args, selected, sizes)
+    if not kernels:
+        print("no bench_matrix timings, reporting total time only", file=sys.stderr)
+
+    results = []
+    print("%-20s %6s %14s %14s %14s %8s" % ("case", "n", "total ns", "kernel ns", "wrapper ns", "wrapper"))
+    for case in selected:
+        for n in sizes:
+            if not case.applies(n):
+                continue
+            fn = case.setup(n)
+            total, loops = time_call(fn, repeats, target_ns)
+            kernel = None
+            if case.kernel is None:
+                kernel = 0.0
+            elif (case.kernel, n) in kernels:
+                kernel = min(kernels[(case.kernel, n)], total)
+            wrapper = None if kernel is None else total - kernel
+            results.append({"case": case.name, "rows": n, "cols": n, "kernel": case.kernel,
+                            "loops": loops, "total_ns": total, "kernel_ns": kernel, "wrapper_ns": wrapper,
+                            "wrapper_fraction": None if wrapper is None else wrapper / total})
+            print("%-20s %6d %14.0f %14s %14s %8s" % (
+                case.name, n, total,
+                "-" if kernel is None else "%.0f" % kernel,
+                "-" if wrapper is None else "%.0f" % wrapper,
+                "-" if wrapper is None else "%.1f%%" % (100 * wrapper / total)))
+            del fn
+
+    if args.out:
+        with open(args.out, "w") as f:
+            json.dump({"meta": {"threads": args.threads, "repeats": repeats, "sizes": sizes},
+                       "results": results}, f, indent=1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,1754 @@
+#include "matrix.h"
+#include "linalg.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <limits.h>
+#include <immintrin.h>
+
+/*
+ * Panel width of the blocked factorizations. Panels are factored with row and column loops; the
+ * trailing update after each one is a product of an (n - k) x block and a block x (n - k) matrix,
+ * which is where blocking pays off.
+ */
+int linalg_block = 64;
+
+/*
+ * Whether a dimension of `mat` does not fit the int indices these routines use. Dense
+ * factorizations of such a matrix would take years anyway, so they are refused up front.
+ */
+static int too_large(matrix *mat) {
+    return mat->rows > INT_MAX || mat->cols > INT_MAX;
+}
+
+static int block_size(int n) {
+    return linalg_block > 0 && linalg_block < n ? linalg_block : n;
+}
+
+/*
+ * A matrix struct over `count` rows given as pointers, for handing blocks of a factorization to
+ * mul_matrix. `rows` must stay valid while the view is in use.
+ */
+static matrix view(double **rows, int count, int cols) {
+    matrix m = {count, cols, rows, 1, 0, 0, NULL};
+    return m;
+}
+
+/*
+ * Fill `out` with rows[i] + col for i < count: the rows of the block that starts at column `col`.
+ */
+static double **block_rows(double **out, double **rows, int count, int col) {
+    for (int i = 0; i < count; i++) {
+        out[i] = rows[i] + col;
+    }
+    return out;
+}
+
+/*
+ * c -= a * b for an m x k block `a`, a k x n block `b` and an m x n block `c`, all given as row
+ * pointers, through mul_matrix: -a is copied out once and the product accumulates into c. With
+ * `trans` set, `a` is given as its k x m transpose instead, which the copy undoes.
+ */
+static int gemm_sub(double **c, double **a, double **b, int m, int n, int k, int trans) {
+    if (m == 0 || n == 0 || k == 0) {
+        return 0;
+    }
+    double *neg = malloc((size_t) m * k * sizeof(double));
+    double **negRows = malloc((size_t) m * sizeof(double *));
+    if (neg == NULL || negRows == NULL) {
+        free(neg);
+        free(negRows);
+        return LINALG_MEMORY;
+    }
+    for (int i = 0; i < m; i++) {
+        negRows[i] = neg + (size_t) i * k;
+    }
+    if (trans) {
+        for (int p = 0; p < k; p++) {
+            for (int i = 0; i < m; i++) {
+                negRows[i][p] = -a[p][i];
+            }
+        }
+    } else {
+        for (int i = 0; i < m; i++) {
+            for (int p = 0; p < k; p++) {
+                negRows[i][p] = -a[i][p];
+            }
+        }
+    }
+    matrix cView = view(c, m, n);
+    matrix aView = view(negRows, m, k);
+    matrix bView = view(b, k, n);
+    mul_matrix(&cView, &aView, &bView);
+    free(negRows);
+    free(neg);
+    return 0;
+}
+
+typedef struct panel_args {
+    double **rows;
+    int pivot;          // row and column of the pivot
+    int end;            // one past the panel's last column
+} panel_args;
+
+/*
+ * Rows pivot + 1 + [begin, end) of a panel step: divide by the pivot to get the column of L,
+ * then eliminate it from the rest of the panel.
+ */
+static void eliminate_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    panel_args *args = argp;
+    int j = args->pivot;
+    const double *pivotRow = args->rows[j];
+    double pivot = pivotRow[j];
+    for (int i = j + 1 + begin; i < j + 1 + end; i++) {
+        double *row = args->rows[i];
+        double l = row[j] / pivot;
+        row[j] = l;
+        for (int c = j + 1; c < args->end; c++) {
+            row[c] -= l * pivotRow[c];
+        }
+    }
+}
+
+typedef struct triangle_args {
+    double **rows;      // rows of the triangular block
+    double **rhs;       // rows of the right-hand sides, solved in place
+    int count;          // order of the triangular block
+    int offset;         // column of the block's diagonal in `rows`
+    int trans;          // solve with the transpose of the stored triangle
+    int unit;           // the diagonal is implied to be all ones
+} triangle_args;
+
+/*
+ * Entry (i, j) of the triangular block, or of its transpose.
+ */
+static inline double triangle_entry(const triangle_args *args, int i, int j) {
+    return args->trans ? args->rows[j][args->offset + i] : args->rows[i][args->offset + j];
+}
+
+/*
+ * Columns [begin, end) of rhs <- L^-1 rhs for a lower triangular `count` x `count` block.
+ */
+static void lower_solve_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    triangle_args *args = argp;
+    for (int i = 0; i < args->count; i++) {
+        double *x = args->rhs[i];
+        for (int j = 0; j < i; j++) {
+            double lij = triangle_entry(args, i, j);
+            const double *y = args->rhs[j];
+            for (int c = begin; c < end; c++) {
+                x[c] -= lij * y[c];
+            }
+        }
+        if (!args->unit) {
+            double inverse = 1 / triangle_entry(args, i, i);
+            for (int c = begin; c < end; c++) {
+                x[c] *= inverse;
+            }
+        }
+    }
+}
+
+/*
+ * Columns [begin, end) of rhs <- U^-1 rhs for an upper triangular `count` x `count` block.
+ */
+static void upper_solve_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    triangle_args *args = argp;
+    for (int i = args->count - 1; i >= 0; i--) {
+        double *x = args->rhs[i];
+        for (int j = i + 1; j < args->count; j++) {
+            double uij = triangle_entry(args, i, j);
+            const double *y = args->rhs[j];
+            for (int c = begin; c < end; c++) {
+                x[c] -= uij * y[c];
+            }
+        }
+        if (!args->unit) {
+            double inverse = 1 / triangle_entry(args, i, i);
+            for (int c = begin; c < end; c++) {
+                x[c] *= inverse;
+            }
+        }
+    }
+}
+
+/*
+ * Run a triangular solve on `columns` right-hand side columns, split over threads as the cost
+ * model sees fit.
+ */
+static void triangular_solve(range_fn fn, triangle_args *args, int columns) {
+    double n = args->count;
+    int threads;
+    int plan = plan_kernel(n * columns, n * n * columns, (n * n / 2 + n * columns) * sizeof(double),
+                           &threads);
+    parallel_for(plan, threads, columns, fn, args);
+}
+
+/*
+ * rhs <- T^-1 rhs in place for the `n` x `n` triangle T stored in the lower (or upper) part of
+ * `rows`, or for its transpose, and `m` right-hand side columns. `scratch` holds n row pointers.
+ * Blocked like the factorizations: each diagonal block is solved column-parallel and the rows
+ * after it (or before it, going backwards) are updated with one product.
+ */
+static int triangular_sweep(double **rows, int n, int lower, int trans, int unit, double **rhs,
+                            int m, double **scratch) {
+    int nb = block_size(n);
+    int ret = 0;
+    if (lower != trans) {
+        for (int k0 = 0; k0 < n && ret == 0; k0 += nb) {
+            int kb = k0 + nb < n ? k0 + nb : n;
+            triangle_args solve = {rows + k0, rhs + k0, kb - k0, k0, trans, unit};
+            triangular_solve(lower_solve_range, &solve, m);
+            double **a = trans ? block_rows(scratch, rows + k0, kb - k0, kb)
+                               : block_rows(scratch, rows + kb, n - kb, k0);
+            ret = gemm_sub(rhs + kb, a, rhs + k0, n - kb, m, kb - k0, trans);
+        }
+    } else {
+        for (int kb = n; kb > 0 && ret == 0; kb -= nb) {
+            int k0 = kb - nb > 0 ? kb - nb : 0;
+            triangle_args solve = {rows + k0, rhs + k0, kb - k0, k0, trans, unit};
+            triangular_solve(upper_solve_range, &solve, m);
+            double **a = trans ? block_rows(scratch, rows + k0, kb - k0, 0)
+                               : block_rows(scratch, rows, k0, k0);
+            ret = gemm_sub(rhs, a, rhs + k0, k0, m, kb - k0, trans);
+        }
+    }
+    return ret;
+}
+
+/*
+ * Factor the `n` x `n` matrix `a` into `lu`, which owns a copy of it afterwards and must be
+ * released with lu_free. A singular matrix still factors, with lu->singular set, so that its
+ * determinant comes out as 0; solving with it fails.
+ *
+ * Right-looking blocked LU: each panel of linalg_block columns is factored with partial pivoting
+ * column by column (exchanging whole rows, which only swaps row pointers), the block row to its
+ * right is solved against the panel's unit lower triangle, and the trailing matrix is updated
+ * with one product.
+ */
+int lu_factor(lu_factors *lu, matrix *a) {
+    if (too_large(a)) {
+        return LINALG_TOO_LARGE;
+    }
+    int n = a->rows;
+    uint64_t start = stats_begin(KERNEL_LU, n, n, n);
+    memset(lu, 0, sizeof(lu_factors));
+    lu->n = n;
+    lu->data = malloc((size_t) n * n * sizeof(double));
+    lu->rows = malloc((size_t) n * sizeof(double *));
+    lu->perm = malloc((size_t) n * sizeof(int));
+    double **scratchA = malloc((size_t) n * sizeof(double *));
+    double **scratchB = malloc((size_t) n * sizeof(double *));
+    double **scratchC = malloc((size_t) n * sizeof(double *));
+    if (lu->data == NULL || lu->rows == NULL || lu->perm == NULL || scratchA == NULL ||
+            scratchB == NULL || scratchC == NULL) {
+        lu_free(lu);
+        free(scratchA);
+        free(scratchB);
+        free(scratchC);
+        stats_end(KERNEL_LU, start, 0, 0);
+        return LINALG_MEMORY;
+    }
+    for (int i = 0; i < n; i++) {
+        lu->rows[i] = lu->data + (size_t) i * n;
+        lu->perm[i] = i;
+        get_row(a, i, 0, n, lu->rows[i]);
+    }
+
+    double **rows = lu->rows;
+    int nb = block_size(n);
+    int ret = 0;
+    for (int k0 = 0; k0 < n && ret == 0; k0 += nb) {
+        int kb = k0 + nb < n ? k0 + nb : n;
+        for (int j = k0; j < kb; j++) {
+            int p = j;
+            double best = fabs(rows[j][j]);
+            for (int i = j + 1; i < n; i++) {
+                if (fabs(rows[i][j]) > best) {
+                    best = fabs(rows[i][j]);
+                    p = i;
+                }
+            }
+            if (p != j) {
+                double *row = rows[p];
+                rows[p] = rows[j];
+                rows[j] = row;
+                int index = lu->perm[p];
+                lu->perm[p] = lu->perm[j];
+                lu->perm[j] = index;
+                lu->swaps++;
+            }
+            if (best == 0) {
+                lu->singular = 1;
+                continue;
+            }
+            panel_args args = {rows, j, kb};
+            double work = (double) (n - j - 1) * (kb - j);
+            int threads;
+            int plan = plan_kernel(work, 2 * work, 2 * work * sizeof(double), &threads);
+            parallel_for(plan, threads, n - j - 1, eliminate_range, &args);
+        }
+        if (kb == n) {
+            break;
+        }
+        /* U12 <- L11^-1 A12, then A22 -= L21 * U12 */
+        triangle_args solve = {rows + k0, block_rows(scratchA, rows + k0, kb - k0, kb),
+                                  kb - k0, k0, 0, 1};
+        triangular_solve(lower_solve_range, &solve, n - kb);
+        ret = gemm_sub(block_rows(scratchB, rows + kb, n - kb, kb),
+                       block_rows(scratchC, rows + kb, n - kb, k0),
+                       scratchA, n - kb, n - kb, kb - k0, 0);
+    }
+    free(scratchA);
+    free(scratchB);
+    free(scratchC);
+    if (ret != 0) {
+        lu_free(lu);
+    }
+    stats_end(KERNEL_LU, start, n * n, 1);
+    return ret;
+}
+
+/*
+ * Solve A x = b for the factored A and an n x m right-hand side `b`, writing the solution to
+ * the n x m matrix `x`, which may be b itself.
+ */
+int lu_solve(lu_factors *lu, matrix *b, matrix *x) {
+    if (too_large(b)) {
+        return LINALG_TOO_LARGE;
+    }
+    int n = lu->n;
+    int m = b->cols;
+    uint64_t start = stats_begin(KERNEL_LU_SOLVE, n, m, n);
+    if (lu->singular) {
+        stats_end(KERNEL_LU_SOLVE, start, 0, 1);
+        return LINALG_SINGULAR;
+    }
+    /* Row i of the work copy is row perm[i] of b */
+    double *work = malloc((size_t) n * m * sizeof(double));
+    double **rhs = malloc((size_t) n * sizeof(double *));
+    double **scratchA = malloc((size_t) n * sizeof(double *));
+    if (work == NULL || rhs == NULL || scratchA == NULL) {
+        free(work);
+        free(rhs);
+        free(scratchA);
+        stats_end(KERNEL_LU_SOLVE, start, 0, 1);
+        return LINALG_MEMORY;
+    }
+    for (int i = 0; i < n; i++) {
+        rhs[i] = work + (size_t) i * m;
+        get_row(b, lu->perm[i], 0, m, rhs[i]);
+    }
+
+    int ret = triangular_sweep(lu->rows, n, 1, 0, 1, rhs, m, scratchA);
+    if (ret == 0) {
+        ret = triangular_sweep(lu->rows, n, 0, 0, 0, rhs, m, scratchA);
+    }
+
+    for (int i = 0; i < n && ret == 0; i++) {
+        memcpy(x->data[i], rhs[i], m * sizeof(double));
+    }
+    free(work);
+    free(rhs);
+    free(scratchA);
+    stats_end(KERNEL_LU_SOLVE, start, n * m, 1);
+    return ret;
+}
+
+/*
+ * The determinant of the factored matrix: the product of U's diagonal, negated for an odd number
+ * of row exchanges.
+ */
+double lu_det(lu_factors *lu) {
+    if (lu->singular) {
+        return 0;
+    }
+    double det = lu->swaps % 2 ? -1 : 1;
+    for (int i = 0; i < lu->n; i++) {
+        det *= lu->rows[i][i];
+    }
+    return det;
+}
+
+void lu_free(lu_factors *lu) {
+    free(lu->data);
+    free(lu->rows);
+    free(lu->perm);
+    lu->data = NULL;
+    lu->rows = NULL;
+    lu->perm = NULL;
+}
+
+typedef struct cholesky_args {
+    double **rows;
+    int first;          // first row of the panel below the diagonal block
+    int k0;             // the diagonal block's columns
+    int kb;
+} cholesky_args;
+
+/*
+ * Rows first + [begin, end) of L21 <- A21 * L11^-T, one row at a time against the factored
+ * diagonal block.
+ */
+static void cholesky_panel_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    cholesky_args *args = argp;
+    double **rows = args->rows;
+    for (int i = args->first + begin; i < args->first + end; i++) {
+        double *row = rows[i];
+        for (int j = args->k0; j < args->kb; j++) {
+            const double *lj = rows[j];
+            double sum = row[j];
+            for (int p = args->k0; p < j; p++) {
+                sum -= row[p] * lj[p];
+            }
+            row[j] = sum / lj[j];
+        }
+    }
+}
+
+/*
+ * Factor the symmetric positive definite `n` x `n` matrix `a` into the lower triangular `l` with
+ * A = L * L^T. Only the lower triangle of `a` is read and only that of `l` is worked on; its
+ * upper triangle comes out zero. Return LINALG_NOT_SPD if some pivot is not positive.
+ *
+ * Right-looking blocked Cholesky: each diagonal block of linalg_block columns is factored in
+ * place, the panel below it is solved against it row-parallel, and the trailing matrix gets the
+ * symmetric rank-k update A22 -= L21 * L21^T one block row at a time, each only as wide as the
+ * lower triangle, through mul_matrix.
+ */
+int chol_factor(matrix *l, matrix *a) {
+    if (too_large(a)) {
+        return LINALG_TOO_LARGE;
+    }
+    int n = a->rows;
+    uint64_t start = stats_begin(KERNEL_CHOLESKY, n, n, n);
+    int nb = block_size(n);
+    double **rows = l->data;
+    double *trans = malloc((size_t) nb * n * sizeof(double));
+    double **transRows = malloc((size_t) nb * sizeof(double *));
+    double **scratchA = malloc((size_t) n * sizeof(double *));
+    double **scratchB = malloc((size_t) n * sizeof(double *));
+    if (trans == NULL || transRows == NULL || scratchA == NULL || scratchB == NULL) {
+        free(trans);
+        free(transRows);
+        free(scratchA);
+        free(scratchB);
+        stats_end(KERNEL_CHOLESKY, start, 0, 1);
+        return LINALG_MEMORY;
+    }
+    for (int i = 0; i < n; i++) {
+        get_row(a, i, 0, i + 1, rows[i]);
+    }
+
+    int ret = 0;
+    for (int k0 = 0; k0 < n && ret == 0; k0 += nb) {
+        int kb = k0 + nb < n ? k0 + nb : n;
+        /* L11 <- chol(A11), left-looking within the block */
+        for (int j = k0; j < kb && ret == 0; j++) {
+            double *lj = rows[j];
+            double d = lj[j];
+            for (int p = k0; p < j; p++) {
+                d -= lj[p] * lj[p];
+            }
+            if (!(d > 0)) {
+                ret = LINALG_NOT_SPD;
+                break;
+            }
+            lj[j] = sqrt(d);
+            for (int i = j + 1; i < kb; i++) {
+                double *li = rows[i];
+                double sum = li[j];
+                for (int p = k0; p < j; p++) {
+                    sum -= li[p] * lj[p];
+                }
+                li[j] = sum / lj[j];
+            }
+        }
+        if (ret != 0 || kb == n) {
+            break;
+        }
+        cholesky_args args = {rows, kb, k0, kb};
+        double work = (double) (n - kb) * (kb - k0) * (kb - k0);
+        int threads;
+        int plan = plan_kernel(work / 2, work, (n - kb) * (kb - k0) * 2.0 * sizeof(double), &threads);
+        parallel_for(plan, threads, n - kb, cholesky_panel_range, &args);
+
+        /* A22 -= L21 * L21^T, lower triangle only: block row i0 stops at its diagonal block */
+        for (int p = 0; p < kb - k0; p++) {
+            transRows[p] = trans + (size_t) p * n;
+            for (int i = kb; i < n; i++) {
+                transRows[p][i - kb] = rows[i][k0 + p];
+            }
+        }
+        for (int i0 = kb; i0 < n && ret == 0; i0 += nb) {
+            int i1 = i0 + nb < n ? i0 + nb : n;
+            ret = gemm_sub(block_rows(scratchA, rows + i0, i1 - i0, kb),
+                           block_rows(scratchB, rows + i0, i1 - i0, k0),
+                           transRows, i1 - i0, i1 - kb, kb - k0, 0);
+        }
+    }
+    /* The diagonal blocks of the updates spill over the diagonal */
+    for (int i = 0; i < n; i++) {
+        memset(rows[i] + i + 1, 0, (n - i - 1) * sizeof(double));
+    }
+    free(trans);
+    free(transRows);
+    free(scratchA);
+    free(scratchB);
+    stats_end(KERNEL_CHOLESKY, start, n * n, 1);
+    return ret;
+}
+
+/*
+ * Solve T x = b, or T^T x = b with `trans` set, for the `n` x `n` triangle T in the lower (or,
+ * with `lower` clear, the upper) triangle of `t` and an n x m right-hand side `b`, writing the
+ * solution to the n x m matrix `x`, which may be b itself. The other triangle of `t` is never
+ * read. Return LINALG_SINGULAR if T has a zero on its diagonal.
+ */
+int tri_solve(matrix *t, int lower, int trans, matrix *b, matrix *x) {
+    if (too_large(t) || too_large(b)) {
+        return LINALG_TOO_LARGE;
+    }
+    int n = t->rows;
+    int m = b->cols;
+    uint64_t start = stats_begin(KERNEL_TRSM, n, m, n);
+    for (int i = 0; i < n; i++) {
+        if (get(t, i, i) == 0) {
+            stats_end(KERNEL_TRSM, start, 0, 1);
+            return LINALG_SINGULAR;
+        }
+    }
+    /* The sweep runs along rows of the triangle, which a column-step slice does not have */
+    matrix packed;
+    matrix *tri = unit_stride(t, &packed);
+    double **scratch = malloc((size_t) n * sizeof(double *));
+    if (tri == NULL || scratch == NULL) {
+        if (tri != NULL) {
+            release_unit_stride(tri, &packed);
+        }
+        free(scratch);
+        stats_end(KERNEL_TRSM, start, 0, 1);
+        return LINALG_MEMORY;
+    }
+    if (x != b) {
+        for (int i = 0; i < n; i++) {
+            get_row(b, i, 0, m, x->data[i]);
+        }
+    }
+    int ret = triangular_sweep(tri->data, n, lower, trans, 0, x->data, m, scratch);
+    release_unit_stride(tri, &packed);
+    free(scratch);
+    stats_end(KERNEL_TRSM, start, n * m, 1);
+    return ret;
+}
+
+/*
+ * Solve A x = b given the Cholesky factor `l` of A, with the same conventions as tri_solve: a
+ * forward sweep with L and a backward one with L^T.
+ */
+int chol_solve(matrix *l, matrix *b, matrix *x) {
+    int ret = tri_solve(l, 1, 0, b, x);
+    return ret != 0 ? ret : tri_solve(l, 1, 1, x, x);
+}
+
+/*
+ * Turn column j of `a`, rows j to m, into a Householder reflector H = I - tau v v^T with
+ * H x = beta e1: beta goes on the diagonal and v below it, with its leading 1 implied.
+ */
+static void make_reflector(double **a, int m, int j, double *tau) {
+    double alpha = a[j][j];
+    double sigma = 0;
+    for (int i = j + 1; i < m; i++) {
+        sigma += a[i][j] * a[i][j];
+    }
+    if (sigma == 0) {
+        *tau = 0;
+        return;
+    }
+    double norm = sqrt(alpha * alpha + sigma);
+    double beta = alpha >= 0 ? -norm : norm;
+    double scale = 1 / (alpha - beta);
+    for (int i = j + 1; i < m; i++) {
+        a[i][j] *= scale;
+    }
+    a[j][j] = beta;
+    *tau = (beta - alpha) / beta;
+}
+
+/*
+ * Panels and right-hand sides narrower than this get their reflectors one at a time: building
+ * T takes a product as big as the update itself would be for this many columns.
+ */
+#define QR_BLOCK_COLUMNS 16
+
+/*
+ * Unblocked QR of columns [k0, kb) of `a`: one reflector per column, each applied to the rest of
+ * the panel right away. `w` has room for kb - k0 sums.
+ */
+static void panel_qr(double **a, int m, int k0, int kb, double *tau, double *w) {
+    for (int j = k0; j < kb; j++) {
+        make_reflector(a, m, j, tau + j);
+        if (tau[j] == 0 || j + 1 == kb) {
+            continue;
+        }
+        int width = kb - j - 1;
+        memcpy(w, a[j] + j + 1, width * sizeof(double));
+        for (int i = j + 1; i < m; i++) {
+            double v = a[i][j];
+            const double *row = a[i] + j + 1;
+            for (int c = 0; c < width; c++) {
+                w[c] += v * row[c];
+            }
+        }
+        for (int c = 0; c < width; c++) {
+            w[c] *= tau[j];
+            a[j][j + 1 + c] -= w[c];
+        }
+        for (int i = j + 1; i < m; i++) {
+            double v = a[i][j];
+            double *row = a[i] + j + 1;
+            for (int c = 0; c < width; c++) {
+                row[c] -= v * w[c];
+            }
+        }
+    }
+}
+
+/*
+ * apply_block for a few columns: c <- H_j c for each reflector in turn, w = tau_j (v_j^T c) and
+ * c -= v_j w.
+ */
+static int apply_reflectors(double **a, int m, int k0, int kb, const double *tau, double **c,
+                            int k, int trans) {
+    double w[QR_BLOCK_COLUMNS];
+    for (int step = 0; step < kb - k0; step++) {
+        int j = trans ? k0 + step : kb - 1 - step;
+        if (tau[j] == 0) {
+            continue;
+        }
+        memcpy(w, c[j], k * sizeof(double));
+        for (int i = j + 1; i < m; i++) {
+            double v = a[i][j];
+            for (int x = 0; x < k; x++) {
+                w[x] += v * c[i][x];
+            }
+        }
+        for (int x = 0; x < k; x++) {
+            w[x] *= tau[j];
+            c[j][x] -= w[x];
+        }
+        for (int i = j + 1; i < m; i++) {
+            double v = a[i][j];
+            for (int x = 0; x < k; x++) {
+                c[i][x] -= v * w[x];
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * c <- H c, or H^T c with `trans` set, for the m x k matrix `c` and the product H of the
+ * reflectors in columns [k0, kb) of `a`. H is used in compact WY form, I - V T V^T with V the
+ * reflectors and T a small upper triangle, so that the work is three products: the Gram matrix
+ * V^T V that T comes from, W = V^T c and c -= V (T W). V's rows below its unit triangle are
+ * used where they are in `a`; only the transpose is copied out.
+ */
+static int apply_block(double **a, int m, int k0, int kb, const double *tau, double **c, int k,
+                       int trans) {
+    int ms = m - k0;
+    int b = kb - k0;
+    if (ms <= 0 || b == 0 || k == 0) {
+        return 0;
+    }
+    if (k < QR_BLOCK_COLUMNS) {
+        return apply_reflectors(a, m, k0, kb, tau, c, k, trans);
+    }
+    double *vt = malloc((size_t) b * ms * sizeof(double));
+    double *top = calloc((size_t) b * b, sizeof(double));
+    double *gram = calloc((size_t) b * b, sizeof(double));
+    double *t = malloc((size_t) b * b * sizeof(double));
+    double *w = calloc((size_t) b * k, sizeof(double));
+    double **vRows = malloc((size_t) ms * sizeof(double *));
+    double **rows = malloc((size_t) 3 * b * sizeof(double *));
+    if (vt == NULL || top == NULL || gram == NULL || t == NULL || w == NULL || vRows == NULL ||
+            rows == NULL) {
+        free(vt);
+        free(top);
+        free(gram);
+        free(t);
+        free(w);
+        free(vRows);
+        free(rows);
+        return LINALG_MEMORY;
+    }
+    double **vtRows = rows;
+    double **wRows = rows + b;
+    double **gramRows = rows + 2 * b;
+    for (int j = 0; j < b; j++) {
+        vtRows[j] = vt + (size_t) j * ms;
+        wRows[j] = w + (size_t) j * k;
+        gramRows[j] = gram + (size_t) j * b;
+    }
+    for (int i = 0; i < ms; i++) {
+        const double *row = a[k0 + i] + k0;
+        if (i < b) {
+            vRows[i] = top + (size_t) i * b;
+            memcpy(vRows[i], row, i * sizeof(double));
+            vRows[i][i] = 1;
+        } else {
+            vRows[i] = (double *) row;
+        }
+        for (int j = 0; j < b; j++) {
+            vtRows[j][i] = vRows[i][j];
+        }
+    }
+    matrix gramView = view(gramRows, b, b);
+    matrix vtView = view(vtRows, b, ms);
+    matrix vView = view(vRows, ms, b);
+    mul_matrix(&gramView, &vtView, &vView);
+    /* T[0:j, j] = -tau_j T[0:j, 0:j] (V^T V)[0:j, j], as in LAPACK's dlarft */
+    for (int j = 0; j < b; j++) {
+        for (int i = 0; i < j; i++) {
+            double sum = 0;
+            for (int l = i; l < j; l++) {
+                sum += t[(size_t) i * b + l] * gramRows[l][j];
+            }
+            t[(size_t) i * b + j] = -tau[k0 + j] * sum;
+        }
+        t[(size_t) j * b + j] = tau[k0 + j];
+    }
+    matrix wView = view(wRows, b, k);
+    matrix cView = view(c + k0, ms, k);
+    mul_matrix(&wView, &vtView, &cView);
+    /* W <- T^T W or T W, in place, in the order that reads each row before overwriting it */
+    if (trans) {
+        for (int i = b - 1; i >= 0; i--) {
+            for (int x = 0; x < k; x++) {
+                wRows[i][x] *= t[(size_t) i * b + i];
+            }
+            for (int j = 0; j < i; j++) {
+                double tji = t[(size_t) j * b + i];
+                for (int x = 0; x < k; x++) {
+                    wRows[i][x] += tji * wRows[j][x];
+                }
+            }
+        }
+    } else {
+        for (int i = 0; i < b; i++) {
+            for (int x = 0; x < k; x++) {
+                wRows[i][x] *= t[(size_t) i * b + i];
+            }
+            for (int j = i + 1; j < b; j++) {
+                double tij = t[(size_t) i * b + j];
+                for (int x = 0; x < k; x++) {
+                    wRows[i][x] += tij * wRows[j][x];
+                }
+            }
+        }
+    }
+    int ret = gemm_sub(c + k0, vRows, wRows, ms, k, b, 0);
+    free(vt);
+    free(top);
+    free(gram);
+    free(t);
+    free(w);
+    free(vRows);
+    free(rows);
+    return ret;
+}
+
+/*
+ * QR of columns [k0, kb) of `a`, recursively (Elmroth and Gustavson, "Applying recursion to serial
+ * and parallel QR factorization leads to better performance"): factor the left half, apply it to
+ * the right half as one block reflector, factor the right half. Below QR_BLOCK_COLUMNS columns
+ * the column loops of panel_qr take over. A tall panel is thereby mostly products too, instead
+ * of one pass over all its rows per column. `scratch` holds m row pointers.
+ */
+static int recursive_panel_qr(double **a, int m, int k0, int kb, double *tau, double *w,
+                              double **scratch) {
+    if (kb - k0 <= QR_BLOCK_COLUMNS) {
+        panel_qr(a, m, k0, kb, tau, w);
+        return 0;
+    }
+    int mid = k0 + (kb - k0) / 2;
+    int ret = recursive_panel_qr(a, m, k0, mid, tau, w, scratch);
+    if (ret == 0) {
+        ret = apply_block(a, m, k0, mid, tau, block_rows(scratch, a, m, mid), kb - mid, 1);
+    }
+    if (ret == 0) {
+        ret = recursive_panel_qr(a, m, mid, kb, tau, w, scratch);
+    }
+    return ret;
+}
+
+/*
+ * Householder QR of the m x n matrix `a` in place: R on and above the diagonal, the reflectors
+ * below it and their min(m, n) scale factors in `tau`. Blocked by linalg_block: each panel is
+ * factored by recursive_panel_qr and then applied to the columns to its right as one block
+ * reflector.
+ */
+static int householder_qr(double **a, int m, int n, double *tau) {
+    int r = m < n ? m : n;
+    int nb = block_size(r);
+    double *w = malloc(QR_BLOCK_COLUMNS * sizeof(double));
+    double **scratch = malloc((size_t) (m > 0 ? m : 1) * sizeof(double *));
+    if (w == NULL || scratch == NULL) {
+        free(w);
+        free(scratch);
+        return LINALG_MEMORY;
+    }
+    int ret = 0;
+    for (int k0 = 0; k0 < r && ret == 0; k0 += nb) {
+        int kb = k0 + nb < r ? k0 + nb : r;
+        ret = recursive_panel_qr(a, m, k0, kb, tau, w, scratch);
+        if (ret == 0 && kb < n) {
+            ret = apply_block(a, m, k0, kb, tau, block_rows(scratch, a, m, kb), n - kb, 1);
+        }
+    }
+    free(w);
+    free(scratch);
+    return ret;
+}
+
+/*
+ * c <- Q c, or Q^T c with `trans` set, for the m x k matrix `c` and the Q = H_1 ... H_r whose r
+ * reflectors householder_qr left in `a`.
+ */
+static int apply_q(double **a, int m, int r, const double *tau, double **c, int k, int trans) {
+    int nb = block_size(r);
+    int ret = 0;
+    if (trans) {
+        for (int k0 = 0; k0 < r && ret == 0; k0 += nb) {
+            ret = apply_block(a, m, k0, k0 + nb < r ? k0 + nb : r, tau, c, k, 1);
+        }
+    } else {
+        for (int k0 = r > 0 ? (r - 1) / nb * nb : 0; k0 >= 0 && r > 0 && ret == 0; k0 -= nb) {
+            ret = apply_block(a, m, k0, k0 + nb < r ? k0 + nb : r, tau, c, k, 0);
+        }
+    }
+    return ret;
+}
+
+/*
+ * Tall-skinny QR (Demmel et al., "Communication-optimal parallel and sequential QR and LU
+ * factorizations"). A plain QR runs each panel down all m rows one column at a time, which for a
+ * tall matrix streams the whole panel through memory twice per column and does not split over
+ * threads. TSQR instead cuts the rows into blocks of about TSQR_BLOCK_BYTES, which are factored
+ * independently, in cache and in parallel; their n x n R factors are stacked and the stack is
+ * factored the same way, until it fits in one block. Q is the block diagonal of the blocks' Qs
+ * times the Q of the stack.
+ */
+#define TSQR_BLOCK_BYTES (512 * 1024)
+
+typedef struct tsqr_args {
+    double **a;         // the m x n matrix, factored block by block in place
+    int m;
+    int n;
+    int blocks;
+    double *tau;        // n scale factors per block
+    double **c;         // m x k matrix to apply Q or Q^T to, or NULL
+    int k;
+    int apply;          // 0: factor and apply Q^T to c, if any, 1: apply Q to c
+    int *status;        // per block
+} tsqr_args;
+
+static void tsqr_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    tsqr_args *args = argp;
+    for (int i = begin; i < end; i++) {
+        int r0 = (int) ((int64_t) args->m * i / args->blocks);
+        int r1 = (int) ((int64_t) args->m * (i + 1) / args->blocks);
+        double *tau = args->tau + (size_t) i * args->n;
+        int ret = 0;
+        if (args->apply == 0) {
+            ret = householder_qr(args->a + r0, r1 - r0, args->n, tau);
+        }
+        if (ret == 0 && args->c != NULL) {
+            ret = apply_q(args->a + r0, r1 - r0, args->n, tau, args->c + r0, args->k,
+                          args->apply == 0);
+        }
+        args->status[i] = ret;
+    }
+}
+
+/*
+ * Run tsqr_range over every block, on as many threads as the cost model gives the whole level.
+ */
+static int tsqr_run(tsqr_args *args) {
+    double m = args->m, n = args->n;
+    int threads;
+    int plan = plan_kernel(m * n, 2 * m * n * (n + args->k), 2 * m * (n + args->k) * sizeof(double),
+                           &threads);
+    parallel_for(plan, threads < args->blocks ? threads : args->blocks, args->blocks, tsqr_range,
+                 args);
+    for (int i = 0; i < args->blocks; i++) {
+        if (args->status[i] != 0) {
+            return args->status[i];
+        }
+    }
+    return 0;
+}
+
+/*
+ * Allocate a zeroed rows x cols matrix and its row pointers in one block, so that the pointers
+ * can be permuted freely and the whole is still released with free_rows. Return the row pointers
+ * or NULL.
+ */
+static double **alloc_rows(int rows, int cols) {
+    size_t pointers = (size_t) (rows > 0 ? rows : 1) * sizeof(double *);
+    double **out = calloc(1, pointers + (size_t) rows * cols * sizeof(double));
+    if (out == NULL) {
+        return NULL;
+    }
+    double *data = (double *) ((char *) out + pointers);
+    for (int i = 0; i < rows; i++) {
+        out[i] = data + (size_t) i * cols;
+    }
+    return out;
+}
+
+static void free_rows(double **rows) {
+    free(rows);
+}
+
+/*
+ * QR of the m x n matrix `a`, m >= n, in place. Afterwards R is in the upper triangle of a's
+ * first n rows, the first n rows of the m x k `c` (if not NULL) are those of Q^T c, and the
+ * m x n `q` (if not NULL) holds the thin Q. What is left in the rest of `a` and `c` is scratch.
+ */
+static int tsqr(double **a, int m, int n, double **c, int k, double **q) {
+    int height = TSQR_BLOCK_BYTES / (n * (int) sizeof(double));
+    int blocks = m / (height > 4 * n ? height : 4 * n);
+    int ret = 0;
+    if (blocks < 2) {
+        double *tau = malloc((size_t) n * sizeof(double));
+        if (tau == NULL) {
+            return LINALG_MEMORY;
+        }
+        ret = householder_qr(a, m, n, tau);
+        if (ret == 0 && c != NULL) {
+            ret = apply_q(a, m, n, tau, c, k, 1);
+        }
+        if (ret == 0 && q != NULL) {
+            for (int i = 0; i < m; i++) {
+                memset(q[i], 0, n * sizeof(double));
+            }
+            for (int i = 0; i < n; i++) {
+                q[i][i] = 1;
+            }
+            ret = apply_q(a, m, n, tau, q, n, 0);
+        }
+        free(tau);
+        return ret;
+    }
+
+    double *tau = malloc((size_t) blocks * n * sizeof(double));
+    int *status = malloc(blocks * sizeof(int));
+    double **stack = alloc_rows(blocks * n, n);
+    double **cStack = c != NULL ? alloc_rows(blocks * n, k) : NULL;
+    double **qStack = q != NULL ? alloc_rows(blocks * n, n) : NULL;
+    if (tau == NULL || status == NULL || stack == NULL || (c != NULL && cStack == NULL) ||
+            (q != NULL && qStack == NULL)) {
+        ret = LINALG_MEMORY;
+    }
+    tsqr_args args = {a, m, n, blocks, tau, c, k, 0, status};
+    if (ret == 0) {
+        ret = tsqr_run(&args);
+    }
+    if (ret == 0) {
+        for (int i = 0; i < blocks; i++) {
+            int r0 = (int) ((int64_t) m * i / blocks);
+            for (int x = 0; x < n; x++) {
+                memcpy(stack[i * n + x] + x, a[r0 + x] + x, (n - x) * sizeof(double));
+                if (c != NULL) {
+                    memcpy(cStack[i * n + x], c[r0 + x], k * sizeof(double));
+                }
+            }
+        }
+        ret = tsqr(stack, blocks * n, n, cStack, k, qStack);
+    }
+    if (ret == 0) {
+        /* Only the upper triangle: the first block's reflectors are below it */
+        for (int x = 0; x < n; x++) {
+            memcpy(a[x] + x, stack[x] + x, (n - x) * sizeof(double));
+            if (c != NULL) {
+                memcpy(c[x], cStack[x], k * sizeof(double));
+            }
+        }
+    }
+    if (ret == 0 && q != NULL) {
+        for (int i = 0; i < m; i++) {
+            memset(q[i], 0, n * sizeof(double));
+        }
+        for (int i = 0; i < blocks; i++) {
+            int r0 = (int) ((int64_t) m * i / blocks);
+            for (int x = 0; x < n; x++) {
+                memcpy(q[r0 + x], qStack[i * n + x], n * sizeof(double));
+            }
+        }
+        args.c = q;
+        args.k = n;
+        args.apply = 1;
+        ret = tsqr_run(&args);
+    }
+    free(tau);
+    free(status);
+    free_rows(stack);
+    free_rows(cStack);
+    free_rows(qStack);
+    return ret;
+}
+
+/*
+ * Thin QR of the m x n matrix `a`: the m x min(m, n) `q` with orthonormal columns (skipped if q
+ * is NULL) and the min(m, n) x n upper triangular `r` with A = Q R. Tall matrices go through
+ * TSQR, wide ones through a plain blocked QR.
+ */
+int qr_decompose(matrix *a, matrix *q, matrix *r) {
+    if (too_large(a)) {
+        return LINALG_TOO_LARGE;
+    }
+    int m = a->rows;
+    int n = a->cols;
+    int k = m < n ? m : n;
+    uint64_t start = stats_begin(KERNEL_QR, m, n, n);
+    double **work = alloc_rows(m, n);
+    if (work == NULL) {
+        stats_end(KERNEL_QR, start, 0, 1);
+        return LINALG_MEMORY;
+    }
+    for (int i = 0; i < m; i++) {
+        get_row(a, i, 0, n, work[i]);
+    }
+    int ret = 0;
+    if (m >= n) {
+        ret = tsqr(work, m, n, NULL, 0, q != NULL ? q->data : NULL);
+    } else {
+        double *tau = malloc((size_t) (k > 0 ? k : 1) * sizeof(double));
+        ret = tau == NULL ? LINALG_MEMORY : householder_qr(work, m, n, tau);
+        if (ret == 0 && q != NULL) {
+            for (int i = 0; i < m; i++) {
+                memset(q->data[i], 0, k * sizeof(double));
+                q->data[i][i] = 1;
+            }
+            ret = apply_q(work, m, k, tau, q->data, k, 0);
+        }
+        free(tau);
+    }
+    for (int i = 0; i < k && ret == 0; i++) {
+        memset(r->data[i], 0, i * sizeof(double));
+        memcpy(r->data[i] + i, work[i] + i, (n - i) * sizeof(double));
+    }
+    free_rows(work);
+    stats_end(KERNEL_QR, start, (uint64_t) m * n, 1);
+    return ret;
+}
+
+/*
+ * Least squares: the n x k `x` that minimizes ||A x - b|| for the m x n `a` with m >= n and the
+ * m x k `b`, from A = Q R as R x = (Q^T b)[0:n]. Q is never formed; its reflectors are applied to
+ * b as they are produced. Return LINALG_SINGULAR if A does not have full column rank, that is
+ * if some diagonal entry of R is within m * DBL_EPSILON of the largest one.
+ */
+int qr_lstsq(matrix *a, matrix *b, matrix *x) {
+    if (too_large(a) || too_large(b)) {
+        return LINALG_TOO_LARGE;
+    }
+    int m = a->rows;
+    int n = a->cols;
+    int k = b->cols;
+    uint64_t start = stats_begin(KERNEL_QR, m, n, n);
+    double **work = alloc_rows(m, n);
+    double **rhs = alloc_rows(m, k);
+    double **scratch = malloc((size_t) (n > 0 ? n : 1) * sizeof(double *));
+    int ret = 0;
+    if (work == NULL || rhs == NULL || scratch == NULL) {
+        ret = LINALG_MEMORY;
+    }
+    if (ret == 0) {
+        for (int i = 0; i < m; i++) {
+            get_row(a, i, 0, n, work[i]);
+            get_row(b, i, 0, k, rhs[i]);
+        }
+        ret = tsqr(work, m, n, rhs, k, NULL);
+    }
+    /* Rank deficient: a diagonal entry of R lost to rounding against the largest */
+    double largest = 0;
+    for (int i = 0; i < n && ret == 0; i++) {
+        largest = fmax(largest, fabs(work[i][i]));
+    }
+    for (int i = 0; i < n && ret == 0; i++) {
+        if (fabs(work[i][i]) <= largest * m * DBL_EPSILON || largest == 0) {
+            ret = LINALG_SINGULAR;
+        }
+    }
+    if (ret == 0) {
+        ret = triangular_sweep(work, n, 0, 0, 0, rhs, k, scratch);
+    }
+    for (int i = 0; i < n && ret == 0; i++) {
+        memcpy(x->data[i], rhs[i], k * sizeof(double));
+    }
+    free_rows(work);
+    free_rows(rhs);
+    free(scratch);
+    stats_end(KERNEL_QR, start, (uint64_t) n * k, 1);
+    return ret;
+}
+
+/*
+ * x . y over `n` elements, with four AVX accumulators so that the adds are not one long chain.
+ */
+static double dot(const double *x, const double *y, int n) {
+    __m256d sum0 = _mm256_setzero_pd();
+    __m256d sum1 = _mm256_setzero_pd();
+    __m256d sum2 = _mm256_setzero_pd();
+    __m256d sum3 = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        sum0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), sum0);
+        sum1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4), sum1);
+        sum2 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 8), _mm256_loadu_pd(y + i + 8), sum2);
+        sum3 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 12), _mm256_loadu_pd(y + i + 12), sum3);
+    }
+    for (; i + 4 <= n; i += 4) {
+        sum0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), sum0);
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(_mm256_add_pd(sum0, sum1), _mm256_add_pd(sum2, sum3)));
+    double total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (; i < n; i++) {
+        total += x[i] * y[i];
+    }
+    return total;
+}
+
+typedef struct symv_args {
+    double **a;
+    const double *v;
+    double *y;
+    int first;          // y[i] = a[i][first:n] . v[first:n] for i >= first
+    int n;
+} symv_args;
+
+static void symv_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    symv_args *args = argp;
+    int first = args->first;
+    for (int i = first + begin; i < first + end; i++) {
+        args->y[i] = dot(args->a[i] + first, args->v + first, args->n - first);
+    }
+}
+
+/*
+ * Reduce the symmetric `n` x `n` matrix in `a` (both triangles) to a tridiagonal T = Q^T A Q with
+ * diagonal `d` and subdiagonal `e`. Q = H_0 ... H_{n-2}, where H_j = I - tau_j v_j v_j^T zeroes
+ * column j below its subdiagonal; v_j is left in row j of `a` from column j + 1 on (with its
+ * leading 1 stored), where the reduction no longer needs it.
+ *
+ * Blocked like LAPACK's dsytrd: within a panel of linalg_block columns the trailing matrix is not
+ * updated but corrected on the fly from the panel's V and W, and after the panel it gets the
+ * rank-2k update A22 -= V W^T + W V^T as two products. What is left per column is one
+ * matrix-vector product with the trailing matrix, split over rows.
+ */
+static int tridiagonalize(double **a, int n, double *d, double *e, double *tau) {
+    int nb = block_size(n > 1 ? n - 1 : 1);
+    double *vt = calloc((size_t) nb * n, sizeof(double));
+    double *wt = calloc((size_t) nb * n, sizeof(double));
+    double *y = malloc((size_t) n * sizeof(double));
+    double **rows = malloc((size_t) 2 * nb * sizeof(double *));
+    double **scratch = malloc((size_t) (2 * nb + n) * sizeof(double *));
+    if (vt == NULL || wt == NULL || y == NULL || rows == NULL || scratch == NULL) {
+        free(vt);
+        free(wt);
+        free(y);
+        free(rows);
+        free(scratch);
+        return LINALG_MEMORY;
+    }
+    double **vtRows = rows;
+    double **wtRows = rows + nb;
+    for (int p = 0; p < nb; p++) {
+        vtRows[p] = vt + (size_t) p * n;
+        wtRows[p] = wt + (size_t) p * n;
+    }
+    int ret = 0;
+    for (int k0 = 0; k0 < n - 1 && ret == 0; k0 += nb) {
+        int kb = k0 + nb < n - 1 ? k0 + nb : n - 1;
+        for (int j = k0; j < kb; j++) {
+            int jj = j - k0;
+            double *x = a[j];
+            /* Bring row j (= column j) up to date with the panel so far */
+            for (int p = 0; p < jj; p++) {
+                double wj = wtRows[p][j];
+                double vj = vtRows[p][j];
+                for (int i = j; i < n; i++) {
+                    x[i] -= wj * vtRows[p][i] + vj * wtRows[p][i];
+                }
+            }
+            d[j] = x[j];
+            /* The reflector for x[j + 1:n], as in make_reflector */
+            double alpha = x[j + 1];
+            double sigma = dot(x + j + 2, x + j + 2, n - j - 2);
+            double *v = vtRows[jj];
+            double *w = wtRows[jj];
+            memset(v, 0, n * sizeof(double));
+            memset(w, 0, n * sizeof(double));
+            if (sigma == 0) {
+                tau[j] = 0;
+                e[j] = alpha;
+                x[j + 1] = 1;
+                continue;
+            }
+            double norm = sqrt(alpha * alpha + sigma);
+            double beta = alpha >= 0 ? -norm : norm;
+            double scale = 1 / (alpha - beta);
+            tau[j] = (beta - alpha) / beta;
+            e[j] = beta;
+            x[j + 1] = 1;
+            for (int i = j + 2; i < n; i++) {
+                x[i] *= scale;
+            }
+            memcpy(v + j + 1, x + j + 1, (n - j - 1) * sizeof(double));
+
+            /* y = A22 v - V (W^T v) - W (V^T v), A22 being rows and columns j + 1 on */
+            symv_args args = {a, v, y, j + 1, n};
+            double m = n - j - 1;
+            int threads;
+            int plan = plan_kernel(m, 2 * m * m, m * m * sizeof(double), &threads);
+            parallel_for(plan, threads, n - j - 1, symv_range, &args);
+            for (int p = 0; p < jj; p++) {
+                double wv = dot(wtRows[p] + j + 1, v + j + 1, n - j - 1);
+                double vv = dot(vtRows[p] + j + 1, v + j + 1, n - j - 1);
+                for (int i = j + 1; i < n; i++) {
+                    y[i] -= vtRows[p][i] * wv + wtRows[p][i] * vv;
+                }
+            }
+            /* w = tau y - (tau^2 / 2) (y . v) v */
+            double half = -0.5 * tau[j] * tau[j] * dot(y + j + 1, v + j + 1, n - j - 1);
+            for (int i = j + 1; i < n; i++) {
+                w[i] = tau[j] * y[i] + half * v[i];
+            }
+        }
+        /* A22 -= V W^T + W V^T for the rows and columns after the panel */
+        int b = kb - k0;
+        int m = n - kb;
+        double **c = block_rows(scratch, a + kb, m, kb);
+        ret = gemm_sub(c, block_rows(scratch + n, vtRows, b, kb),
+                       block_rows(scratch + n + b, wtRows, b, kb), m, m, b, 1);
+        if (ret == 0) {
+            ret = gemm_sub(c, block_rows(scratch + n, wtRows, b, kb),
+                           block_rows(scratch + n + b, vtRows, b, kb), m, m, b, 1);
+        }
+    }
+    if (n > 0) {
+        d[n - 1] = a[n - 1][n - 1];
+    }
+    free(vt);
+    free(wt);
+    free(y);
+    free(rows);
+    free(scratch);
+    return ret;
+}
+
+typedef struct rotation_args {
+    double **rows;
+    const int *index;   // rotation r mixes rows index[r] and index[r] + 1
+    const double *c;
+    const double *s;
+    int count;
+} rotation_args;
+
+/*
+ * Columns [begin, end) of every rotation of a batch, in order.
+ */
+static void rotation_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    rotation_args *args = argp;
+    for (int r = 0; r < args->count; r++) {
+        double *lo = args->rows[args->index[r]];
+        double *hi = args->rows[args->index[r] + 1];
+        double c = args->c[r];
+        double s = args->s[r];
+        for (int x = begin; x < end; x++) {
+            double f = hi[x];
+            hi[x] = s * lo[x] + c * f;
+            lo[x] = c * lo[x] - s * f;
+        }
+    }
+}
+
+/*
+ * Eigenvalues `d` and eigenvectors of the symmetric tridiagonal matrix with diagonal `d` and
+ * subdiagonal `e` (e[n - 1] unused), by implicit QL iterations with Wilkinson shifts (tqli in
+ * Numerical Recipes). The eigenvectors are accumulated into the rows of `z`, which starts as the
+ * identity: row i ends up the eigenvector of d[i]. Each sweep's rotations are collected and then
+ * applied together, column-parallel, since every one of them touches whole rows. With `z` NULL
+ * only the eigenvalues are computed.
+ */
+static int tridiagonal_ql(double *d, double *e, double **z, int n) {
+    int *index = malloc((size_t) (n > 0 ? n : 1) * sizeof(int));
+    double *cosines = malloc((size_t) (n > 0 ? n : 1) * sizeof(double));
+    double *sines = malloc((size_t) (n > 0 ? n : 1) * sizeof(double));
+    if (index == NULL || cosines == NULL || sines == NULL) {
+        free(index);
+        free(cosines);
+        free(sines);
+        return LINALG_MEMORY;
+    }
+    if (n > 0) {
+        e[n - 1] = 0;
+    }
+    int ret = 0;
+    for (int l = 0; l < n && ret == 0; l++) {
+        int iter = 0;
+        int m;
+        do {
+            for (m = l; m < n - 1; m++) {
+                double dd = fabs(d[m]) + fabs(d[m + 1]);
+                if (fabs(e[m]) <= DBL_EPSILON * dd) {
+                    break;
+                }
+            }
+            if (m == l) {
+                break;
+            }
+            if (iter++ == 60) {
+                ret = LINALG_NO_CONVERGENCE;
+                break;
+            }
+            double g = (d[l + 1] - d[l]) / (2 * e[l]);
+            double r = hypot(g, 1);
+            g = d[m] - d[l] + e[l] / (g + (g >= 0 ? r : -r));
+            double s = 1, c = 1, p = 0;
+            int count = 0;
+            int i;
+            for (i = m - 1; i >= l; i--) {
+                double f = s * e[i];
+                double b = c * e[i];
+                e[i + 1] = r = hypot(f, g);
+                if (r == 0) {
+                    d[i + 1] -= p;
+                    e[m] = 0;
+                    break;
+                }
+                s = f / r;
+                c = g / r;
+                g = d[i + 1] - p;
+                r = (d[i] - g) * s + 2 * c * b;
+                d[i + 1] = g + (p = s * r);
+                g = c * r - b;
+                index[count] = i;
+                cosines[count] = c;
+                sines[count] = s;
+                count++;
+            }
+            if (count > 0 && z != NULL) {
+                rotation_args args = {z, index, cosines, sines, count};
+                double work = (double) count * n;
+                int threads;
+                int plan = plan_kernel(work, 6 * work, 4 * work * sizeof(double), &threads);
+                parallel_for(plan, threads, n, rotation_range, &args);
+            }
+            if (r == 0 && i >= l) {
+                continue;
+            }
+            d[l] -= p;
+            e[l] = g;
+            e[m] = 0;
+        } while (m != l);
+    }
+    free(index);
+    free(cosines);
+    free(sines);
+    return ret;
+}
+
+/*
+ * Eigendecomposition of the symmetric `n` x `n` matrix `a`, of which only the lower triangle is
+ * read: the eigenvalues in ascending order in `w` and the eigenvectors as the columns of `v`
+ * (skipped if v is NULL), A = V diag(w) V^T. The matrix is reduced to tridiagonal form, whose
+ * eigenproblem is solved by QL iterations, and the eigenvectors are carried back through the
+ * reduction's reflectors as block reflectors.
+ */
+int sym_eigen(matrix *a, double *w, matrix *v) {
+    if (too_large(a)) {
+        return LINALG_TOO_LARGE;
+    }
+    int n = a->rows;
+    uint64_t start = stats_begin(KERNEL_EIGH, n, n, n);
+    double **work = alloc_rows(n, n);
+    double **z = v != NULL ? alloc_rows(n, n) : NULL;
+    double *e = malloc((size_t) (n > 0 ? n : 1) * sizeof(double));
+    double *tau = malloc((size_t) (n > 0 ? n : 1) * sizeof(double));
+    int ret = 0;
+    if (work == NULL || e == NULL || tau == NULL || (v != NULL && z == NULL)) {
+        ret = LINALG_MEMORY;
+    }
+    if (ret == 0) {
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j <= i; j++) {
+                work[i][j] = work[j][i] = get(a, i, j);
+            }
+        }
+        ret = tridiagonalize(work, n, w, e, tau);
+    }
+    if (ret == 0) {
+        for (int i = 0; i < n && z != NULL; i++) {
+            z[i][i] = 1;
+        }
+        ret = tridiagonal_ql(w, e, z, n);
+    }
+    if (ret == 0) {
+        /* Sort ascending, carrying the eigenvectors (rows of z) along */
+        for (int i = 0; i < n; i++) {
+            int best = i;
+            for (int j = i + 1; j < n; j++) {
+                if (w[j] < w[best]) {
+                    best = j;
+                }
+            }
+            double value = w[i];
+            w[i] = w[best];
+            w[best] = value;
+            if (z != NULL) {
+                double *row = z[i];
+                z[i] = z[best];
+                z[best] = row;
+            }
+        }
+    }
+    if (ret == 0 && v != NULL) {
+        /* V = Q Z^T: the reflectors of row j of work act on rows j + 1 on, which apply_q takes
+         * as column j of an (n - 1) x (n - 1) matrix */
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                v->data[i][j] = z[j][i];
+            }
+        }
+        if (n > 1) {
+            double **reflectors = alloc_rows(n - 1, n - 1);
+            if (reflectors == NULL) {
+                ret = LINALG_MEMORY;
+            } else {
+                for (int j = 0; j < n - 1; j++) {
+                    for (int i = j; i < n - 1; i++) {
+                        reflectors[i][j] = work[j][i + 1];
+                    }
+                }
+                ret = apply_q(reflectors, n - 1, n - 1, tau, v->data + 1, n, 0);
+                free_rows(reflectors);
+            }
+        }
+    }
+    free_rows(work);
+    free_rows(z);
+    free(e);
+    free(tau);
+    stats_end(KERNEL_EIGH, start, (uint64_t) n * n, 1);
+    return ret;
+}
+
+typedef struct jacobi_args {
+    double **w;         // the rows being orthogonalized
+    double **y;         // the rotations accumulate here, or NULL
+    int rows;
+    int width;          // length of the rows of w; those of y are `rows` long
+    const int *pairs;   // this round's disjoint pairs, two row indexes each
+    int *rotated;       // per pair
+    double *norms;      // squared norms of the rows of w
+    double tol;
+    double negligible;  // squared norm below which a row is rounding noise left from a zero one
+} jacobi_args;
+
+/*
+ * Pairs [begin, end) of a Jacobi round: rotate rows i and j of w so that they are orthogonal,
+ * unless they already are to within tol. The rotation's effect on the two squared norms follows
+ * from their dot product, so that is the only one computed.
+ */
+static void jacobi_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    jacobi_args *args = argp;
+    for (int p = begin; p < end; p++) {
+        int i = args->pairs[2 * p];
+        int j = args->pairs[2 * p + 1];
+        args->rotated[p] = 0;
+        if (i >= args->rows || j >= args->rows) {
+            continue;
+        }
+        double *wi = args->w[i];
+        double *wj = args->w[j];
+        double alpha = args->norms[i];
+        double beta = args->norms[j];
+        double gamma = dot(wi, wj, args->width);
+        if (alpha <= args->negligible || beta <= args->negligible ||
+            fabs(gamma) <= args->tol * sqrt(alpha * beta)) {
+            continue;
+        }
+        double zeta = (beta - alpha) / (2 * gamma);
+        double t = (zeta >= 0 ? 1 : -1) / (fabs(zeta) + sqrt(1 + zeta * zeta));
+        double c = 1 / sqrt(1 + t * t);
+        double s = c * t;
+        args->norms[i] = fmax(alpha - t * gamma, 0);
+        args->norms[j] = beta + t * gamma;
+        for (int x = 0; x < args->width; x++) {
+            double a = wi[x];
+            wi[x] = c * a - s * wj[x];
+            wj[x] = s * a + c * wj[x];
+        }
+        if (args->y != NULL) {
+            double *yi = args->y[i];
+            double *yj = args->y[j];
+            for (int x = 0; x < args->rows; x++) {
+                double a = yi[x];
+                yi[x] = c * a - s * yj[x];
+                yj[x] = s * a + c * yj[x];
+            }
+        }
+        args->rotated[p] = 1;
+    }
+}
+
+/*
+ * One-sided Jacobi (Hestenes): rotate pairs of the `rows` rows of `w` until they are mutually
+ * orthogonal, applying the same rotations to the rows of `y` if it is not NULL. Each sweep visits
+ * every pair once in round-robin order, whose rounds are sets of disjoint pairs that are rotated
+ * in parallel. The squared norms are updated with each rotation and recomputed every sweep, as
+ * LAPACK's dgesvj does, to keep rounding from accumulating.
+ */
+static int jacobi_orthogonalize(double **w, int rows, int width, double **y) {
+    int count = rows + (rows & 1);
+    int *order = malloc((size_t) (count > 0 ? count : 1) * sizeof(int));
+    int *pairs = malloc((size_t) (count > 0 ? count : 1) * sizeof(int));
+    int *rotated = malloc((size_t) (count > 0 ? count : 1) * sizeof(int));
+    double *norms = malloc((size_t) (count > 0 ? count : 1) * sizeof(double));
+    if (order == NULL || pairs == NULL || rotated == NULL || norms == NULL) {
+        free(order);
+        free(pairs);
+        free(rotated);
+        free(norms);
+        return LINALG_MEMORY;
+    }
+    double squares = 0;
+    for (int i = 0; i < rows; i++) {
+        squares += dot(w[i], w[i], width);
+    }
+    double noise = width * DBL_EPSILON;
+    jacobi_args args = {w, y, rows, width, pairs, rotated, norms,
+                        sqrt((double) width) * DBL_EPSILON, noise * noise * squares};
+    double work = (double) (count / 2) * (width + (y != NULL ? rows : 0));
+    int threads;
+    int plan = plan_kernel(count / 2, 12 * work, 4 * work * sizeof(double), &threads);
+    int ret = LINALG_NO_CONVERGENCE;
+    for (int sweep = 0; sweep < 60 && ret != 0; sweep++) {
+        for (int i = 0; i < count; i++) {
+            order[i] = i;
+        }
+        for (int i = 0; i < rows; i++) {
+            norms[i] = dot(w[i], w[i], width);
+        }
+        int total = 0;
+        for (int round = 0; round < count - 1; round++) {
+            for (int p = 0; p < count / 2; p++) {
+                pairs[2 * p] = order[p];
+                pairs[2 * p + 1] = order[count - 1 - p];
+            }
+            parallel_for(plan, threads, count / 2, jacobi_range, &args);
+            for (int p = 0; p < count / 2; p++) {
+                total += rotated[p];
+            }
+            /* Keep order[0] and turn the rest one place */
+            int last = order[count - 1];
+            for (int q = count - 1; q > 1; q--) {
+                order[q] = order[q - 1];
+            }
+            order[1] = last;
+        }
+        if (total == 0) {
+            ret = 0;
+        }
+    }
+    free(order);
+    free(pairs);
+    free(rotated);
+    free(norms);
+    return ret;
+}
+
+/*
+ * SVD of the m x n `a` with m >= n: the n singular values in `s`, descending, and if `u` is not
+ * NULL the m x n U in it and the n x n V^T in `vt`. From A = Q R: Jacobi makes the rows of R
+ * orthogonal, R = Y^T (Sigma V^T) with Y the accumulated rotations, so the rows of V^T are those
+ * of the rotated R normalized, and U = Q Y^T. Working on R keeps the rotations to n-element rows
+ * however tall A is, and to contiguous ones.
+ */
+static int svd_tall(matrix *a, double **u, double *s, double **vt) {
+    int m = a->rows;
+    int n = a->cols;
+    double **q = u != NULL ? alloc_rows(m, n) : NULL;
+    double **r = alloc_rows(n, n);
+    double **y = u != NULL ? alloc_rows(n, n) : NULL;
+    double **yt = u != NULL ? alloc_rows(n, n) : NULL;
+    int ret = 0;
+    if (r == NULL || (u != NULL && (q == NULL || y == NULL || yt == NULL))) {
+        ret = LINALG_MEMORY;
+    }
+    if (ret == 0) {
+        matrix qView = view(q, m, n);
+        matrix rView = view(r, n, n);
+        ret = qr_decompose(a, u != NULL ? &qView : NULL, &rView);
+    }
+    if (ret == 0) {
+        for (int i = 0; i < n && y != NULL; i++) {
+            y[i][i] = 1;
+        }
+        ret = jacobi_orthogonalize(r, n, n, y);
+    }
+    if (ret == 0) {
+        for (int i = 0; i < n; i++) {
+            s[i] = sqrt(dot(r[i], r[i], n));
+        }
+        /* Sort descending, carrying rows of r and y along */
+        for (int i = 0; i < n; i++) {
+            int best = i;
+            for (int j = i + 1; j < n; j++) {
+                if (s[j] > s[best]) {
+                    best = j;
+                }
+            }
+            double value = s[i];
+            s[i] = s[best];
+            s[best] = value;
+            double *row = r[i];
+            r[i] = r[best];
+            r[best] = row;
+            if (y != NULL) {
+                row = y[i];
+                y[i] = y[best];
+                y[best] = row;
+            }
+        }
+    }
+    if (ret == 0) {
+        /* Whatever Jacobi left of a zero singular value is rounding noise with no direction, and
+         * rows it skipped as negligible are not orthogonal to the others: anything up to the QR's
+         * rounding level, max(m, n) eps ||A||_F, which also covers Jacobi's, counts as zero */
+        double squares = 0;
+        for (int i = 0; i < n; i++) {
+            squares += s[i] * s[i];
+        }
+        double zero = (m > n ? m : n) * DBL_EPSILON * sqrt(squares);
+        for (int i = 1; i < n; i++) {
+            if (s[i] <= zero) {
+                s[i] = 0;
+            }
+        }
+    }
+    /* Squared norms of the columns of the rows of V^T filled in so far */
+    double *colSquares = ret == 0 && u != NULL ? calloc(n, sizeof(double)) : NULL;
+    if (ret == 0 && u != NULL && colSquares == NULL) {
+        ret = LINALG_MEMORY;
+    }
+    if (ret == 0 && u != NULL) {
+        for (int i = 0; i < n; i++) {
+            if (s[i] > 0) {
+                for (int x = 0; x < n; x++) {
+                    vt[i][x] = r[i][x] / s[i];
+                }
+            } else {
+                /* A zero singular value, sorted after all the others: complete V^T with the e_c
+                 * farthest from the span of the rows before, 1 - colSquares[c] squared, which is
+                 * at least (n - i) / n, orthogonalized against them twice */
+                int c = 0;
+                for (int x = 1; x < n; x++) {
+                    if (colSquares[x] < colSquares[c]) {
+                        c = x;
+                    }
+                }
+                memset(vt[i], 0, n * sizeof(double));
+                vt[i][c] = 1;
+                for (int pass = 0; pass < 2; pass++) {
+                    for (int j = 0; j < i; j++) {
+                        double proj = dot(vt[i], vt[j], n);
+                        for (int x = 0; x < n; x++) {
+                            vt[i][x] -= proj * vt[j][x];
+                        }
+                    }
+                }
+                double norm = sqrt(dot(vt[i], vt[i], n));
+                for (int x = 0; x < n; x++) {
+                    vt[i][x] /= norm;
+                }
+            }
+            for (int x = 0; x < n; x++) {
+                colSquares[x] += vt[i][x] * vt[i][x];
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                yt[i][j] = y[j][i];
+            }
+        }
+        for (int i = 0; i < m; i++) {
+            memset(u[i], 0, n * sizeof(double));
+        }
+        matrix uView = view(u, m, n);
+        matrix qView = view(q, m, n);
+        matrix ytView = view(yt, n, n);
+        mul_matrix(&uView, &qView, &ytView);
+    }
+    free(colSquares);
+    free_rows(q);
+    free_rows(r);
+    free_rows(y);
+    free_rows(yt);
+    return ret;
+}
+
+/*
+ * Thin SVD of the m x n matrix `a`, A = U diag(s) V^T with k = min(m, n): the k singular values in
+ * `s`, descending, and unless `u` is NULL the m x k U in it and the k x n V^T in `vt`. A wide A is
+ * handled as the transpose of a tall one.
+ */
+int svd_decompose(matrix *a, matrix *u, double *s, matrix *vt) {
+    if (too_large(a)) {
+        return LINALG_TOO_LARGE;
+    }
+    int m = a->rows;
+    int n = a->cols;
+    uint64_t start = stats_begin(KERNEL_SVD, m, n, m < n ? m : n);
+    int ret;
+    if (m >= n) {
+        ret = svd_tall(a, u != NULL ? u->data : NULL, s, u != NULL ? vt->data : NULL);
+    } else {
+        /* A^T = U' S V'^T, so U = V' and V^T = U'^T */
+        double **at = alloc_rows(n, m);
+        double **ut = u != NULL ? alloc_rows(n, m) : NULL;
+        double **v = u != NULL ? alloc_rows(m, m) : NULL;
+        ret = at == NULL || (u != NULL && (ut == NULL || v == NULL)) ? LINALG_MEMORY : 0;
+        if (ret == 0) {
+            for (int i = 0; i < m; i++) {
+                for (int j = 0; j < n; j++) {
+                    at[j][i] = get(a, i, j);
+                }
+            }
+            matrix atView = view(at, n, m);
+            ret = svd_tall(&atView, ut, s, v);
+        }
+        if (ret == 0 && u != NULL) {
+            for (int i = 0; i < m; i++) {
+                for (int j = 0; j < m; j++) {
+                    u->data[i][j] = v[j][i];
+                }
+                for (int j = 0; j < n; j++) {
+                    vt->data[i][j] = ut[j][i];
+                }
+            }
+        }
+        free_rows(at);
+        free_rows(ut);
+        free_rows(v);
+    }
+    stats_end(KERNEL_SVD, start, (uint64_t) m * n, 1);
+    return ret;
+}
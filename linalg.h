@@ -0,0 +1,39 @@
+/*
+ * Dense linear algebra on numc matrices. Factorizations work on a private contiguous copy of
+ * their input and are blocked by linalg_block (see matrix.h) so that the bulk of the work is a
+ * trailing matrix update that runs through mul_matrix; the remaining row and column loops are
+ * split with parallel_for. Like the out-of-core routines these do not touch the Python error
+ * state, so that they can run without the GIL, and return 0 on success or a LINALG_* code.
+ */
+#define LINALG_MEMORY -1    // out of memory
+#define LINALG_SINGULAR -2  // the matrix is singular (an exactly zero pivot)
+#define LINALG_NOT_SPD -3   // the matrix is not symmetric positive definite
+#define LINALG_NO_CONVERGENCE -4    // an iterative eigenvalue or SVD solver gave up
+#define LINALG_TOO_LARGE -5 // a dimension does not fit in an int
+
+/*
+ * LU factorization with partial pivoting, P * A = L * U. rows[i] points to row i of the factors
+ * (L below the diagonal with an implied unit diagonal, U on and above it), which was row perm[i]
+ * of A; row exchanges only swap these pointers.
+ */
+typedef struct lu_factors {
+    int n;
+    double *data;
+    double **rows;
+    int *perm;
+    int swaps;          // number of row exchanges, for the sign of the determinant
+    int singular;       // some pivot was exactly zero
+} lu_factors;
+
+int lu_factor(lu_factors *lu, matrix *a);
+int lu_solve(lu_factors *lu, matrix *b, matrix *x);
+double lu_det(lu_factors *lu);
+void lu_free(lu_factors *lu);
+
+int chol_factor(matrix *l, matrix *a);
+int chol_solve(matrix *l, matrix *b, matrix *x);
+int tri_solve(matrix *t, int lower, int trans, matrix *b, matrix *x);
+int qr_decompose(matrix *a, matrix *q, matrix *r);
+int qr_lstsq(matrix *a, matrix *b, matrix *x);
+int sym_eigen(matrix *a, double *w, matrix *v);
+int svd_decompose(matrix *a, matrix *u, double *s, matrix *vt);
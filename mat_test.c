@@ -1,8 +1,19 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <omp.h>
 
 #include "CUnit/Basic.h"
 #include "CUnit/CUnit.h"
 #include "matrix.h"
+#include "profile.h"
+#include "pool.h"
+#include "linalg.h"
 
 /* Test Suite setup and cleanup functions: */
 int init_suite(void) { return 0; }
@@ -85,6 +96,65 @@ void mul_test(void) {
     deallocate_matrix(mat2);
 }
 
+void mul_vector_test(void) {
+    /* 70 x 2100 has a ragged row group for GEMV and two column blocks for GEVM */
+    int rows = 70;
+    int cols = 2100;
+    matrix *mat = NULL;
+    matrix *x = NULL;
+    matrix *y = NULL;
+    matrix *result = NULL;
+    CU_ASSERT_EQUAL(allocate_matrix(&mat, rows, cols), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&x, cols, 1), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&y, 1, rows), 0);
+    rand_matrix(mat, 21, -1, 1);
+    rand_matrix(x, 22, -1, 1);
+    rand_matrix(y, 23, -1, 1);
+
+    CU_ASSERT_EQUAL(allocate_matrix(&result, rows, 1), 0);
+    set(result, 3, 0, 1);
+    CU_ASSERT_EQUAL(mul_matrix(result, mat, x), 0);
+    for (int i = 0; i < rows; i++) {
+        double sum = i == 3;
+        for (int k = 0; k < cols; k++) {
+            sum += get(mat, i, k) * get(x, k, 0);
+        }
+        CU_ASSERT_DOUBLE_EQUAL(get(result, i, 0), sum, 1e-10);
+    }
+    deallocate_matrix(result);
+
+    CU_ASSERT_EQUAL(allocate_matrix(&result, 1, cols), 0);
+    CU_ASSERT_EQUAL(mul_matrix(result, y, mat), 0);
+    for (int j = 0; j < cols; j++) {
+        double sum = 0;
+        for (int k = 0; k < rows; k++) {
+            sum += get(y, 0, k) * get(mat, k, j);
+        }
+        CU_ASSERT_DOUBLE_EQUAL(get(result, 0, j), sum, 1e-10);
+    }
+    deallocate_matrix(result);
+
+    /* A column of a larger matrix is not contiguous */
+    matrix *column = NULL;
+    matrix *square = NULL;
+    CU_ASSERT_EQUAL(allocate_matrix(&square, rows, rows), 0);
+    rand_matrix(square, 24, -1, 1);
+    CU_ASSERT_EQUAL(allocate_matrix_ref(&column, square, 0, 5, rows, 1), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&result, 1, 1), 0);
+    CU_ASSERT_EQUAL(mul_matrix(result, y, column), 0);
+    double dot = 0;
+    for (int k = 0; k < rows; k++) {
+        dot += get(y, 0, k) * get(square, k, 5);
+    }
+    CU_ASSERT_DOUBLE_EQUAL(get(result, 0, 0), dot, 1e-10);
+    deallocate_matrix(result);
+    deallocate_matrix(column);
+    deallocate_matrix(square);
+    deallocate_matrix(mat);
+    deallocate_matrix(x);
+    deallocate_matrix(y);
+}
+
 void neg_test(void) {
     matrix *result = NULL;
     matrix *mat = NULL;
@@ -128,6 +198,165 @@ void abs_test(void) {
     deallocate_matrix(mat);
 }
 
+void ufunc_test(void) {
+    /* 7 columns so that every row ends in a partial vector */
+    int rows = 40;
+    int cols = 7;
+    matrix *mat = NULL;
+    matrix *result = NULL;
+    allocate_matrix(&mat, rows, cols);
+    allocate_matrix(&result, rows, cols);
+    rand_matrix(mat, 41, -30, 30);
+    set(mat, 0, 0, 1e-300);
+    set(mat, 0, 1, 4.9e-324);
+    set(mat, 0, 2, -1e-20);
+    set(mat, 0, 3, 700);
+    set(mat, 0, 4, -740);
+
+    double (*libm[])(double) = {exp, log, sqrt, tanh};
+    int (*kernels[])(matrix *, matrix *) = {exp_matrix, log_matrix, sqrt_matrix, tanh_matrix,
+                                            sigmoid_matrix};
+    for (int k = 0; k < 5; k++) {
+        CU_ASSERT_EQUAL(kernels[k](result, mat), 0);
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < cols; j++) {
+                double x = get(mat, i, j);
+                double want = k < 4 ? libm[k](x) : 1 / (1 + exp(-x));
+                if (k == 4 && x < 0) {
+                    want = exp(x) / (1 + exp(x));
+                }
+                double got = get(result, i, j);
+                if (isnan(want)) {
+                    CU_ASSERT(isnan(got));
+                } else {
+                    CU_ASSERT_DOUBLE_EQUAL(got, want, fabs(want) * 4 * DBL_EPSILON);
+                }
+            }
+        }
+    }
+
+    /* Infinities, zeros and NaNs come out as libm's */
+    double specials[] = {INFINITY, -INFINITY, 0.0, -0.0, NAN, -1};
+    matrix *special = NULL;
+    matrix *out = NULL;
+    allocate_matrix(&special, 1, 6);
+    allocate_matrix(&out, 1, 6);
+    for (int j = 0; j < 6; j++) {
+        set(special, 0, j, specials[j]);
+    }
+    exp_matrix(out, special);
+    CU_ASSERT(isinf(get(out, 0, 0)) && get(out, 0, 1) == 0 && get(out, 0, 2) == 1 &&
+              isnan(get(out, 0, 4)));
+    log_matrix(out, special);
+    CU_ASSERT(isinf(get(out, 0, 0)) && isnan(get(out, 0, 1)) && get(out, 0, 2) == -INFINITY &&
+              get(out, 0, 3) == -INFINITY && isnan(get(out, 0, 4)) && isnan(get(out, 0, 5)));
+    tanh_matrix(out, special);
+    CU_ASSERT(get(out, 0, 0) == 1 && get(out, 0, 1) == -1 && signbit(get(out, 0, 3)) &&
+              isnan(get(out, 0, 4)));
+    sigmoid_matrix(out, special);
+    CU_ASSERT(get(out, 0, 0) == 1 && get(out, 0, 1) == 0 && get(out, 0, 2) == 0.5);
+
+    /* Small whole exponents are products, others go to libm; in place on a strided view */
+    matrix *view = NULL;
+    allocate_matrix_strided(&view, mat, 1, 6, 39, 4, 1, -2);
+    set(mat, 5, 5, 2.75);
+    CU_ASSERT_EQUAL(power_matrix(result, mat, -2), 0);
+    CU_ASSERT_DOUBLE_EQUAL(get(result, 5, 5), 1 / (get(mat, 5, 5) * get(mat, 5, 5)), 1e-15);
+    CU_ASSERT_EQUAL(power_matrix(result, mat, 1.5), 0);
+    CU_ASSERT_EQUAL(get(result, 5, 5), pow(get(mat, 5, 5), 1.5));
+    double before = get(mat, 3, 2);
+    CU_ASSERT_EQUAL(power_matrix(view, view, 3), 0);
+    CU_ASSERT_DOUBLE_EQUAL(get(mat, 3, 2), before * before * before, fabs(before) * 1e-14);
+    CU_ASSERT_EQUAL(power_matrix(out, mat, 2), -1);
+
+    deallocate_matrix(view);
+    deallocate_matrix(out);
+    deallocate_matrix(special);
+    deallocate_matrix(result);
+    deallocate_matrix(mat);
+}
+
+void compare_test(void) {
+    int rows = 5;
+    int cols = 70;
+    matrix *a = NULL;
+    matrix *b = NULL;
+    matrix *mask = NULL;
+    matrix *result = NULL;
+    matrix *view = NULL;
+    allocate_matrix(&a, rows, cols);
+    allocate_matrix(&b, rows, cols);
+    allocate_matrix(&mask, rows, cols);
+    allocate_matrix(&result, rows, cols);
+    rand_matrix(a, 51, -1, 1);
+    rand_matrix(b, 52, -1, 1);
+    set(a, 2, 3, NAN);
+    set(b, 4, 69, get(a, 4, 69));
+
+    CU_ASSERT_EQUAL(compare_matrix(mask, a, b, 0, COMPARE_LT), 0);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            CU_ASSERT_EQUAL(get(mask, i, j), get(a, i, j) < get(b, i, j) ? 1.0 : 0.0);
+        }
+    }
+    compare_matrix(mask, a, b, 0, COMPARE_NE);
+    CU_ASSERT_EQUAL(get(mask, 2, 3), 1);
+    CU_ASSERT_EQUAL(get(mask, 4, 69), 0);
+    compare_matrix(mask, a, b, 0, COMPARE_GE);
+    CU_ASSERT_EQUAL(get(mask, 2, 3), 0);
+    CU_ASSERT_EQUAL(get(mask, 4, 69), 1);
+
+    /* where(a > 0, a, b) on a strided mask and operand */
+    allocate_matrix_strided(&view, a, 0, cols - 1, rows, cols, 1, -1);
+    compare_matrix(mask, view, NULL, 0, COMPARE_GT);
+    CU_ASSERT_EQUAL(where_matrix(result, mask, view, 0, b, 0), 0);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            double x = get(view, i, j);
+            CU_ASSERT_EQUAL(get(result, i, j), x > 0 ? x : get(b, i, j));
+        }
+    }
+    where_matrix(result, mask, NULL, 1, NULL, -1);
+    CU_ASSERT_EQUAL(get(result, 1, 1), get(view, 1, 1) > 0 ? 1 : -1);
+    CU_ASSERT_EQUAL(where_matrix(view, mask, NULL, 1, NULL, -1), -1);
+
+    CU_ASSERT_EQUAL(allclose_matrix(b, b, 0, 0), 1);
+    CU_ASSERT_EQUAL(assign_matrix(result, b), 0);
+    set(result, 4, 68, get(b, 4, 68) * (1 + 1e-9));
+    CU_ASSERT_EQUAL(allclose_matrix(result, b, 1e-8, 0), 1);
+    CU_ASSERT_EQUAL(allclose_matrix(result, b, 1e-10, 0), 0);
+    CU_ASSERT_EQUAL(allclose_matrix(a, a, 1, 1), 0);
+    CU_ASSERT_EQUAL(allclose_matrix(view, a, 1e-5, 1e-8), 0);
+    /* Infinities are close only to themselves and NaN to nothing, as in numpy: (1, 1) is in the
+     * vector loop and (4, 69) in the scalar tail of the last chunk */
+    int probes[2][2] = {{1, 1}, {4, 69}};
+    for (int p = 0; p < 2; p++) {
+        int i = probes[p][0];
+        int j = probes[p][1];
+        assign_matrix(result, b);
+        assign_matrix(mask, b);
+        set(result, i, j, INFINITY);
+        CU_ASSERT_EQUAL(allclose_matrix(result, b, 1e-5, 1e-8), 0);
+        CU_ASSERT_EQUAL(allclose_matrix(b, result, 1e-5, 1e-8), 0);
+        set(mask, i, j, -INFINITY);
+        CU_ASSERT_EQUAL(allclose_matrix(result, mask, 1e-5, 1e-8), 0);
+        CU_ASSERT_EQUAL(allclose_matrix(mask, result, 1e-5, 1e-8), 0);
+        set(mask, i, j, INFINITY);
+        CU_ASSERT_EQUAL(allclose_matrix(result, mask, 1e-5, 1e-8), 1);
+        set(result, i, j, NAN);
+        set(mask, i, j, NAN);
+        CU_ASSERT_EQUAL(allclose_matrix(result, b, 1e-5, 1e-8), 0);
+        CU_ASSERT_EQUAL(allclose_matrix(b, result, 1e-5, 1e-8), 0);
+        CU_ASSERT_EQUAL(allclose_matrix(result, mask, 1e-5, 1e-8), 0);
+    }
+
+    deallocate_matrix(view);
+    deallocate_matrix(result);
+    deallocate_matrix(mask);
+    deallocate_matrix(b);
+    deallocate_matrix(a);
+}
+
 void pow_test(void) {
     matrix *result = NULL;
     matrix *mat = NULL;
@@ -159,6 +388,10 @@ void alloc_fail_test(void) {
     CU_ASSERT_EQUAL(allocate_matrix(&mat, 0, 0), -1);
     CU_ASSERT_EQUAL(allocate_matrix(&mat, 0, 1), -1);
     CU_ASSERT_EQUAL(allocate_matrix(&mat, 1, 0), -1);
+    /* rows * cols * sizeof(double) would overflow */
+    CU_ASSERT_EQUAL(allocate_matrix(&mat, (Py_ssize_t) 1 << 31, (Py_ssize_t) 1 << 31), -1);
+    CU_ASSERT_EQUAL(allocate_matrix(&mat, 1, PY_SSIZE_T_MAX), -1);
+    PyErr_Clear();
 }
 
 void alloc_success_test(void) {
@@ -216,7 +449,156 @@ void alloc_ref_test(void) {
     deallocate_matrix(mat2);
 }
 
+void alloc_strided_test(void) {
+    /* 300 columns so that the view's rows are long enough to go to the kernels in place */
+    int rows = 9;
+    int cols = 300;
+    matrix *from = NULL;
+    matrix *view = NULL;
+    matrix *unit = NULL;
+    matrix *result = NULL;
+    matrix *other = NULL;
+    allocate_matrix(&from, rows, cols);
+    rand_matrix(from, 31, -1, 1);
+    /* from[8:0:-3, 299::-2] and from[1::2, 2:], neither of which is contiguous */
+    CU_ASSERT_EQUAL(allocate_matrix_strided(&view, from, 8, 299, 3, 150, -3, -2), 0);
+    CU_ASSERT_EQUAL(allocate_matrix_strided(&unit, from, 1, 2, 3, 150, 2, 1), 0);
+    CU_ASSERT_EQUAL(view->stride, -2);
+    CU_ASSERT_EQUAL(from->ref_cnt, 3);
+    CU_ASSERT_EQUAL(allocate_matrix_strided(&other, from, 8, 299, 4, 150, -3, -2), -1);
+    CU_ASSERT_EQUAL(allocate_matrix_strided(&other, from, 0, 1, 1, 151, 1, 2), -1);
+    PyErr_Clear();
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 150; j++) {
+            CU_ASSERT_EQUAL(get(view, i, j), get(from, 8 - 3 * i, 299 - 2 * j));
+        }
+    }
+
+    allocate_matrix(&result, 3, 150);
+    CU_ASSERT_EQUAL(add_matrix(result, view, unit), 0);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 150; j++) {
+            CU_ASSERT_DOUBLE_EQUAL(get(result, i, j), get(view, i, j) + get(unit, i, j), 1e-12);
+        }
+    }
+    CU_ASSERT_EQUAL(neg_matrix(result, view), 0);
+    CU_ASSERT_EQUAL(get(result, 2, 149), -get(from, 2, 1));
+
+    /* Writes through a strided view land in `from`, and only where the view points */
+    fill_matrix(view, 7);
+    CU_ASSERT_EQUAL(get(from, 5, 1), 7);
+    CU_ASSERT_NOT_EQUAL(get(from, 5, 2), 7);
+    CU_ASSERT_NOT_EQUAL(get(from, 4, 1), 7);
+
+    /* A product with a column-step operand is packed and matches the scalar definition */
+    allocate_matrix(&other, 150, 4);
+    rand_matrix(other, 32, -1, 1);
+    deallocate_matrix(result);
+    allocate_matrix(&result, 3, 4);
+    CU_ASSERT_EQUAL(mul_matrix(result, view, other), 0);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            double sum = 0;
+            for (int k = 0; k < 150; k++) {
+                sum += get(view, i, k) * get(other, k, j);
+            }
+            CU_ASSERT_DOUBLE_EQUAL(get(result, i, j), sum, 1e-10);
+        }
+    }
+    deallocate_matrix(other);
+    deallocate_matrix(result);
+    deallocate_matrix(unit);
+    deallocate_matrix(view);
+    deallocate_matrix(from);
+}
+
+void copy_on_write_test(void) {
+    matrix *from = NULL;
+    matrix *copy = NULL;
+    matrix *slice = NULL;
+    matrix *sliceCopy = NULL;
+    allocate_matrix(&from, 3, 2);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 2; j++) {
+            set(from, i, j, i * 2 + j);
+        }
+    }
+    /* A copy shares the buffer until it is written */
+    CU_ASSERT_EQUAL(copy_matrix(&copy, from), 0);
+    CU_ASSERT_PTR_EQUAL(copy->data[0], from->data[0]);
+    CU_ASSERT_EQUAL(from->ref_cnt, 2);
+    set(copy, 1, 1, -1);
+    CU_ASSERT_PTR_NOT_EQUAL(copy->data[0], from->data[0]);
+    CU_ASSERT_PTR_EQUAL(copy->parent, NULL);
+    CU_ASSERT_EQUAL(from->ref_cnt, 1);
+    CU_ASSERT_EQUAL(get(copy, 1, 1), -1);
+    CU_ASSERT_EQUAL(get(copy, 2, 0), 4);
+    CU_ASSERT_EQUAL(get(from, 1, 1), 3);
+    deallocate_matrix(copy);
+
+    /* Writing through a slice of the owner copies the buffer out for a copy of another slice */
+    CU_ASSERT_EQUAL(allocate_matrix_ref(&slice, from, 1, 0, 2, 2), 0);
+    CU_ASSERT_EQUAL(copy_matrix(&sliceCopy, slice), 0);
+    CU_ASSERT_PTR_EQUAL(sliceCopy->parent, from);
+    CU_ASSERT_EQUAL(unshare_matrix(from), 0);
+    CU_ASSERT_PTR_EQUAL(from->copies, NULL);
+    set(slice, 0, 0, 10);
+    CU_ASSERT_EQUAL(get(from, 1, 0), 10);
+    CU_ASSERT_EQUAL(get(sliceCopy, 0, 0), 2);
+    CU_ASSERT_EQUAL(get(sliceCopy, 1, 1), 5);
+
+    /* A copy that is still shared keeps its owner alive */
+    CU_ASSERT_EQUAL(copy_matrix(&copy, from), 0);
+    deallocate_matrix(from);
+    deallocate_matrix(slice);
+    CU_ASSERT_EQUAL(get(copy, 2, 1), 5);
+    deallocate_matrix(copy);
+    deallocate_matrix(sliceCopy);
+}
+
 /* Test the null case doesn't crash */
+void assign_test(void) {
+    int rows = 6;
+    int cols = 200;
+    matrix *mat = NULL;
+    matrix *expected = NULL;
+    matrix *dst = NULL;
+    matrix *src = NULL;
+    allocate_matrix(&mat, rows, cols);
+    allocate_matrix(&expected, rows, cols);
+    rand_matrix(mat, 33, -1, 1);
+    CU_ASSERT_EQUAL(assign_matrix(expected, mat), 0);
+    CU_ASSERT_EQUAL(get(expected, 5, 199), get(mat, 5, 199));
+
+    /* mat[1:, ::2] = mat[:-1, ::2] overlaps its source, which must be read before it is written */
+    allocate_matrix_strided(&dst, mat, 1, 0, 5, 100, 1, 2);
+    allocate_matrix_strided(&src, mat, 0, 0, 5, 100, 1, 2);
+    CU_ASSERT_EQUAL(assign_matrix(dst, src), 0);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            double want = i > 0 && j % 2 == 0 ? get(expected, i - 1, j) : get(expected, i, j);
+            CU_ASSERT_EQUAL(get(mat, i, j), want);
+        }
+    }
+    deallocate_matrix(src);
+    deallocate_matrix(dst);
+
+    /* mat[0, :] = mat[0, ::-1] reverses a row in place */
+    CU_ASSERT_EQUAL(assign_matrix(expected, mat), 0);
+    allocate_matrix_strided(&dst, mat, 0, 0, 1, cols, 1, 1);
+    allocate_matrix_strided(&src, mat, 0, cols - 1, 1, cols, 1, -1);
+    CU_ASSERT_EQUAL(assign_matrix(dst, src), 0);
+    for (int j = 0; j < cols; j++) {
+        CU_ASSERT_EQUAL(get(mat, 0, j), get(expected, 0, cols - 1 - j));
+    }
+    CU_ASSERT_EQUAL(assign_matrix(dst, expected), -1);
+    PyErr_Clear();
+    deallocate_matrix(src);
+    deallocate_matrix(dst);
+    deallocate_matrix(expected);
+    deallocate_matrix(mat);
+}
+
 void dealloc_null_test(void) {
     matrix *mat = NULL;
     deallocate_matrix(mat);
@@ -252,6 +634,795 @@ void set_test(void) {
     deallocate_matrix(mat);
 }
 
+void rand_test(void) {
+    matrix *serial = NULL;
+    matrix *parallel = NULL;
+    matrix *other = NULL;
+    CU_ASSERT_EQUAL(allocate_matrix(&serial, 300, 301), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&parallel, 300, 301), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&other, 300, 301), 0);
+    /* Must not disturb the libc generator */
+    srand(61);
+    int expected = rand();
+    srand(61);
+    int threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    rand_matrix(serial, 7, -2, 3);
+    omp_set_num_threads(4);
+    rand_matrix(parallel, 7, -2, 3);
+    omp_set_num_threads(threads);
+    rand_matrix(other, 8, -2, 3);
+    CU_ASSERT_EQUAL(rand(), expected);
+    double sum = 0;
+    int same = 0;
+    for (int i = 0; i < 300; i++) {
+        for (int j = 0; j < 301; j++) {
+            CU_ASSERT_EQUAL(get(serial, i, j), get(parallel, i, j));
+            CU_ASSERT(get(serial, i, j) >= -2 && get(serial, i, j) < 3);
+            same += get(serial, i, j) == get(other, i, j);
+            sum += get(serial, i, j);
+        }
+    }
+    CU_ASSERT(same < 10);
+    CU_ASSERT_DOUBLE_EQUAL(sum / (300 * 301), 0.5, 0.05);
+    deallocate_matrix(serial);
+    deallocate_matrix(parallel);
+    deallocate_matrix(other);
+}
+
+void random_dist_test(void) {
+    matrix *mat = NULL;
+    CU_ASSERT_EQUAL(allocate_matrix(&mat, 200, 250), 0);
+    int n = 200 * 250;
+    double sum = 0, squares = 0;
+    random_matrix(mat, 3, RAND_NORMAL, 1, 2);
+    for (int i = 0; i < n; i++) {
+        sum += mat->data[0][i];
+        squares += mat->data[0][i] * mat->data[0][i];
+    }
+    CU_ASSERT_DOUBLE_EQUAL(sum / n, 1, 0.05);
+    CU_ASSERT_DOUBLE_EQUAL(squares / n - (sum / n) * (sum / n), 4, 0.1);
+    random_matrix(mat, 3, RAND_INT, -2, 5);
+    for (int i = 0; i < n; i++) {
+        double val = mat->data[0][i];
+        CU_ASSERT(val >= -2 && val < 5 && val == (int) val);
+    }
+    sum = 0;
+    random_matrix(mat, 3, RAND_BERNOULLI, 0.25, 0);
+    for (int i = 0; i < n; i++) {
+        CU_ASSERT(mat->data[0][i] == 0 || mat->data[0][i] == 1);
+        sum += mat->data[0][i];
+    }
+    CU_ASSERT_DOUBLE_EQUAL(sum / n, 0.25, 0.01);
+    sum = 0;
+    random_matrix(mat, 3, RAND_EXPONENTIAL, 4, 0);
+    for (int i = 0; i < n; i++) {
+        CU_ASSERT(mat->data[0][i] >= 0);
+        sum += mat->data[0][i];
+    }
+    CU_ASSERT_DOUBLE_EQUAL(sum / n, 4, 0.1);
+    deallocate_matrix(mat);
+}
+
+void stats_test(void) {
+    matrix *result = NULL;
+    matrix *mat = NULL;
+    kernel_stats totals[NUM_KERNELS];
+    stats_reset();
+    stats_enabled = 1;
+    CU_ASSERT_EQUAL(allocate_matrix(&result, 20, 30), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&mat, 20, 30), 0);
+    add_matrix(result, mat, mat);
+    add_matrix(result, mat, mat);
+    neg_matrix(result, mat);
+    stats_enabled = 0;
+    add_matrix(result, mat, mat);
+    stats_snapshot(totals);
+    CU_ASSERT_EQUAL(totals[KERNEL_ALLOCATE].calls, 2);
+    CU_ASSERT(totals[KERNEL_ALLOCATE].bytes >= 2 * 20 * 30 * sizeof(double));
+    CU_ASSERT_EQUAL(totals[KERNEL_ADD].calls, 2);
+    CU_ASSERT_EQUAL(totals[KERNEL_ADD].elements, 2 * 20 * 30);
+    CU_ASSERT(totals[KERNEL_ADD].max_ns <= totals[KERNEL_ADD].total_ns);
+    /* Too little work to be worth a team */
+    CU_ASSERT_EQUAL(totals[KERNEL_NEG].serial, 1);
+    CU_ASSERT_EQUAL(totals[KERNEL_MUL].calls, 0);
+    stats_reset();
+    stats_snapshot(totals);
+    CU_ASSERT_EQUAL(totals[KERNEL_ADD].calls, 0);
+    deallocate_matrix(result);
+    deallocate_matrix(mat);
+}
+
+void matmul_ooc_test(void) {
+    matrix *mat1 = NULL;
+    matrix *mat2 = NULL;
+    matrix *result = NULL;
+    matrix *ooc = NULL;
+    CU_ASSERT_EQUAL(allocate_matrix(&mat1, 13, 9), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&mat2, 9, 11), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&result, 13, 11), 0);
+    for (int i = 0; i < 13; i++) {
+        for (int j = 0; j < 9; j++) {
+            set(mat1, i, j, i - j);
+        }
+    }
+    for (int i = 0; i < 9; i++) {
+        for (int j = 0; j < 11; j++) {
+            set(mat2, i, j, i * j % 5);
+        }
+    }
+    mul_matrix(result, mat1, mat2);
+    CU_ASSERT_EQUAL(save_matrix(mat1, "mat_test_a.bin"), 0);
+    CU_ASSERT_EQUAL(save_matrix(mat2, "mat_test_b.bin"), 0);
+    /* Room for 3x3 tiles only, so every dimension is split with a ragged edge */
+    CU_ASSERT_EQUAL(matmul_ooc("mat_test_a.bin", "mat_test_b.bin", "mat_test_c.bin", 45 * sizeof(double)), 0);
+    CU_ASSERT_EQUAL(load_matrix(&ooc, "mat_test_c.bin"), 0);
+    CU_ASSERT_EQUAL(ooc->rows, 13);
+    CU_ASSERT_EQUAL(ooc->cols, 11);
+    for (int i = 0; i < 13; i++) {
+        for (int j = 0; j < 11; j++) {
+            CU_ASSERT_EQUAL(get(ooc, i, j), get(result, i, j));
+        }
+    }
+    CU_ASSERT_EQUAL(matmul_ooc("mat_test_a.bin", "mat_test_a.bin", "mat_test_c.bin", 1 << 20), OOC_SHAPE);
+    CU_ASSERT_EQUAL(matmul_ooc("mat_test_a.bin", "mat_test_b.bin", "mat_test_c.bin", 4 * sizeof(double)), OOC_MEMORY);
+    CU_ASSERT_EQUAL(matmul_ooc("mat_test_a.bin", "missing.bin", "mat_test_c.bin", 1 << 20), OOC_IO);
+    /* Writing over an operand, under any spelling of its path, is refused and leaves it intact */
+    CU_ASSERT_EQUAL(matmul_ooc("mat_test_a.bin", "mat_test_b.bin", "mat_test_a.bin", 1 << 20), OOC_ALIAS);
+    CU_ASSERT_EQUAL(matmul_ooc("mat_test_a.bin", "mat_test_b.bin", "./mat_test_b.bin", 1 << 20), OOC_ALIAS);
+    deallocate_matrix(ooc);
+    CU_ASSERT_EQUAL(load_matrix(&ooc, "mat_test_a.bin"), 0);
+    CU_ASSERT_EQUAL(ooc->rows, 13);
+    CU_ASSERT_EQUAL(get(ooc, 12, 0), 12);
+    remove("mat_test_a.bin");
+    remove("mat_test_b.bin");
+    remove("mat_test_c.bin");
+    deallocate_matrix(mat1);
+    deallocate_matrix(mat2);
+    deallocate_matrix(result);
+    deallocate_matrix(ooc);
+}
+
+void shared_matrix_test(void) {
+    matrix *shared = NULL;
+    matrix *attached = NULL;
+    matrix *copy = NULL;
+    const char *name = "/numc_mat_test";
+    unlink_matrix(name);
+    CU_ASSERT_EQUAL(shared_matrix(&shared, 4, 3, name), 0);
+    CU_ASSERT_NOT_EQUAL(shared->mapped, 0);
+    CU_ASSERT_EQUAL(get(shared, 3, 2), 0);
+    set(shared, 1, 2, 5);
+    CU_ASSERT_EQUAL(attach_matrix(&attached, name), 0);
+    CU_ASSERT_EQUAL(attached->rows, 4);
+    CU_ASSERT_EQUAL(attached->cols, 3);
+    /* Two mappings of one segment: a write through either is seen by the other */
+    CU_ASSERT_NOT_EQUAL(attached->data[0], shared->data[0]);
+    CU_ASSERT_EQUAL(get(attached, 1, 2), 5);
+    set(attached, 3, 0, -2);
+    CU_ASSERT_EQUAL(get(shared, 3, 0), -2);
+    /* A copy does not share the segment, since other processes can write it at any time */
+    CU_ASSERT_EQUAL(copy_matrix(&copy, shared), 0);
+    CU_ASSERT_EQUAL(copy->cow, 0);
+    set(attached, 1, 2, 6);
+    CU_ASSERT_EQUAL(get(copy, 1, 2), 5);
+    CU_ASSERT_EQUAL(shared_matrix(&copy, 2, 2, name), OOC_IO);
+    CU_ASSERT_EQUAL(errno, EEXIST);
+    CU_ASSERT_EQUAL(unlink_matrix(name), 0);
+    CU_ASSERT_EQUAL(get(shared, 1, 2), 6);
+    CU_ASSERT_EQUAL(attach_matrix(&attached, name), OOC_IO);
+    CU_ASSERT_EQUAL(errno, ENOENT);
+    deallocate_matrix(shared);
+    deallocate_matrix(attached);
+    deallocate_matrix(copy);
+}
+
+void trace_test(void) {
+    matrix *result = NULL;
+    matrix *mat = NULL;
+    matrix *bad = NULL;
+    char line[256];
+    CU_ASSERT_EQUAL(allocate_matrix(&result, 3, 3), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&mat, 3, 3), 0);
+    CU_ASSERT_EQUAL(trace_start(16), 0);
+    CU_ASSERT_EQUAL(trace_dump("mat_test_trace.json"), 0);
+    add_matrix(result, mat, mat);
+    /* Rejected shapes leave no event, which would otherwise stay open in the viewer */
+    CU_ASSERT_EQUAL(allocate_matrix(&bad, 0, 3), -1);
+    PyErr_Clear();
+    pow_matrix(result, mat, 3);
+    trace_stop();
+    add_matrix(result, mat, mat);
+    /* pow_matrix, its two allocate_matrix calls and two mul_pow regions, and add_matrix */
+    CU_ASSERT_EQUAL(trace_dump("mat_test_trace.json"), 12);
+    FILE *f = fopen("mat_test_trace.json", "r");
+    CU_ASSERT_PTR_NOT_NULL(f);
+    CU_ASSERT_PTR_NOT_NULL(fgets(line, sizeof(line), f));
+    CU_ASSERT_STRING_EQUAL(line, "{\"traceEvents\":[\n");
+    CU_ASSERT_PTR_NOT_NULL(fgets(line, sizeof(line), f));
+    CU_ASSERT_PTR_NOT_NULL(strstr(line, "\"name\":\"add_matrix\",\"cat\":\"kernel\",\"ph\":\"B\""));
+    CU_ASSERT_PTR_NOT_NULL(strstr(line, "\"shape\":[3,3]"));
+    fclose(f);
+    /* Dumping drops what was dumped */
+    CU_ASSERT_EQUAL(trace_dump("mat_test_trace.json"), 0);
+    CU_ASSERT_EQUAL(trace_dump("missing/mat_test_trace.json"), -1);
+    remove("mat_test_trace.json");
+    deallocate_matrix(result);
+    deallocate_matrix(mat);
+}
+
+void perf_test(void) {
+    matrix *result = NULL;
+    matrix *mat1 = NULL;
+    matrix *mat2 = NULL;
+    matrix *bad = NULL;
+    perf_entry entries[PERF_BUCKETS];
+    CU_ASSERT_EQUAL(allocate_matrix(&result, 20, 10), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&mat1, 20, 30), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&mat2, 30, 10), 0);
+    perf_reset();
+    /* Whichever counters open, the buckets and modelled work are the same */
+    perf_start();
+    mul_matrix(result, mat1, mat2);
+    mul_matrix(result, mat1, mat2);
+    add_matrix(mat1, mat1, mat1);
+    perf_stop();
+    mul_matrix(result, mat1, mat2);
+    CU_ASSERT_EQUAL(perf_snapshot(entries, PERF_BUCKETS), 2);
+    CU_ASSERT_EQUAL(entries[0].kernel, KERNEL_MUL);
+    CU_ASSERT_EQUAL(entries[0].rows, 32);
+    CU_ASSERT_EQUAL(entries[0].cols, 16);
+    CU_ASSERT_EQUAL(entries[0].calls, 2);
+    CU_ASSERT_DOUBLE_EQUAL(entries[0].flops, 2 * 2 * 20 * 10 * 30, 1e-9);
+    CU_ASSERT_EQUAL(entries[1].kernel, KERNEL_ADD);
+    CU_ASSERT_DOUBLE_EQUAL(entries[1].flops, 20 * 30, 1e-9);
+    CU_ASSERT_DOUBLE_EQUAL(entries[1].bytes, 3 * 20 * 30 * sizeof(double), 1e-9);
+    perf_reset();
+    CU_ASSERT_EQUAL(perf_snapshot(entries, PERF_BUCKETS), 0);
+    /* Rejected shapes push no frame, so the stack has room for and books the calls after them */
+    perf_start();
+    for (int i = 0; i < 10; i++) {
+        CU_ASSERT_EQUAL(allocate_matrix(&bad, 0, 3), -1);
+    }
+    PyErr_Clear();
+    CU_ASSERT_EQUAL(allocate_matrix(&bad, 64, 64), 0);
+    add_matrix(mat1, mat1, mat1);
+    perf_stop();
+    CU_ASSERT_EQUAL(perf_snapshot(entries, PERF_BUCKETS), 2);
+    CU_ASSERT_EQUAL(entries[0].kernel, KERNEL_ALLOCATE);
+    CU_ASSERT_EQUAL(entries[0].rows, 64);
+    CU_ASSERT_EQUAL(entries[0].cols, 64);
+    CU_ASSERT_EQUAL(entries[0].calls, 1);
+    CU_ASSERT_EQUAL(entries[1].kernel, KERNEL_ADD);
+    perf_reset();
+    deallocate_matrix(bad);
+    deallocate_matrix(result);
+    deallocate_matrix(mat1);
+    deallocate_matrix(mat2);
+}
+
+void plan_test(void) {
+    matrix *result = NULL;
+    matrix *mat = NULL;
+    int threads;
+    set_num_threads(4);
+    CU_ASSERT_EQUAL(get_num_threads(), 4);
+    CU_ASSERT_EQUAL(plan_kernel(4, 4, 4 * 3 * sizeof(double), &threads), PLAN_SERIAL);
+    CU_ASSERT_EQUAL(threads, 1);
+    CU_ASSERT_EQUAL(plan_kernel(1000, 1000, 1000 * 3 * sizeof(double), &threads), PLAN_SIMD);
+    CU_ASSERT_EQUAL(threads, 1);
+    CU_ASSERT_EQUAL(plan_kernel(1e6, 1e6, 1e6 * 3 * sizeof(double), &threads), PLAN_THREADED);
+    CU_ASSERT_EQUAL(threads, 4);
+    /* A per-call cap overrides the global one until it is restored */
+    CU_ASSERT_EQUAL(set_call_threads(2), 0);
+    plan_kernel(1e6, 1e6, 1e6 * 3 * sizeof(double), &threads);
+    CU_ASSERT_EQUAL(threads, 2);
+    CU_ASSERT_EQUAL(set_call_threads(0), 2);
+    set_num_threads(1);
+    CU_ASSERT_EQUAL(plan_kernel(1e6, 1e6, 1e6 * 3 * sizeof(double), &threads), PLAN_SIMD);
+
+    /* Every plan gives the same answer */
+    CU_ASSERT_EQUAL(allocate_matrix(&result, 300, 301), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&mat, 300, 301), 0);
+    for (int i = 0; i < 300; i++) {
+        for (int j = 0; j < 301; j++) {
+            set(mat, i, j, i - 2 * j);
+        }
+    }
+    for (int n = 1; n <= 4; n += 3) {
+        set_num_threads(n);
+        add_matrix(result, mat, mat);
+        CU_ASSERT_EQUAL(get(result, 299, 300), 2 * (299 - 600));
+        abs_matrix(result, mat);
+        CU_ASSERT_EQUAL(get(result, 7, 100), 193);
+        neg_matrix(result, mat);
+        CU_ASSERT_EQUAL(get(result, 0, 5), 10);
+        fill_matrix(result, 2.5);
+        CU_ASSERT_EQUAL(get(result, 150, 150), 2.5);
+    }
+    set_num_threads(0);
+    deallocate_matrix(result);
+    deallocate_matrix(mat);
+}
+
+static void count_range(void *args, Py_ssize_t begin, Py_ssize_t end) {
+    int *counts = args;
+    for (int i = begin; i < end; i++) {
+        counts[i]++;
+    }
+}
+
+static void nested_range(void *args, Py_ssize_t begin, Py_ssize_t end) {
+    int *counts = args;
+    for (int i = begin; i < end; i++) {
+        pool_for(2, 1000, count_range, counts + i * 1000);
+    }
+}
+
+static void *pool_caller(void *args) {
+    int *counts = args;
+    for (int round = 0; round < 20; round++) {
+        pool_for(4, 5000, count_range, counts);
+    }
+    return NULL;
+}
+
+static void count_call(void *args) {
+    __atomic_add_fetch((int *) args, 1, __ATOMIC_RELAXED);
+}
+
+void pool_test(void) {
+    pool_counters before, after;
+    pool_get_counters(&before);
+    int *counts = calloc(100003, sizeof(int));
+    CU_ASSERT_EQUAL(pool_for(4, 100003, count_range, counts), 0);
+    CU_ASSERT_TRUE(pool_workers() >= 4);
+    int once = 1;
+    for (int i = 0; i < 100003; i++) {
+        once &= counts[i] == 1;
+    }
+    CU_ASSERT_TRUE(once);
+
+    /* Kernels inside kernels run on the same workers */
+    memset(counts, 0, 16 * 1000 * sizeof(int));
+    CU_ASSERT_EQUAL(pool_for(4, 16, nested_range, counts), 0);
+    once = 1;
+    for (int i = 0; i < 16 * 1000; i++) {
+        once &= counts[i] == 1;
+    }
+    CU_ASSERT_TRUE(once);
+
+    /* Concurrent callers share the workers */
+    pthread_t callers[4];
+    memset(counts, 0, 4 * 5000 * sizeof(int));
+    for (int t = 0; t < 4; t++) {
+        pthread_create(&callers[t], NULL, pool_caller, counts + t * 5000);
+    }
+    for (int t = 0; t < 4; t++) {
+        pthread_join(callers[t], NULL);
+    }
+    int twenty = 1;
+    for (int i = 0; i < 4 * 5000; i++) {
+        twenty &= counts[i] == 20;
+    }
+    CU_ASSERT_TRUE(twenty);
+
+    int calls = 0;
+    CU_ASSERT_EQUAL(pool_broadcast(count_call, &calls), 0);
+    CU_ASSERT_EQUAL(calls, pool_workers());
+    /* Submitted calls run without the caller waiting for them */
+    calls = 0;
+    for (int i = 0; i < 3; i++) {
+        CU_ASSERT_EQUAL(pool_submit(2, count_call, &calls), 0);
+    }
+    while (__atomic_load_n(&calls, __ATOMIC_RELAXED) < 3) {
+        sched_yield();
+    }
+    pool_get_counters(&after);
+    CU_ASSERT_EQUAL(after.jobs - before.jobs, 1 + 1 + 16 + 4 * 20 + 3);
+    CU_ASSERT_TRUE(after.tasks - before.tasks >= after.jobs - before.jobs);
+
+    /* A stopped pool starts again on demand */
+    pool_stop();
+    CU_ASSERT_EQUAL(pool_workers(), 0);
+    memset(counts, 0, 1000 * sizeof(int));
+    CU_ASSERT_EQUAL(pool_for(3, 1000, count_range, counts), 0);
+    CU_ASSERT_EQUAL(counts[0] + counts[500] + counts[999], 3);
+    free(counts);
+}
+
+void lu_test(void) {
+    matrix *a = NULL;
+    matrix *b = NULL;
+    matrix *x = NULL;
+    lu_factors lu;
+    double values[3][3] = {{0, 2, 1}, {4, 1, -1}, {2, 3, 5}};
+    CU_ASSERT_EQUAL(allocate_matrix(&a, 3, 3), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&b, 3, 2), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&x, 3, 2), 0);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            set(a, i, j, values[i][j]);
+        }
+        set(b, i, 0, i + 1);
+        set(b, i, 1, -i);
+    }
+    /* The zero in the corner needs a pivot */
+    CU_ASSERT_EQUAL(lu_factor(&lu, a), 0);
+    CU_ASSERT_EQUAL(lu.singular, 0);
+    CU_ASSERT_DOUBLE_EQUAL(lu_det(&lu), -34, 1e-12);
+    CU_ASSERT_EQUAL(lu_solve(&lu, b, x), 0);
+    for (int i = 0; i < 3; i++) {
+        for (int c = 0; c < 2; c++) {
+            double sum = 0;
+            for (int j = 0; j < 3; j++) {
+                sum += values[i][j] * get(x, j, c);
+            }
+            CU_ASSERT_DOUBLE_EQUAL(sum, get(b, i, c), 1e-12);
+        }
+    }
+    lu_free(&lu);
+
+    /* Blocked and unblocked factorizations agree on a matrix several blocks wide */
+    matrix *big = NULL;
+    CU_ASSERT_EQUAL(allocate_matrix(&big, 70, 70), 0);
+    rand_matrix(big, 3, -1, 1);
+    linalg_block = 0;
+    CU_ASSERT_EQUAL(lu_factor(&lu, big), 0);
+    double unblocked = lu_det(&lu);
+    lu_free(&lu);
+    linalg_block = 16;
+    CU_ASSERT_EQUAL(lu_factor(&lu, big), 0);
+    CU_ASSERT_DOUBLE_EQUAL(lu_det(&lu), unblocked, fabs(unblocked) * 1e-10);
+    lu_free(&lu);
+    linalg_block = 64;
+
+    /* A singular matrix factors with a zero determinant but cannot be solved */
+    set(a, 2, 0, 4);
+    set(a, 2, 1, 5);
+    set(a, 2, 2, 1);
+    CU_ASSERT_EQUAL(lu_factor(&lu, a), 0);
+    CU_ASSERT_EQUAL(lu.singular, 1);
+    CU_ASSERT_EQUAL(lu_det(&lu), 0);
+    CU_ASSERT_EQUAL(lu_solve(&lu, b, x), LINALG_SINGULAR);
+    lu_free(&lu);
+    deallocate_matrix(a);
+    deallocate_matrix(b);
+    deallocate_matrix(x);
+    deallocate_matrix(big);
+}
+
+void cholesky_test(void) {
+    matrix *g = NULL;
+    matrix *a = NULL;
+    matrix *l = NULL;
+    matrix *b = NULL;
+    matrix *x = NULL;
+    int n = 70;
+    CU_ASSERT_EQUAL(allocate_matrix(&g, n, n), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&a, n, n), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&l, n, n), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&b, n, 3), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&x, n, 3), 0);
+    rand_matrix(g, 5, -1, 1);
+    rand_matrix(b, 6, -1, 1);
+    /* A = G * G^T + n I is symmetric positive definite; poison its upper triangle */
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j <= i; j++) {
+            double sum = i == j ? n : 0;
+            for (int p = 0; p < n; p++) {
+                sum += get(g, i, p) * get(g, j, p);
+            }
+            set(a, i, j, sum);
+            if (j < i) {
+                set(a, j, i, 1e6);
+            }
+        }
+    }
+    for (int block = 0; block <= 16; block += 16) {
+        linalg_block = block;
+        CU_ASSERT_EQUAL(chol_factor(l, a), 0);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                double sum = 0;
+                for (int p = 0; p < n; p++) {
+                    sum += get(l, i, p) * get(l, j, p);
+                }
+                CU_ASSERT_DOUBLE_EQUAL(sum, get(a, i < j ? j : i, i < j ? i : j), 1e-9);
+                if (j > i) {
+                    CU_ASSERT_EQUAL(get(l, i, j), 0);
+                }
+            }
+        }
+        CU_ASSERT_EQUAL(chol_solve(l, b, x), 0);
+        for (int i = 0; i < n; i++) {
+            for (int c = 0; c < 3; c++) {
+                double sum = 0;
+                for (int j = 0; j < n; j++) {
+                    sum += get(a, i < j ? j : i, i < j ? i : j) * get(x, j, c);
+                }
+                CU_ASSERT_DOUBLE_EQUAL(sum, get(b, i, c), 1e-9);
+            }
+        }
+        /* The upper triangle of L^T, solved in place */
+        for (int i = 0; i < n; i++) {
+            for (int j = i + 1; j < n; j++) {
+                set(l, i, j, get(l, j, i));
+            }
+        }
+        CU_ASSERT_EQUAL(tri_solve(l, 1, 0, b, x), 0);
+        CU_ASSERT_EQUAL(tri_solve(l, 0, 0, x, x), 0);
+        for (int i = 0; i < n; i++) {
+            for (int c = 0; c < 3; c++) {
+                double sum = 0;
+                for (int j = 0; j < n; j++) {
+                    sum += get(a, i < j ? j : i, i < j ? i : j) * get(x, j, c);
+                }
+                CU_ASSERT_DOUBLE_EQUAL(sum, get(b, i, c), 1e-9);
+            }
+        }
+    }
+    linalg_block = 64;
+
+    /* An indefinite matrix is rejected */
+    set(a, n - 1, n - 1, -1);
+    CU_ASSERT_EQUAL(chol_factor(l, a), LINALG_NOT_SPD);
+    set(l, 0, 0, 0);
+    CU_ASSERT_EQUAL(tri_solve(l, 1, 0, b, x), LINALG_SINGULAR);
+    deallocate_matrix(g);
+    deallocate_matrix(a);
+    deallocate_matrix(l);
+    deallocate_matrix(b);
+    deallocate_matrix(x);
+}
+
+void qr_test(void) {
+    /* 40000 x 5 goes through TSQR, 60 x 45 and 20 x 30 through one blocked QR */
+    int shapes[3][2] = {{40000, 5}, {60, 45}, {20, 30}};
+    linalg_block = 16;
+    for (int s = 0; s < 3; s++) {
+        int m = shapes[s][0];
+        int n = shapes[s][1];
+        int k = m < n ? m : n;
+        matrix *a = NULL;
+        matrix *q = NULL;
+        matrix *r = NULL;
+        CU_ASSERT_EQUAL(allocate_matrix(&a, m, n), 0);
+        CU_ASSERT_EQUAL(allocate_matrix(&q, m, k), 0);
+        CU_ASSERT_EQUAL(allocate_matrix(&r, k, n), 0);
+        rand_matrix(a, s + 7, -1, 1);
+        CU_ASSERT_EQUAL(qr_decompose(a, q, r), 0);
+        for (int i = 0; i < m; i += m / 20 + 1) {
+            for (int j = 0; j < n; j++) {
+                double sum = 0;
+                for (int p = 0; p <= j && p < k; p++) {
+                    sum += get(q, i, p) * get(r, p, j);
+                }
+                CU_ASSERT_DOUBLE_EQUAL(sum, get(a, i, j), 1e-10);
+            }
+        }
+        for (int i = 0; i < k; i++) {
+            for (int j = 0; j < k; j++) {
+                double sum = 0;
+                for (int p = 0; p < m; p++) {
+                    sum += get(q, p, i) * get(q, p, j);
+                }
+                CU_ASSERT_DOUBLE_EQUAL(sum, i == j, 1e-10);
+            }
+            for (int j = 0; j < i && j < n; j++) {
+                CU_ASSERT_EQUAL(get(r, i, j), 0);
+            }
+        }
+        if (m >= n) {
+            /* A consistent system is solved exactly */
+            matrix *b = NULL;
+            matrix *x = NULL;
+            CU_ASSERT_EQUAL(allocate_matrix(&b, m, 2), 0);
+            CU_ASSERT_EQUAL(allocate_matrix(&x, n, 2), 0);
+            for (int i = 0; i < m; i++) {
+                double sum = 0;
+                for (int j = 0; j < n; j++) {
+                    sum += get(a, i, j) * (j + 1);
+                }
+                set(b, i, 0, sum);
+                set(b, i, 1, -sum);
+            }
+            CU_ASSERT_EQUAL(qr_lstsq(a, b, x), 0);
+            for (int j = 0; j < n; j++) {
+                CU_ASSERT_DOUBLE_EQUAL(get(x, j, 0), j + 1, 1e-8);
+                CU_ASSERT_DOUBLE_EQUAL(get(x, j, 1), -(j + 1), 1e-8);
+            }
+            /* Rank deficient: a repeated column */
+            for (int i = 0; i < m; i++) {
+                set(a, i, n - 1, get(a, i, 0));
+            }
+            CU_ASSERT_EQUAL(qr_lstsq(a, b, x), LINALG_SINGULAR);
+            deallocate_matrix(b);
+            deallocate_matrix(x);
+        }
+        deallocate_matrix(a);
+        deallocate_matrix(q);
+        deallocate_matrix(r);
+    }
+    linalg_block = 64;
+}
+
+void eigh_svd_test(void) {
+    /* 50 x 50 takes more than one panel of the tridiagonal reduction */
+    int n = 50;
+    linalg_block = 16;
+    matrix *a = NULL;
+    matrix *v = NULL;
+    double w[50];
+    CU_ASSERT_EQUAL(allocate_matrix(&a, n, n), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&v, n, n), 0);
+    rand_matrix(a, 13, -1, 1);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < i; j++) {
+            set(a, j, i, get(a, i, j));
+        }
+    }
+    CU_ASSERT_EQUAL(sym_eigen(a, w, v), 0);
+    for (int j = 0; j < n; j++) {
+        if (j > 0) {
+            CU_ASSERT(w[j - 1] <= w[j]);
+        }
+        /* A v_j == w_j v_j and the columns are orthonormal */
+        for (int i = 0; i < n; i++) {
+            double sum = 0;
+            for (int p = 0; p < n; p++) {
+                sum += get(a, i, p) * get(v, p, j);
+            }
+            CU_ASSERT_DOUBLE_EQUAL(sum, w[j] * get(v, i, j), 1e-10);
+        }
+        for (int k = 0; k <= j; k++) {
+            double sum = 0;
+            for (int p = 0; p < n; p++) {
+                sum += get(v, p, j) * get(v, p, k);
+            }
+            CU_ASSERT_DOUBLE_EQUAL(sum, j == k, 1e-10);
+        }
+    }
+    deallocate_matrix(a);
+    deallocate_matrix(v);
+
+    /* Tall, wide, tall with a zero column (a zero singular value), and tall and wide products of
+     * rank `rank`, whose zero singular values come out of QR and Jacobi as rounding noise */
+    int shapes[5][3] = {{60, 20, 20}, {15, 40, 15}, {30, 12, 11}, {59, 29, 25}, {20, 42, 18}};
+    for (int s = 0; s < 5; s++) {
+        int m = shapes[s][0];
+        int c = shapes[s][1];
+        int k = m < c ? m : c;
+        int rank = shapes[s][2];
+        matrix *u = NULL;
+        matrix *vt = NULL;
+        double sv[40];
+        CU_ASSERT_EQUAL(allocate_matrix(&a, m, c), 0);
+        CU_ASSERT_EQUAL(allocate_matrix(&u, m, k), 0);
+        CU_ASSERT_EQUAL(allocate_matrix(&vt, k, c), 0);
+        rand_matrix(a, s + 17, -1, 1);
+        if (s == 2) {
+            for (int i = 0; i < m; i++) {
+                set(a, i, 3, 0);
+            }
+        }
+        if (s >= 3) {
+            matrix *left = NULL;
+            matrix *right = NULL;
+            CU_ASSERT_EQUAL(allocate_matrix(&left, m, rank), 0);
+            CU_ASSERT_EQUAL(allocate_matrix(&right, rank, c), 0);
+            rand_matrix(left, s, 0, 1);
+            rand_matrix(right, s + 100, 0, 1);
+            fill_matrix(a, 0);
+            mul_matrix(a, left, right);
+            deallocate_matrix(left);
+            deallocate_matrix(right);
+        }
+        CU_ASSERT_EQUAL(svd_decompose(a, u, sv, vt), 0);
+        for (int j = 0; j < k; j++) {
+            CU_ASSERT(sv[j] >= 0);
+            if (j > 0) {
+                CU_ASSERT(sv[j - 1] >= sv[j]);
+            }
+        }
+        for (int j = rank; j < k; j++) {
+            CU_ASSERT_DOUBLE_EQUAL(sv[j], 0, 1e-12);
+        }
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < c; j++) {
+                double sum = 0;
+                for (int p = 0; p < k; p++) {
+                    sum += get(u, i, p) * sv[p] * get(vt, p, j);
+                }
+                CU_ASSERT_DOUBLE_EQUAL(sum, get(a, i, j), 1e-10);
+            }
+        }
+        for (int i = 0; i < k; i++) {
+            for (int j = 0; j <= i; j++) {
+                double uu = 0;
+                double vv = 0;
+                for (int p = 0; p < m; p++) {
+                    uu += get(u, p, i) * get(u, p, j);
+                }
+                for (int p = 0; p < c; p++) {
+                    vv += get(vt, i, p) * get(vt, j, p);
+                }
+                CU_ASSERT_DOUBLE_EQUAL(uu, i == j, 1e-10);
+                CU_ASSERT_DOUBLE_EQUAL(vv, i == j, 1e-10);
+            }
+        }
+        deallocate_matrix(a);
+        deallocate_matrix(u);
+        deallocate_matrix(vt);
+    }
+    linalg_block = 64;
+}
+
+void tuning_test(void) {
+    matrix *mat1 = NULL;
+    matrix *mat2 = NULL;
+    matrix *plain = NULL;
+    matrix *tiled = NULL;
+    double value;
+    CU_ASSERT_EQUAL(allocate_matrix(&mat1, 37, 53), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&mat2, 53, 29), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&plain, 37, 29), 0);
+    for (int i = 0; i < 37; i++) {
+        for (int j = 0; j < 53; j++) {
+            set(mat1, i, j, (i * j) % 7 - 3);
+        }
+    }
+    for (int i = 0; i < 53; i++) {
+        for (int j = 0; j < 29; j++) {
+            set(mat2, i, j, (i + 2 * j) % 5);
+        }
+    }
+    mul_matrix(plain, mat1, mat2);
+    /* Tiles that leave ragged edges in every dimension, with and without packing */
+    CU_ASSERT_EQUAL(set_tunable("mul_tile_rows", 8), 0);
+    CU_ASSERT_EQUAL(set_tunable("mul_tile_depth", 16), 0);
+    CU_ASSERT_EQUAL(set_tunable("mul_tile_cols", 12), 0);
+    for (int pack = 0; pack <= 1; pack++) {
+        CU_ASSERT_EQUAL(set_tunable("mul_pack", pack), 0);
+        CU_ASSERT_EQUAL(allocate_matrix(&tiled, 37, 29), 0);
+        mul_matrix(tiled, mat1, mat2);
+        for (int i = 0; i < 37; i++) {
+            for (int j = 0; j < 29; j++) {
+                CU_ASSERT_EQUAL(get(tiled, i, j), get(plain, i, j));
+            }
+        }
+        deallocate_matrix(tiled);
+    }
+
+    CU_ASSERT_EQUAL(set_tunable("no_such_setting", 1), -1);
+    CU_ASSERT_EQUAL(set_tunable("mul_pack", -1), -2);
+    CU_ASSERT_EQUAL(set_tunable("mul_tile_rows", 2.5), -2);
+    CU_ASSERT_EQUAL(set_tunable("plan_thread_ns", 0), -2);
+    FILE *f = fopen("mat_test_tuning.conf", "w");
+    fputs("# written by hand\n\nmul_tile_rows = 4\nnewer_setting = 3\n  plan_thread_ns=2500.5\n", f);
+    fclose(f);
+    CU_ASSERT_EQUAL(load_tuning("mat_test_tuning.conf"), 0);
+    CU_ASSERT_EQUAL(get_tunable("mul_tile_rows", &value), 0);
+    CU_ASSERT_EQUAL(value, 4);
+    CU_ASSERT_EQUAL(get_tunable("plan_thread_ns", &value), 0);
+    CU_ASSERT_EQUAL(value, 2500.5);
+    f = fopen("mat_test_tuning.conf", "w");
+    fputs("mul_tile_cols = 8\nmul_pack = yes\n", f);
+    fclose(f);
+    CU_ASSERT_EQUAL(load_tuning("mat_test_tuning.conf"), 2);
+    CU_ASSERT_EQUAL(load_tuning("missing.conf"), -1);
+    remove("mat_test_tuning.conf");
+
+    set_tunable("mul_tile_rows", 0);
+    set_tunable("mul_tile_depth", 0);
+    set_tunable("mul_tile_cols", 0);
+    set_tunable("mul_pack", 0);
+    set_tunable("plan_thread_ns", 5000);
+    deallocate_matrix(mat1);
+    deallocate_matrix(mat2);
+    deallocate_matrix(plain);
+}
+
 /************* Test Runner Code goes here **************/
 
 int main(void) {
@@ -273,15 +1444,35 @@ int main(void) {
     if ((CU_add_test(pSuite, "add_test", add_test) == NULL) ||
             (CU_add_test(pSuite, "sub_test", sub_test) == NULL) ||
             (CU_add_test(pSuite, "mul_test", mul_test) == NULL) ||
+            (CU_add_test(pSuite, "mul_vector_test", mul_vector_test) == NULL) ||
             (CU_add_test(pSuite, "neg_test", neg_test) == NULL) ||
             (CU_add_test(pSuite, "abs_test", abs_test) == NULL) ||
+            (CU_add_test(pSuite, "ufunc_test", ufunc_test) == NULL) ||
+            (CU_add_test(pSuite, "compare_test", compare_test) == NULL) ||
             (CU_add_test(pSuite, "pow_test", pow_test) == NULL) ||
             (CU_add_test(pSuite, "alloc_fail_test", alloc_fail_test) == NULL) ||
             (CU_add_test(pSuite, "alloc_success_test", alloc_success_test) == NULL) ||
             (CU_add_test(pSuite, "alloc_ref_test", alloc_ref_test) == NULL) ||
+            (CU_add_test(pSuite, "alloc_strided_test", alloc_strided_test) == NULL) ||
+            (CU_add_test(pSuite, "assign_test", assign_test) == NULL) ||
             (CU_add_test(pSuite, "dealloc_null_test", dealloc_null_test) == NULL) ||
+            (CU_add_test(pSuite, "copy_on_write_test", copy_on_write_test) == NULL) ||
             (CU_add_test(pSuite, "get_test", get_test) == NULL) ||
-            (CU_add_test(pSuite, "set_test", set_test) == NULL)) {
+            (CU_add_test(pSuite, "set_test", set_test) == NULL) ||
+            (CU_add_test(pSuite, "rand_test", rand_test) == NULL) ||
+            (CU_add_test(pSuite, "random_dist_test", random_dist_test) == NULL) ||
+            (CU_add_test(pSuite, "stats_test", stats_test) == NULL) ||
+            (CU_add_test(pSuite, "matmul_ooc_test", matmul_ooc_test) == NULL) ||
+            (CU_add_test(pSuite, "shared_matrix_test", shared_matrix_test) == NULL) ||
+            (CU_add_test(pSuite, "trace_test", trace_test) == NULL) ||
+            (CU_add_test(pSuite, "perf_test", perf_test) == NULL) ||
+            (CU_add_test(pSuite, "plan_test", plan_test) == NULL) ||
+            (CU_add_test(pSuite, "pool_test", pool_test) == NULL) ||
+            (CU_add_test(pSuite, "lu_test", lu_test) == NULL) ||
+            (CU_add_test(pSuite, "cholesky_test", cholesky_test) == NULL) ||
+            (CU_add_test(pSuite, "qr_test", qr_test) == NULL) ||
+            (CU_add_test(pSuite, "eigh_svd_test", eigh_svd_test) == NULL) ||
+            (CU_add_test(pSuite, "tuning_test", tuning_test) == NULL)) {
         CU_cleanup_registry();
         return CU_get_error();
     }
@@ -1,7 +1,18 @@
 #include "matrix.h"
+#include "profile.h"
+#include "pool.h"
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <omp.h>
 
 // Include SSE intrinsics
@@ -26,27 +37,423 @@
  * __m256d _mm256_max_pd (__m256d a, __m256d b)
 */
 
+/* EXECUTION PLANS */
+
+/*
+ * Cost model behind plan_kernel. A kernel's single-thread time is estimated from its FLOPs and
+ * its memory traffic, whichever takes longer, and every thread of a team has to get at least
+ * plan_thread_ns of that to pay for its share of the fork and join. Below plan_simd_elements the
+ * vector loop's setup and remainder handling cost more than they save.
+ */
+double plan_flops_per_ns = 2.0;
+double plan_bytes_per_ns = 8.0;
+double plan_thread_ns = 5000.0;
+int plan_simd_elements = 16;
+
+/*
+ * Blocking for matrix products (see mul_tiled). 0 tile sizes keep the untiled row loop; the
+ * autotuner picks sizes that fit the host's caches.
+ */
+int mul_tile_rows = 0;
+int mul_tile_depth = 0;
+int mul_tile_cols = 0;
+int mul_pack = 0;
+
+/*
+ * Whether threaded kernels run on the shared work-stealing pool in pool.c (1) or open an OpenMP
+ * team of their own per call (0).
+ */
+int thread_pool = 1;
+
+static int num_threads = 0;
+static __thread int call_threads = 0;
+
 /*
- * Generates a random double between `low` and `high`.
+ * Cap the threads every kernel may use; 0 restores the OpenMP default (OMP_NUM_THREADS or one per
+ * core).
  */
-double rand_double(double low, double high) {
-    double range = (high - low);
-    double div = RAND_MAX / range;
-    return low + (rand() / div);
+void set_num_threads(int threads) {
+    num_threads = threads > 0 ? threads : 0;
 }
 
 /*
- * Generates a random matrix with `seed`.
+ * Override the cap for kernels called from this thread until it is set back to 0, and return the
+ * previous override so that calls can nest.
  */
-void rand_matrix(matrix *result, unsigned int seed, double low, double high) {
-    srand(seed);
-    for (int i = 0; i < result->rows; i++) {
-        for (int j = 0; j < result->cols; j++) {
-            set(result, i, j, rand_double(low, high));
+int set_call_threads(int threads) {
+    int previous = call_threads;
+    call_threads = threads > 0 ? threads : 0;
+    return previous;
+}
+
+/*
+ * The most threads a kernel called from this thread may use.
+ */
+int get_num_threads(void) {
+    if (call_threads > 0) {
+        return call_threads;
+    }
+    return num_threads > 0 ? num_threads : omp_get_max_threads();
+}
+
+/*
+ * Every tunable parameter by name, for load_tuning and for numc.tuning() / numc.set_tuning().
+ * Integers must not be negative and rates must be positive.
+ */
+typedef struct tunable {
+    const char *name;
+    int *intValue;
+    double *doubleValue;
+} tunable;
+
+static const tunable tunables[] = {
+    {"num_threads", &num_threads, NULL},
+    {"plan_flops_per_ns", NULL, &plan_flops_per_ns},
+    {"plan_bytes_per_ns", NULL, &plan_bytes_per_ns},
+    {"plan_thread_ns", NULL, &plan_thread_ns},
+    {"plan_simd_elements", &plan_simd_elements, NULL},
+    {"mul_tile_rows", &mul_tile_rows, NULL},
+    {"mul_tile_depth", &mul_tile_depth, NULL},
+    {"mul_tile_cols", &mul_tile_cols, NULL},
+    {"mul_pack", &mul_pack, NULL},
+    {"thread_pool", &thread_pool, NULL},
+    {"linalg_block", &linalg_block, NULL},
+};
+
+#define NUM_TUNABLES ((int) (sizeof(tunables) / sizeof(tunable)))
+
+/*
+ * The name of tunable `i`, or NULL once `i` is past the last one.
+ */
+const char *tunable_name(int i) {
+    return i >= 0 && i < NUM_TUNABLES ? tunables[i].name : NULL;
+}
+
+/*
+ * Whether tunable `i` takes whole numbers only.
+ */
+int tunable_is_int(int i) {
+    return i >= 0 && i < NUM_TUNABLES && tunables[i].intValue != NULL;
+}
+
+/*
+ * Read the tunable `name` into `value`. Return 0 upon success and -1 if there is no such tunable.
+ */
+int get_tunable(const char *name, double *value) {
+    for (int i = 0; i < NUM_TUNABLES; i++) {
+        if (strcmp(tunables[i].name, name) == 0) {
+            *value = tunables[i].intValue != NULL ? *tunables[i].intValue
+                                                  : *tunables[i].doubleValue;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Set the tunable `name` to `value`. Return 0 upon success, -1 if there is no such tunable and -2
+ * if `value` is out of range for it. The tile sizes are all-or-nothing: setting one to 0 turns
+ * tiling off but leaves the others as they are.
+ */
+int set_tunable(const char *name, double value) {
+    for (int i = 0; i < NUM_TUNABLES; i++) {
+        if (strcmp(tunables[i].name, name) != 0) {
+            continue;
+        }
+        if (tunables[i].intValue != NULL) {
+            if (value < 0 || value > INT32_MAX || value != (int) value) {
+                return -2;
+            }
+            *tunables[i].intValue = (int) value;
+        } else {
+            if (!(value > 0) || isinf(value)) {
+                return -2;
+            }
+            *tunables[i].doubleValue = value;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * Apply a tuning file of `name = value` lines, as written by numc_autotune.py. Blank lines and
+ * lines starting with '#' are skipped, and so are unknown names, so that older builds can read
+ * newer files. Return 0 upon success, -1 (with errno set) if the file cannot be read, or the
+ * number of the first line that is malformed or out of range; lines before it have been applied.
+ */
+int load_tuning(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    char line[256];
+    int lineNo = 0;
+    int ret = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineNo++;
+        char name[64];
+        double value;
+        char *text = line;
+        while (*text == ' ' || *text == '\t') {
+            text++;
+        }
+        if (*text == '#' || *text == '\n' || *text == '\0') {
+            continue;
+        }
+        if (sscanf(text, "%63[A-Za-z0-9_] = %lf", name, &value) != 2 ||
+                set_tunable(name, value) == -2) {
+            ret = lineNo;
+            break;
+        }
+    }
+    fclose(f);
+    return ret;
+}
+
+/*
+ * Pick how to run a kernel that produces `elements` results with `flops` floating point
+ * operations and `bytes` of memory traffic. Return one of the PLAN_* constants and store the
+ * team size in `threads` (1 unless the plan is PLAN_THREADED).
+ */
+int plan_kernel(double elements, double flops, double bytes, int *threads) {
+    *threads = 1;
+    if (elements < plan_simd_elements) {
+        return PLAN_SERIAL;
+    }
+    double ns = fmax(flops / plan_flops_per_ns, bytes / plan_bytes_per_ns);
+    double useful = ns / plan_thread_ns;
+    int limit = get_num_threads();
+    if (useful < 2 || limit < 2) {
+        return PLAN_SIMD;
+    }
+    *threads = useful < limit ? (int) useful : limit;
+    return PLAN_THREADED;
+}
+
+/*
+ * Run fn(args, begin, end) over [0, count). Under PLAN_THREADED the range goes to the thread pool,
+ * with at most `threads` workers on it, or with thread_pool off (or if the pool cannot start) is
+ * split evenly over an OpenMP team of `threads`. Otherwise fn runs once on the calling thread,
+ * without entering a parallel region at all, since even a team of one costs a fork.
+ */
+void parallel_for(int plan, int threads, Py_ssize_t count, range_fn fn, void *args) {
+    if (plan != PLAN_THREADED || threads < 2) {
+        fn(args, 0, count);
+        return;
+    }
+    if (thread_pool && pool_for(threads, count, fn, args) == 0) {
+        return;
+    }
+    #pragma omp parallel num_threads(threads)
+    {
+        int t = omp_get_thread_num();
+        int n = omp_get_num_threads();
+        fn(args, count * t / n, count * (t + 1) / n);
+    }
+}
+
+/*
+ * Random matrices come from the Philox4x32-10 counter-based generator (Salmon et al., "Parallel
+ * Random Numbers: As Easy as 1, 2, 3"). Block `n` under a given seed is a pure function of `n`,
+ * so element `e` of a matrix is always generated from block e / 2 no matter which thread gets
+ * to it. That keeps the output bit-for-bit reproducible from the seed for any thread count, and
+ * leaves the global libc rand() state alone.
+ */
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_LANES 8
+#define RAND_CHUNK (2 * PHILOX_LANES)
+#define RAND_FLOPS 40      // rough cost of one sample, for plan_kernel
+
+/*
+ * Run the 10 Philox rounds on PHILOX_LANES consecutive counters starting at `counter`. The lanes
+ * are kept in separate arrays so that every round is a straight-line SIMD loop.
+ */
+static void philox_blocks(uint64_t counter, uint32_t seed, uint32_t out[4][PHILOX_LANES]) {
+    uint32_t *c0 = out[0], *c1 = out[1], *c2 = out[2], *c3 = out[3];
+    for (int l = 0; l < PHILOX_LANES; l++) {
+        c0[l] = (uint32_t) (counter + l);
+        c1[l] = (uint32_t) ((counter + l) >> 32);
+        c2[l] = 0;
+        c3[l] = 0;
+    }
+    uint32_t k0 = seed;
+    uint32_t k1 = 0;
+    for (int round = 0; round < 10; round++) {
+        #pragma omp simd
+        for (int l = 0; l < PHILOX_LANES; l++) {
+            uint64_t p0 = (uint64_t) PHILOX_M0 * c0[l];
+            uint64_t p1 = (uint64_t) PHILOX_M1 * c2[l];
+            uint32_t n0 = (uint32_t) (p1 >> 32) ^ c1[l] ^ k0;
+            uint32_t n2 = (uint32_t) (p0 >> 32) ^ c3[l] ^ k1;
+            c1[l] = (uint32_t) p1;
+            c3[l] = (uint32_t) p0;
+            c0[l] = n0;
+            c2[l] = n2;
+        }
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+}
+
+/*
+ * Fill `u` with the RAND_CHUNK uniform doubles in [0, 1) for elements chunk * RAND_CHUNK onwards.
+ * Each double takes 53 bits from a pair of Philox words.
+ */
+static void uniform_chunk(uint64_t chunk, uint32_t seed, double u[RAND_CHUNK]) {
+    uint32_t words[4][PHILOX_LANES];
+    philox_blocks(chunk * PHILOX_LANES, seed, words);
+    #pragma omp simd
+    for (int l = 0; l < PHILOX_LANES; l++) {
+        u[2 * l] = (double) (int64_t) ((((uint64_t) words[0][l] << 32) | words[1][l]) >> 11) * 0x1.0p-53;
+        u[2 * l + 1] = (double) (int64_t) ((((uint64_t) words[2][l] << 32) | words[3][l]) >> 11) * 0x1.0p-53;
+    }
+}
+
+static inline __m256d select_vec(__m256d a, __m256d b, __m256d mask);
+static inline __m256d log_vec(__m256d x);
+
+/*
+ * sin and cos of 2 pi t for t in [0, 1]. t is split into the nearest quarter turn q / 4 and a
+ * remainder of at most an eighth of a turn, which is exact because t is a multiple of 2^-53, and
+ * the Taylor series of the remainder's angle are rotated by q quarter turns.
+ */
+static inline void sincos_turns_vec(__m256d t, __m256d *sin_t, __m256d *cos_t) {
+    __m256d q = _mm256_round_pd(_mm256_mul_pd(t, _mm256_set1_pd(4)),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d y = _mm256_mul_pd(_mm256_fnmadd_pd(q, _mm256_set1_pd(0.25), t),
+                              _mm256_set1_pd(2 * M_PI));
+    __m256d z = _mm256_mul_pd(y, y);
+
+    /* sin y = y (1 + z S(z)) and cos y = 1 + z C(z); the next terms are below 2^-54 for |y| <= pi / 4 */
+    static const double sin_terms[] = {-1.0 / 6, 1.0 / 120, -1.0 / 5040, 1.0 / 362880,
+                                       -1.0 / 39916800, 1.0 / 6227020800, -1.0 / 1307674368000};
+    static const double cos_terms[] = {-1.0 / 2, 1.0 / 24, -1.0 / 720, 1.0 / 40320, -1.0 / 3628800,
+                                       1.0 / 479001600, -1.0 / 87178291200, 1.0 / 20922789888000};
+    __m256d s = _mm256_set1_pd(sin_terms[6]);
+    for (int i = 5; i >= 0; i--) {
+        s = _mm256_fmadd_pd(s, z, _mm256_set1_pd(sin_terms[i]));
+    }
+    __m256d c = _mm256_set1_pd(cos_terms[7]);
+    for (int i = 6; i >= 0; i--) {
+        c = _mm256_fmadd_pd(c, z, _mm256_set1_pd(cos_terms[i]));
+    }
+    s = _mm256_fmadd_pd(_mm256_mul_pd(s, z), y, y);
+    c = _mm256_fmadd_pd(c, z, _mm256_set1_pd(1));
+
+    /* Quarter turns 1 and 3 swap sin and cos, 1 and 2 negate cos, 2 and 3 negate sin */
+    __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d one = _mm256_cmp_pd(q, _mm256_set1_pd(1), _CMP_EQ_OQ);
+    __m256d two = _mm256_cmp_pd(q, _mm256_set1_pd(2), _CMP_EQ_OQ);
+    __m256d three = _mm256_cmp_pd(q, _mm256_set1_pd(3), _CMP_EQ_OQ);
+    __m256d swap = _mm256_or_pd(one, three);
+    *sin_t = _mm256_xor_pd(select_vec(s, c, swap), _mm256_and_pd(_mm256_or_pd(two, three), sign));
+    *cos_t = _mm256_xor_pd(select_vec(c, s, swap), _mm256_and_pd(_mm256_or_pd(one, two), sign));
+}
+
+/*
+ * Turn one chunk of uniforms into samples of `dist` in place. Normals use Box-Muller on the pair of
+ * uniforms drawn from the same Philox block, so each block yields two independent normals.
+ */
+static void transform_chunk(double u[RAND_CHUNK], int dist, double a, double b) {
+    switch (dist) {
+    case RAND_UNIFORM:
+        #pragma omp simd
+        for (int i = 0; i < RAND_CHUNK; i++) {
+            u[i] = a + (b - a) * u[i];
+        }
+        break;
+    case RAND_NORMAL:
+        for (int i = 0; i < RAND_CHUNK; i += 8) {
+            /* Split four (radius, angle) pairs into a vector of each, with lanes in order 0 2 1 3 */
+            __m256d lo = _mm256_loadu_pd(u + i);
+            __m256d hi = _mm256_loadu_pd(u + i + 4);
+            __m256d r = _mm256_unpacklo_pd(lo, hi);
+            __m256d t = _mm256_unpackhi_pd(lo, hi);
+            __m256d radius = _mm256_sqrt_pd(_mm256_mul_pd(_mm256_set1_pd(-2),
+                                            log_vec(_mm256_sub_pd(_mm256_set1_pd(1), r))));
+            __m256d sin_t, cos_t;
+            sincos_turns_vec(t, &sin_t, &cos_t);
+            radius = _mm256_mul_pd(radius, _mm256_set1_pd(b));
+            __m256d x = _mm256_fmadd_pd(radius, cos_t, _mm256_set1_pd(a));
+            __m256d y = _mm256_fmadd_pd(radius, sin_t, _mm256_set1_pd(a));
+            _mm256_storeu_pd(u + i, _mm256_unpacklo_pd(x, y));
+            _mm256_storeu_pd(u + i + 4, _mm256_unpackhi_pd(x, y));
+        }
+        break;
+    case RAND_INT:
+        #pragma omp simd
+        for (int i = 0; i < RAND_CHUNK; i++) {
+            u[i] = a + floor((b - a) * u[i]);
+        }
+        break;
+    case RAND_BERNOULLI:
+        #pragma omp simd
+        for (int i = 0; i < RAND_CHUNK; i++) {
+            u[i] = u[i] < a ? 1.0 : 0.0;
+        }
+        break;
+    case RAND_EXPONENTIAL:
+        for (int i = 0; i < RAND_CHUNK; i += 4) {
+            __m256d logs = log_vec(_mm256_sub_pd(_mm256_set1_pd(1), _mm256_loadu_pd(u + i)));
+            _mm256_storeu_pd(u + i, _mm256_mul_pd(_mm256_set1_pd(a),
+                                                  _mm256_sub_pd(_mm256_setzero_pd(), logs)));
+        }
+        break;
+    }
+}
+
+typedef struct random_args {
+    double *out;
+    Py_ssize_t total;
+    unsigned int seed;
+    int dist;
+    double a, b;
+} random_args;
+
+/*
+ * Generate chunks [begin, end) of a random_matrix call.
+ */
+static void random_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    random_args *args = argp;
+    for (Py_ssize_t c = begin; c < end; c++) {
+        double u[RAND_CHUNK];
+        uniform_chunk(c, args->seed, u);
+        transform_chunk(u, args->dist, args->a, args->b);
+        Py_ssize_t first = c * RAND_CHUNK;
+        int n = args->total - first < RAND_CHUNK ? (int) (args->total - first) : RAND_CHUNK;
+        for (int i = 0; i < n; i++) {
+            args->out[first + i] = u[i];
         }
     }
 }
 
+/*
+ * Fill `result` with samples of the distribution `dist` with parameters `a` and `b` (see the
+ * RAND_* constants in matrix.h), split into chunks over an OpenMP team. Only the element index
+ * and `seed` decide a value, so the result is the same for any number of threads.
+ */
+void random_matrix(matrix *result, unsigned int seed, int dist, double a, double b) {
+    uint64_t start = stats_begin(KERNEL_RANDOM, result->rows, result->cols, 0);
+    Py_ssize_t total = result->rows * result->cols;
+    Py_ssize_t chunks = (total + RAND_CHUNK - 1) / RAND_CHUNK;
+    int threads;
+    int plan = plan_kernel(total, (double) RAND_FLOPS * total, total * sizeof(double), &threads);
+    random_args args = {result->data[0], total, seed, dist, a, b};
+    parallel_for(plan, threads, chunks, random_range, &args);
+    stats_end(KERNEL_RANDOM, start, total, threads);
+}
+
+/*
+ * Generates a random matrix with `seed`, uniform in [low, high).
+ */
+void rand_matrix(matrix *result, unsigned int seed, double low, double high) {
+    random_matrix(result, seed, RAND_UNIFORM, low, high);
+}
+
 /*
  * Allocate space for a matrix struct pointed to by the double pointer mat with
  * `rows` rows and `cols` columns. You should also allocate memory for the data array
@@ -57,34 +464,46 @@ void rand_matrix(matrix *result, unsigned int seed, double low, double high) {
  * failure, then remember to set it in numc.c.
  * Return 0 upon success and non-zero upon failure.
  */
- int allocate_matrix(matrix **mat, int rows, int cols) {
+ int allocate_matrix(matrix **mat, Py_ssize_t rows, Py_ssize_t cols) {
     if (rows <= 0 || cols <= 0) {
         PyErr_SetString(PyExc_ValueError, "Matrix row or col value received invalid input");
         return -1;
     } 
+    /* rows * cols doubles plus the row pointers must be addressable */
+    if (rows > PY_SSIZE_T_MAX / (Py_ssize_t) sizeof(double) / cols) {
+        PyErr_SetString(PyExc_MemoryError, "Matrix dimensions are too large");
+        return -1;
+    }
+    /* Opened past the argument checks; each failure below closes it so traces stay balanced */
+    uint64_t start = stats_begin(KERNEL_ALLOCATE, rows, cols, 0);
     *(mat) = (matrix*) malloc(sizeof(matrix));
     if (*(mat) ==  NULL) {
+        stats_end(KERNEL_ALLOCATE, start, 0, 0);
         PyErr_SetString(PyExc_RuntimeError, "Malloc of *(mat) failed");
         return -1;
     }
     (*(mat))->data = malloc(rows * sizeof(double*));
     if ((*(mat))->data ==  NULL) {
+        free((*(mat)));
+        stats_end(KERNEL_ALLOCATE, start, 0, 0);
         PyErr_SetString(PyExc_RuntimeError, "Malloc of *(mat)->data failed");
         return -1;
     }
-    *((*(mat))->data) = (double *) calloc(1, rows * cols * sizeof(double));
+    *((*(mat))->data) = (double *) calloc(rows * cols, sizeof(double));
     if (*((*(mat))->data) == NULL) {
         free((*(mat))->data);
         free((*(mat)));
+        stats_end(KERNEL_ALLOCATE, start, 0, 0);
         PyErr_SetString(PyExc_RuntimeError, "Malloc of *(mat)->data cols failed");
         return -1;
     }
-    for (int i = 0; i < rows; i++){
+    for (Py_ssize_t i = 0; i < rows; i++){
         *((*(mat))->data + i) = (*((*(mat))->data) + cols * i);
     }
 
     (*(mat))->rows = rows;
     (*(mat))->cols = cols;
+    (*(mat))->stride = 1;
     if(rows == 1 || cols == 1) {
         (*(mat))->is_1d = 1;
     } else {
@@ -92,6 +511,14 @@ void rand_matrix(matrix *result, unsigned int seed, double low, double high) {
     } 
     (*(mat))->ref_cnt = 1;
     (*(mat))->parent = NULL;
+    (*(mat))->cow = 0;
+    (*(mat))->copies = NULL;
+    (*(mat))->next_copy = NULL;
+    (*(mat))->mapped = 0;
+    if (start != 0) {
+        stats_record(KERNEL_ALLOCATE, start, rows * cols,
+                     sizeof(matrix) + rows * sizeof(double *) + (uint64_t) rows * cols * sizeof(double), 0);
+    }
     return 0;
 }
 
@@ -102,11 +529,32 @@ void rand_matrix(matrix *result, unsigned int seed, double low, double high) {
  * If you don't set python error messages here upon failure, then remember to set it in numc.c.
  * Return 0 upon success and non-zero upon failure.
  */
-int allocate_matrix_ref(matrix **mat, matrix *from, int row_offset, int col_offset, int rows, int cols) {
-    if (row_offset + rows > from->rows || col_offset + cols > from->cols) {
+int allocate_matrix_ref(matrix **mat, matrix *from, Py_ssize_t row_offset, Py_ssize_t col_offset,
+                        Py_ssize_t rows, Py_ssize_t cols) {
+    return allocate_matrix_strided(mat, from, row_offset, col_offset, rows, cols, 1, 1);
+}
+
+/*
+ * Like allocate_matrix_ref, but taking every `row_step`th row and `col_step`th column, starting
+ * from row `row_offset` and column `col_offset`; either step may be negative. Row steps only
+ * change which rows the row pointers point at, and column steps multiply `stride`, so no data is
+ * copied whatever the steps are.
+ */
+int allocate_matrix_strided(matrix **mat, matrix *from, Py_ssize_t row_offset,
+                            Py_ssize_t col_offset, Py_ssize_t rows, Py_ssize_t cols,
+                            Py_ssize_t row_step, Py_ssize_t col_step) {
+    Py_ssize_t lastRow = row_offset + (rows - 1) * row_step;
+    Py_ssize_t lastCol = col_offset + (cols - 1) * col_step;
+    if (rows <= 0 || cols <= 0 || row_offset < 0 || row_offset >= from->rows || lastRow < 0 ||
+            lastRow >= from->rows || col_offset < 0 || col_offset >= from->cols || lastCol < 0 ||
+            lastCol >= from->cols) {
         PyErr_SetString(PyExc_RuntimeError, "Matrix Range Out of Bounds.");
         return -1;
     }
+    /* A slice writes through to `from`, so a copy-on-write `from` needs a buffer of its own now */
+    if (from->cow && unshare_matrix(from) != 0) {
+        return -1;
+    }
     *(mat) = (matrix *) malloc(sizeof(matrix));
     if (*(mat) ==  NULL) {
         PyErr_SetString(PyExc_RuntimeError, "Malloc of *(mat) failed");
@@ -117,15 +565,12 @@ int allocate_matrix_ref(matrix **mat, matrix *from, int row_offset, int col_offs
         PyErr_SetString(PyExc_RuntimeError, "Malloc of *(mat)->data failed");
         return -1;
     }
-    //int fromCol = from->cols;
-    for(int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            *((*(mat))->data + i) = (*(from->data + i + row_offset) + col_offset);
-            //printf("%f\n", *(*(from->data + i + row_offset) + col_offset));
-        }
+    for (Py_ssize_t i = 0; i < rows; i++) {
+        (*(mat))->data[i] = from->data[row_offset + i * row_step] + col_offset * from->stride;
     }
     (*(mat))->rows = rows;
     (*(mat))->cols = cols;
+    (*(mat))->stride = from->stride * col_step;
     if(rows == 1 || cols == 1) {
         (*(mat))->is_1d = 1;
     } else {
@@ -133,82 +578,444 @@ int allocate_matrix_ref(matrix **mat, matrix *from, int row_offset, int col_offs
     } 
     (*(mat))->ref_cnt = 1;
     (*(mat))->parent = from;
+    (*(mat))->cow = 0;
+    (*(mat))->copies = NULL;
+    (*(mat))->next_copy = NULL;
+    (*(mat))->mapped = 0;
     from->ref_cnt += 1;
     return 0;
 
 }
 
+static int materialize_copy(matrix *copy);
+
+/*
+ * Allocate a copy of `from` that shares its buffer until either side is written: the copy is
+ * linked into the copies list of the matrix that owns the buffer and holds a reference on it,
+ * like a slice. A copy of a shared-memory matrix gets a buffer of its own right away.
+ * Return 0 upon success and non-zero upon failure.
+ */
+int copy_matrix(matrix **mat, matrix *from) {
+    matrix *owner = from;
+    while (owner->parent != NULL) {
+        owner = owner->parent;
+    }
+    matrix *copy = malloc(sizeof(matrix));
+    double **rows = malloc(from->rows * sizeof(double *));
+    if (copy == NULL || rows == NULL) {
+        free(copy);
+        free(rows);
+        PyErr_SetString(PyExc_RuntimeError, "Malloc of copy failed");
+        return -1;
+    }
+    memcpy(rows, from->data, from->rows * sizeof(double *));
+    copy->rows = from->rows;
+    copy->cols = from->cols;
+    copy->data = rows;
+    copy->stride = from->stride;
+    copy->is_1d = from->is_1d;
+    copy->ref_cnt = 1;
+    copy->parent = owner;
+    copy->cow = 1;
+    copy->copies = NULL;
+    copy->next_copy = owner->copies;
+    copy->mapped = 0;
+    owner->copies = copy;
+    owner->ref_cnt += 1;
+    /* Other processes write a shared buffer without going through unshare_matrix */
+    if (owner->mapped != 0 && materialize_copy(copy) != 0) {
+        deallocate_matrix(copy);
+        return -1;
+    }
+    *mat = copy;
+    return 0;
+}
+
+/*
+ * Take the copy-on-write matrix `copy` off its owner's list and give it a buffer of its own.
+ */
+static int materialize_copy(matrix *copy) {
+    Py_ssize_t rows = copy->rows;
+    Py_ssize_t cols = copy->cols;
+    double *block = malloc((size_t) rows * cols * sizeof(double));
+    if (block == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Malloc of copied data failed");
+        return -1;
+    }
+    for (Py_ssize_t i = 0; i < rows; i++) {
+        get_row(copy, i, 0, cols, block + i * cols);
+        copy->data[i] = block + i * cols;
+    }
+    copy->stride = 1;
+    matrix *owner = copy->parent;
+    matrix **link = &owner->copies;
+    while (*link != copy) {
+        link = &(*link)->next_copy;
+    }
+    *link = copy->next_copy;
+    copy->next_copy = NULL;
+    copy->cow = 0;
+    copy->parent = NULL;
+    deallocate_matrix(owner);
+    return 0;
+}
+
+/*
+ * Make `mat` safe to write: a copy-on-write matrix gets its own buffer, and a buffer that
+ * copies are sharing is copied out for each of them before its owner or a slice changes it.
+ * Every write from Python goes through here first; when nothing is shared it is a pointer walk.
+ * Return 0 upon success and non-zero upon failure, leaving the data unchanged.
+ */
+int unshare_matrix(matrix *mat) {
+    if (mat->cow) {
+        return materialize_copy(mat);
+    }
+    matrix *owner = mat;
+    while (owner->parent != NULL) {
+        owner = owner->parent;
+    }
+    while (owner->copies != NULL) {
+        if (materialize_copy(owner->copies) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 /*
  * This function will be called automatically by Python when a numc matrix loses all of its
  * reference pointers.
  * You need to make sure that you only free `mat->data` if no other existing matrices are also
  * referring this data array.
  * See the spec for more information.
+ * `ref_cnt` counts the matrix itself plus every slice or copy of it, so a parent outlives the
+ * matrices that point into it and is freed with the last of them.
  */
 void deallocate_matrix(matrix *mat) {
     if (mat == NULL) {
         return;
     }
-    if (mat->ref_cnt > 1 && mat->parent == NULL) {
-        mat->ref_cnt--;
-        return;
-    } 
-    if (mat->parent != NULL) {
-        mat->parent->ref_cnt -= 1;
-        free(mat->data);
-        free(mat);
+    mat->ref_cnt--;
+    if (mat->ref_cnt > 0) {
         return;
     }
-    if (mat->parent == NULL && mat->ref_cnt == 1) {
+    matrix *parent = mat->parent;
+    if (mat->cow) {
+        matrix **link = &parent->copies;
+        while (*link != mat) {
+            link = &(*link)->next_copy;
+        }
+        *link = mat->next_copy;
+    }
+    if (parent == NULL && mat->mapped != 0) {
+        munmap((char *) mat->data[0] - MATRIX_FILE_HEADER, mat->mapped);
+    } else if (parent == NULL) {
         free(*((mat)->data));
-        free((mat)->data );
-        free(mat);
     }
+    free(mat->data);
+    free(mat);
+    deallocate_matrix(parent);
 }
 
 /*
  * Return the double value of the matrix at the given row and column.
  * You may assume `row` and `col` are valid.
  */
-/*double get(matrix *mat, int row, int col) {
+/*double get(matrix *mat, Py_ssize_t row, Py_ssize_t col) {
     return (*(mat->data))[(col * row) + col];
 }*/
-double get(matrix *mat, int row, int col) {
-    return (mat->data)[row][col];
+double get(matrix *mat, Py_ssize_t row, Py_ssize_t col) {
+    return (mat->data)[row][col * mat->stride];
 }
 
 /*
  * Set the value at the given row and column to val. You may assume `row` and
  * `col` are valid
  */
-/*void set(matrix *mat, int row, int col, double val) {
+/*void set(matrix *mat, Py_ssize_t row, Py_ssize_t col, double val) {
     //*(*(mat->data + row) + col) = val;
-    int cols = mat->cols;
+    Py_ssize_t cols = mat->cols;
     (*(mat->data))[(cols * row)+ col] = val;
 }*/
-void set(matrix *mat, int row, int col, double val) {
-    (mat->data)[row][col] = val;
+void set(matrix *mat, Py_ssize_t row, Py_ssize_t col, double val) {
+    if (unshare_matrix(mat) != 0) {
+        return;
+    }
+    (mat->data)[row][col * mat->stride] = val;
 }
 
 /*
- * Set all entries in mat to val
+ * Copy the `count` entries of row `row` of `mat` from column `col` on to `out`.
  */
-void fill_matrix(matrix *mat, double val) {
-    int cols = mat->cols;
-    int rows = mat->rows;
+void get_row(matrix *mat, Py_ssize_t row, Py_ssize_t col, Py_ssize_t count, double *out) {
+    Py_ssize_t stride = mat->stride;
+    const double *in = mat->data[row] + col * stride;
+    if (stride == 1) {
+        memcpy(out, in, count * sizeof(double));
+        return;
+    }
+    for (Py_ssize_t j = 0; j < count; j++) {
+        out[j] = in[j * stride];
+    }
+}
+
+/*
+ * `mat` itself if its rows have unit stride, or else a contiguous copy of it in `packed`, for
+ * kernels that run vector loads along rows. The copy costs one pass over `mat`, which is small
+ * next to the products and factorizations that ask for it. Release the result with
+ * release_unit_stride. Returns NULL if the copy cannot be allocated; the Python error state is
+ * left alone so that this can run without the GIL.
+ */
+matrix *unit_stride(matrix *mat, matrix *packed) {
+    if (mat->stride == 1) {
+        return mat;
+    }
+    *packed = *mat;
+    packed->stride = 1;
+    packed->parent = NULL;
+    packed->cow = 0;
+    packed->copies = NULL;
+    packed->next_copy = NULL;
+    packed->data = malloc(mat->rows * sizeof(double *));
+    double *block = malloc((size_t) mat->rows * mat->cols * sizeof(double));
+    if (packed->data == NULL || block == NULL) {
+        free(packed->data);
+        free(block);
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < mat->rows; i++) {
+        packed->data[i] = block + i * mat->cols;
+        get_row(mat, i, 0, mat->cols, packed->data[i]);
+    }
+    return packed;
+}
+
+void release_unit_stride(matrix *used, matrix *packed) {
+    if (used == packed) {
+        free(packed->data[0]);
+        free(packed->data);
+    }
+}
+
+/*
+ * Operands of the element-wise range functions below: out[i] = in1[i] op in2[i], or `val`.
+ */
+typedef struct elementwise_args {
+    double *out;
+    const double *in1;
+    const double *in2;
+    double val;
+} elementwise_args;
+
+static void fill_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    elementwise_args *args = argp;
+    __m256d vec = _mm256_set1_pd(args->val);
+    Py_ssize_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        _mm256_storeu_pd(args->out + i, vec);
+    }
+    for (; i < end; i++) {
+        args->out[i] = args->val;
+    }
+}
+
+static void copy_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    elementwise_args *args = argp;
+    Py_ssize_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        _mm256_storeu_pd(args->out + i, _mm256_loadu_pd(args->in1 + i));
+    }
+    for (; i < end; i++) {
+        args->out[i] = args->in1[i];
+    }
+}
+
+static void add_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    elementwise_args *args = argp;
+    Py_ssize_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m256d mat1Res = _mm256_loadu_pd(args->in1 + i);
+        __m256d mat2Res = _mm256_loadu_pd(args->in2 + i);
+        _mm256_storeu_pd(args->out + i, _mm256_add_pd(mat1Res, mat2Res));
+    }
+    for (; i < end; i++) {
+        args->out[i] = args->in1[i] + args->in2[i];
+    }
+}
+
+static void sub_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    elementwise_args *args = argp;
+    Py_ssize_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m256d mat1Res = _mm256_loadu_pd(args->in1 + i);
+        __m256d mat2Res = _mm256_loadu_pd(args->in2 + i);
+        _mm256_storeu_pd(args->out + i, _mm256_sub_pd(mat1Res, mat2Res));
+    }
+    for (; i < end; i++) {
+        args->out[i] = args->in1[i] - args->in2[i];
+    }
+}
+
+static void neg_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    elementwise_args *args = argp;
+    __m256d negative = _mm256_set1_pd(-1);
+    Py_ssize_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        _mm256_storeu_pd(args->out + i, _mm256_mul_pd(_mm256_loadu_pd(args->in1 + i), negative));
+    }
+    for (; i < end; i++) {
+        args->out[i] = args->in1[i] * -1;
+    }
+}
+
+static void abs_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    elementwise_args *args = argp;
+    __m256d zeros = _mm256_set1_pd(-0.);
+    Py_ssize_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m256d values = _mm256_loadu_pd(args->in1 + i);
+        _mm256_storeu_pd(args->out + i, _mm256_max_pd(_mm256_sub_pd(zeros, values), values));
+    }
+    for (; i < end; i++) {
+        args->out[i] = args->in1[i] >= 0 ? args->in1[i] : -1 * args->in1[i];
+    }
+}
+
+/*
+ * Whether the entries of `mat` are one contiguous run in row-major order, as the flat loops of
+ * the element-wise kernels need. A slice with a column range, a row step or a column step is not.
+ */
+static int is_flat(matrix *mat) {
+    if (mat == NULL) {
+        return 1;
+    }
+    if (mat->stride != 1) {
+        return 0;
+    }
+    for (Py_ssize_t i = 1; i < mat->rows; i++) {
+        if (mat->data[i] != mat->data[0] + i * mat->cols) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Entries an element-wise kernel handles at a time on views, through stack buffers if needed */
+#define VIEW_CHUNK 256
+
+/*
+ * An element-wise range function applied to matrices that may be views: out = in1 op in2.
+ * Each flag is set if that operand is flat (see is_flat) and can be indexed directly.
+ */
+typedef struct view_args {
+    range_fn fn;
+    matrix *out;
+    matrix *in1;
+    matrix *in2;
+    double val;
+    int flat[3];
+} view_args;
+
+/*
+ * Entries [e, e + count) of `mat` in row-major order, copied to `buf` unless they are one run
+ * in memory, in which case they are returned in place.
+ */
+static double *view_run(matrix *mat, int flat, Py_ssize_t e, Py_ssize_t count, double *buf,
+                        int load) {
+    Py_ssize_t cols = mat->cols;
+    Py_ssize_t i = e / cols;
+    Py_ssize_t j = e % cols;
+    if (flat) {
+        return mat->data[0] + e;
+    }
+    if (mat->stride == 1 && j + count <= cols) {
+        return mat->data[i] + j;
+    }
+    for (Py_ssize_t k = 0; load && k < count; k++) {
+        buf[k] = mat->data[i][j * mat->stride];
+        if (++j == cols) {
+            j = 0;
+            i++;
+        }
+    }
+    return buf;
+}
 
-    __m256d vec = _mm256_set1_pd (val);
+static void view_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    view_args *args = argp;
+    Py_ssize_t cols = args->out->cols;
+    double outBuf[VIEW_CHUNK];
+    double in1Buf[VIEW_CHUNK];
+    double in2Buf[VIEW_CHUNK];
+    Py_ssize_t e = begin;
+    while (e < end) {
+        /* Rows long enough to be worth a call each are taken one at a time, so that unit-stride
+         * rows of a view go to the kernel in place rather than through the buffers */
+        Py_ssize_t count = end - e < VIEW_CHUNK ? end - e : VIEW_CHUNK;
+        if (cols >= VIEW_CHUNK / 4 && cols - e % cols < count) {
+            count = cols - e % cols;
+        }
+        elementwise_args chunk = {
+            view_run(args->out, args->flat[0], e, count, outBuf, 0),
+            args->in1 != NULL ? view_run(args->in1, args->flat[1], e, count, in1Buf, 1) : NULL,
+            args->in2 != NULL ? view_run(args->in2, args->flat[2], e, count, in2Buf, 1) : NULL,
+            args->val
+        };
+        args->fn(&chunk, 0, count);
+        if (chunk.out == outBuf) {
+            matrix *out = args->out;
+            Py_ssize_t i = e / cols;
+            Py_ssize_t j = e % cols;
+            for (Py_ssize_t k = 0; k < count; k++) {
+                out->data[i][j * out->stride] = outBuf[k];
+                if (++j == cols) {
+                    j = 0;
+                    i++;
+                }
+            }
+        }
+        e += count;
+    }
+}
 
-    //#pragma omp parallel for
-    for (int i = 0; i < ((rows * cols) / 4) * 4; i += 4) {
-        _mm256_storeu_pd((*(mat->data) + i), vec);
+/*
+ * Run the element-wise range function `fn` over out = in1 op in2 (either input may be NULL) with
+ * the given plan. Flat operands go straight to `fn`, as they always did; views are fed to it a
+ * row or a VIEW_CHUNK at a time.
+ */
+static void elementwise(int plan, int threads, range_fn fn, matrix *out, matrix *in1, matrix *in2,
+                        double val) {
+    Py_ssize_t count = out->rows * out->cols;
+    view_args args = {fn, out, in1, in2, val, {is_flat(out), is_flat(in1), is_flat(in2)}};
+    if (args.flat[0] && args.flat[1] && args.flat[2]) {
+        elementwise_args flat = {out->data[0], in1 != NULL ? in1->data[0] : NULL,
+                                 in2 != NULL ? in2->data[0] : NULL, val};
+        parallel_for(plan, threads, count, fn, &flat);
+        return;
     }
-    
-    if ((rows * cols) % 4 != 0) {
-        for (int i = ((rows * cols) / 4) * 4; i < (rows * cols); i++) {
+    parallel_for(plan, threads, count, view_range, &args);
+}
+
+/*
+ * Set all entries in mat to val
+ */
+void fill_matrix(matrix *mat, double val) {
+    uint64_t start = stats_begin(KERNEL_FILL, mat->rows, mat->cols, 0);
+    Py_ssize_t cols = mat->cols;
+    Py_ssize_t rows = mat->rows;
+    int threads;
+    int plan = plan_kernel(rows * cols, 0, rows * cols * sizeof(double), &threads);
+
+    if (plan == PLAN_SERIAL && is_flat(mat)) {
+        for (Py_ssize_t i = 0; i < rows * cols; i++) {
             mat->data[0][i] = val;
         }
+        stats_end(KERNEL_FILL, start, rows * cols, 1);
+        return;
     }
+
+    elementwise(plan, threads, fill_range, mat, NULL, NULL, val);
+    stats_end(KERNEL_FILL, start, rows * cols, threads);
 }
 
 /*
@@ -220,26 +1027,22 @@ int add_matrix(matrix *result, matrix *mat1, matrix *mat2) {
         PyErr_SetString(PyExc_ValueError, "Dimensions of matricies don't match!");
         return -1;
     }
-    int rows = mat1->rows;
-    int cols = mat1->cols;
+    uint64_t start = stats_begin(KERNEL_ADD, mat1->rows, mat1->cols, 0);
+    Py_ssize_t rows = mat1->rows;
+    Py_ssize_t cols = mat1->cols;
+    int threads;
+    int plan = plan_kernel(rows * cols, rows * cols, 3 * rows * cols * sizeof(double), &threads);
 
-    __m256d mat1Res;
-    __m256d mat2Res;
-    __m256d resRes;
-    
-    #pragma omp parallel for private(mat1Res, mat2Res, resRes)
-    for (int i = 0; i < ((rows * cols) / 4) * 4; i += 4) {
-        mat1Res = _mm256_loadu_pd((*(mat1->data) + i));
-        mat2Res = _mm256_loadu_pd((*(mat2->data) + i));
-        resRes = _mm256_add_pd(mat1Res, mat2Res);
-        _mm256_storeu_pd((*(result->data) + i), resRes);
-    }
-    if ((rows * cols) % 4 != 0) {
-        for (int i = ((rows * cols) / 4) * 4; i < (rows * cols); i++) {
-	        result->data[0][i] = mat1->data[0][i] + mat2->data[0][i];
+    if (plan == PLAN_SERIAL && is_flat(result) && is_flat(mat1) && is_flat(mat2)) {
+        for (Py_ssize_t i = 0; i < rows * cols; i++) {
+            result->data[0][i] = mat1->data[0][i] + mat2->data[0][i];
         }
+        stats_end(KERNEL_ADD, start, rows * cols, 1);
+        return 0;
     }
 
+    elementwise(plan, threads, add_range, result, mat1, mat2, 0);
+    stats_end(KERNEL_ADD, start, rows * cols, threads);
     return 0;
 }
 
@@ -252,55 +1055,46 @@ int sub_matrix(matrix *result, matrix *mat1, matrix *mat2) {
         return -1;
     }
 
-    int rows = mat1->rows;
-    int cols = mat1->cols;
-
-    __m256d mat1Res;
-    __m256d mat2Res;
-    __m256d resRes;
-    #pragma omp parallel for private(mat1Res, mat2Res, resRes)
-    for (int i = 0; i < ((rows * cols) / 4) * 4; i += 4) {
-        mat1Res = _mm256_loadu_pd((*(mat1->data) + i));
-        mat2Res = _mm256_loadu_pd((*(mat2->data) + i));
-        resRes = _mm256_sub_pd(mat1Res, mat2Res);
-         _mm256_storeu_pd((*(result->data) + i), resRes);
+    uint64_t start = stats_begin(KERNEL_SUB, mat1->rows, mat1->cols, 0);
+    Py_ssize_t rows = mat1->rows;
+    Py_ssize_t cols = mat1->cols;
+    int threads;
+    int plan = plan_kernel(rows * cols, rows * cols, 3 * rows * cols * sizeof(double), &threads);
 
-    }
-    if ((rows * cols) % 4 != 0) {
-        for (int i = ((rows * cols) / 4) * 4; i < (rows * cols); i++) {
-	        result->data[0][i] = mat1->data[0][i] - mat2->data[0][i];
+    if (plan == PLAN_SERIAL && is_flat(result) && is_flat(mat1) && is_flat(mat2)) {
+        for (Py_ssize_t i = 0; i < rows * cols; i++) {
+            result->data[0][i] = mat1->data[0][i] - mat2->data[0][i];
         }
+        stats_end(KERNEL_SUB, start, rows * cols, 1);
+        return 0;
     }
 
+    elementwise(plan, threads, sub_range, result, mat1, mat2, 0);
+    stats_end(KERNEL_SUB, start, rows * cols, threads);
     return 0;
 }
 
 /*
- * Store the result of multiplying mat1 and mat2 to `result`.
- * Return 0 upon success and a nonzero value upon failure.
- * Remember that matrix multiplication is not the same as multiplying individual elements.
+ * Operands of the matrix product range functions: result += mat1 * mat2.
  */
- int mul_matrix(matrix *result, matrix *mat1, matrix *mat2) {
-    int i,j,k;
-    int mat1rows = mat1->rows;
-    int mat2cols = mat2->cols;
-
-    if ((mat1rows < 8) && (mat2cols < 8)) {
-        for(i = 0; i < mat1->rows; i++) {
-            for(k = 0; k < mat2->rows; k++) {
-                for(j = 0; j < mat2->cols; j++) {
-                    result->data[i][j] += mat1->data[i][k] * mat2->data[k][j];
-                }
-            }
-        }
-        return 0;
-    }
+typedef struct product_args {
+    matrix *result;
+    matrix *mat1;
+    matrix *mat2;
+} product_args;
 
-    #pragma omp parallel for
-    for(i = 0; i < mat1->rows; i++) {
+/*
+ * Rows [begin, end) of the untiled product, four steps of the summed dimension at a time.
+ */
+static void mul_rows(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    product_args *args = argp;
+    matrix *result = args->result;
+    matrix *mat1 = args->mat1;
+    matrix *mat2 = args->mat2;
+    Py_ssize_t i, j, k;
+    for(i = begin; i < end; i++) {
         for(k = 0; k < ((mat2->rows) / 4) * 4; k+= 4) {
             for(j = 0; j < mat2->cols; j++) {
-                #pragma critical
                 result->data[i][j] += mat1->data[i][k] * mat2->data[k][j];
                 result->data[i][j] += mat1->data[i][k + 1] * mat2->data[k + 1][j];
                 result->data[i][j] += mat1->data[i][k + 2] * mat2->data[k + 2][j];
@@ -309,97 +1103,397 @@ int sub_matrix(matrix *result, matrix *mat1, matrix *mat2) {
         }
         for (k = ((mat2->rows) / 4) * 4; k < mat2->rows; k++){
             for(j = 0; j < mat2->cols; j++){
-                #pragma critical
                 result->data[i][j] += mat1->data[i][k] * mat2->data[k][j];
             }
         }
     }
-    return 0;
 }
 
-int mul_pow(matrix *temp, matrix *result, matrix *mat1, matrix *mat2){
-    int i,j,k;
-    /* This is jki loop order. */
-    int rows = mat1->rows;
-    int cols = mat1->cols;
-    if (rows < 8){
-        for(i = 0; i < rows; i++) {
-            for(k = 0; k < rows; k++) {
-                for(j = 0; j < cols; j++) {
-                    temp->data[i][j] += mat1->data[i][k] * mat2->data[k][j];
+/*
+ * Row tiles [begin, end) of the product, in mul_tile_rows x mul_tile_depth x mul_tile_cols
+ * blocks so that a block of mat2 stays in cache while a tile of rows streams past it. With
+ * mul_pack every block of mat2 is first copied into a contiguous buffer, which saves TLB misses
+ * and cache conflicts when rows of mat2 are far apart; if the buffer cannot be allocated mat2 is
+ * read in place.
+ */
+static void mul_tiles(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    product_args *args = argp;
+    matrix *result = args->result;
+    matrix *mat1 = args->mat1;
+    matrix *mat2 = args->mat2;
+    Py_ssize_t rows = mat1->rows;
+    Py_ssize_t depth = mat1->cols;
+    Py_ssize_t cols = mat2->cols;
+    Py_ssize_t tileRows = mul_tile_rows;
+    Py_ssize_t tileDepth = mul_tile_depth;
+    Py_ssize_t tileCols = mul_tile_cols;
+    double *packed = mul_pack ? malloc((size_t) tileDepth * tileCols * sizeof(double)) : NULL;
+
+    for (Py_ssize_t t = begin; t < end; t++) {
+        Py_ssize_t rowStart = t * tileRows;
+        Py_ssize_t rowEnd = rowStart + tileRows < rows ? rowStart + tileRows : rows;
+        for (Py_ssize_t k0 = 0; k0 < depth; k0 += tileDepth) {
+            Py_ssize_t kEnd = k0 + tileDepth < depth ? k0 + tileDepth : depth;
+            for (Py_ssize_t j0 = 0; j0 < cols; j0 += tileCols) {
+                Py_ssize_t width = j0 + tileCols < cols ? tileCols : cols - j0;
+                if (packed != NULL) {
+                    for (Py_ssize_t k = k0; k < kEnd; k++) {
+                        memcpy(packed + (k - k0) * width, mat2->data[k] + j0,
+                               width * sizeof(double));
+                    }
+                }
+                for (Py_ssize_t i = rowStart; i < rowEnd; i++) {
+                    double *cRow = result->data[i] + j0;
+                    for (Py_ssize_t k = k0; k < kEnd; k++) {
+                        const double *bRow = packed != NULL ? packed + (k - k0) * width
+                                                            : mat2->data[k] + j0;
+                        double aVal = mat1->data[i][k];
+                        __m256d aVec = _mm256_set1_pd(aVal);
+                        Py_ssize_t j = 0;
+                        for (; j < (width / 4) * 4; j += 4) {
+                            __m256d bVec = _mm256_loadu_pd(bRow + j);
+                            _mm256_storeu_pd(cRow + j, _mm256_fmadd_pd(aVec, bVec,
+                                                                       _mm256_loadu_pd(cRow + j)));
+                        }
+                        for (; j < width; j++) {
+                            cRow[j] += aVal * bRow[j];
+                        }
+                    }
                 }
             }
         }
-        for (int i = 0; i < rows * cols; i++){
-            result->data[0][i] = temp->data[0][i];
-        } 
-        return 0;
     }
+    free(packed);
+}
+
+/*
+ * Operands of the matrix-vector kernels: result += mat * x for an n x 1 `x`, or result += x * mat
+ * for a 1 x n one, with the vector's elements contiguous in `x`.
+ */
+typedef struct vector_product_args {
+    matrix *result;
+    matrix *mat;
+    const double *x;
+} vector_product_args;
+
+/* Columns of mat that one gevm_range index covers: short enough that result's slice of them stays
+ * in L1, long enough that the four rows streamed past it are read in long runs */
+#define GEVM_BLOCK_COLS 2048
+
+static double horizontal_sum(__m256d v) {
+    __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+}
+
+/*
+ * Rows [begin, end) of result += mat * x, four rows of mat at a time so that every load of x
+ * feeds four independent FMA chains. The product is one pass over mat, so this is bound by
+ * memory bandwidth once mat is out of cache.
+ */
+static void gemv_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    vector_product_args *args = argp;
+    const double *x = args->x;
+    Py_ssize_t depth = args->mat->cols;
+    Py_ssize_t vecDepth = (depth / 4) * 4;
+    Py_ssize_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const double *r0 = args->mat->data[i];
+        const double *r1 = args->mat->data[i + 1];
+        const double *r2 = args->mat->data[i + 2];
+        const double *r3 = args->mat->data[i + 3];
+        __m256d acc0 = _mm256_setzero_pd();
+        __m256d acc1 = _mm256_setzero_pd();
+        __m256d acc2 = _mm256_setzero_pd();
+        __m256d acc3 = _mm256_setzero_pd();
+        for (Py_ssize_t k = 0; k < vecDepth; k += 4) {
+            __m256d xVec = _mm256_loadu_pd(x + k);
+            acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(r0 + k), xVec, acc0);
+            acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(r1 + k), xVec, acc1);
+            acc2 = _mm256_fmadd_pd(_mm256_loadu_pd(r2 + k), xVec, acc2);
+            acc3 = _mm256_fmadd_pd(_mm256_loadu_pd(r3 + k), xVec, acc3);
+        }
+        double sum0 = horizontal_sum(acc0);
+        double sum1 = horizontal_sum(acc1);
+        double sum2 = horizontal_sum(acc2);
+        double sum3 = horizontal_sum(acc3);
+        for (Py_ssize_t k = vecDepth; k < depth; k++) {
+            sum0 += r0[k] * x[k];
+            sum1 += r1[k] * x[k];
+            sum2 += r2[k] * x[k];
+            sum3 += r3[k] * x[k];
+        }
+        args->result->data[i][0] += sum0;
+        args->result->data[i + 1][0] += sum1;
+        args->result->data[i + 2][0] += sum2;
+        args->result->data[i + 3][0] += sum3;
+    }
+    for (; i < end; i++) {
+        const double *row = args->mat->data[i];
+        __m256d acc = _mm256_setzero_pd();
+        for (Py_ssize_t k = 0; k < vecDepth; k += 4) {
+            acc = _mm256_fmadd_pd(_mm256_loadu_pd(row + k), _mm256_loadu_pd(x + k), acc);
+        }
+        double sum = horizontal_sum(acc);
+        for (Py_ssize_t k = vecDepth; k < depth; k++) {
+            sum += row[k] * x[k];
+        }
+        args->result->data[i][0] += sum;
+    }
+}
 
-    #pragma omp parallel for
-    for(i = 0; i < rows; i++) {
-        for(k = 0; k < (rows / 4) * 4; k+= 4) {
-            for(j = 0; j < cols; j++) {
-                #pragma critical
-                temp->data[i][j] += mat1->data[i][k] * mat2->data[k][j];
-                temp->data[i][j] += mat1->data[i][k + 1] * mat2->data[k + 1][j];
-                temp->data[i][j] += mat1->data[i][k + 2] * mat2->data[k + 2][j];
-                temp->data[i][j] += mat1->data[i][k + 3] * mat2->data[k + 3][j];
+/*
+ * Column blocks [begin, end) of result += x * mat. Each block of the result row is updated from
+ * four rows of mat at a time, so it is loaded and stored once per four rows rather than per row.
+ */
+static void gevm_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    vector_product_args *args = argp;
+    const double *x = args->x;
+    double **rows = args->mat->data;
+    Py_ssize_t depth = args->mat->rows;
+    Py_ssize_t cols = args->mat->cols;
+    double *out = args->result->data[0];
+    for (Py_ssize_t block = begin; block < end; block++) {
+        Py_ssize_t j0 = block * GEVM_BLOCK_COLS;
+        Py_ssize_t j1 = j0 + GEVM_BLOCK_COLS < cols ? j0 + GEVM_BLOCK_COLS : cols;
+        Py_ssize_t vecEnd = j0 + ((j1 - j0) / 4) * 4;
+        Py_ssize_t k = 0;
+        for (; k + 4 <= depth; k += 4) {
+            const double *b0 = rows[k];
+            const double *b1 = rows[k + 1];
+            const double *b2 = rows[k + 2];
+            const double *b3 = rows[k + 3];
+            __m256d x0 = _mm256_set1_pd(x[k]);
+            __m256d x1 = _mm256_set1_pd(x[k + 1]);
+            __m256d x2 = _mm256_set1_pd(x[k + 2]);
+            __m256d x3 = _mm256_set1_pd(x[k + 3]);
+            Py_ssize_t j = j0;
+            for (; j < vecEnd; j += 4) {
+                __m256d acc = _mm256_loadu_pd(out + j);
+                acc = _mm256_fmadd_pd(x0, _mm256_loadu_pd(b0 + j), acc);
+                acc = _mm256_fmadd_pd(x1, _mm256_loadu_pd(b1 + j), acc);
+                acc = _mm256_fmadd_pd(x2, _mm256_loadu_pd(b2 + j), acc);
+                acc = _mm256_fmadd_pd(x3, _mm256_loadu_pd(b3 + j), acc);
+                _mm256_storeu_pd(out + j, acc);
+            }
+            for (; j < j1; j++) {
+                out[j] += x[k] * b0[j] + x[k + 1] * b1[j] + x[k + 2] * b2[j] + x[k + 3] * b3[j];
+            }
+        }
+        for (; k < depth; k++) {
+            const double *b = rows[k];
+            __m256d xk = _mm256_set1_pd(x[k]);
+            Py_ssize_t j = j0;
+            for (; j < vecEnd; j += 4) {
+                _mm256_storeu_pd(out + j, _mm256_fmadd_pd(xk, _mm256_loadu_pd(b + j),
+                                                          _mm256_loadu_pd(out + j)));
+            }
+            for (; j < j1; j++) {
+                out[j] += x[k] * b[j];
             }
         }
-        for (k = (rows/ 4) * 4; k < mat2->rows; k++){
-            for(j = 0; j < cols; j++){
-                #pragma critical
-                temp->data[i][j] += mat1->data[i][k] * mat2->data[k][j];
+    }
+}
+
+/*
+ * result += mat1 * mat2 where mat2 is a column vector (GEMV) or mat1 a row vector (GEVM). Both
+ * read every element of the matrix exactly once, so the plan is made for their memory traffic
+ * rather than the general product's. A vector that is a column of some larger matrix is gathered
+ * into a contiguous copy first. Returns the number of threads used, or -1 without touching result
+ * if that copy cannot be made.
+ */
+static int multiply_vector(matrix *result, matrix *mat1, matrix *mat2) {
+    int gemv = mat2->cols == 1;
+    matrix *mat = gemv ? mat1 : mat2;
+    matrix *vec = gemv ? mat2 : mat1;
+    Py_ssize_t length = vec->rows * vec->cols;
+    const double *x = vec->data[0];
+    double *gathered = NULL;
+    if (gemv && length > 1 && vec->data[length - 1] != vec->data[0] + length - 1) {
+        gathered = malloc((size_t) length * sizeof(double));
+        if (gathered == NULL) {
+            return -1;
+        }
+        for (Py_ssize_t k = 0; k < length; k++) {
+            gathered[k] = vec->data[k][0];
+        }
+        x = gathered;
+    }
+
+    double elements = (double) mat->rows * mat->cols;
+    int threads;
+    int plan = plan_kernel(elements, 2 * elements,
+                           (elements + length + 2.0 * (gemv ? mat->rows : mat->cols)) * sizeof(double),
+                           &threads);
+    vector_product_args args = {result, mat, x};
+    if (gemv) {
+        parallel_for(plan, threads, mat->rows, gemv_range, &args);
+    } else {
+        parallel_for(plan, threads, (mat->cols + GEVM_BLOCK_COLS - 1) / GEVM_BLOCK_COLS, gevm_range,
+                     &args);
+    }
+    free(gathered);
+    return threads;
+}
+
+/*
+ * result += mat1 * mat2 with the plan and thread count picked for it, tiled if the host has
+ * tile sizes set.
+ */
+static void multiply(matrix *result, matrix *mat1, matrix *mat2, int plan, int threads) {
+    product_args args = {result, mat1, mat2};
+    if (mul_tile_rows > 0 && mul_tile_depth > 0 && mul_tile_cols > 0) {
+        Py_ssize_t tiles = (mat1->rows + mul_tile_rows - 1) / mul_tile_rows;
+        parallel_for(plan, threads, tiles, mul_tiles, &args);
+    } else {
+        parallel_for(plan, threads, mat1->rows, mul_rows, &args);
+    }
+}
+
+/*
+ * result += mat1 * mat2 as a plain triple loop, reading the operands through their strides.
+ */
+static void mul_serial(matrix *result, matrix *mat1, matrix *mat2) {
+    Py_ssize_t stride1 = mat1->stride;
+    Py_ssize_t stride2 = mat2->stride;
+    for (Py_ssize_t i = 0; i < mat1->rows; i++) {
+        for (Py_ssize_t k = 0; k < mat2->rows; k++) {
+            double aVal = mat1->data[i][k * stride1];
+            for (Py_ssize_t j = 0; j < mat2->cols; j++) {
+                result->data[i][j] += aVal * mat2->data[k][j * stride2];
             }
         }
     }
+}
+
+/*
+ * Store the result of multiplying mat1 and mat2 to `result`.
+ * Return 0 upon success and a nonzero value upon failure.
+ * Remember that matrix multiplication is not the same as multiplying individual elements.
+ * The vector kernels run along rows, so operands sliced with a column step are packed first; if
+ * that copy cannot be made the product falls back to the scalar loop on the views themselves.
+ */
+ int mul_matrix(matrix *result, matrix *mat1, matrix *mat2) {
+    uint64_t start = stats_begin(KERNEL_MUL, mat1->rows, mat2->cols, mat1->cols);
+    Py_ssize_t mat1rows = mat1->rows;
+    Py_ssize_t mat2cols = mat2->cols;
+    int threads;
+    matrix packed1;
+    matrix packed2;
+    matrix *in1 = unit_stride(mat1, &packed1);
+    matrix *in2 = in1 != NULL ? unit_stride(mat2, &packed2) : NULL;
+    if (in2 == NULL) {
+        if (in1 != NULL) {
+            release_unit_stride(in1, &packed1);
+        }
+        mul_serial(result, mat1, mat2);
+        stats_end(KERNEL_MUL, start, mat1rows * mat2cols, 1);
+        return 0;
+    }
+    if (mat2cols == 1 || mat1rows == 1) {
+        threads = multiply_vector(result, in1, in2);
+        if (threads > 0) {
+            release_unit_stride(in1, &packed1);
+            release_unit_stride(in2, &packed2);
+            stats_end(KERNEL_MUL, start, mat1rows * mat2cols, threads);
+            return 0;
+        }
+    }
+    int plan = plan_kernel(mat1rows * mat2cols, 2.0 * mat1rows * mat2cols * mat1->cols,
+        (mat1rows * mat1->cols + mat2->rows * mat2cols + 2 * mat1rows * mat2cols) * sizeof(double),
+        &threads);
 
-    #pragma omp parallel for
-    for (int i = 0; i < ((rows * cols) / 4) * 4; i += 4) {
-        _mm256_storeu_pd((*(result->data) + i), _mm256_loadu_pd((*(temp->data) + i)));
+    if (plan == PLAN_SERIAL) {
+        mul_serial(result, in1, in2);
+        threads = 1;
+    } else {
+        multiply(result, in1, in2, plan, threads);
     }
-        
-    if ((rows * cols) % 4 != 0) {
-        for (int i = ((rows * cols) / 4) * 4; i < (rows * cols); i++) {
+    release_unit_stride(in1, &packed1);
+    release_unit_stride(in2, &packed2);
+    stats_end(KERNEL_MUL, start, mat1rows * mat2cols, threads);
+    return 0;
+}
+
+/*
+ * One product of pow_matrix: result = mat1 * mat2, accumulated in `temp`, run with the plan
+ * and thread count pow_matrix picked for a single product.
+ */
+int mul_pow(matrix *temp, matrix *result, matrix *mat1, matrix *mat2, int plan, int threads){
+    Py_ssize_t i,j,k;
+    /* This is jki loop order. */
+    Py_ssize_t rows = mat1->rows;
+    Py_ssize_t cols = mat1->cols;
+    trace_begin("region", "mul_pow", rows, cols, 0, 0);
+    if (plan == PLAN_SERIAL){
+        for(i = 0; i < rows; i++) {
+            for(k = 0; k < rows; k++) {
+                for(j = 0; j < cols; j++) {
+                    temp->data[i][j] += mat1->data[i][k] * mat2->data[k][j];
+                }
+            }
+        }
+        for (Py_ssize_t i = 0; i < rows * cols; i++){
             result->data[0][i] = temp->data[0][i];
         }
-    } 
+        trace_end("region", "mul_pow", 1);
+        return 0;
+    }
+
+    multiply(temp, mat1, mat2, plan, threads);
+    elementwise_args args = {result->data[0], temp->data[0], NULL, 0};
+    parallel_for(plan, threads, rows * cols, copy_range, &args);
 
     //start 0 out
+    trace_end("region", "mul_pow", threads);
     return 0;
 }
 
-
+/*
+ * The number of matrix products pow_matrix performs for exponent `pow`: one squaring per bit
+ * below the top one, plus one multiply into the result per set bit above the lowest.
+ */
+static int pow_products(int pow) {
+    if (pow < 2) {
+        return 0;
+    }
+    if (pow == 2) {
+        return 1;
+    }
+    int products = 0;
+    for (int rest = pow >> 1; rest != 0; rest >>= 1) {
+        products += 1 + (rest & 1);
+    }
+    return products;
+}
 
 int pow_matrix(matrix *result, matrix *mat, int pow) {
     //printf("pow: %d\n", pow);
+    uint64_t start = stats_begin(KERNEL_POW, mat->rows, mat->cols, mat->rows * pow_products(pow));
     if (pow == 0) {
-      for (int i = 0; i < mat->rows; i++){
+      for (Py_ssize_t i = 0; i < mat->rows; i++){
         result->data[i][i] = 1;
       }
+      stats_end(KERNEL_POW, start, mat->rows * mat->cols, 1);
       return 0;
     }
     if (pow == 2) {
         mul_matrix(result, mat, mat);
+        stats_end(KERNEL_POW, start, mat->rows * mat->cols, 1);
         return 0;
     }
 
-    int rows = result->rows;
-    int cols = result->cols;
+    Py_ssize_t rows = result->rows;
+    Py_ssize_t cols = result->cols;
+    /* Copies and fills are planned as element-wise kernels, products as one mul_matrix each */
+    int copyThreads;
+    int copyPlan = plan_kernel(rows * cols, 0, 2 * rows * cols * sizeof(double), &copyThreads);
+    int threads;
+    int plan = plan_kernel(rows * cols, 2.0 * rows * cols * rows, 4 * rows * cols * sizeof(double),
+        &threads);
 
     if (pow == 1) {
-        #pragma omp parallel for
-        for (int i = 0; i < ((rows * cols) / 4) * 4; i += 4) {
-            _mm256_storeu_pd((*(result->data) + i), _mm256_loadu_pd((*(mat->data) + i)));
-        }
-        
-        if ((rows * cols) % 4 != 0) {
-            for (int i = ((rows * cols) / 4) * 4; i < (rows * cols); i++) {
-                result->data[0][i] = mat->data[0][i];
-            }
-        } 
-
+        elementwise(copyPlan, copyThreads, copy_range, result, mat, NULL, 0);
+        stats_end(KERNEL_POW, start, rows * cols, copyThreads);
         return 0;
     }
 
@@ -410,73 +1504,37 @@ int pow_matrix(matrix *result, matrix *mat, int pow) {
     matrix *good;
     matrix **squared = &good;
     allocate_matrix(squared, rows, cols);
-    for (int i = 0; i < rows * cols; i++){
-        (*squared)->data[0][i] = mat->data[0][i];
-    }
+    elementwise(copyPlan, copyThreads, copy_range, *squared, mat, NULL, 0);
 
     int lastBit = pow & 1;
     pow = pow >> 1;
     int currBit = pow & 1;
     if (lastBit == 0){
-        #pragma omp parallel for
-        for (int i = 0; i < rows * cols; i++){
-            result->data[0][i] = 0;
-        } 
-        #pragma omp parallel for
-        for (int i = 0; i < rows; i++){
+        elementwise_args zero = {result->data[0], NULL, NULL, 0};
+        parallel_for(copyPlan, copyThreads, rows * cols, fill_range, &zero);
+        for (Py_ssize_t i = 0; i < rows; i++){
             result->data[i][i] = 1;
         }
 
     } else {
-        #pragma omp parallel for
-        for (int i = 0; i < ((rows * cols) / 4) * 4; i += 4) {
-            _mm256_storeu_pd((*(result->data) + i), _mm256_loadu_pd((*(mat->data) + i)));
-        }
-        
-        if ((rows * cols) % 4 != 0) {
-            for (int i = ((rows * cols) / 4) * 4; i < (rows * cols); i++) {
-                result->data[0][i] = mat->data[0][i];
-            }
-        } 
- 
+        elementwise(copyPlan, copyThreads, copy_range, result, mat, NULL, 0);
     }
-    __m256d vec = _mm256_set1_pd(0);
+    elementwise_args clear = {(*temp)->data[0], NULL, NULL, 0};
     while (pow != 0 || currBit != 0) {
-        mul_pow((*temp), (*squared), (*squared), (*squared));
-        //fill_matrix((*temp), 0);
-        //-----------------------fill start-------------------------------------
-        #pragma omp parallel for
-        for (int i = 0; i < ((rows * cols) / 4) * 4; i += 4) {
-            _mm256_storeu_pd((*((*temp)->data) + i), vec);
-        }
-        
-        if ((rows * cols) % 4 != 0) {
-            for (int i = ((rows * cols) / 4) * 4; i < (rows * cols); i++) {
-                (*temp)->data[0][i] = 0;
-            }
-        }
-        //-----------------------fill end----------------------------------
+        mul_pow((*temp), (*squared), (*squared), (*squared), plan, threads);
+        parallel_for(copyPlan, copyThreads, rows * cols, fill_range, &clear);
         if (currBit == 1) {
-            mul_pow((*temp), result, result, (*squared));
-            //fill_matrix((*temp), 0);
-            #pragma omp parallel for
-            for (int i = 0; i < ((rows * cols) / 4) * 4; i += 4) {
-                _mm256_storeu_pd((*((*temp)->data) + i), vec);
-            }
-            
-            if ((rows * cols) % 4 != 0) {
-                for (int i = ((rows * cols) / 4) * 4; i < (rows * cols); i++) {
-                    (*temp)->data[0][i] = 0;
-                }
-            }
+            mul_pow((*temp), result, result, (*squared), plan, threads);
+            parallel_for(copyPlan, copyThreads, rows * cols, fill_range, &clear);
         }//end currbit 1 case
         pow = pow >> 1;
         currBit = pow & 1;
-        
+
     }
     deallocate_matrix((*squared));
     deallocate_matrix((*temp));
 
+    stats_end(KERNEL_POW, start, rows * cols, threads);
     return 0;
 }
 
@@ -488,28 +1546,21 @@ int neg_matrix(matrix *result, matrix *mat) {
     if (result->rows != mat->rows || result->cols != mat->cols) {
         return -1;
     }
-    int rows = mat->rows;
-    int cols = mat->cols;
-    if (rows < 8 && cols < 8){
-        for (int i = 0; i < rows * cols; i++){
+    uint64_t start = stats_begin(KERNEL_NEG, mat->rows, mat->cols, 0);
+    Py_ssize_t rows = mat->rows;
+    Py_ssize_t cols = mat->cols;
+    int threads;
+    int plan = plan_kernel(rows * cols, rows * cols, 2 * rows * cols * sizeof(double), &threads);
+    if (plan == PLAN_SERIAL && is_flat(result) && is_flat(mat)){
+        for (Py_ssize_t i = 0; i < rows * cols; i++){
             result->data[0][i] = mat->data[0][i] * -1;
         }
+        stats_end(KERNEL_NEG, start, rows * cols, 1);
         return 0;
     }
 
-    __m256d negative =_mm256_set1_pd (-1);
-    
-    #pragma omp parallel for
-    for (int i = 0; i < ((rows * cols) / 4) * 4; i += 4) {
-        _mm256_storeu_pd((*(result->data) + i), _mm256_mul_pd(_mm256_loadu_pd((*(mat->data) + i)), negative));
-    }
-    
-    if ((rows * cols) % 4 != 0) {
-        for (int i = ((rows * cols) / 4) * 4; i < (rows * cols); i++) {
-            result->data[0][i] = mat->data[0][i] * -1;
-        }
-    } 
- 
+    elementwise(plan, threads, neg_range, result, mat, NULL, 0);
+    stats_end(KERNEL_NEG, start, rows * cols, threads);
     return 0;
 }
 
@@ -521,48 +1572,1106 @@ int abs_matrix(matrix *result, matrix *mat) {
     if (result->rows != mat->rows || result->cols != mat->cols) {
         return -1;
     }
-    int rows = mat->rows;
-    int cols = mat->cols;
+    uint64_t start = stats_begin(KERNEL_ABS, mat->rows, mat->cols, 0);
+    Py_ssize_t rows = mat->rows;
+    Py_ssize_t cols = mat->cols;
+    int threads;
+    int plan = plan_kernel(rows * cols, rows * cols, 2 * rows * cols * sizeof(double), &threads);
 
-    if (rows < 8 && cols < 8){
-        for (int i = 0; i < rows*cols; i++){
+    if (plan == PLAN_SERIAL && is_flat(result) && is_flat(mat)){
+        for (Py_ssize_t i = 0; i < rows*cols; i++){
             if (mat->data[0][i] >= 0) {
                 result->data[0][i] = mat->data[0][i];
             } else {
                 result->data[0][i] = -1 * mat->data[0][i];
             }
         }
+        stats_end(KERNEL_ABS, start, rows * cols, 1);
         return 0;
     }
-    
-    __m256d zeros =_mm256_set1_pd (-0.);
-    __m256d values;
 
-    #pragma omp parallel for
-    for (int i = 0; i < ((rows * cols) / 4) * 4; i += 4) {
-        values = _mm256_loadu_pd((*(mat->data) + i));
-        _mm256_storeu_pd((*(result->data) + i), _mm256_max_pd(_mm256_sub_pd(zeros,values), values));
+    elementwise(plan, threads, abs_range, result, mat, NULL, 0);
+    stats_end(KERNEL_ABS, start, rows * cols, threads);
+    return 0;
+}
+
+/*
+ * The lowest and highest addresses of the entries of `mat`.
+ */
+static void entry_span(matrix *mat, uintptr_t *low, uintptr_t *high) {
+    Py_ssize_t last = (mat->cols - 1) * mat->stride;
+    *low = UINTPTR_MAX;
+    *high = 0;
+    for (Py_ssize_t i = 0; i < mat->rows; i++) {
+        uintptr_t first = (uintptr_t) mat->data[i];
+        uintptr_t end = (uintptr_t) (mat->data[i] + last);
+        if (first > end) {
+            uintptr_t swap = first;
+            first = end;
+            end = swap;
+        }
+        *low = first < *low ? first : *low;
+        *high = end > *high ? end : *high;
+    }
+}
+
+/*
+ * How two matrices of the same shape share memory: OVERLAP_NONE if no entry of one can be an
+ * entry of the other, OVERLAP_SAME if every entry of `a` is the entry of `b` at the same position,
+ * and OVERLAP_PARTIAL otherwise. The last is judged from address spans, so it may be a false alarm
+ * for interleaved views, which only costs the caller a temporary.
+ */
+int matrix_overlap(matrix *a, matrix *b) {
+    uintptr_t aLow, aHigh, bLow, bHigh;
+    entry_span(a, &aLow, &aHigh);
+    entry_span(b, &bLow, &bHigh);
+    if (aHigh < bLow || bHigh < aLow) {
+        return OVERLAP_NONE;
     }
-    if ((rows * cols) % 4 != 0) {
-        for (int i = ((rows * cols) / 4) * 4; i < (rows * cols); i++) {
-            if (mat->data[0][i] >= 0) {
-                result->data[0][i] = mat->data[0][i];
-            }
-            else {
-                result->data[0][i] = -1 * mat->data[0][i];
+    if (a->rows != b->rows || a->cols != b->cols || (a->stride != b->stride && a->cols > 1)) {
+        return OVERLAP_PARTIAL;
+    }
+    for (Py_ssize_t i = 0; i < a->rows; i++) {
+        if (a->data[i] != b->data[i]) {
+            return OVERLAP_PARTIAL;
+        }
+    }
+    return OVERLAP_SAME;
+}
+
+/*
+ * Copy the entries of `src` into `dst`, which must have the same shape. Either may be a strided
+ * view, and they may be views of the same buffer: if their entries partly overlap, `src` is
+ * packed into a temporary first, so the result is as if all of `src` was read before `dst` was
+ * written.
+ * Return 0 upon success and -1 (with a Python error set) upon failure.
+ */
+int assign_matrix(matrix *dst, matrix *src) {
+    if (dst->rows != src->rows || dst->cols != src->cols) {
+        PyErr_SetString(PyExc_ValueError, "Dimensions of matricies don't match!");
+        return -1;
+    }
+    Py_ssize_t rows = dst->rows;
+    Py_ssize_t cols = dst->cols;
+    int overlap = matrix_overlap(dst, src);
+    if (overlap == OVERLAP_SAME) {
+        return 0;
+    }
+    matrix *temp = NULL;
+    if (overlap == OVERLAP_PARTIAL && allocate_matrix(&temp, rows, cols) != 0) {
+        return -1;
+    }
+    uint64_t start = stats_begin(KERNEL_ASSIGN, rows, cols, 0);
+    if (temp != NULL) {
+        for (Py_ssize_t i = 0; i < rows; i++) {
+            get_row(src, i, 0, cols, temp->data[i]);
+        }
+        src = temp;
+    }
+
+    int threads;
+    int plan = plan_kernel(rows * cols, 0, 2 * rows * cols * sizeof(double), &threads);
+    if (plan == PLAN_SERIAL && is_flat(dst) && is_flat(src)) {
+        memcpy(dst->data[0], src->data[0], rows * cols * sizeof(double));
+    } else {
+        elementwise(plan, threads, copy_range, dst, src, NULL, 0);
+    }
+    if (temp != NULL) {
+        deallocate_matrix(temp);
+    }
+    stats_end(KERNEL_ASSIGN, start, rows * cols, threads);
+    return 0;
+}
+
+/* ELEMENT-WISE FUNCTIONS */
+
+/*
+ * Vector versions of exp, log, tanh and the logistic sigmoid for the element-wise kernels below.
+ * exp reduces x = n ln2 + r with |r| <= ln2 / 2 (ln2 split in two so that n ln2 is exact) and
+ * sums the Taylor series of e^r - 1 to r^13, whose remainder is below half an ulp; log follows
+ * fdlibm, log(1 + f) = 2 atanh(f / (2 + f)) around a mantissa in [sqrt(1/2), sqrt(2)). Both are
+ * within two ulps of the correctly rounded result over the whole range, subnormals included, and
+ * pass infinities and NaNs through as libm does. AVX has no 256-bit integer arithmetic, so the
+ * exponent field is read and written 128 bits at a time.
+ */
+#define LN2_HI 6.93147180369123816490e-01
+#define LN2_LO 1.90821492927058770002e-10
+#define UFUNC_FLOPS 40     // rough cost of one exp, log, tanh or sigmoid, for plan_kernel
+
+/*
+ * b where `mask` (a comparison result) is set and a elsewhere. _mm256_blendv_pd would do, but
+ * GCC splits it into scalar branches when it cannot prove the mask is a comparison under AVX1.
+ */
+static inline __m256d select_vec(__m256d a, __m256d b, __m256d mask) {
+    return _mm256_or_pd(_mm256_and_pd(mask, b), _mm256_andnot_pd(mask, a));
+}
+
+/* 2^n for whole numbers n in [-1022, 1023] */
+static inline __m256d pow2_vec(__m256d n) {
+    __m128i k = _mm256_cvtpd_epi32(n);
+    __m128i bias = _mm_set1_epi64x(1023);
+    __m128i lo = _mm_slli_epi64(_mm_add_epi64(_mm_cvtepi32_epi64(k), bias), 52);
+    __m128i hi = _mm_slli_epi64(_mm_add_epi64(_mm_cvtepi32_epi64(_mm_srli_si128(k, 8)), bias), 52);
+    return _mm256_castsi256_pd(_mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1));
+}
+
+/* The biased exponent field of positive x, as a double */
+static inline __m256d exponent_vec(__m256d x) {
+    __m128i magic = _mm_set1_epi64x(0x4330000000000000);     // 2^52, whose low bits are the field
+    __m128i lo = _mm_or_si128(_mm_srli_epi64(_mm_castpd_si128(_mm256_castpd256_pd128(x)), 52), magic);
+    __m128i hi = _mm_or_si128(_mm_srli_epi64(_mm_castpd_si128(_mm256_extractf128_pd(x, 1)), 52), magic);
+    __m256d bits = _mm256_castsi256_pd(_mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1));
+    return _mm256_sub_pd(bits, _mm256_set1_pd(4503599627370496.0));
+}
+
+/* e^r - 1 for |r| <= ln2 / 2 */
+static inline __m256d expm1_poly(__m256d r) {
+    __m256d p = _mm256_set1_pd(1.0 / 6227020800.0);
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 479001600));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 39916800));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 3628800));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 362880));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 40320));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 5040));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 720));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 120));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 24));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 6));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 2));
+    return _mm256_fmadd_pd(_mm256_mul_pd(r, r), p, r);
+}
+
+/* x = n ln2 + r, returning r and setting n */
+static inline __m256d reduce_ln2(__m256d x, __m256d *n) {
+    *n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(1.44269504088896340736)),
+                         _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(*n, _mm256_set1_pd(LN2_HI), x);
+    return _mm256_fnmadd_pd(*n, _mm256_set1_pd(LN2_LO), r);
+}
+
+static inline __m256d exp_vec(__m256d x) {
+    /* Past these bounds e^x is 0 or infinite; 2^n is applied in two halves to reach subnormals */
+    __m256d clamped = _mm256_max_pd(_mm256_min_pd(x, _mm256_set1_pd(710)), _mm256_set1_pd(-746));
+    __m256d n;
+    __m256d r = reduce_ln2(clamped, &n);
+    __m256d p = _mm256_add_pd(_mm256_set1_pd(1), expm1_poly(r));
+    __m256d half = _mm256_floor_pd(_mm256_mul_pd(n, _mm256_set1_pd(0.5)));
+    p = _mm256_mul_pd(_mm256_mul_pd(p, pow2_vec(half)), pow2_vec(_mm256_sub_pd(n, half)));
+    return select_vec(p, _mm256_add_pd(x, x), _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+}
+
+/* e^x - 1 for x in [0, 40], accurate near 0 where exp_vec(x) - 1 cancels */
+static inline __m256d expm1_vec(__m256d x) {
+    __m256d n;
+    __m256d r = reduce_ln2(x, &n);
+    __m256d scale = pow2_vec(n);
+    return _mm256_fmadd_pd(scale, expm1_poly(r), _mm256_sub_pd(scale, _mm256_set1_pd(1)));
+}
+
+static inline __m256d log_vec(__m256d x) {
+    /* Scale subnormals up so that their exponent field is meaningful */
+    __m256d tiny = _mm256_cmp_pd(x, _mm256_set1_pd(2.2250738585072014e-308), _CMP_LT_OQ);
+    __m256d scaled = select_vec(x, _mm256_mul_pd(x, _mm256_set1_pd(4503599627370496.0)), tiny);
+    __m256d k = _mm256_sub_pd(exponent_vec(scaled), _mm256_set1_pd(1023));
+    k = _mm256_sub_pd(k, _mm256_and_pd(tiny, _mm256_set1_pd(52)));
+
+    /* The mantissa in [1, 2), halved (and k raised by one) past sqrt(2) */
+    __m256d mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x000fffffffffffff));
+    __m256d m = _mm256_or_pd(_mm256_and_pd(scaled, mask), _mm256_set1_pd(1));
+    __m256d big = _mm256_cmp_pd(m, _mm256_set1_pd(1.41421356237309504880), _CMP_GT_OQ);
+    m = select_vec(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+    k = _mm256_add_pd(k, _mm256_and_pd(big, _mm256_set1_pd(1)));
+
+    __m256d f = _mm256_sub_pd(m, _mm256_set1_pd(1));
+    __m256d s = _mm256_div_pd(f, _mm256_add_pd(f, _mm256_set1_pd(2)));
+    __m256d z = _mm256_mul_pd(s, s);
+    __m256d poly = _mm256_set1_pd(2.0 / 23);
+    for (int i = 21; i >= 3; i -= 2) {
+        poly = _mm256_fmadd_pd(poly, z, _mm256_set1_pd(2.0 / i));
+    }
+    __m256d R = _mm256_mul_pd(poly, z);
+    __m256d hfsq = _mm256_mul_pd(_mm256_mul_pd(f, f), _mm256_set1_pd(0.5));
+    __m256d low = _mm256_fmadd_pd(s, _mm256_add_pd(hfsq, R), _mm256_mul_pd(k, _mm256_set1_pd(LN2_LO)));
+    __m256d result = _mm256_fmsub_pd(k, _mm256_set1_pd(LN2_HI), _mm256_sub_pd(_mm256_sub_pd(hfsq, low), f));
+
+    /* log(+-0) = -inf, log(x < 0) = NaN, log(inf) = inf, and NaN stays NaN */
+    result = select_vec(result, _mm256_set1_pd(-INFINITY),
+                              _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_EQ_OQ));
+    result = select_vec(result, _mm256_set1_pd(NAN),
+                              _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_LT_OQ));
+    result = select_vec(result, x, _mm256_cmp_pd(x, _mm256_set1_pd(INFINITY), _CMP_EQ_OQ));
+    return select_vec(result, _mm256_add_pd(x, x), _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+}
+
+static inline __m256d sqrt_vec(__m256d x) {
+    return _mm256_sqrt_pd(x);
+}
+
+/* tanh |x| = e / (e + 2) with e = e^(2|x|) - 1, which is 1 in double precision past |x| = 20 */
+static inline __m256d tanh_vec(__m256d x) {
+    __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d twice = _mm256_min_pd(_mm256_add_pd(_mm256_andnot_pd(sign, x), _mm256_andnot_pd(sign, x)),
+                                  _mm256_set1_pd(40));
+    __m256d e = expm1_vec(twice);
+    __m256d result = _mm256_or_pd(_mm256_div_pd(e, _mm256_add_pd(e, _mm256_set1_pd(2))),
+                                  _mm256_and_pd(sign, x));
+    return select_vec(result, _mm256_add_pd(x, x), _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+}
+
+/* 1 / (1 + e^-x), through t = e^-|x| so that nothing overflows and small results keep their digits */
+static inline __m256d sigmoid_vec(__m256d x) {
+    __m256d t = exp_vec(_mm256_or_pd(x, _mm256_set1_pd(-0.0)));
+    __m256d denominator = _mm256_add_pd(t, _mm256_set1_pd(1));
+    __m256d numerator = select_vec(_mm256_set1_pd(1), t,
+                                         _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_LT_OQ));
+    return _mm256_div_pd(numerator, denominator);
+}
+
+/*
+ * out[i] = fn(in1[i]) over [begin, end). The last partial vector goes through a padded buffer, so
+ * that every entry gets the same arithmetic whatever the size and split of the range.
+ */
+static inline void map_range(elementwise_args *args, Py_ssize_t begin, Py_ssize_t end,
+                             __m256d (*fn)(__m256d)) {
+    Py_ssize_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        _mm256_storeu_pd(args->out + i, fn(_mm256_loadu_pd(args->in1 + i)));
+    }
+    if (i < end) {
+        double tail[4] = {1, 1, 1, 1};
+        memcpy(tail, args->in1 + i, (end - i) * sizeof(double));
+        _mm256_storeu_pd(tail, fn(_mm256_loadu_pd(tail)));
+        memcpy(args->out + i, tail, (end - i) * sizeof(double));
+    }
+}
+
+static void exp_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    map_range(argp, begin, end, exp_vec);
+}
+
+static void log_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    map_range(argp, begin, end, log_vec);
+}
+
+static void sqrt_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    map_range(argp, begin, end, sqrt_vec);
+}
+
+static void tanh_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    map_range(argp, begin, end, tanh_vec);
+}
+
+static void sigmoid_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    map_range(argp, begin, end, sigmoid_vec);
+}
+
+/*
+ * x^val for whole val with |val| <= POWER_MULTIPLIES + 1, by repeated products, so within about
+ * one ulp per product; 1 / x^|val| for negative val.
+ */
+#define POWER_MULTIPLIES 3
+
+static void power_int_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    elementwise_args *args = argp;
+    int count = (int) fabs(args->val);
+    for (Py_ssize_t i = begin; i < end; i += 4) {
+        double tail[4] = {1, 1, 1, 1};
+        const double *in = args->in1 + i;
+        if (i + 4 > end) {
+            memcpy(tail, in, (end - i) * sizeof(double));
+            in = tail;
+        }
+        __m256d x = _mm256_loadu_pd(in);
+        __m256d result = count == 0 ? _mm256_set1_pd(1) : x;
+        for (int k = 1; k < count; k++) {
+            result = _mm256_mul_pd(result, x);
+        }
+        if (args->val < 0) {
+            result = _mm256_div_pd(_mm256_set1_pd(1), result);
+        }
+        if (i + 4 > end) {
+            _mm256_storeu_pd(tail, result);
+            memcpy(args->out + i, tail, (end - i) * sizeof(double));
+        } else {
+            _mm256_storeu_pd(args->out + i, result);
+        }
+    }
+}
+
+static void power_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    elementwise_args *args = argp;
+    for (Py_ssize_t i = begin; i < end; i++) {
+        args->out[i] = pow(args->in1[i], args->val);
+    }
+}
+
+/*
+ * result = fn(mat) entry by entry for the functions above, which cost `flops` per entry. There is
+ * no scalar loop: even a single entry goes through the vector code, so results do not depend on
+ * the shape. Return 0 upon success and a nonzero value upon failure.
+ */
+static int map_matrix(int kernel, range_fn fn, double flops, matrix *result, matrix *mat, double val) {
+    if (result->rows != mat->rows || result->cols != mat->cols) {
+        return -1;
+    }
+    uint64_t start = stats_begin(kernel, mat->rows, mat->cols, 0);
+    Py_ssize_t n = mat->rows * mat->cols;
+    int threads;
+    int plan = plan_kernel(n, flops * n, 2 * n * sizeof(double), &threads);
+    elementwise(plan, threads, fn, result, mat, NULL, val);
+    stats_end(kernel, start, n, threads);
+    return 0;
+}
+
+/*
+ * Store e^x, the natural logarithm, the square root, tanh or the logistic sigmoid 1 / (1 + e^-x)
+ * of every entry of `mat` to `result`, which may be `mat` itself.
+ * Return 0 upon success and a nonzero value upon failure.
+ */
+int exp_matrix(matrix *result, matrix *mat) {
+    return map_matrix(KERNEL_EXP, exp_range, UFUNC_FLOPS, result, mat, 0);
+}
+
+int log_matrix(matrix *result, matrix *mat) {
+    return map_matrix(KERNEL_LOG, log_range, UFUNC_FLOPS, result, mat, 0);
+}
+
+int sqrt_matrix(matrix *result, matrix *mat) {
+    return map_matrix(KERNEL_SQRT, sqrt_range, 1, result, mat, 0);
+}
+
+int tanh_matrix(matrix *result, matrix *mat) {
+    return map_matrix(KERNEL_TANH, tanh_range, UFUNC_FLOPS, result, mat, 0);
+}
+
+int sigmoid_matrix(matrix *result, matrix *mat) {
+    return map_matrix(KERNEL_SIGMOID, sigmoid_range, UFUNC_FLOPS, result, mat, 0);
+}
+
+/*
+ * Store every entry of `mat` raised to `exponent` to `result`. Small whole exponents (squares,
+ * cubes, reciprocals) are vector products; any other exponent calls libm's pow per entry, in
+ * parallel, since a vector exp(y log x) loses |y log x| ulps to the rounding of the logarithm.
+ * Return 0 upon success and a nonzero value upon failure.
+ */
+int power_matrix(matrix *result, matrix *mat, double exponent) {
+    if (exponent == floor(exponent) && fabs(exponent) <= POWER_MULTIPLIES + 1) {
+        return map_matrix(KERNEL_POWER, power_int_range, fabs(exponent), result, mat, exponent);
+    }
+    return map_matrix(KERNEL_POWER, power_range, UFUNC_FLOPS, result, mat, exponent);
+}
+
+/* COMPARISONS */
+
+/*
+ * Masks hold 1.0 where a comparison holds and 0.0 elsewhere, so that they are ordinary matrices
+ * (a mask times a matrix zeroes the other entries). Comparisons with NaN are false except for
+ * !=, as in Python. Each range function compares in1 with in2, or with `val` if in2 is NULL.
+ */
+static inline void compare_range(elementwise_args *args, Py_ssize_t begin, Py_ssize_t end,
+                                 __m256d (*cmp)(__m256d, __m256d)) {
+    __m256d one = _mm256_set1_pd(1);
+    __m256d val = _mm256_set1_pd(args->val);
+    Py_ssize_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m256d y = args->in2 != NULL ? _mm256_loadu_pd(args->in2 + i) : val;
+        _mm256_storeu_pd(args->out + i, _mm256_and_pd(cmp(_mm256_loadu_pd(args->in1 + i), y), one));
+    }
+    if (i < end) {
+        double x[4] = {0, 0, 0, 0};
+        double y[4] = {args->val, args->val, args->val, args->val};
+        memcpy(x, args->in1 + i, (end - i) * sizeof(double));
+        if (args->in2 != NULL) {
+            memcpy(y, args->in2 + i, (end - i) * sizeof(double));
+        }
+        _mm256_storeu_pd(x, _mm256_and_pd(cmp(_mm256_loadu_pd(x), _mm256_loadu_pd(y)), one));
+        memcpy(args->out + i, x, (end - i) * sizeof(double));
+    }
+}
+
+static inline __m256d lt_vec(__m256d x, __m256d y) {
+    return _mm256_cmp_pd(x, y, _CMP_LT_OQ);
+}
+
+static inline __m256d le_vec(__m256d x, __m256d y) {
+    return _mm256_cmp_pd(x, y, _CMP_LE_OQ);
+}
+
+static inline __m256d eq_vec(__m256d x, __m256d y) {
+    return _mm256_cmp_pd(x, y, _CMP_EQ_OQ);
+}
+
+static inline __m256d ne_vec(__m256d x, __m256d y) {
+    return _mm256_cmp_pd(x, y, _CMP_NEQ_UQ);
+}
+
+static inline __m256d gt_vec(__m256d x, __m256d y) {
+    return _mm256_cmp_pd(x, y, _CMP_GT_OQ);
+}
+
+static inline __m256d ge_vec(__m256d x, __m256d y) {
+    return _mm256_cmp_pd(x, y, _CMP_GE_OQ);
+}
+
+static void lt_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    compare_range(argp, begin, end, lt_vec);
+}
+
+static void le_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    compare_range(argp, begin, end, le_vec);
+}
+
+static void eq_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    compare_range(argp, begin, end, eq_vec);
+}
+
+static void ne_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    compare_range(argp, begin, end, ne_vec);
+}
+
+static void gt_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    compare_range(argp, begin, end, gt_vec);
+}
+
+static void ge_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    compare_range(argp, begin, end, ge_vec);
+}
+
+/*
+ * Store the mask of mat1 `op` mat2 to `result`, where op is one of the COMPARE_* codes (the same
+ * values as Python's Py_LT ... Py_GE). If mat2 is NULL, every entry of mat1 is compared with
+ * `val` instead. Return 0 upon success and a nonzero value upon failure.
+ */
+int compare_matrix(matrix *result, matrix *mat1, matrix *mat2, double val, int op) {
+    static const range_fn ranges[] = {lt_range, le_range, eq_range, ne_range, gt_range, ge_range};
+    if (result->rows != mat1->rows || result->cols != mat1->cols || op < 0 || op > COMPARE_GE ||
+            (mat2 != NULL && (mat2->rows != mat1->rows || mat2->cols != mat1->cols))) {
+        return -1;
+    }
+    uint64_t start = stats_begin(KERNEL_COMPARE, mat1->rows, mat1->cols, 0);
+    Py_ssize_t n = mat1->rows * mat1->cols;
+    int threads;
+    int plan = plan_kernel(n, n, (mat2 != NULL ? 3 : 2) * n * sizeof(double), &threads);
+    elementwise(plan, threads, ranges[op], result, mat1, mat2, val);
+    stats_end(KERNEL_COMPARE, start, n, threads);
+    return 0;
+}
+
+/*
+ * out[i] = in2[i] (or `val`) where in1[i] is nonzero; out[i] is left alone elsewhere. Only used on
+ * a flat `out`, which view_range then hands over in place, so out[i] holds its old value.
+ */
+static void select_range(void *argp, Py_ssize_t begin, Py_ssize_t end) {
+    elementwise_args *args = argp;
+    __m256d zero = _mm256_setzero_pd();
+    __m256d val = _mm256_set1_pd(args->val);
+    Py_ssize_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m256d mask = _mm256_cmp_pd(_mm256_loadu_pd(args->in1 + i), zero, _CMP_NEQ_UQ);
+        __m256d chosen = args->in2 != NULL ? _mm256_loadu_pd(args->in2 + i) : val;
+        __m256d old = _mm256_loadu_pd(args->out + i);
+        _mm256_storeu_pd(args->out + i, _mm256_or_pd(_mm256_and_pd(mask, chosen),
+                                                     _mm256_andnot_pd(mask, old)));
+    }
+    for (; i < end; i++) {
+        if (args->in1[i] != 0) {
+            args->out[i] = args->in2 != NULL ? args->in2[i] : args->val;
+        }
+    }
+}
+
+/*
+ * Store `a` where `mask` is nonzero and `b` elsewhere to `result`, which must be flat (a new
+ * matrix, not a view). A NULL `a` or `b` stands for the number aVal or bVal. `b` goes in first,
+ * then `a` is blended over it, so each pass is an ordinary two-operand element-wise kernel.
+ * Return 0 upon success and a nonzero value upon failure.
+ */
+int where_matrix(matrix *result, matrix *mask, matrix *a, double aVal, matrix *b, double bVal) {
+    Py_ssize_t rows = mask->rows;
+    Py_ssize_t cols = mask->cols;
+    if (result->rows != rows || result->cols != cols || !is_flat(result) ||
+            (a != NULL && (a->rows != rows || a->cols != cols)) ||
+            (b != NULL && (b->rows != rows || b->cols != cols))) {
+        return -1;
+    }
+    uint64_t start = stats_begin(KERNEL_WHERE, rows, cols, 0);
+    int threads;
+    int plan = plan_kernel(rows * cols, rows * cols, 4 * rows * cols * sizeof(double), &threads);
+    if (b != NULL) {
+        elementwise(plan, threads, copy_range, result, b, NULL, 0);
+    } else {
+        elementwise(plan, threads, fill_range, result, NULL, NULL, bVal);
+    }
+    elementwise(plan, threads, select_range, result, mask, a, aVal);
+    stats_end(KERNEL_WHERE, start, rows * cols, threads);
+    return 0;
+}
+
+/*
+ * Whether every |a - b| <= atol + rtol |b|, or a == b for infinities, as numpy.allclose without
+ * equal_nan: 1 if so, 0 if not and -1 if the shapes differ. The scan runs a VIEW_CHUNK at a time
+ * on the calling thread and stops at the first chunk with a mismatch, so matrices that differ
+ * early cost next to nothing.
+ */
+int allclose_matrix(matrix *a, matrix *b, double rtol, double atol) {
+    if (a->rows != b->rows || a->cols != b->cols) {
+        return -1;
+    }
+    uint64_t start = stats_begin(KERNEL_ALLCLOSE, a->rows, a->cols, 0);
+    Py_ssize_t n = a->rows * a->cols;
+    int flatA = is_flat(a);
+    int flatB = is_flat(b);
+    double aBuf[VIEW_CHUNK];
+    double bBuf[VIEW_CHUNK];
+    __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d rtolVec = _mm256_set1_pd(rtol);
+    __m256d atolVec = _mm256_set1_pd(atol);
+    __m256d infinity = _mm256_set1_pd(INFINITY);
+    int close = 1;
+    Py_ssize_t e = 0;
+    for (; e < n && close; e += VIEW_CHUNK) {
+        Py_ssize_t count = n - e < VIEW_CHUNK ? n - e : VIEW_CHUNK;
+        const double *x = view_run(a, flatA, e, count, aBuf, 1);
+        const double *y = view_run(b, flatB, e, count, bBuf, 1);
+        __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        Py_ssize_t k = 0;
+        for (; k + 4 <= count; k += 4) {
+            __m256d xv = _mm256_loadu_pd(x + k);
+            __m256d yv = _mm256_loadu_pd(y + k);
+            __m256d xAbs = _mm256_andnot_pd(sign, xv);
+            __m256d yAbs = _mm256_andnot_pd(sign, yv);
+            /* An infinite |b| makes the bound infinite too, so the tolerance is for finite lanes */
+            __m256d finite = _mm256_and_pd(_mm256_cmp_pd(xAbs, infinity, _CMP_LT_OQ),
+                                           _mm256_cmp_pd(yAbs, infinity, _CMP_LT_OQ));
+            __m256d diff = _mm256_andnot_pd(sign, _mm256_sub_pd(xv, yv));
+            __m256d bound = _mm256_fmadd_pd(rtolVec, yAbs, atolVec);
+            __m256d within = _mm256_and_pd(finite, _mm256_cmp_pd(diff, bound, _CMP_LE_OQ));
+            all = _mm256_and_pd(all, _mm256_or_pd(within, _mm256_cmp_pd(xv, yv, _CMP_EQ_OQ)));
+        }
+        close = _mm256_movemask_pd(all) == 0xf;
+        for (; k < count && close; k++) {
+            close = x[k] == y[k] || (isfinite(x[k]) && isfinite(y[k]) &&
+                                     fabs(x[k] - y[k]) <= atol + rtol * fabs(y[k]));
+        }
+    }
+    stats_end(KERNEL_ALLCLOSE, start, e < n ? e : n, 1);
+    return close;
+}
+
+/* OUT-OF-CORE MATRICES */
+
+/*
+ * Read or write exactly `len` bytes at `offset`, retrying on short transfers and EINTR.
+ * Return 0 upon success and OOC_IO (with errno set) upon failure.
+ */
+static int pread_full(int fd, void *buf, size_t len, off_t offset) {
+    char *dst = buf;
+    while (len > 0) {
+        ssize_t got = pread(fd, dst, len, offset);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            if (got == 0) {
+                errno = EIO;
             }
+            return OOC_IO;
         }
+        dst += got;
+        offset += got;
+        len -= got;
     }
     return 0;
-    /*
-    for(int i = 0; i < mat->rows; i++) {
-        for (int j = 0; j < mat->cols; j++) {
-            if (*(*(mat->data + i) + j) >= 0) {
-                *(*(result->data + i) + j) = *(*(mat->data + i) + j);
-            } else {
-                *(*(result->data + i) + j) = *(*(mat->data + i) + j) * -1;
+}
+
+static int pwrite_full(int fd, const void *buf, size_t len, off_t offset) {
+    const char *src = buf;
+    while (len > 0) {
+        ssize_t put = pwrite(fd, src, len, offset);
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+        if (put < 0) {
+            return OOC_IO;
+        }
+        src += put;
+        offset += put;
+        len -= put;
+    }
+    return 0;
+}
+
+/*
+ * The 32 byte header of a matrix file: the magic string, then rows and cols as int64s and a
+ * reserved word. The data follows in row-major order.
+ */
+static int write_matrix_header(int fd, int64_t rows, int64_t cols) {
+    char header[MATRIX_FILE_HEADER] = {0};
+    memcpy(header, MATRIX_FILE_MAGIC, sizeof(MATRIX_FILE_MAGIC));
+    memcpy(header + 8, &rows, sizeof(int64_t));
+    memcpy(header + 16, &cols, sizeof(int64_t));
+    return pwrite_full(fd, header, MATRIX_FILE_HEADER, 0);
+}
+
+static int read_matrix_header(int fd, int64_t *rows, int64_t *cols) {
+    char header[MATRIX_FILE_HEADER];
+    struct stat info;
+    if (pread_full(fd, header, MATRIX_FILE_HEADER, 0) != 0) {
+        return errno == EIO ? OOC_FORMAT : OOC_IO;
+    }
+    if (memcmp(header, MATRIX_FILE_MAGIC, sizeof(MATRIX_FILE_MAGIC)) != 0) {
+        return OOC_FORMAT;
+    }
+    memcpy(rows, header + 8, sizeof(int64_t));
+    memcpy(cols, header + 16, sizeof(int64_t));
+    if (*rows <= 0 || *cols <= 0 || *rows > INT64_MAX / *cols / (int64_t) sizeof(double)) {
+        return OOC_FORMAT;
+    }
+    if (fstat(fd, &info) != 0) {
+        return OOC_IO;
+    }
+    if (info.st_size < MATRIX_FILE_HEADER + *rows * *cols * (int64_t) sizeof(double)) {
+        return OOC_FORMAT;
+    }
+    return 0;
+}
+
+/*
+ * Write `mat` to `path` in the numc matrix file format.
+ */
+int save_matrix(matrix *mat, const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return OOC_IO;
+    }
+    int ret = write_matrix_header(fd, mat->rows, mat->cols);
+    size_t rowBytes = (size_t) mat->cols * sizeof(double);
+    /* Rows of a view sliced with a column step are gathered one at a time */
+    double *row = mat->stride != 1 ? malloc(rowBytes) : NULL;
+    if (mat->stride != 1 && row == NULL) {
+        errno = ENOMEM;
+        ret = OOC_IO;
+    }
+    for (Py_ssize_t i = 0; i < mat->rows && ret == 0; i++) {
+        if (row != NULL) {
+            get_row(mat, i, 0, mat->cols, row);
+        }
+        ret = pwrite_full(fd, row != NULL ? row : mat->data[i], rowBytes,
+                          MATRIX_FILE_HEADER + (off_t) i * rowBytes);
+    }
+    free(row);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return ret;
+}
+
+/*
+ * Read the matrix stored at `path` into a newly allocated matrix. The matrix has to fit in
+ * memory; use matmul_ooc to operate on files that don't.
+ */
+int load_matrix(matrix **mat, const char *path) {
+    int64_t rows, cols;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return OOC_IO;
+    }
+    int ret = read_matrix_header(fd, &rows, &cols);
+    if (ret == 0 && allocate_matrix(mat, rows, cols) != 0) {
+        PyErr_Clear();
+        ret = OOC_MEMORY;
+    }
+    if (ret == 0) {
+        ret = pread_full(fd, (*mat)->data[0], (size_t) (rows * cols) * sizeof(double), MATRIX_FILE_HEADER);
+        if (ret != 0) {
+            deallocate_matrix(*mat);
+        }
+    }
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return ret;
+}
+
+/*
+ * State shared by matmul_ooc and its prefetch thread. Tiles are double buffered: while the
+ * compute side multiplies the tiles in one slot, the prefetch thread reads the next pair of
+ * tiles into the other slot.
+ */
+typedef struct ooc_state {
+    int aFd;
+    int bFd;
+    int64_t m, k, n;        // C(m x n) = A(m x k) * B(k x n)
+    int64_t tm, tk, tn;     // tile sizes
+    double *aTile[2];
+    double *bTile[2];
+    int ready[2];
+    int error;
+    int savedErrno;
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} ooc_state;
+
+static inline int64_t min64(int64_t a, int64_t b) {
+    return a < b ? a : b;
+}
+
+/*
+ * Read the `rows` x `cols` block at (row0, col0) of a file-backed matrix with `ld` columns
+ * into `tile`, packed with leading dimension `cols`.
+ */
+static int ooc_read_tile(int fd, double *tile, int64_t ld, int64_t row0, int64_t col0,
+                         int64_t rows, int64_t cols) {
+    for (int64_t r = 0; r < rows; r++) {
+        off_t offset = MATRIX_FILE_HEADER + ((row0 + r) * ld + col0) * (off_t) sizeof(double);
+        if (pread_full(fd, tile + r * cols, cols * sizeof(double), offset) != 0) {
+            return OOC_IO;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Prefetch thread. Walks the same (i, j, p) tile schedule as matmul_ooc and fills the slots
+ * in turn, blocking while the slot it wants is still being multiplied.
+ */
+static void *ooc_prefetch(void *arg) {
+    ooc_state *st = arg;
+    int64_t step = 0;
+    for (int64_t i = 0; i < st->m; i += st->tm) {
+        for (int64_t j = 0; j < st->n; j += st->tn) {
+            for (int64_t p = 0; p < st->k; p += st->tk, step++) {
+                int slot = step & 1;
+                pthread_mutex_lock(&st->lock);
+                while (st->ready[slot] && !st->stop) {
+                    pthread_cond_wait(&st->cond, &st->lock);
+                }
+                int stop = st->stop;
+                pthread_mutex_unlock(&st->lock);
+                if (stop) {
+                    return NULL;
+                }
+                int64_t rows = min64(st->tm, st->m - i);
+                int64_t depth = min64(st->tk, st->k - p);
+                int64_t cols = min64(st->tn, st->n - j);
+                int ret = ooc_read_tile(st->aFd, st->aTile[slot], st->k, i, p, rows, depth);
+                if (ret == 0) {
+                    ret = ooc_read_tile(st->bFd, st->bTile[slot], st->n, p, j, depth, cols);
+                }
+                pthread_mutex_lock(&st->lock);
+                if (ret != 0) {
+                    st->error = ret;
+                    st->savedErrno = errno;
+                } else {
+                    st->ready[slot] = 1;
+                }
+                pthread_cond_broadcast(&st->cond);
+                pthread_mutex_unlock(&st->lock);
+                if (ret != 0) {
+                    return NULL;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+typedef struct ooc_tile_args {
+    double *c;
+    const double *a;
+    const double *b;
+    int64_t depth;
+    int64_t cols;
+} ooc_tile_args;
+
+/*
+ * Rows [begin, end) of c[rows x cols] += a[rows x depth] * b[depth x cols] for densely packed
+ * tiles.
+ */
+static void ooc_tile_rows(void *argsPtr, Py_ssize_t begin, Py_ssize_t end) {
+    ooc_tile_args *args = argsPtr;
+    double *c = args->c;
+    const double *a = args->a;
+    const double *b = args->b;
+    int64_t depth = args->depth;
+    int64_t cols = args->cols;
+    for (int64_t i = begin; i < end; i++) {
+        double *cRow = c + i * cols;
+        for (int64_t p = 0; p < depth; p++) {
+            double aVal = a[i * depth + p];
+            __m256d aVec = _mm256_set1_pd(aVal);
+            const double *bRow = b + p * cols;
+            int64_t j = 0;
+            for (; j < (cols / 4) * 4; j += 4) {
+                _mm256_storeu_pd(cRow + j, _mm256_fmadd_pd(aVec, _mm256_loadu_pd(bRow + j),
+                                 _mm256_loadu_pd(cRow + j)));
+            }
+            for (; j < cols; j++) {
+                cRow[j] += aVal * bRow[j];
             }
         }
     }
-    */
-}
\ No newline at end of file
+}
+
+/*
+ * Pick tile sizes so that two slots of A and B tiles plus one C tile fit in `budget` doubles.
+ * Start from square tiles, clamp them to the matrix, then give whatever is left to the inner
+ * dimension so that reads are as long as possible.
+ */
+static int ooc_plan_tiles(ooc_state *st, size_t budget) {
+    int64_t square = (int64_t) (budget / 5);
+    int64_t t = 0;
+    for (int64_t bit = (int64_t) 1 << 30; bit > 0; bit >>= 1) {
+        if ((t + bit) * (t + bit) <= square) {
+            t += bit;
+        }
+    }
+    if (t == 0) {
+        return OOC_MEMORY;
+    }
+    st->tm = min64(t, st->m);
+    st->tn = min64(t, st->n);
+    int64_t spare = (int64_t) budget - st->tm * st->tn;
+    st->tk = min64(spare / (2 * (st->tm + st->tn)), st->k);
+    return st->tk > 0 ? 0 : OOC_MEMORY;
+}
+
+/*
+ * Multiply the file-backed matrices at `a_path` and `b_path` and write the product to `out_path`
+ * without ever holding more than `memory_limit` bytes of tile buffers. The output is computed one
+ * C tile at a time, streaming the matching row panel of A and column panel of B through a pair
+ * of buffers that a prefetch thread fills while the current tiles are being multiplied.
+ * `out_path` may not name either operand's file. Return 0 upon success and an OOC_* code upon
+ * failure.
+ */
+int matmul_ooc(const char *a_path, const char *b_path, const char *out_path, size_t memory_limit) {
+    uint64_t start = stats_begin(KERNEL_MATMUL_OOC, 0, 0, 0);
+    ooc_state st;
+    memset(&st, 0, sizeof(ooc_state));
+    int64_t bRows, bCols;
+    int cFd = -1;
+    double *cTile = NULL;
+    int ret = 0;
+    int saved;
+    int threads = get_num_threads();
+
+    st.bFd = -1;
+    st.aFd = open(a_path, O_RDONLY);
+    if (st.aFd < 0 || (st.bFd = open(b_path, O_RDONLY)) < 0) {
+        ret = OOC_IO;
+        goto done;
+    }
+    if ((ret = read_matrix_header(st.aFd, &st.m, &st.k)) != 0 ||
+            (ret = read_matrix_header(st.bFd, &bRows, &bCols)) != 0) {
+        goto done;
+    }
+    if (st.k != bRows) {
+        ret = OOC_SHAPE;
+        goto done;
+    }
+    st.n = bCols;
+    if ((ret = ooc_plan_tiles(&st, memory_limit / sizeof(double))) != 0) {
+        goto done;
+    }
+    for (int s = 0; s < 2; s++) {
+        st.aTile[s] = malloc(st.tm * st.tk * sizeof(double));
+        st.bTile[s] = malloc(st.tk * st.tn * sizeof(double));
+        if (st.aTile[s] == NULL || st.bTile[s] == NULL) {
+            ret = OOC_MEMORY;
+            goto done;
+        }
+    }
+    cTile = malloc(st.tm * st.tn * sizeof(double));
+    if (cTile == NULL) {
+        ret = OOC_MEMORY;
+        goto done;
+    }
+    /* Truncating an operand would destroy it before it is read, so check the open output file
+     * against both operands first, which also catches links and different spellings of a path */
+    cFd = open(out_path, O_RDWR | O_CREAT, 0644);
+    if (cFd < 0) {
+        ret = OOC_IO;
+        goto done;
+    }
+    struct stat cInfo, aInfo, bInfo;
+    if (fstat(cFd, &cInfo) != 0 || fstat(st.aFd, &aInfo) != 0 || fstat(st.bFd, &bInfo) != 0) {
+        ret = OOC_IO;
+        goto done;
+    }
+    if ((cInfo.st_dev == aInfo.st_dev && cInfo.st_ino == aInfo.st_ino) ||
+            (cInfo.st_dev == bInfo.st_dev && cInfo.st_ino == bInfo.st_ino)) {
+        ret = OOC_ALIAS;
+        goto done;
+    }
+    if (ftruncate(cFd, 0) != 0 || (ret = write_matrix_header(cFd, st.m, st.n)) != 0 ||
+            ftruncate(cFd, MATRIX_FILE_HEADER + st.m * st.n * (off_t) sizeof(double)) != 0) {
+        ret = OOC_IO;
+        goto done;
+    }
+
+    pthread_t prefetcher;
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.cond, NULL);
+    if (pthread_create(&prefetcher, NULL, ooc_prefetch, &st) != 0) {
+        pthread_mutex_destroy(&st.lock);
+        pthread_cond_destroy(&st.cond);
+        ret = OOC_IO;
+        goto done;
+    }
+    int64_t step = 0;
+    for (int64_t i = 0; i < st.m && ret == 0; i += st.tm) {
+        for (int64_t j = 0; j < st.n && ret == 0; j += st.tn) {
+            int64_t rows = min64(st.tm, st.m - i);
+            int64_t cols = min64(st.tn, st.n - j);
+            memset(cTile, 0, rows * cols * sizeof(double));
+            for (int64_t p = 0; p < st.k; p += st.tk, step++) {
+                int slot = step & 1;
+                pthread_mutex_lock(&st.lock);
+                while (!st.ready[slot] && !st.error) {
+                    pthread_cond_wait(&st.cond, &st.lock);
+                }
+                if (!st.ready[slot]) {
+                    ret = st.error;
+                    errno = st.savedErrno;
+                }
+                pthread_mutex_unlock(&st.lock);
+                if (ret != 0) {
+                    break;
+                }
+                ooc_tile_args tile = {cTile, st.aTile[slot], st.bTile[slot], min64(st.tk, st.k - p), cols};
+                parallel_for(threads > 1 ? PLAN_THREADED : PLAN_SIMD, threads, rows, ooc_tile_rows, &tile);
+                pthread_mutex_lock(&st.lock);
+                st.ready[slot] = 0;
+                pthread_cond_broadcast(&st.cond);
+                pthread_mutex_unlock(&st.lock);
+            }
+            for (int64_t r = 0; r < rows && ret == 0; r++) {
+                off_t offset = MATRIX_FILE_HEADER + ((i + r) * st.n + j) * (off_t) sizeof(double);
+                ret = pwrite_full(cFd, cTile + r * cols, cols * sizeof(double), offset);
+            }
+        }
+    }
+    saved = errno;
+    pthread_mutex_lock(&st.lock);
+    st.stop = 1;
+    pthread_cond_broadcast(&st.cond);
+    pthread_mutex_unlock(&st.lock);
+    pthread_join(prefetcher, NULL);
+    pthread_mutex_destroy(&st.lock);
+    pthread_cond_destroy(&st.cond);
+    errno = saved;
+
+done:
+    saved = errno;
+    for (int s = 0; s < 2; s++) {
+        free(st.aTile[s]);
+        free(st.bTile[s]);
+    }
+    free(cTile);
+    if (st.aFd >= 0) close(st.aFd);
+    if (st.bFd >= 0) close(st.bFd);
+    if (cFd >= 0) close(cFd);
+    stats_end(KERNEL_MATMUL_OOC, start, ret == 0 ? st.m * st.n : 0, threads);
+    errno = saved;
+    return ret;
+}
+
+/* SHARED-MEMORY MATRICES */
+
+/*
+ * Map the matrix file open at `fd` read-write and shared, and make a matrix whose rows point into
+ * the mapping. The mapping outlives `fd` and is unmapped when the matrix is deallocated.
+ */
+static int map_segment(matrix **mat, int fd, int64_t rows, int64_t cols) {
+    size_t size = MATRIX_FILE_HEADER + (size_t) (rows * cols) * sizeof(double);
+    char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        return OOC_IO;
+    }
+    matrix *shared = malloc(sizeof(matrix));
+    double **data = malloc(rows * sizeof(double *));
+    if (shared == NULL || data == NULL) {
+        free(shared);
+        free(data);
+        munmap(base, size);
+        errno = ENOMEM;
+        return OOC_IO;
+    }
+    for (int64_t i = 0; i < rows; i++) {
+        data[i] = (double *) (base + MATRIX_FILE_HEADER) + i * cols;
+    }
+    shared->rows = rows;
+    shared->cols = cols;
+    shared->data = data;
+    shared->stride = 1;
+    shared->is_1d = rows == 1 || cols == 1;
+    shared->ref_cnt = 1;
+    shared->parent = NULL;
+    shared->cow = 0;
+    shared->copies = NULL;
+    shared->next_copy = NULL;
+    shared->mapped = size;
+    *mat = shared;
+    return 0;
+}
+
+/*
+ * Create the shared-memory segment `name` (as for shm_open) holding a zeroed rows x cols matrix
+ * and map it into `*mat`. Fails with EEXIST if the segment exists. The whole segment is
+ * allocated up front, so running out of shared memory is an error here rather than a SIGBUS
+ * on first touch.
+ */
+int shared_matrix(matrix **mat, Py_ssize_t rows, Py_ssize_t cols, const char *name) {
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        return OOC_IO;
+    }
+    off_t size = MATRIX_FILE_HEADER + (off_t) rows * cols * sizeof(double);
+    int ret = posix_fallocate(fd, 0, size);
+    if (ret != 0) {
+        errno = ret;
+        ret = OOC_IO;
+    }
+    if (ret == 0) {
+        ret = write_matrix_header(fd, rows, cols);
+    }
+    if (ret == 0) {
+        ret = map_segment(mat, fd, rows, cols);
+    }
+    int saved = errno;
+    if (ret != 0) {
+        shm_unlink(name);
+    }
+    close(fd);
+    errno = saved;
+    return ret;
+}
+
+/*
+ * Map the existing shared-memory segment `name`, made by shared_matrix in any process, into
+ * `*mat`. Writes through either matrix are seen by both at once.
+ */
+int attach_matrix(matrix **mat, const char *name) {
+    int64_t rows, cols;
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return OOC_IO;
+    }
+    int ret = read_matrix_header(fd, &rows, &cols);
+    if (ret == 0) {
+        ret = map_segment(mat, fd, rows, cols);
+    }
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return ret;
+}
+
+/*
+ * Remove the name of the shared-memory segment `name`. Matrices mapping it keep working, and the
+ * memory is freed once the last of them, in any process, is deallocated.
+ */
+int unlink_matrix(const char *name) {
+    return shm_unlink(name) == 0 ? 0 : OOC_IO;
+}
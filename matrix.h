@@ -1,23 +1,50 @@
 #include <Python.h>
 
 typedef struct matrix {
-    int rows;      	// number of rows
-    int cols;      	// number of columns
+    Py_ssize_t rows;	// number of rows
+    Py_ssize_t cols;	// number of columns
     double **data; 	// each element is a pointer to a row of data
+    Py_ssize_t stride;  // distance between neighbouring entries of a row: 1, or a slice's column step
     int is_1d;     	// Whether this matrix is a 1d matrix
     // For 1D matrix, shape is (rows * cols)
     int ref_cnt;
     struct matrix *parent;
+    // A copy shares the buffer of `parent` like a slice does, but with cow set: the first write
+    // through it, or through any matrix that owns or views that buffer, copies it out first.
+    int cow;
+    struct matrix *copies;      // on the buffer's owner: its copy-on-write sharers
+    struct matrix *next_copy;   // on a copy: the next one in its owner's list
+    // On the owner of a buffer in a shared-memory segment: the bytes mapped, which
+    // deallocate_matrix unmaps instead of freeing the buffer. 0 for malloc'd buffers.
+    size_t mapped;
 } matrix;
 
 
+/*
+ * Distributions for random_matrix and the meaning of its parameters `a` and `b`.
+ */
+#define RAND_UNIFORM 0      // uniform doubles in [a, b)
+#define RAND_NORMAL 1       // normal with mean a and standard deviation b
+#define RAND_INT 2          // uniform integers in [a, b)
+#define RAND_BERNOULLI 3    // 1 with probability a, else 0
+#define RAND_EXPONENTIAL 4  // exponential with scale (mean) a
+
 void rand_matrix(matrix *result, unsigned int seed, double low, double high);
-int allocate_matrix(matrix **mat, int rows, int cols);
-int allocate_matrix_ref(matrix **mat, matrix *from, int row_offset,
-                        int col_offset, int rows, int cols);
+void random_matrix(matrix *result, unsigned int seed, int dist, double a, double b);
+int allocate_matrix(matrix **mat, Py_ssize_t rows, Py_ssize_t cols);
+int allocate_matrix_ref(matrix **mat, matrix *from, Py_ssize_t row_offset,
+                        Py_ssize_t col_offset, Py_ssize_t rows, Py_ssize_t cols);
+int allocate_matrix_strided(matrix **mat, matrix *from, Py_ssize_t row_offset,
+                            Py_ssize_t col_offset, Py_ssize_t rows, Py_ssize_t cols,
+                            Py_ssize_t row_step, Py_ssize_t col_step);
 void deallocate_matrix(matrix *mat);
-double get(matrix *mat, int row, int col);
-void set(matrix *mat, int row, int col, double val);
+int copy_matrix(matrix **mat, matrix *from);
+int unshare_matrix(matrix *mat);
+double get(matrix *mat, Py_ssize_t row, Py_ssize_t col);
+void set(matrix *mat, Py_ssize_t row, Py_ssize_t col, double val);
+void get_row(matrix *mat, Py_ssize_t row, Py_ssize_t col, Py_ssize_t count, double *out);
+matrix *unit_stride(matrix *mat, matrix *packed);
+void release_unit_stride(matrix *used, matrix *packed);
 void fill_matrix(matrix *mat, double val);
 int add_matrix(matrix *result, matrix *mat1, matrix *mat2);
 int sub_matrix(matrix *result, matrix *mat1, matrix *mat2);
@@ -25,3 +52,82 @@ int mul_matrix(matrix *result, matrix *mat1, matrix *mat2);
 int pow_matrix(matrix *result, matrix *mat, int pow);
 int neg_matrix(matrix *result, matrix *mat);
 int abs_matrix(matrix *result, matrix *mat);
+#define OVERLAP_NONE 0
+#define OVERLAP_SAME 1
+#define OVERLAP_PARTIAL 2
+int matrix_overlap(matrix *a, matrix *b);
+int assign_matrix(matrix *dst, matrix *src);
+int exp_matrix(matrix *result, matrix *mat);
+int log_matrix(matrix *result, matrix *mat);
+int sqrt_matrix(matrix *result, matrix *mat);
+int tanh_matrix(matrix *result, matrix *mat);
+int sigmoid_matrix(matrix *result, matrix *mat);
+int power_matrix(matrix *result, matrix *mat, double exponent);
+#define COMPARE_LT 0
+#define COMPARE_LE 1
+#define COMPARE_EQ 2
+#define COMPARE_NE 3
+#define COMPARE_GT 4
+#define COMPARE_GE 5
+int compare_matrix(matrix *result, matrix *mat1, matrix *mat2, double val, int op);
+int where_matrix(matrix *result, matrix *mask, matrix *a, double aVal, matrix *b, double bVal);
+int allclose_matrix(matrix *a, matrix *b, double rtol, double atol);
+
+/*
+ * How a kernel runs. plan_kernel picks one from the kernel's size and work, using the cost model
+ * parameters below, and never uses more threads than get_num_threads allows.
+ */
+#define PLAN_SERIAL 0       // scalar loop on the calling thread
+#define PLAN_SIMD 1         // AVX loop on the calling thread
+#define PLAN_THREADED 2     // AVX loop split over the thread pool (or an OpenMP team)
+extern double plan_flops_per_ns;    // single-thread FLOP rate
+extern double plan_bytes_per_ns;    // single-thread memory bandwidth
+extern double plan_thread_ns;       // least work per thread that pays for forking it
+extern int plan_simd_elements;      // smallest result worth a vector loop
+extern int thread_pool;             // threaded kernels share pool.c's workers, else OpenMP teams
+void set_num_threads(int threads);
+int set_call_threads(int threads);
+int get_num_threads(void);
+int plan_kernel(double elements, double flops, double bytes, int *threads);
+typedef void (*range_fn)(void *args, Py_ssize_t begin, Py_ssize_t end);
+void parallel_for(int plan, int threads, Py_ssize_t count, range_fn fn, void *args);
+
+/*
+ * Host tuning. mul_tile_* block matrix products (0 = untiled) and mul_pack copies each block of
+ * the right operand before use. linalg_block is the panel width of the factorizations in
+ * linalg.c (0 = unblocked). Every tunable, including num_threads and the plan_* cost model, can
+ * be read and set by name and loaded from a file written by numc_autotune.py.
+ */
+extern int mul_tile_rows;
+extern int mul_tile_depth;
+extern int mul_tile_cols;
+extern int mul_pack;
+extern int linalg_block;
+const char *tunable_name(int i);
+int tunable_is_int(int i);
+int get_tunable(const char *name, double *value);
+int set_tunable(const char *name, double value);
+int load_tuning(const char *path);
+
+/*
+ * Out-of-core (file-backed) matrices. These routines do not touch the Python error state so that
+ * they can run without the GIL; they return 0 on success or one of the OOC_* codes below.
+ */
+#define MATRIX_FILE_MAGIC "NUMCMAT"
+#define MATRIX_FILE_HEADER 32
+#define OOC_IO -1       // a system call failed, errno is set
+#define OOC_FORMAT -2   // the file is not a numc matrix file
+#define OOC_SHAPE -3    // the operand shapes do not line up
+#define OOC_MEMORY -4   // memory_limit is too small to hold a single tile
+#define OOC_ALIAS -5    // the output file is one of the operand files
+int save_matrix(matrix *mat, const char *path);
+int load_matrix(matrix **mat, const char *path);
+int matmul_ooc(const char *a_path, const char *b_path, const char *out_path, size_t memory_limit);
+
+/*
+ * Matrices in POSIX shared-memory segments, laid out as matrix files, that any number of
+ * processes can map. Same conventions as the out-of-core routines.
+ */
+int shared_matrix(matrix **mat, Py_ssize_t rows, Py_ssize_t cols, const char *name);
+int attach_matrix(matrix **mat, const char *name);
+int unlink_matrix(const char *name);
@@ -1,25 +1,29 @@
 #include "numc.h"
+#include "profile.h"
+#include "pool.h"
+#include "linalg.h"
 #include <structmember.h>
 
 
 PyTypeObject Matrix61cType;
+PyTypeObject FutureType;
 
 /* Helper functions for initalization of matrices and vectors */
 
 /*
  * Return a tuple given rows and cols
  */
-PyObject *get_shape(int rows, int cols) {
+PyObject *get_shape(Py_ssize_t rows, Py_ssize_t cols) {
   if (rows == 1 || cols == 1) {
-    return PyTuple_Pack(1, PyLong_FromLong(rows * cols));
+    return PyTuple_Pack(1, PyLong_FromSsize_t(rows * cols));
   } else {
-    return PyTuple_Pack(2, PyLong_FromLong(rows), PyLong_FromLong(cols));
+    return PyTuple_Pack(2, PyLong_FromSsize_t(rows), PyLong_FromSsize_t(cols));
   }
 }
 /*
  * Matrix(rows, cols, low, high). Fill a matrix random double values
  */
-int init_rand(PyObject *self, int rows, int cols, unsigned int seed, double low,
+int init_rand(PyObject *self, Py_ssize_t rows, Py_ssize_t cols, unsigned int seed, double low,
               double high) {
     matrix *new_mat;
     int alloc_failed = allocate_matrix(&new_mat, rows, cols);
@@ -33,7 +37,7 @@ int init_rand(PyObject *self, int rows, int cols, unsigned int seed, double low,
 /*
  * Matrix(rows, cols, val). Fill a matrix of dimension rows * cols with val
  */
-int init_fill(PyObject *self, int rows, int cols, double val) {
+int init_fill(PyObject *self, Py_ssize_t rows, Py_ssize_t cols, double val) {
     matrix *new_mat;
     int alloc_failed = allocate_matrix(&new_mat, rows, cols);
     if (alloc_failed)
@@ -49,7 +53,7 @@ int init_fill(PyObject *self, int rows, int cols, double val) {
 /*
  * Matrix(rows, cols, 1d_list). Fill a matrix with dimension rows * cols with 1d_list values
  */
-int init_1d(PyObject *self, int rows, int cols, PyObject *lst) {
+int init_1d(PyObject *self, Py_ssize_t rows, Py_ssize_t cols, PyObject *lst) {
     if (rows * cols != PyList_Size(lst)) {
         PyErr_SetString(PyExc_ValueError, "Incorrect number of elements in list");
         return -1;
@@ -57,9 +61,9 @@ int init_1d(PyObject *self, int rows, int cols, PyObject *lst) {
     matrix *new_mat;
     int alloc_failed = allocate_matrix(&new_mat, rows, cols);
     if (alloc_failed) return alloc_failed;
-    int count = 0;
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
+    Py_ssize_t count = 0;
+    for (Py_ssize_t i = 0; i < rows; i++) {
+        for (Py_ssize_t j = 0; j < cols; j++) {
             set(new_mat, i, j, PyFloat_AsDouble(PyList_GetItem(lst, count)));
             count++;
         }
@@ -73,20 +77,20 @@ int init_1d(PyObject *self, int rows, int cols, PyObject *lst) {
  * Matrix(2d_list). Fill a matrix with dimension len(2d_list) * len(2d_list[0])
  */
 int init_2d(PyObject *self, PyObject *lst) {
-    int rows = PyList_Size(lst);
+    Py_ssize_t rows = PyList_Size(lst);
     if (rows == 0) {
         PyErr_SetString(PyExc_ValueError,
                         "Cannot initialize numc.Matrix with an empty list");
         return -1;
     }
-    int cols;
+    Py_ssize_t cols;
     if (!PyList_Check(PyList_GetItem(lst, 0))) {
         PyErr_SetString(PyExc_ValueError, "List values not valid");
         return -1;
     } else {
         cols = PyList_Size(PyList_GetItem(lst, 0));
     }
-    for (int i = 0; i < rows; i++) {
+    for (Py_ssize_t i = 0; i < rows; i++) {
         if (!PyList_Check(PyList_GetItem(lst, i)) ||
                 PyList_Size(PyList_GetItem(lst, i)) != cols) {
             PyErr_SetString(PyExc_ValueError, "List values not valid");
@@ -96,8 +100,8 @@ int init_2d(PyObject *self, PyObject *lst) {
     matrix *new_mat;
     int alloc_failed = allocate_matrix(&new_mat, rows, cols);
     if (alloc_failed) return alloc_failed;
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
+    for (Py_ssize_t i = 0; i < rows; i++) {
+        for (Py_ssize_t j = 0; j < cols; j++) {
             set(new_mat, i, j,
                 PyFloat_AsDouble(PyList_GetItem(PyList_GetItem(lst, i), j)));
         }
@@ -182,7 +186,7 @@ int Matrix61c_init(PyObject *self, PyObject *args, PyObject *kwds) {
         PyObject *cols = NULL;
         if (PyArg_UnpackTuple(args, "args", 2, 2, &rows, &cols)) {
             if (rows && cols && PyLong_Check(rows) && PyLong_Check(cols)) {
-                return init_rand(self, PyLong_AsLong(rows), PyLong_AsLong(cols), unsigned_seed, double_low,
+                return init_rand(self, PyLong_AsSsize_t(rows), PyLong_AsSsize_t(cols), unsigned_seed, double_low,
                                  double_high);
             }
         } else {
@@ -198,18 +202,18 @@ int Matrix61c_init(PyObject *self, PyObject *args, PyObject *kwds) {
         if (arg1 && arg2 && arg3 && PyLong_Check(arg1) && PyLong_Check(arg2) && (PyLong_Check(arg3)
                 || PyFloat_Check(arg3))) {
             if (PyLong_Check(arg3)) {
-                return init_fill(self, PyLong_AsLong(arg1), PyLong_AsLong(arg2), PyLong_AsLong(arg3));
+                return init_fill(self, PyLong_AsSsize_t(arg1), PyLong_AsSsize_t(arg2), PyLong_AsLong(arg3));
             } else
-                return init_fill(self, PyLong_AsLong(arg1), PyLong_AsLong(arg2), PyFloat_AsDouble(arg3));
+                return init_fill(self, PyLong_AsSsize_t(arg1), PyLong_AsSsize_t(arg2), PyFloat_AsDouble(arg3));
         } else if (arg1 && arg2 && arg3 && PyLong_Check(arg1) && PyLong_Check(arg2) && PyList_Check(arg3)) {
             /* Matrix(rows, cols, 1D list) */
-            return init_1d(self, PyLong_AsLong(arg1), PyLong_AsLong(arg2), arg3);
+            return init_1d(self, PyLong_AsSsize_t(arg1), PyLong_AsSsize_t(arg2), arg3);
         } else if (arg1 && PyList_Check(arg1) && arg2 == NULL && arg3 == NULL) {
             /* Matrix(rows, cols, 1D list) */
             return init_2d(self, arg1);
         } else if (arg1 && arg2 && PyLong_Check(arg1) && PyLong_Check(arg2) && arg3 == NULL) {
             /* Matrix(rows, cols, 1D list) */
-            return init_fill(self, PyLong_AsLong(arg1), PyLong_AsLong(arg2), 0);
+            return init_fill(self, PyLong_AsSsize_t(arg1), PyLong_AsSsize_t(arg2), 0);
         } else {
             PyErr_SetString(PyExc_TypeError, "Invalid arguments");
             return -1;
@@ -224,24 +228,24 @@ int Matrix61c_init(PyObject *self, PyObject *args, PyObject *kwds) {
  * List of lists representations for matrices
  */
 PyObject *Matrix61c_to_list(Matrix61c *self) {
-    int rows = self->mat->rows;
-    int cols = self->mat->cols;
+    Py_ssize_t rows = self->mat->rows;
+    Py_ssize_t cols = self->mat->cols;
     PyObject *py_lst = NULL;
     if (self->mat->is_1d) {  // If 1D matrix, print as a single list
         py_lst = PyList_New(rows * cols);
-        int count = 0;
-        for (int i = 0; i < rows; i++) {
-            for (int j = 0; j < cols; j++) {
+        Py_ssize_t count = 0;
+        for (Py_ssize_t i = 0; i < rows; i++) {
+            for (Py_ssize_t j = 0; j < cols; j++) {
                 PyList_SetItem(py_lst, count, PyFloat_FromDouble(get(self->mat, i, j)));
                 count++;
             }
         }
     } else {  // if 2D, print as nested list
         py_lst = PyList_New(rows);
-        for (int i = 0; i < rows; i++) {
+        for (Py_ssize_t i = 0; i < rows; i++) {
             PyList_SetItem(py_lst, i, PyList_New(cols));
             PyObject *curr_row = PyList_GetItem(py_lst, i);
-            for (int j = 0; j < cols; j++) {
+            for (Py_ssize_t j = 0; j < cols; j++) {
                 PyList_SetItem(curr_row, j, PyFloat_FromDouble(get(self->mat, i, j)));
             }
         }
@@ -264,11 +268,2065 @@ PyObject *Matrix61c_class_to_list(Matrix61c *self, PyObject *args) {
     }
 }
 
+/*
+ * Raise the Python exception matching an OOC_* code returned by the file-backed routines.
+ * `path` may be NULL when the failing file is not known.
+ */
+void set_ooc_error(int code, const char *path) {
+    switch (code) {
+    case OOC_IO:
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+        break;
+    case OOC_FORMAT:
+        PyErr_Format(PyExc_ValueError, "%s is not a numc matrix file", path ? path : "operand");
+        break;
+    case OOC_SHAPE:
+        PyErr_SetString(PyExc_ValueError, "Dimensions of matricies don't match!");
+        break;
+    case OOC_ALIAS:
+        PyErr_SetString(PyExc_ValueError, "out_path is the same file as an operand");
+        break;
+    default:
+        PyErr_SetString(PyExc_MemoryError, "memory_limit is too small for a single tile");
+        break;
+    }
+}
+
+/*
+ * numc.save(mat, path). Write a numc.Matrix to a file that matmul_ooc can read.
+ */
+PyObject *Matrix61c_class_save(Matrix61c *self, PyObject *args) {
+    PyObject *mat = NULL;
+    const char *path = NULL;
+    if (!PyArg_ParseTuple(args, "O!s", &Matrix61cType, &mat, &path)) {
+        return NULL;
+    }
+    int ret = save_matrix(((Matrix61c *)mat)->mat, path);
+    if (ret != 0) {
+        set_ooc_error(ret, path);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+/*
+ * numc.load(path). Read a matrix file written by numc.save or numc.matmul_ooc.
+ */
+PyObject *Matrix61c_class_load(Matrix61c *self, PyObject *args) {
+    const char *path = NULL;
+    if (!PyArg_ParseTuple(args, "s", &path)) {
+        return NULL;
+    }
+    matrix *newMat;
+    int ret = load_matrix(&newMat, path);
+    if (ret != 0) {
+        set_ooc_error(ret, path);
+        return NULL;
+    }
+    Matrix61c *temp = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
+    temp->mat = newMat;
+    temp->shape = get_shape(newMat->rows, newMat->cols);
+    return (PyObject *) temp;
+}
+
+/*
+ * Wrap a matrix made by shared_matrix or attach_matrix in a numc.Matrix.
+ */
+static PyObject *wrap_shared(matrix *mat) {
+    Matrix61c *temp = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
+    if (temp == NULL) {
+        deallocate_matrix(mat);
+        return NULL;
+    }
+    temp->mat = mat;
+    temp->shape = get_shape(mat->rows, mat->cols);
+    return (PyObject *) temp;
+}
+
+/*
+ * Matrix.shared(rows, cols, name). A new zeroed rows x cols matrix in the POSIX shared-memory
+ * segment `name`, which other processes map with Matrix.attach(name) to share one physical copy.
+ * The segment outlives the matrices mapping it until Matrix.unlink(name).
+ */
+PyObject *Matrix61c_shared(PyObject *unused, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"rows", "cols", "name", NULL};
+    Py_ssize_t rows, cols;
+    const char *name = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "nns", kwlist, &rows, &cols, &name)) {
+        return NULL;
+    }
+    if (rows <= 0 || cols <= 0) {
+        PyErr_SetString(PyExc_ValueError, "Matrix row or col value received invalid input");
+        return NULL;
+    }
+    if (rows > PY_SSIZE_T_MAX / (Py_ssize_t) sizeof(double) / cols) {
+        PyErr_SetString(PyExc_MemoryError, "Matrix dimensions are too large");
+        return NULL;
+    }
+    matrix *mat;
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = shared_matrix(&mat, rows, cols, name);
+    Py_END_ALLOW_THREADS
+    if (ret != 0) {
+        set_ooc_error(ret, name);
+        return NULL;
+    }
+    return wrap_shared(mat);
+}
+
+/*
+ * Matrix.attach(name). The matrix in the shared-memory segment `name` made by Matrix.shared,
+ * mapped without copying. Writes from any process that maps it are seen by all of them.
+ */
+PyObject *Matrix61c_attach(PyObject *unused, PyObject *args) {
+    const char *name = NULL;
+    if (!PyArg_ParseTuple(args, "s", &name)) {
+        return NULL;
+    }
+    matrix *mat;
+    int ret = attach_matrix(&mat, name);
+    if (ret != 0) {
+        set_ooc_error(ret, name);
+        return NULL;
+    }
+    return wrap_shared(mat);
+}
+
+/*
+ * Matrix.unlink(name). Remove the shared-memory segment `name`; matrices already mapping it keep
+ * working and its memory is freed with the last of them.
+ */
+PyObject *Matrix61c_unlink(PyObject *unused, PyObject *args) {
+    const char *name = NULL;
+    if (!PyArg_ParseTuple(args, "s", &name)) {
+        return NULL;
+    }
+    if (unlink_matrix(name) != 0) {
+        set_ooc_error(OOC_IO, name);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+/*
+ * Validate a `threads=` argument: a thread cap for one call, or 0 for the global one.
+ * Return 0 if it is valid and -1 with a ValueError set otherwise.
+ */
+static int check_threads(int threads) {
+    if (threads < 0) {
+        PyErr_SetString(PyExc_ValueError, "threads must not be negative");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * numc.matmul_ooc(a_path, b_path, out_path, memory_limit=1 << 30, *, threads=0). Multiply two
+ * file-backed matrices that need not fit in memory, keeping the tile buffers under
+ * `memory_limit` bytes.
+ */
+PyObject *Matrix61c_class_matmul_ooc(Matrix61c *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"a_path", "b_path", "out_path", "memory_limit", "threads", NULL};
+    const char *a_path = NULL;
+    const char *b_path = NULL;
+    const char *out_path = NULL;
+    Py_ssize_t memory_limit = 1 << 30;
+    int threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "sss|n$i", kwlist, &a_path, &b_path, &out_path,
+                                     &memory_limit, &threads)) {
+        return NULL;
+    }
+    if (memory_limit <= 0) {
+        PyErr_SetString(PyExc_ValueError, "memory_limit must be positive");
+        return NULL;
+    }
+    if (check_threads(threads) < 0) {
+        return NULL;
+    }
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    int saved = set_call_threads(threads);
+    ret = matmul_ooc(a_path, b_path, out_path, (size_t) memory_limit);
+    set_call_threads(saved);
+    Py_END_ALLOW_THREADS
+    if (ret != 0) {
+        set_ooc_error(ret, NULL);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+/* RANDOM SUBMODULE */
+
+/*
+ * Allocate a rows * cols matrix, fill it from the distribution `dist` and wrap it in a numc.Matrix.
+ * The fill runs without the GIL since it never touches Python objects.
+ */
+PyObject *random_new(Py_ssize_t rows, Py_ssize_t cols, unsigned int seed, int dist, double a, double b) {
+    matrix *new_mat;
+    if (allocate_matrix(&new_mat, rows, cols)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    random_matrix(new_mat, seed, dist, a, b);
+    Py_END_ALLOW_THREADS
+    Matrix61c *temp = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
+    temp->mat = new_mat;
+    temp->shape = get_shape(rows, cols);
+    return (PyObject *) temp;
+}
+
+/*
+ * numc.random.uniform(rows, cols, low=0, high=1, seed=0)
+ */
+PyObject *Random_uniform(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"rows", "cols", "low", "high", "seed", NULL};
+    Py_ssize_t rows, cols;
+    double low = 0, high = 1;
+    unsigned int seed = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "nn|ddI", kwlist, &rows, &cols, &low, &high, &seed)) {
+        return NULL;
+    }
+    if (low >= high) {
+        PyErr_SetString(PyExc_ValueError, "low must be less than high");
+        return NULL;
+    }
+    return random_new(rows, cols, seed, RAND_UNIFORM, low, high);
+}
+
+/*
+ * numc.random.normal(rows, cols, mean=0, std=1, seed=0)
+ */
+PyObject *Random_normal(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"rows", "cols", "mean", "std", "seed", NULL};
+    Py_ssize_t rows, cols;
+    double mean = 0, std = 1;
+    unsigned int seed = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "nn|ddI", kwlist, &rows, &cols, &mean, &std, &seed)) {
+        return NULL;
+    }
+    if (std < 0) {
+        PyErr_SetString(PyExc_ValueError, "std must be non-negative");
+        return NULL;
+    }
+    return random_new(rows, cols, seed, RAND_NORMAL, mean, std);
+}
+
+/*
+ * numc.random.randint(rows, cols, low, high, seed=0). Integers in [low, high), stored as doubles.
+ */
+PyObject *Random_randint(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"rows", "cols", "low", "high", "seed", NULL};
+    Py_ssize_t rows, cols;
+    long long low, high;
+    unsigned int seed = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "nnLL|I", kwlist, &rows, &cols, &low, &high, &seed)) {
+        return NULL;
+    }
+    if (low >= high) {
+        PyErr_SetString(PyExc_ValueError, "low must be less than high");
+        return NULL;
+    }
+    if (high - low > (1LL << 53)) {
+        PyErr_SetString(PyExc_ValueError, "high - low must be at most 2**53");
+        return NULL;
+    }
+    return random_new(rows, cols, seed, RAND_INT, (double) low, (double) high);
+}
+
+/*
+ * numc.random.bernoulli(rows, cols, p=0.5, seed=0). A 0/1 mask with P(1) = p.
+ */
+PyObject *Random_bernoulli(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"rows", "cols", "p", "seed", NULL};
+    Py_ssize_t rows, cols;
+    double p = 0.5;
+    unsigned int seed = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "nn|dI", kwlist, &rows, &cols, &p, &seed)) {
+        return NULL;
+    }
+    if (p < 0 || p > 1) {
+        PyErr_SetString(PyExc_ValueError, "p must be in [0, 1]");
+        return NULL;
+    }
+    return random_new(rows, cols, seed, RAND_BERNOULLI, p, 0);
+}
+
+/*
+ * numc.random.exponential(rows, cols, scale=1, seed=0)
+ */
+PyObject *Random_exponential(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"rows", "cols", "scale", "seed", NULL};
+    Py_ssize_t rows, cols;
+    double scale = 1;
+    unsigned int seed = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "nn|dI", kwlist, &rows, &cols, &scale, &seed)) {
+        return NULL;
+    }
+    if (scale <= 0) {
+        PyErr_SetString(PyExc_ValueError, "scale must be positive");
+        return NULL;
+    }
+    return random_new(rows, cols, seed, RAND_EXPONENTIAL, scale, 0);
+}
+
+PyMethodDef Random_methods[] = {
+    {"uniform", (PyCFunction)Random_uniform, METH_VARARGS | METH_KEYWORDS, "Uniform doubles in [low, high)"},
+    {"normal", (PyCFunction)Random_normal, METH_VARARGS | METH_KEYWORDS, "Normal samples with the given mean and std"},
+    {"randint", (PyCFunction)Random_randint, METH_VARARGS | METH_KEYWORDS, "Uniform integers in [low, high)"},
+    {"bernoulli", (PyCFunction)Random_bernoulli, METH_VARARGS | METH_KEYWORDS, "0/1 mask that is 1 with probability p"},
+    {"exponential", (PyCFunction)Random_exponential, METH_VARARGS | METH_KEYWORDS, "Exponential samples with the given scale"},
+    {NULL, NULL, 0, NULL}
+};
+
+struct PyModuleDef numcrandommodule = {
+    PyModuleDef_HEAD_INIT,
+    "numc.random",
+    "Random numc matrices from a counter-based generator",
+    -1,
+    Random_methods
+};
+
+/* PROFILING */
+
+/*
+ * numc.enable_stats() / numc.disable_stats(). Turn the per-kernel counters on or off; counts
+ * collected so far are kept either way.
+ */
+PyObject *Matrix61c_class_enable_stats(PyObject *self, PyObject *args) {
+    stats_enabled = 1;
+    Py_RETURN_NONE;
+}
+
+PyObject *Matrix61c_class_disable_stats(PyObject *self, PyObject *args) {
+    stats_enabled = 0;
+    Py_RETURN_NONE;
+}
+
+/*
+ * numc.stats(reset=False). Return {kernel name: {counter: value}} for every kernel called since
+ * the last reset, summed over all threads, and start over if `reset` is true.
+ */
+PyObject *Matrix61c_class_stats(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"reset", NULL};
+    int reset = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|p", kwlist, &reset)) {
+        return NULL;
+    }
+    kernel_stats totals[NUM_KERNELS];
+    stats_snapshot(totals);
+    if (reset) {
+        stats_reset();
+    }
+    PyObject *result = PyDict_New();
+    if (result == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < NUM_KERNELS; i++) {
+        kernel_stats *k = &totals[i];
+        if (k->calls == 0) {
+            continue;
+        }
+        PyObject *entry = Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K,s:K}",
+                                        "calls", k->calls, "total_ns", k->total_ns, "max_ns", k->max_ns,
+                                        "elements", k->elements, "bytes_allocated", k->bytes,
+                                        "serial", k->serial, "parallel", k->parallel);
+        if (entry == NULL || PyDict_SetItemString(result, kernel_names[i], entry) < 0) {
+            Py_XDECREF(entry);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(entry);
+    }
+    return result;
+}
+
+/*
+ * numc.enable_trace(capacity=65536) / numc.disable_trace(). Start or stop recording a begin and
+ * end event for every operator and kernel call into a ring of at least `capacity` events; once
+ * the ring is full the oldest events are overwritten.
+ */
+PyObject *Matrix61c_class_enable_trace(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"capacity", NULL};
+    Py_ssize_t capacity = 1 << 16;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|n", kwlist, &capacity)) {
+        return NULL;
+    }
+    if (capacity <= 0) {
+        PyErr_SetString(PyExc_ValueError, "capacity must be positive");
+        return NULL;
+    }
+    if (trace_start((size_t) capacity) != 0) {
+        return PyErr_NoMemory();
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject *Matrix61c_class_disable_trace(PyObject *self, PyObject *args) {
+    trace_stop();
+    Py_RETURN_NONE;
+}
+
+/*
+ * numc.trace_dump(path). Write the events recorded since the last dump to `path` as Chrome trace
+ * JSON, viewable in chrome://tracing or ui.perfetto.dev, and return how many were written.
+ */
+PyObject *Matrix61c_class_trace_dump(PyObject *self, PyObject *args) {
+    const char *path;
+    if (!PyArg_ParseTuple(args, "s", &path)) {
+        return NULL;
+    }
+    long count;
+    Py_BEGIN_ALLOW_THREADS
+    count = trace_dump(path);
+    Py_END_ALLOW_THREADS
+    if (count < 0) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    }
+    return PyLong_FromLong(count);
+}
+
+/* Counters perf_start could open; bit PERF_X for counter X */
+static int perf_counters = 0;
+
+/*
+ * numc.enable_perf() / numc.disable_perf(). Start or stop reading hardware counters around every
+ * kernel call. enable_perf returns the names of the counters that could be opened, which is empty
+ * where perf_event_open is unavailable or not permitted; perf_report then has times and
+ * modelled FLOPs and bytes only.
+ */
+PyObject *Matrix61c_class_enable_perf(PyObject *self, PyObject *args) {
+    perf_counters = perf_start();
+    PyObject *names = PyList_New(0);
+    if (names == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (perf_counters & (1 << i)) {
+            PyObject *name = PyUnicode_FromString(perf_counter_names[i]);
+            if (name == NULL || PyList_Append(names, name) < 0) {
+                Py_XDECREF(name);
+                Py_DECREF(names);
+                return NULL;
+            }
+            Py_DECREF(name);
+        }
+    }
+    return names;
+}
+
+PyObject *Matrix61c_class_disable_perf(PyObject *self, PyObject *args) {
+    perf_stop();
+    Py_RETURN_NONE;
+}
+
+/*
+ * One perf_report row. FLOPs come from the FP counters when they counted anything, and from the
+ * kernel's operation count otherwise; bytes are last-level cache misses times the line size when
+ * available, and the compulsory traffic otherwise.
+ */
+static PyObject *perf_row(perf_entry *e) {
+    double seconds = e->total_ns * 1e-9;
+    int measuredFlops = (perf_counters & (1 << PERF_FP_OPS)) && e->counters[PERF_FP_OPS] > 0;
+    int measuredBytes = (perf_counters & (1 << PERF_LLC_MISSES)) && e->counters[PERF_LLC_MISSES] > 0;
+    double flops = measuredFlops ? (double) e->counters[PERF_FP_OPS] : e->flops;
+    double bytes = measuredBytes ? e->counters[PERF_LLC_MISSES] * 64.0 : e->bytes;
+    PyObject *row = Py_BuildValue("{s:s,s:(LL),s:K,s:d,s:d,s:d,s:s,s:s,s:d,s:d}",
+                                  "kernel", kernel_names[e->kernel], "shape",
+                                  (long long) e->rows, (long long) e->cols,
+                                  "calls", e->calls, "seconds", seconds, "flops", flops,
+                                  "bytes", bytes, "flops_from", measuredFlops ? "counters" : "model",
+                                  "bytes_from", measuredBytes ? "counters" : "model",
+                                  "intensity", bytes > 0 ? flops / bytes : 0.0,
+                                  "gflops", seconds > 0 ? flops / seconds * 1e-9 : 0.0);
+    if (row == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (perf_counters & (1 << i)) {
+            PyObject *value = PyLong_FromUnsignedLongLong(e->counters[i]);
+            if (value == NULL || PyDict_SetItemString(row, perf_counter_names[i], value) < 0) {
+                Py_XDECREF(value);
+                Py_DECREF(row);
+                return NULL;
+            }
+            Py_DECREF(value);
+        }
+    }
+    if ((perf_counters & (1 << PERF_CYCLES)) && (perf_counters & (1 << PERF_INSTRUCTIONS))) {
+        double ipc = e->counters[PERF_CYCLES] > 0 ?
+            (double) e->counters[PERF_INSTRUCTIONS] / e->counters[PERF_CYCLES] : 0.0;
+        PyObject *value = PyFloat_FromDouble(ipc);
+        if (value == NULL || PyDict_SetItemString(row, "ipc", value) < 0) {
+            Py_XDECREF(value);
+            Py_DECREF(row);
+            return NULL;
+        }
+        Py_DECREF(value);
+    }
+    return row;
+}
+
+/*
+ * numc.perf_report(reset=False). Return a roofline-style list with one dict per kernel and
+ * shape bucket seen since the last reset: calls, time, FLOPs, bytes, arithmetic intensity
+ * (FLOPs per byte), achieved GFLOP/s and the raw counters. A bucket (r, c) holds results of at
+ * most r x c, both powers of two.
+ */
+PyObject *Matrix61c_class_perf_report(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"reset", NULL};
+    int reset = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|p", kwlist, &reset)) {
+        return NULL;
+    }
+    perf_entry *entries = PyMem_Malloc(PERF_BUCKETS * sizeof(perf_entry));
+    if (entries == NULL) {
+        return PyErr_NoMemory();
+    }
+    int count = perf_snapshot(entries, PERF_BUCKETS);
+    if (reset) {
+        perf_reset();
+    }
+    PyObject *report = PyList_New(count);
+    for (int i = 0; report != NULL && i < count; i++) {
+        PyObject *row = perf_row(&entries[i]);
+        if (row == NULL) {
+            Py_CLEAR(report);
+            break;
+        }
+        PyList_SET_ITEM(report, i, row);
+    }
+    PyMem_Free(entries);
+    return report;
+}
+
+/* THREADS */
+
+/*
+ * numc.set_num_threads(n) / numc.get_num_threads(). Cap the threads any kernel may use, or go
+ * back to the OpenMP default with 0. get_num_threads returns the cap in effect. Kernels still
+ * use fewer threads, or none, when the cost model says the work is too small to split.
+ */
+PyObject *Matrix61c_class_set_num_threads(PyObject *self, PyObject *args) {
+    int threads;
+    if (!PyArg_ParseTuple(args, "i", &threads) || check_threads(threads) < 0) {
+        return NULL;
+    }
+    set_num_threads(threads);
+    Py_RETURN_NONE;
+}
+
+PyObject *Matrix61c_class_get_num_threads(PyObject *self, PyObject *args) {
+    return PyLong_FromLong(get_num_threads());
+}
+
+/*
+ * numc.pool_stats(). The thread pool's size and what its workers have done since it started:
+ * jobs submitted, tasks run after splitting, tasks stolen from another worker and times a worker
+ * went to sleep for lack of work.
+ */
+PyObject *Matrix61c_class_pool_stats(PyObject *self, PyObject *args) {
+    pool_counters counters;
+    pool_get_counters(&counters);
+    return Py_BuildValue("{s:i,s:K,s:K,s:K,s:K}", "workers", pool_workers(),
+                         "jobs", (unsigned long long) counters.jobs,
+                         "tasks", (unsigned long long) counters.tasks,
+                         "steals", (unsigned long long) counters.steals,
+                         "sleeps", (unsigned long long) counters.sleeps);
+}
+
+/* TUNING */
+
+/*
+ * Where the tuning file lives: $NUMC_TUNING if set, else $XDG_CONFIG_HOME/numc/tuning.conf, else
+ * ~/.config/numc/tuning.conf. Return 0 upon success and -1 if there is no home to put it in.
+ */
+static int tuning_path(char *path, size_t size) {
+    const char *env = getenv("NUMC_TUNING");
+    const char *xdg = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+    int len;
+    if (env != NULL && env[0] != '\0') {
+        len = snprintf(path, size, "%s", env);
+    } else if (xdg != NULL && xdg[0] != '\0') {
+        len = snprintf(path, size, "%s/numc/tuning.conf", xdg);
+    } else if (home != NULL && home[0] != '\0') {
+        len = snprintf(path, size, "%s/.config/numc/tuning.conf", home);
+    } else {
+        return -1;
+    }
+    return len >= 0 && (size_t) len < size ? 0 : -1;
+}
+
+/*
+ * numc.tuning_path(). The file numc reads its tuning from at import, or None.
+ */
+PyObject *Matrix61c_class_tuning_path(PyObject *self, PyObject *args) {
+    char path[4096];
+    if (tuning_path(path, sizeof(path)) != 0) {
+        Py_RETURN_NONE;
+    }
+    return PyUnicode_DecodeFSDefault(path);
+}
+
+/*
+ * numc.tuning(). Return {name: value} for every tunable parameter currently in effect.
+ */
+PyObject *Matrix61c_class_tuning(PyObject *self, PyObject *args) {
+    PyObject *result = PyDict_New();
+    if (result == NULL) {
+        return NULL;
+    }
+    const char *name;
+    for (int i = 0; (name = tunable_name(i)) != NULL; i++) {
+        double value;
+        get_tunable(name, &value);
+        PyObject *item = tunable_is_int(i) ? PyLong_FromLong((long) value) : PyFloat_FromDouble(value);
+        if (item == NULL || PyDict_SetItemString(result, name, item) < 0) {
+            Py_XDECREF(item);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return result;
+}
+
+/*
+ * numc.set_tuning(**params), e.g. numc.set_tuning(mul_tile_rows=64). Unknown names raise
+ * KeyError and out-of-range values ValueError; parameters before the bad one are applied.
+ */
+PyObject *Matrix61c_class_set_tuning(PyObject *self, PyObject *args, PyObject *kwds) {
+    if (PyTuple_Size(args) != 0) {
+        PyErr_SetString(PyExc_TypeError, "set_tuning takes keyword arguments only");
+        return NULL;
+    }
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    while (kwds != NULL && PyDict_Next(kwds, &pos, &key, &value)) {
+        double number = PyFloat_AsDouble(value);
+        if (number == -1.0 && PyErr_Occurred()) {
+            return NULL;
+        }
+        int ret = set_tunable(PyUnicode_AsUTF8(key), number);
+        if (ret == -1) {
+            PyErr_SetObject(PyExc_KeyError, key);
+            return NULL;
+        }
+        if (ret == -2) {
+            PyErr_Format(PyExc_ValueError, "%U is out of range: %R", key, value);
+            return NULL;
+        }
+    }
+    Py_RETURN_NONE;
+}
+
+/*
+ * numc.load_tuning(path=None). Apply a tuning file, by default the one at tuning_path().
+ */
+PyObject *Matrix61c_class_load_tuning(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"path", NULL};
+    const char *path = NULL;
+    char defaultPath[4096];
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|z", kwlist, &path)) {
+        return NULL;
+    }
+    if (path == NULL) {
+        if (tuning_path(defaultPath, sizeof(defaultPath)) != 0) {
+            PyErr_SetString(PyExc_RuntimeError, "no tuning file: neither NUMC_TUNING nor HOME is set");
+            return NULL;
+        }
+        path = defaultPath;
+    }
+    int ret = load_tuning(path);
+    if (ret < 0) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    }
+    if (ret > 0) {
+        PyErr_Format(PyExc_ValueError, "%s:%d: malformed or out-of-range setting", path, ret);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+/* FUTURES */
+
+#define FUTURE_ADD 0
+#define FUTURE_SUB 1
+#define FUTURE_MUL 2
+#define FUTURE_NEG 3
+#define FUTURE_ABS 4
+
+/*
+ * Operations numc.submit accepts, by name or by a callable with that __name__ (operator.mul,
+ * abs, ...). pow is left out because it allocates, which needs the GIL to report failure.
+ */
+static const struct {
+    const char *name;
+    int op;
+    int operands;
+} future_ops[] = {
+    {"add", FUTURE_ADD, 2},
+    {"sub", FUTURE_SUB, 2},
+    {"mul", FUTURE_MUL, 2},
+    {"matmul", FUTURE_MUL, 2},
+    {"neg", FUTURE_NEG, 1},
+    {"abs", FUTURE_ABS, 1},
+};
+
+static void start_future(Future *future);
+
+/*
+ * Run the callbacks added with add_done_callback, with the GIL held. Errors are reported the
+ * way exceptions in __del__ are, since there is no caller to raise them to.
+ */
+static void run_callbacks(Future *future) {
+    PyObject *callbacks = future->callbacks;
+    future->callbacks = NULL;
+    for (Py_ssize_t i = 0; callbacks != NULL && i < PyList_GET_SIZE(callbacks); i++) {
+        PyObject *ret = PyObject_CallOneArg(PyList_GET_ITEM(callbacks, i), (PyObject *) future);
+        if (ret == NULL) {
+            PyErr_WriteUnraisable(PyList_GET_ITEM(callbacks, i));
+        }
+        Py_XDECREF(ret);
+    }
+    Py_XDECREF(callbacks);
+}
+
+/*
+ * Done Futures whose callbacks wait for the callback thread, oldest first. Pool workers cannot
+ * run callbacks themselves: taking the GIL there deadlocks as soon as the thread holding it is
+ * waiting in pool_for for those same workers, as every element-wise operator may be.
+ */
+static pthread_mutex_t callback_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t callback_cond = PTHREAD_COND_INITIALIZER;
+static Future *callback_head;
+static Future *callback_tail;
+static int callback_started;
+static pthread_once_t callback_atfork_once = PTHREAD_ONCE_INIT;
+
+static void *callback_thread(void *unused) {
+    for (;;) {
+        pthread_mutex_lock(&callback_lock);
+        while (callback_head == NULL) {
+            pthread_cond_wait(&callback_cond, &callback_lock);
+        }
+        Future *batch = callback_head;
+        callback_head = NULL;
+        callback_tail = NULL;
+        pthread_mutex_unlock(&callback_lock);
+        PyGILState_STATE gil = PyGILState_Ensure();
+        while (batch != NULL) {
+            Future *next = batch->next_callback;
+            batch->next_callback = NULL;
+            run_callbacks(batch);
+            Py_DECREF(batch);
+            batch = next;
+        }
+        PyGILState_Release(gil);
+    }
+    return NULL;
+}
+
+/*
+ * A forked child has no callback thread, and callback_lock may have been held at the fork.
+ * Futures queued then belong to the parent's pool and are left behind.
+ */
+static void reset_callbacks_after_fork(void) {
+    pthread_mutex_init(&callback_lock, NULL);
+    pthread_cond_init(&callback_cond, NULL);
+    callback_head = NULL;
+    callback_tail = NULL;
+    callback_started = 0;
+}
+
+static void register_callbacks_atfork(void) {
+    pthread_atfork(NULL, NULL, reset_callbacks_after_fork);
+}
+
+/*
+ * Start the callback thread unless it is running. Called with the GIL held, which serializes it.
+ * Return 0 upon success and -1 with an exception set otherwise.
+ */
+static int start_callback_thread(void) {
+    pthread_once(&callback_atfork_once, register_callbacks_atfork);
+    if (callback_started) {
+        return 0;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, callback_thread, NULL) != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "cannot start the numc callback thread");
+        return -1;
+    }
+    pthread_detach(thread);
+    callback_started = 1;
+    return 0;
+}
+
+/*
+ * Hand `future`, with the reference its `owner` held, to the callback thread.
+ */
+static void queue_callbacks(Future *future) {
+    pthread_mutex_lock(&callback_lock);
+    if (callback_tail != NULL) {
+        callback_tail->next_callback = future;
+    } else {
+        callback_head = future;
+    }
+    callback_tail = future;
+    pthread_cond_signal(&callback_cond);
+    pthread_mutex_unlock(&callback_lock);
+}
+
+/*
+ * Mark `future` done and release what waits on it: threads in result(), Futures that take it as
+ * an operand, and callbacks. Nothing may touch `future` after the unlock unless `owner` keeps it
+ * alive, since a thread in Future_dealloc may be waiting to free it.
+ */
+static void complete_future(Future *future) {
+    pthread_mutex_lock(&future->lock);
+    future->done = 1;
+    future_link *dependents = future->dependents;
+    future->dependents = NULL;
+    PyObject *owner = future->owner;
+    future->owner = NULL;
+    pthread_cond_broadcast(&future->cond);
+    pthread_mutex_unlock(&future->lock);
+    while (dependents != NULL) {
+        future_link *next = dependents->next;
+        if (__atomic_sub_fetch(&dependents->future->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+            start_future(dependents->future);
+        }
+        free(dependents);
+        dependents = next;
+    }
+    if (owner != NULL) {
+        queue_callbacks((Future *) owner);
+    }
+}
+
+/*
+ * The pool task of a Future: run its kernel under the thread cap it was submitted with.
+ */
+static void run_future(void *args) {
+    Future *future = args;
+    matrix *out = future->value->mat;
+    int saved = set_call_threads(future->threads);
+    switch (future->op) {
+        case FUTURE_ADD:
+            add_matrix(out, future->in1, future->in2);
+            break;
+        case FUTURE_SUB:
+            sub_matrix(out, future->in1, future->in2);
+            break;
+        case FUTURE_MUL:
+            mul_matrix(out, future->in1, future->in2);
+            break;
+        case FUTURE_NEG:
+            neg_matrix(out, future->in1);
+            break;
+        case FUTURE_ABS:
+            abs_matrix(out, future->in1);
+            break;
+    }
+    set_call_threads(saved);
+    complete_future(future);
+}
+
+/*
+ * Queue a Future whose operands are all ready. If the pool cannot take it, run it here.
+ */
+static void start_future(Future *future) {
+    if (pool_submit(future->threads, run_future, future) != 0) {
+        run_future(future);
+    }
+}
+
+/*
+ * The matrix behind an operand of numc.submit, which is either a Matrix or a Future whose value
+ * will be filled in. Return NULL with a TypeError set otherwise.
+ */
+static matrix *operand_matrix(PyObject *operand) {
+    if (PyObject_TypeCheck(operand, &Matrix61cType)) {
+        return ((Matrix61c *) operand)->mat;
+    }
+    if (PyObject_TypeCheck(operand, &FutureType)) {
+        return ((Future *) operand)->value->mat;
+    }
+    PyErr_SetString(PyExc_TypeError, "operands must be numc.Matrix or numc.Future objects");
+    return NULL;
+}
+
+/*
+ * Create and queue a Future for `op` on `operands`, which the Future keeps a reference to.
+ * Shapes are checked here so that the kernel cannot fail later on a worker.
+ */
+static PyObject *submit_future(int op, PyObject *operands, int threads) {
+    matrix *in1 = operand_matrix(PyTuple_GET_ITEM(operands, 0));
+    matrix *in2 = PyTuple_GET_SIZE(operands) > 1 ? operand_matrix(PyTuple_GET_ITEM(operands, 1)) : NULL;
+    if (in1 == NULL || (PyTuple_GET_SIZE(operands) > 1 && in2 == NULL)) {
+        return NULL;
+    }
+    Py_ssize_t rows = in1->rows;
+    Py_ssize_t cols = in1->cols;
+    if ((op == FUTURE_ADD || op == FUTURE_SUB) && (in2->rows != rows || in2->cols != cols)) {
+        PyErr_SetString(PyExc_ValueError, "Dimensions of matricies don't match!");
+        return NULL;
+    }
+    if (op == FUTURE_MUL) {
+        if (in1->cols != in2->rows) {
+            PyErr_SetString(PyExc_ValueError, "Dimensions of matricies don't match!");
+            return NULL;
+        }
+        cols = in2->cols;
+    }
+    Matrix61c *value = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
+    if (value == NULL) {
+        return NULL;
+    }
+    if (allocate_matrix(&value->mat, rows, cols) != 0) {
+        value->mat = NULL;
+        Py_DECREF(value);
+        return NULL;
+    }
+    value->shape = get_shape(rows, cols);
+    Future *future = (Future *) FutureType.tp_alloc(&FutureType, 0);
+    if (future == NULL) {
+        Py_DECREF(value);
+        return NULL;
+    }
+    pthread_mutex_init(&future->lock, NULL);
+    pthread_cond_init(&future->cond, NULL);
+    future->op = op;
+    future->threads = threads > 0 ? threads : get_num_threads();
+    future->in1 = in1;
+    future->in2 = in2;
+    Py_INCREF(operands);
+    future->operands = operands;
+    future->value = value;
+    future->pending = 1;
+
+    /* Chain onto operands that are still being computed rather than waiting for them here */
+    for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(operands); i++) {
+        PyObject *operand = PyTuple_GET_ITEM(operands, i);
+        if (!PyObject_TypeCheck(operand, &FutureType)) {
+            continue;
+        }
+        Future *input = (Future *) operand;
+        future_link *link = malloc(sizeof(future_link));
+        pthread_mutex_lock(&input->lock);
+        int waiting = !input->done;
+        if (waiting && link != NULL) {
+            link->future = future;
+            link->next = input->dependents;
+            input->dependents = link;
+            future->pending++;
+            waiting = 0;
+            link = NULL;
+        }
+        pthread_mutex_unlock(&input->lock);
+        free(link);
+        if (waiting) {
+            /* Out of memory for the link: wait for the operand instead */
+            Py_BEGIN_ALLOW_THREADS
+            pthread_mutex_lock(&input->lock);
+            while (!input->done) {
+                pthread_cond_wait(&input->cond, &input->lock);
+            }
+            pthread_mutex_unlock(&input->lock);
+            Py_END_ALLOW_THREADS
+        }
+    }
+    if (__atomic_sub_fetch(&future->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        Py_BEGIN_ALLOW_THREADS
+        start_future(future);
+        Py_END_ALLOW_THREADS
+    }
+    return (PyObject *) future;
+}
+
+/*
+ * numc.submit(op, *operands, threads=0). Start `op` ("add", "sub", "mul" or "matmul", "neg",
+ * "abs", or a callable with one of those names such as operator.mul) on numc's worker threads
+ * and return a numc.Future right away. Operands may be Futures themselves, in which case the
+ * operation starts once they are done, without blocking the caller.
+ */
+PyObject *Matrix61c_class_submit(PyObject *self, PyObject *args, PyObject *kwds) {
+    int threads = 0;
+    if (kwds != NULL) {
+        static char *kwlist[] = {"threads", NULL};
+        PyObject *empty = PyTuple_New(0);
+        int ok = empty != NULL && PyArg_ParseTupleAndKeywords(empty, kwds, "|$i", kwlist, &threads);
+        Py_XDECREF(empty);
+        if (!ok || check_threads(threads) < 0) {
+            return NULL;
+        }
+    }
+    if (PyTuple_GET_SIZE(args) < 1) {
+        PyErr_SetString(PyExc_TypeError, "submit() needs an operation");
+        return NULL;
+    }
+    PyObject *op = PyTuple_GET_ITEM(args, 0);
+    PyObject *name = PyUnicode_Check(op) ? (Py_INCREF(op), op) : PyObject_GetAttrString(op, "__name__");
+    if (name == NULL || !PyUnicode_Check(name)) {
+        Py_XDECREF(name);
+        PyErr_SetString(PyExc_TypeError, "operation must be a name or a named callable");
+        return NULL;
+    }
+    const char *text = PyUnicode_AsUTF8(name);
+    int found = -1;
+    for (size_t i = 0; text != NULL && i < sizeof(future_ops) / sizeof(future_ops[0]); i++) {
+        if (strcmp(future_ops[i].name, text) == 0) {
+            found = (int) i;
+        }
+    }
+    if (found < 0) {
+        if (text != NULL) {
+            PyErr_Format(PyExc_ValueError, "unsupported operation '%s'", text);
+        }
+        Py_DECREF(name);
+        return NULL;
+    }
+    Py_DECREF(name);
+    if (PyTuple_GET_SIZE(args) - 1 != future_ops[found].operands) {
+        PyErr_Format(PyExc_TypeError, "%s takes %d operand(s)", future_ops[found].name,
+                     future_ops[found].operands);
+        return NULL;
+    }
+    PyObject *operands = PyTuple_GetSlice(args, 1, PyTuple_GET_SIZE(args));
+    if (operands == NULL) {
+        return NULL;
+    }
+    PyObject *future = submit_future(future_ops[found].op, operands, threads);
+    Py_DECREF(operands);
+    return future;
+}
+
+/*
+ * Dropping the last reference to a Future that is still running waits for it, since its worker
+ * writes into `value` and reads the operands.
+ */
+void Future_dealloc(Future *self) {
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->lock);
+    while (!self->done) {
+        pthread_cond_wait(&self->cond, &self->lock);
+    }
+    pthread_mutex_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+    pthread_mutex_destroy(&self->lock);
+    pthread_cond_destroy(&self->cond);
+    Py_XDECREF(self->operands);
+    Py_XDECREF(self->value);
+    Py_XDECREF(self->callbacks);
+    Py_TYPE(self)->tp_free(self);
+}
+
+PyObject *Future_done(Future *self, PyObject *args) {
+    pthread_mutex_lock(&self->lock);
+    int done = self->done;
+    pthread_mutex_unlock(&self->lock);
+    return PyBool_FromLong(done);
+}
+
+/*
+ * future.result(timeout=None). Wait for the result and return it as a numc.Matrix, raising
+ * TimeoutError if `timeout` seconds pass first. The wait wakes up every 100ms to let signal
+ * handlers (KeyboardInterrupt) run.
+ */
+PyObject *Future_result(Future *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"timeout", NULL};
+    PyObject *timeoutObj = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &timeoutObj)) {
+        return NULL;
+    }
+    double timeout = -1;
+    if (timeoutObj != Py_None) {
+        timeout = PyFloat_AsDouble(timeoutObj);
+        if (timeout == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+        /* NaN waits no time; a billion seconds (over 30 years) keeps the deadline in range */
+        timeout = timeout > 0 ? (timeout < 1e9 ? timeout : 1e9) : 0;
+    }
+    uint64_t deadline = 0;
+    if (timeout >= 0) {
+        deadline = stats_now() + (uint64_t) (timeout * 1e9);
+    }
+    int done = 0;
+    for (;;) {
+        uint64_t slice = 100000000;
+        if (timeout >= 0) {
+            uint64_t now = stats_now();
+            uint64_t left = now < deadline ? deadline - now : 0;
+            slice = left < slice ? left : slice;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += slice;
+        until.tv_sec += until.tv_nsec / 1000000000;
+        until.tv_nsec %= 1000000000;
+        pthread_mutex_lock(&self->lock);
+        while (!self->done && pthread_cond_timedwait(&self->cond, &self->lock, &until) == 0) {
+        }
+        done = self->done;
+        pthread_mutex_unlock(&self->lock);
+        Py_END_ALLOW_THREADS
+        if (done) {
+            break;
+        }
+        if (PyErr_CheckSignals() < 0) {
+            return NULL;
+        }
+        if (timeout >= 0 && stats_now() >= deadline) {
+            PyErr_SetString(PyExc_TimeoutError, "numc.Future result not ready");
+            return NULL;
+        }
+    }
+    Py_INCREF(self->value);
+    return (PyObject *) self->value;
+}
+
+/*
+ * future.add_done_callback(fn). Call fn(future) once the result is ready: right away if it
+ * already is, else from numc's callback thread, with the GIL held.
+ */
+PyObject *Future_add_done_callback(Future *self, PyObject *fn) {
+    if (!PyCallable_Check(fn)) {
+        PyErr_SetString(PyExc_TypeError, "callback must be callable");
+        return NULL;
+    }
+    if (start_callback_thread() != 0) {
+        return NULL;
+    }
+    if (self->callbacks == NULL && (self->callbacks = PyList_New(0)) == NULL) {
+        return NULL;
+    }
+    if (PyList_Append(self->callbacks, fn) < 0) {
+        return NULL;
+    }
+    pthread_mutex_lock(&self->lock);
+    int done = self->done;
+    if (!done && self->owner == NULL) {
+        Py_INCREF(self);
+        self->owner = (PyObject *) self;
+    }
+    pthread_mutex_unlock(&self->lock);
+    if (done) {
+        /* Too late for the worker: run this and any others left over here */
+        PyObject *callbacks = self->callbacks;
+        self->callbacks = NULL;
+        for (Py_ssize_t i = 0; callbacks != NULL && i < PyList_GET_SIZE(callbacks); i++) {
+            PyObject *ret = PyObject_CallOneArg(PyList_GET_ITEM(callbacks, i), (PyObject *) self);
+            if (ret == NULL) {
+                Py_DECREF(callbacks);
+                return NULL;
+            }
+            Py_DECREF(ret);
+        }
+        Py_XDECREF(callbacks);
+    }
+    Py_RETURN_NONE;
+}
+
+/*
+ * Resolve an asyncio future with a Future's value unless it was cancelled; runs on the event
+ * loop via call_soon_threadsafe. `args` is (asyncio future, value).
+ */
+static PyObject *resolve_awaiter(PyObject *unused, PyObject *args) {
+    PyObject *awaiter = PyTuple_GET_ITEM(args, 0);
+    PyObject *done = PyObject_CallMethod(awaiter, "done", NULL);
+    if (done == NULL) {
+        return NULL;
+    }
+    int isDone = PyObject_IsTrue(done);
+    Py_DECREF(done);
+    if (isDone) {
+        Py_RETURN_NONE;
+    }
+    return PyObject_CallMethod(awaiter, "set_result", "O", PyTuple_GET_ITEM(args, 1));
+}
+
+static PyMethodDef resolve_awaiter_def = {"resolve_awaiter", resolve_awaiter, METH_VARARGS, NULL};
+
+/*
+ * The done callback behind `await future`: hand the value over to the loop's thread. `state` is
+ * (loop, asyncio future, resolve_awaiter).
+ */
+static PyObject *wake_awaiter(PyObject *state, PyObject *future) {
+    return PyObject_CallMethod(PyTuple_GET_ITEM(state, 0), "call_soon_threadsafe", "OOO",
+                               PyTuple_GET_ITEM(state, 2), PyTuple_GET_ITEM(state, 1),
+                               ((Future *) future)->value);
+}
+
+static PyMethodDef wake_awaiter_def = {"wake_awaiter", wake_awaiter, METH_O, NULL};
+
+/*
+ * `await future` from asyncio: wait on an asyncio future of the running loop that a done
+ * callback resolves with the value, so the loop keeps running other tasks meanwhile.
+ */
+PyObject *Future_await(Future *self) {
+    PyObject *asyncio = PyImport_ImportModule("asyncio");
+    if (asyncio == NULL) {
+        return NULL;
+    }
+    PyObject *loop = PyObject_CallMethod(asyncio, "get_running_loop", NULL);
+    Py_DECREF(asyncio);
+    if (loop == NULL) {
+        return NULL;
+    }
+    PyObject *awaiter = PyObject_CallMethod(loop, "create_future", NULL);
+    PyObject *resolve = PyCFunction_New(&resolve_awaiter_def, NULL);
+    PyObject *state = awaiter != NULL && resolve != NULL ? PyTuple_Pack(3, loop, awaiter, resolve) : NULL;
+    PyObject *wake = state != NULL ? PyCFunction_New(&wake_awaiter_def, state) : NULL;
+    PyObject *added = wake != NULL ? Future_add_done_callback(self, wake) : NULL;
+    PyObject *iter = added != NULL ? PyObject_CallMethod(awaiter, "__await__", NULL) : NULL;
+    Py_XDECREF(added);
+    Py_XDECREF(wake);
+    Py_XDECREF(state);
+    Py_XDECREF(resolve);
+    Py_XDECREF(awaiter);
+    Py_DECREF(loop);
+    return iter;
+}
+
+PyObject *Future_repr(Future *self) {
+    pthread_mutex_lock(&self->lock);
+    int done = self->done;
+    pthread_mutex_unlock(&self->lock);
+    return PyUnicode_FromFormat("<numc.Future %s %R>", done ? "done" : "pending", self->value->shape);
+}
+
+PyMethodDef Future_methods[] = {
+    {"result", (PyCFunction)Future_result, METH_VARARGS | METH_KEYWORDS, "Waits for and returns the result Matrix"},
+    {"done", (PyCFunction)Future_done, METH_NOARGS, "Whether the result is ready"},
+    {"add_done_callback", (PyCFunction)Future_add_done_callback, METH_O, "Calls fn(future) once the result is ready"},
+    {NULL, NULL, 0, NULL}
+};
+
+PyAsyncMethods Future_as_async = {
+    .am_await = (unaryfunc)Future_await,
+};
+
+PyTypeObject FutureType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "numc.Future",
+    .tp_basicsize = sizeof(Future),
+    .tp_dealloc = (destructor)Future_dealloc,
+    .tp_repr = (reprfunc)Future_repr,
+    .tp_as_async = &Future_as_async,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "The pending result of numc.submit or Matrix.matmul_async",
+    .tp_methods = Future_methods,
+};
+
+/* LINEAR ALGEBRA */
+
+static PyObject *LinAlgError;
+
+/*
+ * Raise the Python exception for a LINALG_* code and return NULL.
+ */
+static PyObject *linalg_error(int code) {
+    if (code == LINALG_SINGULAR) {
+        PyErr_SetString(LinAlgError, "Singular matrix");
+    } else if (code == LINALG_NOT_SPD) {
+        PyErr_SetString(LinAlgError, "Matrix is not positive definite");
+    } else if (code == LINALG_NO_CONVERGENCE) {
+        PyErr_SetString(LinAlgError, "Did not converge");
+    } else if (code == LINALG_TOO_LARGE) {
+        PyErr_SetString(PyExc_ValueError, "Matrix dimensions are too large for linalg");
+    } else {
+        PyErr_NoMemory();
+    }
+    return NULL;
+}
+
+/*
+ * The matrix behind a square numc.Matrix argument, or NULL with an exception set.
+ */
+static matrix *square_operand(PyObject *obj, const char *name) {
+    if (!PyObject_TypeCheck(obj, &Matrix61cType)) {
+        PyErr_Format(PyExc_TypeError, "%s must be a numc.Matrix", name);
+        return NULL;
+    }
+    matrix *mat = ((Matrix61c *) obj)->mat;
+    if (mat->rows != mat->cols) {
+        PyErr_Format(LinAlgError, "%s must be square, not %zd x %zd", name, mat->rows, mat->cols);
+        return NULL;
+    }
+    return mat;
+}
+
+/*
+ * Factor `a` without holding the GIL. Return 0 or a LINALG_* code.
+ */
+static int factor_unlocked(lu_factors *lu, matrix *a) {
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = lu_factor(lu, a);
+    Py_END_ALLOW_THREADS
+    return ret;
+}
+
+/*
+ * An n x 1 matrix over the elements of the vector `vec`, whose row pointers go in `rows`.
+ */
+static matrix column_view(matrix *vec, double **rows) {
+    Py_ssize_t n = vec->rows * vec->cols;
+    for (Py_ssize_t e = 0; e < n; e++) {
+        rows[e] = vec->data[e / vec->cols] + e % vec->cols * vec->stride;
+    }
+    matrix view = {n, 1, rows, 1, 1, 0, NULL};
+    return view;
+}
+
+/*
+ * The right-hand side and solution of a solve against an m x n system. A vector B is handled as
+ * a column, through views whose row pointers live in `rows`.
+ */
+typedef struct solve_operands {
+    matrix *b;
+    matrix *x;
+    matrix bColumn;
+    matrix xColumn;
+    double **rows;
+} solve_operands;
+
+/*
+ * Check the right-hand side `bObj` of an m x n system, which must have m rows or be a vector of
+ * m elements, and allocate the n-row result (or n-element vector) to solve it into. Return the
+ * result, or NULL with an exception set. Release `ops` with solve_operands_free either way.
+ */
+static Matrix61c *solve_operands_init(solve_operands *ops, PyObject *bObj, Py_ssize_t m, Py_ssize_t n) {
+    ops->rows = NULL;
+    if (!PyObject_TypeCheck(bObj, &Matrix61cType)) {
+        PyErr_SetString(PyExc_TypeError, "B must be a numc.Matrix");
+        return NULL;
+    }
+    matrix *b = ((Matrix61c *) bObj)->mat;
+    int vector = b->is_1d && b->rows * b->cols == m;
+    if (!vector && b->rows != m) {
+        PyErr_SetString(PyExc_ValueError, "Dimensions of matricies don't match!");
+        return NULL;
+    }
+    Matrix61c *result = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
+    if (result == NULL) {
+        return NULL;
+    }
+    Py_ssize_t rows = vector && b->rows == 1 ? 1 : n;
+    Py_ssize_t cols = vector && b->rows == 1 ? n : b->cols;
+    if (allocate_matrix(&result->mat, rows, cols) != 0) {
+        result->mat = NULL;
+        Py_DECREF(result);
+        return NULL;
+    }
+    result->shape = get_shape(rows, cols);
+    ops->b = b;
+    ops->x = result->mat;
+    if (vector) {
+        ops->rows = PyMem_Malloc((m + n) * sizeof(double *));
+        if (ops->rows == NULL) {
+            Py_DECREF(result);
+            PyErr_NoMemory();
+            return NULL;
+        }
+        ops->bColumn = column_view(b, ops->rows);
+        ops->xColumn = column_view(result->mat, ops->rows + m);
+        ops->b = &ops->bColumn;
+        ops->x = &ops->xColumn;
+    }
+    return result;
+}
+
+static void solve_operands_free(solve_operands *ops) {
+    PyMem_Free(ops->rows);
+    ops->rows = NULL;
+}
+
+/*
+ * numc.solve(A, B). Solve A X = B for a square A and a right-hand side B with as many rows as A,
+ * or a vector as long as A is wide, which gives a vector back. Raises numc.LinAlgError if A is
+ * singular.
+ */
+PyObject *Matrix61c_class_solve(PyObject *self, PyObject *args) {
+    PyObject *aObj, *bObj;
+    if (!PyArg_ParseTuple(args, "OO", &aObj, &bObj)) {
+        return NULL;
+    }
+    matrix *a = square_operand(aObj, "A");
+    if (a == NULL) {
+        return NULL;
+    }
+    solve_operands ops;
+    Matrix61c *result = solve_operands_init(&ops, bObj, a->rows, a->rows);
+    if (result == NULL) {
+        return NULL;
+    }
+    lu_factors lu;
+    int ret = factor_unlocked(&lu, a);
+    if (ret == 0) {
+        Py_BEGIN_ALLOW_THREADS
+        ret = lu_solve(&lu, ops.b, ops.x);
+        lu_free(&lu);
+        Py_END_ALLOW_THREADS
+    }
+    solve_operands_free(&ops);
+    if (ret != 0) {
+        Py_DECREF(result);
+        return linalg_error(ret);
+    }
+    return (PyObject *) result;
+}
+
+/*
+ * numc.det(A). The determinant of a square matrix, from its LU factorization.
+ */
+PyObject *Matrix61c_class_det(PyObject *self, PyObject *args) {
+    PyObject *aObj;
+    if (!PyArg_ParseTuple(args, "O", &aObj)) {
+        return NULL;
+    }
+    matrix *a = square_operand(aObj, "A");
+    if (a == NULL) {
+        return NULL;
+    }
+    lu_factors lu;
+    int ret = factor_unlocked(&lu, a);
+    if (ret != 0) {
+        return linalg_error(ret);
+    }
+    double det = lu_det(&lu);
+    lu_free(&lu);
+    return PyFloat_FromDouble(det);
+}
+
+/*
+ * numc.inv(A). The inverse of a square matrix, by solving A X = I. Raises numc.LinAlgError if A
+ * is singular.
+ */
+PyObject *Matrix61c_class_inv(PyObject *self, PyObject *args) {
+    PyObject *aObj;
+    if (!PyArg_ParseTuple(args, "O", &aObj)) {
+        return NULL;
+    }
+    matrix *a = square_operand(aObj, "A");
+    if (a == NULL) {
+        return NULL;
+    }
+    Py_ssize_t n = a->rows;
+    Matrix61c *result = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
+    if (result == NULL) {
+        return NULL;
+    }
+    if (allocate_matrix(&result->mat, n, n) != 0) {
+        result->mat = NULL;
+        Py_DECREF(result);
+        return NULL;
+    }
+    result->shape = get_shape(n, n);
+    lu_factors lu;
+    int ret = factor_unlocked(&lu, a);
+    if (ret == 0) {
+        Py_BEGIN_ALLOW_THREADS
+        for (Py_ssize_t i = 0; i < n; i++) {
+            result->mat->data[i][i] = 1;
+        }
+        ret = lu_solve(&lu, result->mat, result->mat);
+        lu_free(&lu);
+        Py_END_ALLOW_THREADS
+    }
+    if (ret != 0) {
+        Py_DECREF(result);
+        return linalg_error(ret);
+    }
+    return (PyObject *) result;
+}
+
+/*
+ * numc.cholesky(A). The lower triangular L with A = L * L^T for a symmetric positive definite A,
+ * of which only the lower triangle is read. Raises numc.LinAlgError if A is not positive definite.
+ */
+PyObject *Matrix61c_class_cholesky(PyObject *self, PyObject *args) {
+    PyObject *aObj;
+    if (!PyArg_ParseTuple(args, "O", &aObj)) {
+        return NULL;
+    }
+    matrix *a = square_operand(aObj, "A");
+    if (a == NULL) {
+        return NULL;
+    }
+    Py_ssize_t n = a->rows;
+    Matrix61c *result = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
+    if (result == NULL) {
+        return NULL;
+    }
+    if (allocate_matrix(&result->mat, n, n) != 0) {
+        result->mat = NULL;
+        Py_DECREF(result);
+        return NULL;
+    }
+    result->shape = get_shape(n, n);
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = chol_factor(result->mat, a);
+    Py_END_ALLOW_THREADS
+    if (ret != 0) {
+        Py_DECREF(result);
+        return linalg_error(ret);
+    }
+    return (PyObject *) result;
+}
+
+/*
+ * numc.cho_solve(L, B). Solve A X = B given the Cholesky factor L of A, as returned by
+ * numc.cholesky. B is as for numc.solve.
+ */
+PyObject *Matrix61c_class_cho_solve(PyObject *self, PyObject *args) {
+    PyObject *lObj, *bObj;
+    if (!PyArg_ParseTuple(args, "OO", &lObj, &bObj)) {
+        return NULL;
+    }
+    matrix *l = square_operand(lObj, "L");
+    if (l == NULL) {
+        return NULL;
+    }
+    solve_operands ops;
+    Matrix61c *result = solve_operands_init(&ops, bObj, l->rows, l->rows);
+    if (result == NULL) {
+        return NULL;
+    }
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = chol_solve(l, ops.b, ops.x);
+    Py_END_ALLOW_THREADS
+    solve_operands_free(&ops);
+    if (ret != 0) {
+        Py_DECREF(result);
+        return linalg_error(ret);
+    }
+    return (PyObject *) result;
+}
+
+/*
+ * numc.trsm(T, B, lower=True). Solve T X = B for the triangle in the lower (or upper) part of the
+ * square T; the other part is ignored. B is as for numc.solve. Raises numc.LinAlgError if the
+ * triangle has a zero on its diagonal.
+ */
+PyObject *Matrix61c_class_trsm(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"T", "B", "lower", NULL};
+    PyObject *tObj, *bObj;
+    int lower = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|p", kwlist, &tObj, &bObj, &lower)) {
+        return NULL;
+    }
+    matrix *t = square_operand(tObj, "T");
+    if (t == NULL) {
+        return NULL;
+    }
+    solve_operands ops;
+    Matrix61c *result = solve_operands_init(&ops, bObj, t->rows, t->rows);
+    if (result == NULL) {
+        return NULL;
+    }
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = tri_solve(t, lower, 0, ops.b, ops.x);
+    Py_END_ALLOW_THREADS
+    solve_operands_free(&ops);
+    if (ret != 0) {
+        Py_DECREF(result);
+        return linalg_error(ret);
+    }
+    return (PyObject *) result;
+}
+
+/*
+ * numc.qr(A). The thin QR factorization of A as a tuple (Q, R): for an m x n A, Q is m x min(m, n)
+ * with orthonormal columns and R is min(m, n) x n upper triangular, with A = Q * R.
+ */
+PyObject *Matrix61c_class_qr(PyObject *self, PyObject *args) {
+    PyObject *aObj;
+    if (!PyArg_ParseTuple(args, "O", &aObj)) {
+        return NULL;
+    }
+    if (!PyObject_TypeCheck(aObj, &Matrix61cType)) {
+        PyErr_SetString(PyExc_TypeError, "A must be a numc.Matrix");
+        return NULL;
+    }
+    matrix *a = ((Matrix61c *) aObj)->mat;
+    Py_ssize_t m = a->rows;
+    Py_ssize_t n = a->cols;
+    Py_ssize_t k = m < n ? m : n;
+    Matrix61c *q = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
+    Matrix61c *r = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
+    if (q == NULL || r == NULL) {
+        Py_XDECREF(q);
+        Py_XDECREF(r);
+        return NULL;
+    }
+    if (allocate_matrix(&q->mat, m, k) != 0) {
+        q->mat = NULL;
+        Py_DECREF(q);
+        Py_DECREF(r);
+        return NULL;
+    }
+    if (allocate_matrix(&r->mat, k, n) != 0) {
+        r->mat = NULL;
+        Py_DECREF(q);
+        Py_DECREF(r);
+        return NULL;
+    }
+    q->shape = get_shape(m, k);
+    r->shape = get_shape(k, n);
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = qr_decompose(a, q->mat, r->mat);
+    Py_END_ALLOW_THREADS
+    if (ret != 0) {
+        Py_DECREF(q);
+        Py_DECREF(r);
+        return linalg_error(ret);
+    }
+    PyObject *pair = PyTuple_Pack(2, q, r);
+    Py_DECREF(q);
+    Py_DECREF(r);
+    return pair;
+}
+
+/*
+ * numc.lstsq(A, b). The least-squares solution x of A x = b for an m x n A with m >= n and full
+ * column rank, from its QR factorization. b has m rows, or is a vector of m elements, which gives
+ * a vector of n back. Raises numc.LinAlgError if A is rank deficient.
+ */
+PyObject *Matrix61c_class_lstsq(PyObject *self, PyObject *args) {
+    PyObject *aObj, *bObj;
+    if (!PyArg_ParseTuple(args, "OO", &aObj, &bObj)) {
+        return NULL;
+    }
+    if (!PyObject_TypeCheck(aObj, &Matrix61cType)) {
+        PyErr_SetString(PyExc_TypeError, "A must be a numc.Matrix");
+        return NULL;
+    }
+    matrix *a = ((Matrix61c *) aObj)->mat;
+    if (a->rows < a->cols) {
+        PyErr_Format(LinAlgError, "A must have at least as many rows as columns, not %zd x %zd",
+                     a->rows, a->cols);
+        return NULL;
+    }
+    solve_operands ops;
+    Matrix61c *result = solve_operands_init(&ops, bObj, a->rows, a->cols);
+    if (result == NULL) {
+        return NULL;
+    }
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = qr_lstsq(a, ops.b, ops.x);
+    Py_END_ALLOW_THREADS
+    solve_operands_free(&ops);
+    if (ret != 0) {
+        Py_DECREF(result);
+        return linalg_error(ret);
+    }
+    return (PyObject *) result;
+}
+
+/*
+ * A new rows x cols numc.Matrix for a result, or NULL with an exception set.
+ */
+static Matrix61c *linalg_result(Py_ssize_t rows, Py_ssize_t cols) {
+    Matrix61c *result = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
+    if (result == NULL) {
+        return NULL;
+    }
+    if (allocate_matrix(&result->mat, rows, cols) != 0) {
+        result->mat = NULL;
+        Py_DECREF(result);
+        return NULL;
+    }
+    result->shape = get_shape(rows, cols);
+    return result;
+}
+
+/*
+ * numc.eigh(A). The eigendecomposition of a symmetric matrix, of which only the lower triangle is
+ * read, as a tuple (w, V): the eigenvalues in ascending order as a vector and the matching
+ * eigenvectors as the columns of V, with A = V * diag(w) * V^T.
+ */
+PyObject *Matrix61c_class_eigh(PyObject *self, PyObject *args) {
+    PyObject *aObj;
+    if (!PyArg_ParseTuple(args, "O", &aObj)) {
+        return NULL;
+    }
+    matrix *a = square_operand(aObj, "A");
+    if (a == NULL) {
+        return NULL;
+    }
+    Py_ssize_t n = a->rows;
+    Matrix61c *w = linalg_result(1, n);
+    Matrix61c *v = w != NULL ? linalg_result(n, n) : NULL;
+    if (v == NULL) {
+        Py_XDECREF(w);
+        return NULL;
+    }
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = sym_eigen(a, w->mat->data[0], v->mat);
+    Py_END_ALLOW_THREADS
+    if (ret != 0) {
+        Py_DECREF(w);
+        Py_DECREF(v);
+        return linalg_error(ret);
+    }
+    PyObject *pair = PyTuple_Pack(2, w, v);
+    Py_DECREF(w);
+    Py_DECREF(v);
+    return pair;
+}
+
+/*
+ * numc.svd(A). The thin singular value decomposition of an m x n matrix as a tuple (U, S, Vh):
+ * with k = min(m, n), U is m x k with orthonormal columns, S the k singular values in descending
+ * order as a vector and Vh the k x n V^T, with A = U * diag(S) * Vh.
+ */
+PyObject *Matrix61c_class_svd(PyObject *self, PyObject *args) {
+    PyObject *aObj;
+    if (!PyArg_ParseTuple(args, "O", &aObj)) {
+        return NULL;
+    }
+    if (!PyObject_TypeCheck(aObj, &Matrix61cType)) {
+        PyErr_SetString(PyExc_TypeError, "A must be a numc.Matrix");
+        return NULL;
+    }
+    matrix *a = ((Matrix61c *) aObj)->mat;
+    Py_ssize_t m = a->rows;
+    Py_ssize_t n = a->cols;
+    Py_ssize_t k = m < n ? m : n;
+    Matrix61c *u = linalg_result(m, k);
+    Matrix61c *s = u != NULL ? linalg_result(1, k) : NULL;
+    Matrix61c *vt = s != NULL ? linalg_result(k, n) : NULL;
+    if (vt == NULL) {
+        Py_XDECREF(u);
+        Py_XDECREF(s);
+        return NULL;
+    }
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = svd_decompose(a, u->mat, s->mat->data[0], vt->mat);
+    Py_END_ALLOW_THREADS
+    if (ret != 0) {
+        Py_DECREF(u);
+        Py_DECREF(s);
+        Py_DECREF(vt);
+        return linalg_error(ret);
+    }
+    PyObject *triple = PyTuple_Pack(3, u, s, vt);
+    Py_DECREF(u);
+    Py_DECREF(s);
+    Py_DECREF(vt);
+    return triple;
+}
+
+/*
+ * The element-wise functions: numc.exp, log, sqrt, tanh, sigmoid and power.
+ */
+#define UFUNC_EXP 0
+#define UFUNC_LOG 1
+#define UFUNC_SQRT 2
+#define UFUNC_TANH 3
+#define UFUNC_SIGMOID 4
+#define UFUNC_POWER 5
+
+static void run_ufunc(int op, matrix *result, matrix *mat, double exponent) {
+    switch (op) {
+        case UFUNC_EXP:
+            exp_matrix(result, mat);
+            break;
+        case UFUNC_LOG:
+            log_matrix(result, mat);
+            break;
+        case UFUNC_SQRT:
+            sqrt_matrix(result, mat);
+            break;
+        case UFUNC_TANH:
+            tanh_matrix(result, mat);
+            break;
+        case UFUNC_SIGMOID:
+            sigmoid_matrix(result, mat);
+            break;
+        default:
+            power_matrix(result, mat, exponent);
+    }
+}
+
+/*
+ * `op` of every entry of the numc.Matrix `mObj`. The result goes to `outObj` if it is not None:
+ * a numc.Matrix of the same shape, which may be m itself or a view, and is returned. Otherwise
+ * it goes to a new matrix. An `out` that partly overlaps m is written through a temporary.
+ */
+static PyObject *ufunc(int op, PyObject *mObj, PyObject *outObj, double exponent) {
+    if (!PyObject_TypeCheck(mObj, &Matrix61cType)) {
+        PyErr_SetString(PyExc_TypeError, "m must be a numc.Matrix");
+        return NULL;
+    }
+    matrix *mat = ((Matrix61c *) mObj)->mat;
+    Matrix61c *result;
+    if (outObj == Py_None) {
+        result = linalg_result(mat->rows, mat->cols);
+        if (result == NULL) {
+            return NULL;
+        }
+    } else {
+        if (!PyObject_TypeCheck(outObj, &Matrix61cType)) {
+            PyErr_SetString(PyExc_TypeError, "out must be a numc.Matrix");
+            return NULL;
+        }
+        result = (Matrix61c *) outObj;
+        if (result->mat->rows != mat->rows || result->mat->cols != mat->cols) {
+            PyErr_SetString(PyExc_ValueError, "out must have the shape of m");
+            return NULL;
+        }
+        if (unshare_matrix(result->mat) != 0) {
+            return NULL;
+        }
+        Py_INCREF(result);
+    }
+
+    matrix *temp = NULL;
+    if (matrix_overlap(result->mat, mat) == OVERLAP_PARTIAL &&
+            allocate_matrix(&temp, mat->rows, mat->cols) != 0) {
+        Py_DECREF(result);
+        return NULL;
+    }
+    trace_begin("numc", "ufunc", mat->rows, mat->cols, 0, 0);
+    Py_BEGIN_ALLOW_THREADS
+    run_ufunc(op, temp != NULL ? temp : result->mat, mat, exponent);
+    Py_END_ALLOW_THREADS
+    trace_end("numc", "ufunc", 0);
+    if (temp != NULL) {
+        assign_matrix(result->mat, temp);
+        deallocate_matrix(temp);
+    }
+    return (PyObject *) result;
+}
+
+/*
+ * numc.exp(m, out=None), numc.log, numc.sqrt, numc.tanh and numc.sigmoid. log and sqrt give NaN
+ * for negative entries, as libm does.
+ */
+static PyObject *ufunc_args(int op, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"m", "out", NULL};
+    PyObject *mObj;
+    PyObject *outObj = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", kwlist, &mObj, &outObj)) {
+        return NULL;
+    }
+    return ufunc(op, mObj, outObj, 0);
+}
+
+PyObject *Matrix61c_class_exp(PyObject *self, PyObject *args, PyObject *kwargs) {
+    return ufunc_args(UFUNC_EXP, args, kwargs);
+}
+
+PyObject *Matrix61c_class_log(PyObject *self, PyObject *args, PyObject *kwargs) {
+    return ufunc_args(UFUNC_LOG, args, kwargs);
+}
+
+PyObject *Matrix61c_class_sqrt(PyObject *self, PyObject *args, PyObject *kwargs) {
+    return ufunc_args(UFUNC_SQRT, args, kwargs);
+}
+
+PyObject *Matrix61c_class_tanh(PyObject *self, PyObject *args, PyObject *kwargs) {
+    return ufunc_args(UFUNC_TANH, args, kwargs);
+}
+
+PyObject *Matrix61c_class_sigmoid(PyObject *self, PyObject *args, PyObject *kwargs) {
+    return ufunc_args(UFUNC_SIGMOID, args, kwargs);
+}
+
+/*
+ * numc.power(m, exponent, out=None). Every entry of m raised to the number `exponent`, unlike
+ * m ** n, which is a matrix power.
+ */
+PyObject *Matrix61c_class_power(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"m", "exponent", "out", NULL};
+    PyObject *mObj;
+    double exponent;
+    PyObject *outObj = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Od|O", kwlist, &mObj, &exponent, &outObj)) {
+        return NULL;
+    }
+    return ufunc(UFUNC_POWER, mObj, outObj, exponent);
+}
+
+/*
+ * An operand of numc.where: a numc.Matrix of the mask's shape, returned with `val` untouched, or
+ * a number, returned as NULL with the number in `val`. Sets `*error` on anything else.
+ */
+static matrix *where_operand(PyObject *obj, matrix *mask, double *val, int *error, const char *name) {
+    if (PyObject_TypeCheck(obj, &Matrix61cType)) {
+        matrix *mat = ((Matrix61c *) obj)->mat;
+        if (mat->rows != mask->rows || mat->cols != mask->cols) {
+            PyErr_Format(PyExc_ValueError, "%s must have the shape of mask", name);
+            *error = 1;
+        }
+        return mat;
+    }
+    if (PyFloat_Check(obj) || PyLong_Check(obj)) {
+        *val = PyFloat_AsDouble(obj);
+        *error = *val == -1 && PyErr_Occurred();
+        return NULL;
+    }
+    PyErr_Format(PyExc_TypeError, "%s must be a numc.Matrix or a number", name);
+    *error = 1;
+    return NULL;
+}
+
+/*
+ * numc.where(mask, a, b). A new matrix with the entries of a where mask is nonzero and those of
+ * b elsewhere; a and b are matrices of the mask's shape or numbers.
+ */
+PyObject *Matrix61c_class_where(PyObject *self, PyObject *args) {
+    PyObject *maskObj, *aObj, *bObj;
+    if (!PyArg_ParseTuple(args, "OOO", &maskObj, &aObj, &bObj)) {
+        return NULL;
+    }
+    if (!PyObject_TypeCheck(maskObj, &Matrix61cType)) {
+        PyErr_SetString(PyExc_TypeError, "mask must be a numc.Matrix");
+        return NULL;
+    }
+    matrix *mask = ((Matrix61c *) maskObj)->mat;
+    double aVal = 0;
+    double bVal = 0;
+    int error = 0;
+    matrix *a = where_operand(aObj, mask, &aVal, &error, "a");
+    matrix *b = error ? NULL : where_operand(bObj, mask, &bVal, &error, "b");
+    if (error) {
+        return NULL;
+    }
+    Matrix61c *result = linalg_result(mask->rows, mask->cols);
+    if (result == NULL) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    where_matrix(result->mat, mask, a, aVal, b, bVal);
+    Py_END_ALLOW_THREADS
+    return (PyObject *) result;
+}
+
+/*
+ * numc.allclose(a, b, rtol=1e-05, atol=1e-08). True if every |a - b| <= atol + rtol * |b|, as
+ * numpy.allclose with NaNs never close. Stops at the first mismatch.
+ */
+PyObject *Matrix61c_class_allclose(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"a", "b", "rtol", "atol", NULL};
+    PyObject *aObj, *bObj;
+    double rtol = 1e-05;
+    double atol = 1e-08;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|dd", kwlist, &aObj, &bObj, &rtol, &atol)) {
+        return NULL;
+    }
+    if (!PyObject_TypeCheck(aObj, &Matrix61cType) || !PyObject_TypeCheck(bObj, &Matrix61cType)) {
+        PyErr_SetString(PyExc_TypeError, "a and b must be numc.Matrix objects");
+        return NULL;
+    }
+    int close;
+    Py_BEGIN_ALLOW_THREADS
+    close = allclose_matrix(((Matrix61c *) aObj)->mat, ((Matrix61c *) bObj)->mat, rtol, atol);
+    Py_END_ALLOW_THREADS
+    if (close < 0) {
+        PyErr_SetString(PyExc_ValueError, "Dimensions of matricies don't match!");
+        return NULL;
+    }
+    return PyBool_FromLong(close);
+}
+
+/*
+ * numc.frombuffer(buffer, rows, cols). A new rows x cols matrix holding a copy of a contiguous
+ * buffer of rows * cols doubles in row-major order, as Matrix.__reduce_ex__ pickles them: bytes,
+ * a PickleBuffer, a memoryview or another matrix. Costs one memcpy and no Python objects.
+ */
+PyObject *Matrix61c_class_frombuffer(PyObject *self, PyObject *args) {
+    PyObject *obj;
+    Py_ssize_t rows, cols;
+    if (!PyArg_ParseTuple(args, "Onn", &obj, &rows, &cols)) {
+        return NULL;
+    }
+    if (rows < 1 || cols < 1) {
+        PyErr_SetString(PyExc_ValueError, "rows and cols must be positive");
+        return NULL;
+    }
+    if (rows > PY_SSIZE_T_MAX / (Py_ssize_t) sizeof(double) / cols) {
+        PyErr_SetString(PyExc_ValueError, "rows * cols is too large");
+        return NULL;
+    }
+    Py_buffer buffer;
+    if (PyObject_GetBuffer(obj, &buffer, PyBUF_SIMPLE) != 0) {
+        return NULL;
+    }
+    Py_ssize_t bytes = rows * cols * (Py_ssize_t) sizeof(double);
+    if (buffer.len != bytes) {
+        PyErr_Format(PyExc_ValueError, "buffer holds %zd bytes, not %zd for a %zd x %zd matrix",
+                     buffer.len, bytes, rows, cols);
+        PyBuffer_Release(&buffer);
+        return NULL;
+    }
+    Matrix61c *result = linalg_result(rows, cols);
+    if (result != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        memcpy(result->mat->data[0], buffer.buf, bytes);
+        Py_END_ALLOW_THREADS
+    }
+    PyBuffer_Release(&buffer);
+    return (PyObject *) result;
+}
+
 /*
  * Add class methods
  */
 PyMethodDef Matrix61c_class_methods[] = {
     {"to_list", (PyCFunction)Matrix61c_class_to_list, METH_VARARGS, "Returns a list representation of numc.Matrix"},
+    {"save", (PyCFunction)Matrix61c_class_save, METH_VARARGS, "Writes a numc.Matrix to a matrix file"},
+    {"load", (PyCFunction)Matrix61c_class_load, METH_VARARGS, "Reads a numc.Matrix from a matrix file"},
+    {"matmul_ooc", (PyCFunction)Matrix61c_class_matmul_ooc, METH_VARARGS | METH_KEYWORDS, "Multiplies two matrix files out of core into a third"},
+    {"enable_stats", (PyCFunction)Matrix61c_class_enable_stats, METH_NOARGS, "Starts collecting per-kernel counters"},
+    {"disable_stats", (PyCFunction)Matrix61c_class_disable_stats, METH_NOARGS, "Stops collecting per-kernel counters"},
+    {"stats", (PyCFunction)Matrix61c_class_stats, METH_VARARGS | METH_KEYWORDS, "Returns per-kernel counters, optionally resetting them"},
+    {"enable_trace", (PyCFunction)Matrix61c_class_enable_trace, METH_VARARGS | METH_KEYWORDS, "Starts recording a timeline of operator and kernel calls"},
+    {"disable_trace", (PyCFunction)Matrix61c_class_disable_trace, METH_NOARGS, "Stops recording the timeline"},
+    {"trace_dump", (PyCFunction)Matrix61c_class_trace_dump, METH_VARARGS, "Writes the recorded timeline as Chrome trace JSON"},
+    {"set_num_threads", (PyCFunction)Matrix61c_class_set_num_threads, METH_VARARGS, "Caps the threads any kernel may use"},
+    {"get_num_threads", (PyCFunction)Matrix61c_class_get_num_threads, METH_NOARGS, "Returns the thread cap in effect"},
+    {"pool_stats", (PyCFunction)Matrix61c_class_pool_stats, METH_NOARGS, "Returns the thread pool's size and counters"},
+    {"submit", (PyCFunction)Matrix61c_class_submit, METH_VARARGS | METH_KEYWORDS, "Starts an operation on the worker threads and returns a Future"},
+    {"solve", (PyCFunction)Matrix61c_class_solve, METH_VARARGS, "Solves A X = B by LU factorization"},
+    {"det", (PyCFunction)Matrix61c_class_det, METH_VARARGS, "Returns the determinant of a square matrix"},
+    {"inv", (PyCFunction)Matrix61c_class_inv, METH_VARARGS, "Returns the inverse of a square matrix"},
+    {"cholesky", (PyCFunction)Matrix61c_class_cholesky, METH_VARARGS, "Returns the Cholesky factor of a symmetric positive definite matrix"},
+    {"cho_solve", (PyCFunction)Matrix61c_class_cho_solve, METH_VARARGS, "Solves A X = B given the Cholesky factor of A"},
+    {"trsm", (PyCFunction)Matrix61c_class_trsm, METH_VARARGS | METH_KEYWORDS, "Solves T X = B for a triangular T"},
+    {"qr", (PyCFunction)Matrix61c_class_qr, METH_VARARGS, "Returns the thin QR factorization (Q, R) of a matrix"},
+    {"lstsq", (PyCFunction)Matrix61c_class_lstsq, METH_VARARGS, "Returns the least-squares solution of A x = b"},
+    {"eigh", (PyCFunction)Matrix61c_class_eigh, METH_VARARGS, "Returns the eigenvalues and eigenvectors (w, V) of a symmetric matrix"},
+    {"svd", (PyCFunction)Matrix61c_class_svd, METH_VARARGS, "Returns the thin singular value decomposition (U, S, Vh) of a matrix"},
+    {"exp", (PyCFunction)Matrix61c_class_exp, METH_VARARGS | METH_KEYWORDS, "Returns e raised to every entry of a matrix"},
+    {"log", (PyCFunction)Matrix61c_class_log, METH_VARARGS | METH_KEYWORDS, "Returns the natural logarithm of every entry of a matrix"},
+    {"sqrt", (PyCFunction)Matrix61c_class_sqrt, METH_VARARGS | METH_KEYWORDS, "Returns the square root of every entry of a matrix"},
+    {"tanh", (PyCFunction)Matrix61c_class_tanh, METH_VARARGS | METH_KEYWORDS, "Returns tanh of every entry of a matrix"},
+    {"sigmoid", (PyCFunction)Matrix61c_class_sigmoid, METH_VARARGS | METH_KEYWORDS, "Returns the logistic sigmoid of every entry of a matrix"},
+    {"power", (PyCFunction)Matrix61c_class_power, METH_VARARGS | METH_KEYWORDS, "Returns every entry of a matrix raised to a number"},
+    {"where", (PyCFunction)Matrix61c_class_where, METH_VARARGS, "Returns entries of a where a mask is nonzero and of b elsewhere"},
+    {"allclose", (PyCFunction)Matrix61c_class_allclose, METH_VARARGS | METH_KEYWORDS, "Returns whether two matrices are equal within a tolerance"},
+    {"frombuffer", (PyCFunction)Matrix61c_class_frombuffer, METH_VARARGS, "Returns a matrix copied from a contiguous buffer of doubles"},
+    {"tuning_path", (PyCFunction)Matrix61c_class_tuning_path, METH_NOARGS, "Returns the tuning file read at import"},
+    {"tuning", (PyCFunction)Matrix61c_class_tuning, METH_NOARGS, "Returns the tunable parameters in effect"},
+    {"set_tuning", (PyCFunction)Matrix61c_class_set_tuning, METH_VARARGS | METH_KEYWORDS, "Sets tunable parameters by name"},
+    {"load_tuning", (PyCFunction)Matrix61c_class_load_tuning, METH_VARARGS | METH_KEYWORDS, "Applies a tuning file"},
+    {"enable_perf", (PyCFunction)Matrix61c_class_enable_perf, METH_NOARGS, "Starts reading hardware counters around every kernel"},
+    {"disable_perf", (PyCFunction)Matrix61c_class_disable_perf, METH_NOARGS, "Stops reading hardware counters"},
+    {"perf_report", (PyCFunction)Matrix61c_class_perf_report, METH_VARARGS | METH_KEYWORDS, "Returns a per-kernel, per-shape roofline report"},
     {NULL, NULL, 0, NULL}
 };
 
@@ -291,12 +2349,13 @@ PyObject *Matrix61c_add(Matrix61c* self, PyObject* args) {
         PyErr_SetString(PyExc_TypeError, "Argument must of type numc.Matrix!");
         return NULL;
     }
-    int argRows = ((Matrix61c*)args)->mat->rows;
-    int argCols = ((Matrix61c*)args)->mat->cols;
+    Py_ssize_t argRows = ((Matrix61c*)args)->mat->rows;
+    Py_ssize_t argCols = ((Matrix61c*)args)->mat->cols;
     if(self->mat->rows != argRows || self->mat->cols != argCols) {
         PyErr_SetString(PyExc_ValueError, "Dimensions of matricies don't match!");
         return NULL;
     }
+    trace_begin("numc", "__add__", self->mat->rows, self->mat->cols, argRows, argCols);
     Matrix61c *temp = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
     matrix *newMat;
     matrix **newTest = &newMat;
@@ -304,6 +2363,7 @@ PyObject *Matrix61c_add(Matrix61c* self, PyObject* args) {
     add_matrix(*newTest, self->mat, ((Matrix61c*)args)->mat);
     temp->mat = *newTest;
     temp->shape = get_shape(argRows, argCols);
+    trace_end("numc", "__add__", 0);
     return temp;
 }
 
@@ -316,12 +2376,13 @@ PyObject *Matrix61c_sub(Matrix61c* self, PyObject* args) {
         PyErr_SetString(PyExc_TypeError, "Argument must of type numc.Matrix!");
         return NULL;
     }
-    int argRows = ((Matrix61c*)args)->mat->rows;
-    int argCols = ((Matrix61c*)args)->mat->cols;
+    Py_ssize_t argRows = ((Matrix61c*)args)->mat->rows;
+    Py_ssize_t argCols = ((Matrix61c*)args)->mat->cols;
     if(self->mat->rows != argRows || self->mat->cols != argCols) {
         PyErr_SetString(PyExc_ValueError, "Dimensions of matricies don't match!");
         return NULL;
     }
+    trace_begin("numc", "__sub__", self->mat->rows, self->mat->cols, argRows, argCols);
     Matrix61c *temp = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
     matrix *newMat;
     matrix **newTest = &newMat;
@@ -329,6 +2390,7 @@ PyObject *Matrix61c_sub(Matrix61c* self, PyObject* args) {
     sub_matrix(*newTest, self->mat, ((Matrix61c*)args)->mat);
     temp->mat = *newTest;
     temp->shape = get_shape(argRows, argCols);
+    trace_end("numc", "__sub__", 0);
     return temp;
 }
 
@@ -341,19 +2403,24 @@ PyObject *Matrix61c_multiply(Matrix61c* self, PyObject *args) {
         PyErr_SetString(PyExc_TypeError, "Argument must of type numc.Matrix!");
         return NULL;
     }
-    int argRows = ((Matrix61c*)args)->mat->rows;
-    int argCols = ((Matrix61c*)args)->mat->cols;
+    Py_ssize_t argRows = ((Matrix61c*)args)->mat->rows;
+    Py_ssize_t argCols = ((Matrix61c*)args)->mat->cols;
     if(self->mat->cols != argRows) {
         PyErr_SetString(PyExc_ValueError, "Dimensions of matricies don't match!");
         return NULL;
     }
+    trace_begin("numc", "__mul__", self->mat->rows, self->mat->cols, argRows, argCols);
     Matrix61c *temp = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
     matrix *newMat;
     matrix **newTest = &newMat;
     allocate_matrix(newTest, self->mat->rows, argCols);
+    /* Products are long enough that other Python threads should get to run, or to multiply too */
+    Py_BEGIN_ALLOW_THREADS
     mul_matrix(*newTest, self->mat, ((Matrix61c*)args)->mat);
+    Py_END_ALLOW_THREADS
     temp->mat = *newTest;
     temp->shape = get_shape(self->mat->rows, argCols);
+    trace_end("numc", "__mul__", 0);
     return temp;
 }
 
@@ -361,6 +2428,7 @@ PyObject *Matrix61c_multiply(Matrix61c* self, PyObject *args) {
  * Negates the given numc.Matrix.
  */
 PyObject *Matrix61c_neg(Matrix61c* self) {
+    trace_begin("numc", "__neg__", self->mat->rows, self->mat->cols, 0, 0);
     Matrix61c *temp = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
     matrix *newMat;
     matrix **newTest = &newMat;
@@ -368,6 +2436,7 @@ PyObject *Matrix61c_neg(Matrix61c* self) {
     neg_matrix(*newTest, self->mat);
     temp->mat = *newTest;
     temp->shape = get_shape(self->mat->rows, self->mat->cols);
+    trace_end("numc", "__neg__", 0);
     return temp;
 }
 
@@ -375,6 +2444,7 @@ PyObject *Matrix61c_neg(Matrix61c* self) {
  * Take the element-wise absolute value of this numc.Matrix.
  */
 PyObject *Matrix61c_abs(Matrix61c *self) {
+    trace_begin("numc", "__abs__", self->mat->rows, self->mat->cols, 0, 0);
     Matrix61c *temp = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
     matrix *newMat;
     matrix **newTest = &newMat;
@@ -382,6 +2452,7 @@ PyObject *Matrix61c_abs(Matrix61c *self) {
     abs_matrix(*newTest, self->mat);
     temp->mat = *newTest;
     temp->shape = get_shape(self->mat->rows, self->mat->cols);
+    trace_end("numc", "__abs__", 0);
     return temp;
 }
 
@@ -397,6 +2468,7 @@ PyObject *Matrix61c_pow(Matrix61c *self, PyObject *pow, PyObject *optional) {
         PyErr_SetString(PyExc_ValueError, "Dimensions of matricies don't match!");
         return NULL;
     }
+    trace_begin("numc", "__pow__", self->mat->rows, self->mat->cols, 0, 0);
     Matrix61c *temp = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
     matrix *newMat;
     matrix **newTest = &newMat;
@@ -404,9 +2476,55 @@ PyObject *Matrix61c_pow(Matrix61c *self, PyObject *pow, PyObject *optional) {
     pow_matrix(*newTest, self->mat, PyLong_AsLong(pow));
     temp->mat = *newTest;
     temp->shape = get_shape(self->mat->rows, self->mat->cols);
+    trace_end("numc", "__pow__", 0);
     return temp;
 }
 
+/*
+ * Compare this numc.Matrix entry by entry with another of the same shape or with a number, for
+ * <, <=, ==, !=, > and >=. The result is a mask: a matrix of 1.0 where the comparison holds and
+ * 0.0 elsewhere. Anything else is left to Python (so == falls back to identity).
+ */
+PyObject *Matrix61c_richcompare(PyObject *self, PyObject *other, int op) {
+    matrix *mat = ((Matrix61c *) self)->mat;
+    matrix *mat2 = NULL;
+    double val = 0;
+    if (PyObject_TypeCheck(other, &Matrix61cType)) {
+        mat2 = ((Matrix61c *) other)->mat;
+        if (mat2->rows != mat->rows || mat2->cols != mat->cols) {
+            PyErr_SetString(PyExc_ValueError, "Dimensions of matricies don't match!");
+            return NULL;
+        }
+    } else if (PyFloat_Check(other) || PyLong_Check(other)) {
+        val = PyFloat_AsDouble(other);
+        if (val == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+    } else {
+        Py_RETURN_NOTIMPLEMENTED;
+    }
+    trace_begin("numc", "compare", mat->rows, mat->cols, 0, 0);
+    Matrix61c *result = linalg_result(mat->rows, mat->cols);
+    if (result != NULL) {
+        compare_matrix(result->mat, mat, mat2, val, op);
+    }
+    trace_end("numc", "compare", 0);
+    return (PyObject *) result;
+}
+
+/*
+ * The truth value of a matrix with a single entry. As in numpy, that of a bigger matrix (such as
+ * the mask of a == b) is ambiguous and raises ValueError: use numc.allclose or a reduction.
+ */
+int Matrix61c_bool(Matrix61c *self) {
+    if (self->mat->rows * self->mat->cols != 1) {
+        PyErr_SetString(PyExc_ValueError,
+                        "The truth value of a matrix with more than one entry is ambiguous");
+        return -1;
+    }
+    return get(self->mat, 0, 0) != 0;
+}
+
 /*
  * Create a PyNumberMethods struct for overloading operators with all the number methods you have
  * define. You might find this link helpful: https://docs.python.org/3.6/c-api/typeobj.html
@@ -421,7 +2539,7 @@ PyNumberMethods Matrix61c_as_number = {
     .nb_negative = Matrix61c_neg,
     .nb_positive = 0,
     .nb_absolute = Matrix61c_abs,
-    .nb_bool = 0,
+    .nb_bool = (inquiry) Matrix61c_bool,
     .nb_invert = 0,
     .nb_lshift = 0,
     .nb_rshift = 0,
@@ -452,10 +2570,243 @@ PyNumberMethods Matrix61c_as_number = {
 };
 
 
-/* INSTANCE METHODS */
+/* INSTANCE METHODS */
+
+/*
+ * The operators as methods that take a `threads=` cap for the one call, e.g. a.mul(b, threads=2).
+ */
+static PyObject *binary_with_threads(PyObject *self, PyObject *args, PyObject *kwds, binaryfunc op) {
+    static char *kwlist[] = {"other", "threads", NULL};
+    PyObject *other;
+    int threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|$i", kwlist, &other, &threads) ||
+            check_threads(threads) < 0) {
+        return NULL;
+    }
+    int saved = set_call_threads(threads);
+    PyObject *result = op(self, other);
+    set_call_threads(saved);
+    return result;
+}
+
+static PyObject *unary_with_threads(PyObject *self, PyObject *args, PyObject *kwds, unaryfunc op) {
+    static char *kwlist[] = {"threads", NULL};
+    int threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|$i", kwlist, &threads) ||
+            check_threads(threads) < 0) {
+        return NULL;
+    }
+    int saved = set_call_threads(threads);
+    PyObject *result = op(self);
+    set_call_threads(saved);
+    return result;
+}
+
+static PyObject *pow_binary(PyObject *self, PyObject *pow) {
+    return Matrix61c_pow((Matrix61c *) self, pow, Py_None);
+}
+
+PyObject *Matrix61c_add_method(PyObject *self, PyObject *args, PyObject *kwds) {
+    return binary_with_threads(self, args, kwds, (binaryfunc) Matrix61c_add);
+}
+
+PyObject *Matrix61c_sub_method(PyObject *self, PyObject *args, PyObject *kwds) {
+    return binary_with_threads(self, args, kwds, (binaryfunc) Matrix61c_sub);
+}
+
+PyObject *Matrix61c_mul_method(PyObject *self, PyObject *args, PyObject *kwds) {
+    return binary_with_threads(self, args, kwds, (binaryfunc) Matrix61c_multiply);
+}
+
+PyObject *Matrix61c_pow_method(PyObject *self, PyObject *args, PyObject *kwds) {
+    return binary_with_threads(self, args, kwds, pow_binary);
+}
+
+PyObject *Matrix61c_neg_method(PyObject *self, PyObject *args, PyObject *kwds) {
+    return unary_with_threads(self, args, kwds, (unaryfunc) Matrix61c_neg);
+}
+
+PyObject *Matrix61c_abs_method(PyObject *self, PyObject *args, PyObject *kwds) {
+    return unary_with_threads(self, args, kwds, (unaryfunc) Matrix61c_abs);
+}
+
+/*
+ * a.matmul_async(b, *, threads=0): a * b as a numc.Future, like numc.submit("mul", a, b).
+ */
+PyObject *Matrix61c_matmul_async(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"other", "threads", NULL};
+    PyObject *other;
+    int threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|$i", kwlist, &other, &threads) ||
+            check_threads(threads) < 0) {
+        return NULL;
+    }
+    PyObject *operands = PyTuple_Pack(2, self, other);
+    if (operands == NULL) {
+        return NULL;
+    }
+    PyObject *future = submit_future(FUTURE_MUL, operands, threads);
+    Py_DECREF(operands);
+    return future;
+}
+
+/*
+ * Return a copy of this numc.Matrix (or slice) that shares its data until one of them is
+ * written, so a copy that is only read never costs more than its row pointers.
+ */
+PyObject *Matrix61c_copy(Matrix61c *self, PyObject *unused) {
+    Matrix61c *temp = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
+    if (temp == NULL) {
+        return NULL;
+    }
+    if (copy_matrix(&temp->mat, self->mat) != 0) {
+        Py_DECREF(temp);
+        return NULL;
+    }
+    temp->shape = get_shape(self->mat->rows, self->mat->cols);
+    return (PyObject *) temp;
+}
+
+/* numc.frombuffer, looked up at import for the tuples __reduce_ex__ returns */
+static PyObject *frombuffer;
+
+/*
+ * Set `*step` to the distance in doubles from each row of `mat` to the next. Return 0 if the
+ * rows are evenly spaced, as those of matrices, slices and copies are, and -1 otherwise.
+ */
+static int row_step(matrix *mat, Py_ssize_t *step) {
+    *step = mat->rows > 1 ? mat->data[1] - mat->data[0] : mat->cols * mat->stride;
+    for (Py_ssize_t i = 2; i < mat->rows; i++) {
+        if (mat->data[i] != mat->data[0] + i * *step) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Whether the entries of `mat` are one row-major block that a buffer can hand out as is.
+ */
+static int is_contiguous(matrix *mat) {
+    Py_ssize_t step;
+    return row_step(mat, &step) == 0 && mat->stride == 1 && (mat->rows == 1 || step == mat->cols);
+}
+
+/*
+ * Export the entries of this numc.Matrix (or slice) through the buffer protocol, read-only so
+ * that no write can get around copy-on-write: as a vector for 1D matrices and as rows x cols
+ * otherwise, with strides for slices. A copy-on-write matrix gets its own data first, since its
+ * rows move the next time whatever it shares with is written.
+ */
+static int Matrix61c_getbuffer(Matrix61c *self, Py_buffer *view, int flags) {
+    matrix *mat = self->mat;
+    Py_ssize_t step;
+    if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "numc.Matrix buffers are read-only");
+        return -1;
+    }
+    if (mat->cow && unshare_matrix(mat) != 0) {
+        return -1;
+    }
+    if (row_step(mat, &step) != 0) {
+        PyErr_SetString(PyExc_BufferError, "matrix rows are not evenly spaced");
+        return -1;
+    }
+    int contiguous = mat->stride == 1 && (mat->rows == 1 || step == mat->cols);
+    int vector = mat->rows == 1 || mat->cols == 1;
+    if (!contiguous && ((flags & PyBUF_STRIDES) != PyBUF_STRIDES
+                        || (flags & PyBUF_C_CONTIGUOUS) == PyBUF_C_CONTIGUOUS
+                        || (flags & PyBUF_ANY_CONTIGUOUS) == PyBUF_ANY_CONTIGUOUS)) {
+        PyErr_SetString(PyExc_BufferError, "matrix slice is not contiguous");
+        return -1;
+    }
+    if (!vector && (flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS) {
+        PyErr_SetString(PyExc_BufferError, "matrix is row-major, not Fortran contiguous");
+        return -1;
+    }
+    /* shape then strides, freed in Matrix61c_releasebuffer */
+    Py_ssize_t *dims = PyMem_Malloc(4 * sizeof(Py_ssize_t));
+    if (dims == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    int ndim = vector ? 1 : 2;
+    if (vector) {
+        dims[0] = mat->rows == 1 ? mat->cols : mat->rows;
+        dims[1] = (mat->rows == 1 ? mat->stride : step) * (Py_ssize_t) sizeof(double);
+    } else {
+        dims[0] = mat->rows;
+        dims[1] = mat->cols;
+        dims[2] = step * (Py_ssize_t) sizeof(double);
+        dims[3] = mat->stride * (Py_ssize_t) sizeof(double);
+    }
+    view->buf = mat->data[0];
+    view->obj = (PyObject *) self;
+    Py_INCREF(self);
+    view->len = mat->rows * mat->cols * (Py_ssize_t) sizeof(double);
+    view->readonly = 1;
+    view->itemsize = sizeof(double);
+    view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? "d" : NULL;
+    view->ndim = ndim;
+    view->shape = (flags & PyBUF_ND) == PyBUF_ND ? dims : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? dims + ndim : NULL;
+    view->suboffsets = NULL;
+    view->internal = dims;
+    return 0;
+}
+
+static void Matrix61c_releasebuffer(Matrix61c *self, Py_buffer *view) {
+    PyMem_Free(view->internal);
+}
+
+/*
+ * Pickle support: reduce to numc.frombuffer(entries, rows, cols) with the entries as one block.
+ * From protocol 5 the block is a PickleBuffer that pickle.dumps with a buffer_callback hands
+ * over out of band, so a contiguous matrix is never copied to be sent; slices and copies are
+ * packed once first. Older protocols get one bytes object. Loading costs one memcpy.
+ */
+PyObject *Matrix61c_reduce_ex(Matrix61c *self, PyObject *args) {
+    int protocol;
+    if (!PyArg_ParseTuple(args, "i", &protocol)) {
+        return NULL;
+    }
+    matrix *mat = self->mat;
+    Py_ssize_t rows = mat->rows;
+    Py_ssize_t cols = mat->cols;
+    PyObject *data;
+    if (protocol >= 5) {
+        PyObject *source = (PyObject *) self;
+        if (mat->cow || !is_contiguous(mat)) {
+            Matrix61c *packed = linalg_result(rows, cols);
+            if (packed == NULL) {
+                return NULL;
+            }
+            for (Py_ssize_t i = 0; i < rows; i++) {
+                get_row(mat, i, 0, cols, packed->mat->data[i]);
+            }
+            source = (PyObject *) packed;
+        } else {
+            Py_INCREF(source);
+        }
+        data = PyPickleBuffer_FromObject(source);
+        Py_DECREF(source);
+    } else {
+        data = PyBytes_FromStringAndSize(NULL, rows * cols * (Py_ssize_t) sizeof(double));
+        if (data != NULL) {
+            double *block = (double *) PyBytes_AS_STRING(data);
+            for (Py_ssize_t i = 0; i < rows; i++) {
+                get_row(mat, i, 0, cols, block + i * cols);
+            }
+        }
+    }
+    if (data == NULL) {
+        return NULL;
+    }
+    return Py_BuildValue("O(Nnn)", frombuffer, data, rows, cols);
+}
 
 /*
- * Given a numc.Matrix self, parse `args` to (int) row, (int) col, and (double/int) val.
+ * Given a numc.Matrix self, parse `args` to row, col, and (double/int) val.
  * Return None in Python (this is different from returning null).
  */
 PyObject *Matrix61c_set_value(Matrix61c *self, PyObject* args) {
@@ -480,19 +2831,22 @@ PyObject *Matrix61c_set_value(Matrix61c *self, PyObject* args) {
             return NULL;
         }
     }
-    if (PyLong_AsLong(PyTuple_GetItem(args, 0)) > self->mat->rows - 1 || PyLong_AsLong(PyTuple_GetItem(args, 1)) > self->mat->cols - 1) {
+    if (PyLong_AsSsize_t(PyTuple_GetItem(args, 0)) > self->mat->rows - 1 || PyLong_AsSsize_t(PyTuple_GetItem(args, 1)) > self->mat->cols - 1) {
         PyErr_SetString(PyExc_IndexError, "Row or col is out of bounds");
         return NULL;
     }
     //printf("pre-Rows\n");
-    int rows = (int) PyLong_AsLong(PyTuple_GET_ITEM(args, 0));
-    int cols = (int) PyLong_AsLong(PyTuple_GET_ITEM(args, 1));
+    Py_ssize_t rows = PyLong_AsSsize_t(PyTuple_GET_ITEM(args, 0));
+    Py_ssize_t cols = PyLong_AsSsize_t(PyTuple_GET_ITEM(args, 1));
+    if (unshare_matrix(self->mat) != 0) {
+        return NULL;
+    }
     set(self->mat, rows, cols, PyFloat_AsDouble(PyTuple_GET_ITEM(args, 2)));
-    return Py_None;
+    Py_RETURN_NONE;
 }
 
 /*
- * Given a numc.Matrix `self`, parse `args` to (int) row and (int) col.
+ * Given a numc.Matrix `self`, parse `args` to row and col.
  * Return the value at the `row`th row and `col`th column, which is a Python
  * float/int.
  */
@@ -510,13 +2864,13 @@ PyObject *Matrix61c_get_value(Matrix61c *self, PyObject* args) {
         PyErr_SetString(PyExc_TypeError, "col is not proper type");
         return NULL;
     }
-    if (PyLong_AsLong(PyTuple_GetItem(args, 0)) > self->mat->rows - 1 || PyLong_AsLong(PyTuple_GetItem(args, 1)) > self->mat->cols - 1) {
+    if (PyLong_AsSsize_t(PyTuple_GetItem(args, 0)) > self->mat->rows - 1 || PyLong_AsSsize_t(PyTuple_GetItem(args, 1)) > self->mat->cols - 1) {
         PyErr_SetString(PyExc_IndexError, "Row or col is out of bounds");
         return NULL;
     } //*(*(mat->data + row) + col)
-    int rows = (int) PyLong_AsLong(PyTuple_GET_ITEM(args, 0));
-    int cols = (int) PyLong_AsLong(PyTuple_GET_ITEM(args, 1));
-    return PyFloat_FromDouble(self->mat->data[rows][cols]);
+    Py_ssize_t rows = PyLong_AsSsize_t(PyTuple_GET_ITEM(args, 0));
+    Py_ssize_t cols = PyLong_AsSsize_t(PyTuple_GET_ITEM(args, 1));
+    return PyFloat_FromDouble(get(self->mat, rows, cols));
 }
 
 /*
@@ -529,6 +2883,18 @@ PyMethodDef Matrix61c_methods[] = { // Matrix61c_set_value
     /* TODO: YOUR CODE HERE */
     {"set", (PyCFunction)Matrix61c_set_value, METH_VARARGS, "sets value of numc.Matrix"}, 
     {"get", (PyCFunction)Matrix61c_get_value, METH_VARARGS, "gets value of numc.Matrix"},
+    {"add", (PyCFunction)Matrix61c_add_method, METH_VARARGS | METH_KEYWORDS, "self + other, optionally capping the threads"},
+    {"sub", (PyCFunction)Matrix61c_sub_method, METH_VARARGS | METH_KEYWORDS, "self - other, optionally capping the threads"},
+    {"mul", (PyCFunction)Matrix61c_mul_method, METH_VARARGS | METH_KEYWORDS, "self * other, optionally capping the threads"},
+    {"pow", (PyCFunction)Matrix61c_pow_method, METH_VARARGS | METH_KEYWORDS, "self ** n, optionally capping the threads"},
+    {"neg", (PyCFunction)Matrix61c_neg_method, METH_VARARGS | METH_KEYWORDS, "-self, optionally capping the threads"},
+    {"abs", (PyCFunction)Matrix61c_abs_method, METH_VARARGS | METH_KEYWORDS, "abs(self), optionally capping the threads"},
+    {"copy", (PyCFunction)Matrix61c_copy, METH_NOARGS, "copy of self that shares its data until either is written"},
+    {"matmul_async", (PyCFunction)Matrix61c_matmul_async, METH_VARARGS | METH_KEYWORDS, "self * other as a numc.Future"},
+    {"__reduce_ex__", (PyCFunction)Matrix61c_reduce_ex, METH_VARARGS, "pickles self as one block of doubles"},
+    {"shared", (PyCFunction)Matrix61c_shared, METH_VARARGS | METH_KEYWORDS | METH_STATIC, "new matrix in a named shared-memory segment"},
+    {"attach", (PyCFunction)Matrix61c_attach, METH_VARARGS | METH_STATIC, "maps the matrix in a named shared-memory segment"},
+    {"unlink", (PyCFunction)Matrix61c_unlink, METH_VARARGS | METH_STATIC, "removes a named shared-memory segment"},
     {NULL, NULL, 0, NULL}
 };
 
@@ -537,13 +2903,13 @@ PyMethodDef Matrix61c_methods[] = { // Matrix61c_set_value
 /*
  * Given a numc.Matrix `self`, index into it with `key`. Return the indexed result.
  */
-PyObject *Matrix61c_subscript(Matrix61c* self, PyObject* key) {
-    int rowDim = self->mat->rows;
-    int colDim = self->mat->cols;
-    int rowOffset = 0;
-    int colOffset = 0;
-    int rows = 0;
-    int cols = 0;
+static PyObject *get_subscript(Matrix61c* self, PyObject* key) {
+    Py_ssize_t rowDim = self->mat->rows;
+    Py_ssize_t colDim = self->mat->cols;
+    Py_ssize_t rowOffset = 0;
+    Py_ssize_t colOffset = 0;
+    Py_ssize_t rows = 0;
+    Py_ssize_t cols = 0;
     Matrix61c *temp = (Matrix61c *) Matrix61c_new(&Matrix61cType, NULL, NULL);
     matrix *newMat;
     matrix **newTest = &newMat;
@@ -551,28 +2917,33 @@ PyObject *Matrix61c_subscript(Matrix61c* self, PyObject* key) {
     //1-D CASE (also handles a[x][x] case)
     if (self->mat->rows == 1) {
         if (PyObject_TypeCheck(key, &PyLong_Type)) {
-            if ((int) PyLong_AsLong(key) >= colDim || (int) PyLong_AsLong(key) < 0) {
-                PyErr_SetString(PyExc_IndexError, "Out of Bounds Error");
+            if (PyLong_AsSsize_t(key) >= colDim || PyLong_AsSsize_t(key) < 0) {
+                PyErr_Format(PyExc_IndexError, "Vector index %zd is out of bounds for length %zd",
+                             PyLong_AsSsize_t(key), colDim);
                 return NULL;
             }
-            return PyFloat_FromDouble(get(self->mat, 0, (int) PyLong_AsLong(key)));
+            return PyFloat_FromDouble(get(self->mat, 0, PyLong_AsSsize_t(key)));
         }
         if (PyObject_TypeCheck(key, &PySlice_Type)){
             PyObject* slice = key;
             Py_ssize_t length = colDim;
             Py_ssize_t begin = 0; Py_ssize_t stop = 0; Py_ssize_t step = 0; Py_ssize_t sliceLength = 0;
             PySlice_GetIndicesEx(slice, length, &begin, &stop, &step, &sliceLength);
-            if (sliceLength == 0 || step != 1) {
-                PyErr_SetString(PyExc_ValueError, "Incorrect Slicing format or bounds or step size not 1\n");
+            if (sliceLength == 0) {
+                PyErr_SetString(PyExc_ValueError, "Vector slice selects no entries");
                 return NULL;
             }
             if (sliceLength == 1) {
-                return PyFloat_FromDouble(get(self->mat, 0, (int) begin));
+                return PyFloat_FromDouble(get(self->mat, 0, begin));
             }
             rows = 1;
             cols = sliceLength;
             temp->shape = get_shape(rows, cols);
-            allocate_matrix_ref(newTest, self->mat, 0, (int) begin, (int) rows, cols);
+            if (allocate_matrix_strided(newTest, self->mat, 0, begin, rows, cols, 1, step) != 0) {
+                temp->mat = NULL;
+                Py_DECREF(temp);
+                return NULL;
+            }
             temp->mat = *newTest;
             return temp;
         }
@@ -581,18 +2952,23 @@ PyObject *Matrix61c_subscript(Matrix61c* self, PyObject* key) {
     }
     //LONG ONLY
     if (PyObject_TypeCheck(key, &PyLong_Type)) {
-        if (PyLong_AsLong(key) < 0 || PyLong_AsLong(key) >= rowDim) {
-            PyErr_SetString(PyExc_IndexError, "Row is out of bounds");
+        if (PyLong_AsSsize_t(key) < 0 || PyLong_AsSsize_t(key) >= rowDim) {
+            PyErr_Format(PyExc_IndexError, "%s index %zd is out of bounds for length %zd",
+                         colDim == 1 ? "Vector" : "Row", PyLong_AsSsize_t(key), rowDim);
             return NULL;
         }
         if (colDim == 1) {
-            return PyFloat_FromDouble(get(self->mat, PyLong_AsLong(key), 0));
+            return PyFloat_FromDouble(get(self->mat, PyLong_AsSsize_t(key), 0));
         }
-        rowOffset = PyLong_AsLong(key);
+        rowOffset = PyLong_AsSsize_t(key);
         rows = 1;
         cols = colDim;
         temp->shape = get_shape(rows, cols);
-        allocate_matrix_ref(newTest, self->mat, rowOffset, colOffset, rows, cols);
+        if (allocate_matrix_ref(newTest, self->mat, rowOffset, colOffset, rows, cols) != 0) {
+            temp->mat = NULL;
+            Py_DECREF(temp);
+            return NULL;
+        }
         temp->mat = *newTest;
         return temp;
     } 
@@ -603,24 +2979,28 @@ PyObject *Matrix61c_subscript(Matrix61c* self, PyObject* key) {
         Py_ssize_t begin = 0; Py_ssize_t stop = 0; Py_ssize_t step = 0; Py_ssize_t sliceLength = 0;
         int ret = PySlice_GetIndicesEx(slice, length, &begin, &stop, &step, &sliceLength);
         if (ret == -1) {
-            PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into slice\n");
+            PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into slice");
             return NULL;
         }
         
-        if (sliceLength == 0 || step != 1) {
-            PyErr_SetString(PyExc_ValueError, "Incorrect Slicing format or bounds, or step size not 1\n");
+        if (sliceLength == 0) {
+            PyErr_SetString(PyExc_ValueError, colDim == 1 ? "Vector slice selects no entries"
+                                                           : "Row slice selects no entries");
             return NULL;
         }
         if (sliceLength == 1 && colDim == 1) {
-            return PyFloat_FromDouble(get(self->mat, (int) begin, 0));
+            return PyFloat_FromDouble(get(self->mat, begin, 0));
         }
         //printf("did stuff\n");
         
         rows = sliceLength;
         cols = colDim;
         temp->shape = get_shape(rows, cols);
-        allocate_matrix_ref(newTest, self->mat, (int) begin, 0, (int) rows, cols);
-        printf("%d\n",self->mat->ref_cnt);
+        if (allocate_matrix_strided(newTest, self->mat, begin, 0, rows, cols, step, 1) != 0) {
+            temp->mat = NULL;
+            Py_DECREF(temp);
+            return NULL;
+        }
         temp->mat = *newTest;
         return temp;
 
@@ -628,15 +3008,21 @@ PyObject *Matrix61c_subscript(Matrix61c* self, PyObject* key) {
     //TUPLE TYPES
     if (PyObject_TypeCheck(key, &PyTuple_Type)) {
         if (self->mat->cols == 1) {
-            PyErr_SetString(PyExc_TypeError, "matrix has 1 column, 2d access not allowed.\n");
+            PyErr_SetString(PyExc_TypeError, "matrix has 1 column, 2d access not allowed");
             return NULL;
         }
         //LONG LONG
         if (PyObject_TypeCheck(PyTuple_GET_ITEM(key, 0), &PyLong_Type) && PyObject_TypeCheck(PyTuple_GET_ITEM(key, 1), &PyLong_Type)) {
-            int rowOffset = (int) PyLong_AsLong(PyTuple_GET_ITEM(key, 0));
-            int colOffset = (int) PyLong_AsLong(PyTuple_GET_ITEM(key, 1));
-            if (rowOffset >= self->mat->rows || colOffset >= self->mat->cols || rowOffset < 0 || colOffset < 0) {
-                PyErr_SetString(PyExc_IndexError, "row or col is out of bounds \n");
+            Py_ssize_t rowOffset = PyLong_AsSsize_t(PyTuple_GET_ITEM(key, 0));
+            Py_ssize_t colOffset = PyLong_AsSsize_t(PyTuple_GET_ITEM(key, 1));
+            if (rowOffset >= self->mat->rows || rowOffset < 0) {
+                PyErr_Format(PyExc_IndexError, "Row index %zd is out of bounds for length %zd",
+                             rowOffset, rowDim);
+                return NULL;
+            }
+            if (colOffset >= self->mat->cols || colOffset < 0) {
+                PyErr_Format(PyExc_IndexError, "Column index %zd is out of bounds for length %zd",
+                             colOffset, colDim);
                 return NULL;
             }
             return PyFloat_FromDouble(get(self->mat, rowOffset, colOffset));
@@ -648,12 +3034,12 @@ PyObject *Matrix61c_subscript(Matrix61c* self, PyObject* key) {
             Py_ssize_t begin0 = 0; Py_ssize_t stop0 = 0; Py_ssize_t step0 = 0; Py_ssize_t sliceLength0 = 0;
             int ret = PySlice_GetIndicesEx(slice0, length0, &begin0, &stop0, &step0, &sliceLength0);
             if (ret == -1) {
-                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into first slice\n");
+                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into first slice");
                 return NULL;
             }
 
-            if (sliceLength0 == 0 || step0 != 1) {
-                PyErr_SetString(PyExc_ValueError, "Incorrect Slicing format or bounds or step size not 1\n");
+            if (sliceLength0 == 0) {
+                PyErr_SetString(PyExc_ValueError, "Row slice selects no entries");
                 return NULL;
             }
 
@@ -662,12 +3048,12 @@ PyObject *Matrix61c_subscript(Matrix61c* self, PyObject* key) {
             Py_ssize_t begin1 = 0; Py_ssize_t stop1 = 0; Py_ssize_t step1 = 0; Py_ssize_t sliceLength1 = 0;
             ret = PySlice_GetIndicesEx(slice1, length1, &begin1, &stop1, &step1, &sliceLength1);
             if (ret == -1) {
-                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into second slice\n");
+                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into second slice");
                 return NULL;
             }
 
-            if (sliceLength1 == 0 || step1 != 1) {
-                PyErr_SetString(PyExc_ValueError, "Incorrect Slicing format or bounds or step size not 1\n");
+            if (sliceLength1 == 0) {
+                PyErr_SetString(PyExc_ValueError, "Column slice selects no entries");
                 return NULL;
             }
 
@@ -675,11 +3061,15 @@ PyObject *Matrix61c_subscript(Matrix61c* self, PyObject* key) {
             cols = sliceLength1;
             //Case for a single integer being returned
             if (sliceLength0 == 1 && sliceLength1 == 1) {
-                return PyFloat_FromDouble(get(self->mat, (int) begin0, (int) begin1));
+                return PyFloat_FromDouble(get(self->mat, begin0, begin1));
             }
 
             temp->shape = get_shape(rows, cols);
-            allocate_matrix_ref(newTest, self->mat, (int) begin0, (int) begin1, (int) rows, cols);
+            if (allocate_matrix_strided(newTest, self->mat, begin0, begin1, rows, cols, step0, step1) != 0) {
+                temp->mat = NULL;
+                Py_DECREF(temp);
+                return NULL;
+            }
             temp->mat = *newTest;
             return temp;
             
@@ -688,516 +3078,345 @@ PyObject *Matrix61c_subscript(Matrix61c* self, PyObject* key) {
         if (PyObject_TypeCheck(PyTuple_GET_ITEM(key, 0), &PySlice_Type) && PyObject_TypeCheck(PyTuple_GET_ITEM(key, 1), &PyLong_Type)) {
             //TODO
             PyObject* slice0 = PyTuple_GET_ITEM(key, 0);
-            int colNum = PyLong_AsLong(PyTuple_GET_ITEM(key, 1));
+            Py_ssize_t colNum = PyLong_AsSsize_t(PyTuple_GET_ITEM(key, 1));
             Py_ssize_t length0 = rowDim;
             Py_ssize_t begin0 = 0; Py_ssize_t stop0 = 0; Py_ssize_t step0 = 0; Py_ssize_t sliceLength0 = 0;
             int ret = PySlice_GetIndicesEx(slice0, length0, &begin0, &stop0, &step0, &sliceLength0);
             if (ret == -1) {
-                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into slice\n");
+                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into slice");
                 return NULL;
             }
 
-            if (sliceLength0 == 0 || step0 != 1) {
-                PyErr_SetString(PyExc_ValueError, "Incorrect Slicing format or bounds or step size not 1\n");
+            if (sliceLength0 == 0) {
+                PyErr_SetString(PyExc_ValueError, "Row slice selects no entries");
                 return NULL;
             }
 
             rows = sliceLength0;
             cols = 1;
             if (colNum >= self->mat->cols || colNum < 0) {
-                PyErr_SetString(PyExc_IndexError, "col is out of bounds \n");
+                PyErr_Format(PyExc_IndexError, "Column index %zd is out of bounds for length %zd",
+                             colNum, colDim);
                 return NULL;
             }
             //Case for a single integer being returned
             if (rows == 1) {
-                return PyFloat_FromDouble(get(self->mat, (int) begin0, (int) colNum));
+                return PyFloat_FromDouble(get(self->mat, begin0, colNum));
             }
             
             temp->shape = get_shape(rows, cols);
-            allocate_matrix_ref(newTest, self->mat, (int) begin0, (int) colNum, (int) rows, cols);
+            if (allocate_matrix_strided(newTest, self->mat, begin0, colNum, rows, cols, step0, 1) != 0) {
+                temp->mat = NULL;
+                Py_DECREF(temp);
+                return NULL;
+            }
             temp->mat = *newTest;
             return temp;
         }
         //LONG SLICE
         if (PyObject_TypeCheck(PyTuple_GetItem(key, 1), &PySlice_Type) && PyObject_TypeCheck(PyTuple_GetItem(key, 0), &PyLong_Type)) {
             PyObject* slice0 = PyTuple_GetItem(key, 1);
-            int rowNum = PyLong_AsLong(PyTuple_GetItem(key, 0));
-            if(rowNum > rowDim) {
-                PyErr_SetString(PyExc_IndexError, "Row out of bounds\n");
-                return NULL;
-            }
-            
+            Py_ssize_t rowNum = PyLong_AsSsize_t(PyTuple_GetItem(key, 0));
             Py_ssize_t length0 = colDim;
             Py_ssize_t begin0 = 0; Py_ssize_t stop0 = 0; Py_ssize_t step0 = 0; Py_ssize_t sliceLength0 = 0;
             int ret = PySlice_GetIndicesEx(slice0, length0, &begin0, &stop0, &step0, &sliceLength0);
             if (ret == -1) {
-                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into slice\n");
+                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into slice");
                 return NULL;
             }
 
-            if (sliceLength0 == 0 || step0 != 1) {
-                PyErr_SetString(PyExc_ValueError, "Incorrect Slicing format or bounds or step size not 1\n");
+            if (sliceLength0 == 0) {
+                PyErr_SetString(PyExc_ValueError, "Column slice selects no entries");
                 return NULL;
             }
 
             rows = 1;
             cols = sliceLength0;
             if (rowNum >= self->mat->rows || rowNum < 0) {
-                PyErr_SetString(PyExc_IndexError, "row is out of bounds \n");
+                PyErr_Format(PyExc_IndexError, "Row index %zd is out of bounds for length %zd",
+                             rowNum, rowDim);
                 return NULL;
             }
             //Case for a single integer being returned
             if (cols == 1) {
-                return PyFloat_FromDouble(get(self->mat, (int) rowNum, (int) begin0));
+                return PyFloat_FromDouble(get(self->mat, rowNum, begin0));
             }
             
             temp->shape = get_shape(rows, cols);
-            allocate_matrix_ref(newTest, self->mat, (int) rowNum, (int) begin0, rows, (int) cols);
+            if (allocate_matrix_strided(newTest, self->mat, rowNum, begin0, rows, cols, 1, step0) != 0) {
+                temp->mat = NULL;
+                Py_DECREF(temp);
+                return NULL;
+            }
             temp->mat = *newTest;
             return temp;
         }
 
     }
-    PyErr_SetString(PyExc_TypeError, "You've Done messed up\n");
+    PyErr_SetString(PyExc_TypeError, "You've Done messed up");
     return NULL;
 }
 
 /*
- * Given a numc.Matrix `self`, index into it with `key`, and set the indexed result to `v`.
+ * One axis of a subscript: the int or slice `key` over an axis of `length`, as `count` entries
+ * from `start` in steps of `step`. `axis` names the axis in errors. Return 0, or -1 with an
+ * exception set.
  */
-int Matrix61c_set_subscript(Matrix61c* self, PyObject *key, PyObject *v) {
-    int rowDim = self->mat->rows;
-    int colDim = self->mat->cols;
-    
-    //LONG
-    if (PyObject_TypeCheck(key, &PyLong_Type)) {
-        //1D CASES ONLY
-        if (rowDim == 1) {
-            if (!PyObject_TypeCheck(v, &PyFloat_Type) && !PyObject_TypeCheck(v, &PyLong_Type)) {
-                PyErr_SetString(PyExc_TypeError, "Value is not valid\n");
-                return -1;
-            } 
-            int colAdd = (int) PyLong_AsLong(key);
-            double value = PyFloat_AsDouble(v);
-            if (colAdd < 0 || colAdd >= colDim) {
-                PyErr_SetString(PyExc_IndexError, "Value out of bounds\n");
-                return -1;
-            }
-            set(self->mat, 0, colAdd, value);
-            return 0;
-        }
-        if (colDim == 1) {
-            if (!PyObject_TypeCheck(v, &PyFloat_Type) && !PyObject_TypeCheck(v, &PyLong_Type)) {
-                PyErr_SetString(PyExc_TypeError, "Value is not valid");
-                return -1;
-            } 
-            int rowAdd = (int) PyLong_AsLong(key);
-            double value = PyFloat_AsDouble(v);
-            if (rowAdd < 0 || rowAdd >= rowDim) {
-                PyErr_SetString(PyExc_IndexError, "Value out of bounds");
-                return -1;
-            }
-            set(self->mat, rowAdd, 0, value);
-            return 0;
-        }
-        if (PyLong_AsLong(key) >= rowDim || PyLong_AsLong(key) < 0) {
-            PyErr_SetString(PyExc_IndexError, "Value out of bounds");
+static int parse_axis(PyObject *key, const char *axis, Py_ssize_t length, Py_ssize_t *start,
+                      Py_ssize_t *count, Py_ssize_t *step) {
+    if (PyLong_Check(key)) {
+        Py_ssize_t index = PyLong_AsSsize_t(key);
+        if (index == -1 && PyErr_Occurred()) {
             return -1;
         }
-        if (!PyObject_TypeCheck(v, &PyList_Type)) {
-            PyErr_SetString(PyExc_TypeError, "Type is invalid");
+        if (index < 0 || index >= length) {
+            PyErr_Format(PyExc_IndexError, "%s index %zd is out of bounds for length %zd", axis,
+                         index, length);
             return -1;
         }
-        if (PyObject_TypeCheck(PyList_GetItem(v, 0), &PyList_Type)) {
-            PyErr_SetString(PyExc_ValueError, "Value is invalid");
+        *start = index;
+        *count = 1;
+        *step = 1;
+        return 0;
+    }
+    if (PySlice_Check(key)) {
+        Py_ssize_t stop;
+        if (PySlice_GetIndicesEx(key, length, start, &stop, step, count) != 0) {
             return -1;
         }
-        //printf("%d %d\n",PyList_GET_SIZE(v), colDim );
-        if (PyList_GET_SIZE(v) != colDim) {
-            PyErr_SetString(PyExc_ValueError, "Mismatched col values");
+        if (*count == 0) {
+            PyErr_Format(PyExc_ValueError, "%s slice selects no entries", axis);
             return -1;
         }
-        double val = 0;
-        int rowVal = (int) PyLong_AsLong(key);
-        for (int j = 0; j < colDim; j++) {
-            val = PyFloat_AsDouble(PyList_GetItem(v, j));
-            set(self->mat, rowVal, j, val);
-        }
         return 0;
     }
-    //SLICE
-    if (PyObject_TypeCheck(key, &PySlice_Type)) {
-        //1D CASES ONLY
-        if (rowDim == 1) {
-            PyObject* slice = key;
-            Py_ssize_t length = colDim;
-            Py_ssize_t begin = 0; Py_ssize_t stop = 0; Py_ssize_t step = 0; Py_ssize_t sliceLength = 0;
-            int ret = PySlice_GetIndicesEx(slice, length, &begin, &stop, &step, &sliceLength);
-            if (ret == -1) {
-                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into first slice\n");
-                return -1;
-            }
-            if (sliceLength == 0 || step != 1) {
-                PyErr_SetString(PyExc_ValueError, "Incorrect Slicing format or bounds or step size not 1\n");
-                return -1;
-            }
-            if (sliceLength == 1) {
-                if (!PyObject_TypeCheck(v, &PyFloat_Type) && !PyObject_TypeCheck(v, &PyLong_Type)) {
-                    PyErr_SetString(PyExc_TypeError, "Invalid inputs to matrix value\n");
-                    return -1;
-                } 
-                double value = PyFloat_AsDouble(v);
-                set(self->mat, 0, begin, value);
-                return 0;
-            }
-            if (!PyObject_TypeCheck(v, &PyList_Type)) {
-                PyErr_SetString(PyExc_TypeError, "Value is not valid\n");
-                return -1;
-            }
-            if (PyList_GET_SIZE(v) != sliceLength) {
-                PyErr_SetString(PyExc_ValueError, "Size is not valid\n");
-                return -1;
-            }
-            double val = 0;
-            int count = 0;
-            for (int j = begin; j < stop; j++) {
-                val = PyFloat_AsDouble(PyList_GetItem(v, count));
-                set(self->mat, 0, j, val);
-                count += 1;
-            }
-            return 0;
-            
-        }
-        if (colDim == 1) {
-            PyObject* slice = key;
-            Py_ssize_t length = rowDim;
-            Py_ssize_t begin = 0; Py_ssize_t stop = 0; Py_ssize_t step = 0; Py_ssize_t sliceLength = 0;
-            int ret = PySlice_GetIndicesEx(slice, length, &begin, &stop, &step, &sliceLength);
-            if (ret == -1) {
-                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into first slice\n");
-                return -1;
-            }
-            if (sliceLength == 0 || step != 1) {
-                PyErr_SetString(PyExc_ValueError, "Incorrect Slicing format or bounds or step size not 1\n");
-                return -1;
-            }
-            if (sliceLength == 1) {
-                if (!PyObject_TypeCheck(v, &PyFloat_Type) && !PyObject_TypeCheck(v, &PyLong_Type)) {
-                    PyErr_SetString(PyExc_TypeError, "Invalid inputs to matrix value\n");
-                    return -1;
-                } 
-                double value = PyFloat_AsDouble(v);
-                set(self->mat, 0, begin, value);
-                return 0;
-            }
-            if (!PyObject_TypeCheck(v, &PyList_Type)) {
-                PyErr_SetString(PyExc_TypeError, "Value is not valid\n");
-                return -1;
-            }
-            if (PyList_GET_SIZE(v) != sliceLength) {
-                PyErr_SetString(PyExc_ValueError, "Size is not valid\n");
-                return -1;
-            }
-            double val = 0;
-            int count = 0;
-            for (int i = begin; i < stop; i++) {
-                val = PyFloat_AsDouble(PyList_GetItem(v, count));
-                set(self->mat, i, 0, val);
-                count += 1;
-            }
-            return 0;
-        }
-        PyObject* slice = key;
-        Py_ssize_t length = rowDim;
-        Py_ssize_t begin = 0; Py_ssize_t stop = 0; Py_ssize_t step = 0; Py_ssize_t sliceLength = 0;
-        int ret = PySlice_GetIndicesEx(slice, length, &begin, &stop, &step, &sliceLength);
-        if (ret == -1) {
-            PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into first slice\n");
+    PyErr_SetString(PyExc_TypeError, "Index must be an integer or a slice");
+    return -1;
+}
+
+/*
+ * The entries of `self` that `key` selects. As in get_subscript, a single key indexes the
+ * columns of a 1 x n matrix and the rows of anything else, and only 2D matrices take a pair.
+ */
+typedef struct region {
+    Py_ssize_t row, rows, rowStep;
+    Py_ssize_t col, cols, colStep;
+    int sliced;     // whether key has a slice, so that a scalar may fill more than one entry
+} region;
+
+static int parse_region(Matrix61c *self, PyObject *key, region *r) {
+    matrix *mat = self->mat;
+    r->row = r->col = 0;
+    r->rows = mat->rows;
+    r->cols = mat->cols;
+    r->rowStep = r->colStep = 1;
+    if (PyTuple_Check(key)) {
+        if (mat->rows == 1 || mat->cols == 1) {
+            PyErr_SetString(PyExc_TypeError, "1D matrices only support single slice!");
             return -1;
         }
-        if (sliceLength == 0 || step != 1) {
-            PyErr_SetString(PyExc_ValueError, "Incorrect Slicing format or bounds or step size not 1\n");
+        if (PyTuple_GET_SIZE(key) != 2) {
+            PyErr_SetString(PyExc_TypeError, "Index must be one or two integers or slices");
             return -1;
         }
-        if (sliceLength == 1){
-            if (PyList_GET_SIZE(v) != colDim) {
-                PyErr_SetString(PyExc_ValueError, "Dimension of input is not valid\n");
-                return -1;
-            }
-            for(int j = 0; j < colDim; j++) {
-                PyObject* item = PyList_GetItem(v, j);
-                if (!PyObject_TypeCheck(item, &PyFloat_Type) && !PyObject_TypeCheck(item, &PyLong_Type)) {
-                    PyErr_SetString(PyExc_ValueError, "Value is not valid\n");
-                    return -1;
-                }
-                double value = PyFloat_AsDouble(PyList_GetItem(v, j));
-                set(self->mat, begin, j, value);
-            }
-            return 0;
-
-        }
-
-        if (PyList_GET_SIZE(v) != sliceLength) {
-            PyErr_SetString(PyExc_ValueError, "Dimension of input is not valid\n");
+        PyObject *rowKey = PyTuple_GET_ITEM(key, 0);
+        PyObject *colKey = PyTuple_GET_ITEM(key, 1);
+        r->sliced = PySlice_Check(rowKey) || PySlice_Check(colKey);
+        if (parse_axis(rowKey, "Row", mat->rows, &r->row, &r->rows, &r->rowStep) != 0) {
             return -1;
         }
+        return parse_axis(colKey, "Column", mat->cols, &r->col, &r->cols, &r->colStep);
+    }
+    r->sliced = PySlice_Check(key);
+    if (mat->rows == 1) {
+        return parse_axis(key, "Vector", mat->cols, &r->col, &r->cols, &r->colStep);
+    }
+    return parse_axis(key, mat->cols == 1 ? "Vector" : "Row", mat->rows, &r->row, &r->rows,
+                      &r->rowStep);
+}
 
-        //error check pass
-        PyObject* tempList = NULL;
-        for(int i = 0; i < sliceLength; i++) {
-            tempList = PyList_GetItem(v, i);
-            if (PyList_GET_SIZE(tempList) != colDim) {
-                PyErr_SetString(PyExc_ValueError, "Dimension of cols is not valid\n");
-                return -1;
-            }
-        }
-        //setting values in matrix
-        int count = 0;
-        for(int i = begin; i < stop; i++) {
-            PyObject* currList = PyList_GetItem(v, count);
-            for(int j = 0; j < colDim; j++) {
-                double value = PyFloat_AsDouble(PyList_GetItem(currList, j));
-                set(self->mat, i, j, value);
-            }
-            count += 1;
-        }
-        return 0;
+/*
+ * Read the list `v` into `out`, which has the shape of the region it is assigned to: a flat list
+ * of numbers for a 1D region, a list of rows otherwise. Return 0, or -1 with an exception set.
+ */
+static int list_values(PyObject *v, matrix *out) {
+    int flat = out->rows == 1 || out->cols == 1;
+    Py_ssize_t n = flat ? out->rows * out->cols : out->rows;
+    if (PyList_GET_SIZE(v) != n) {
+        PyErr_SetString(PyExc_ValueError, "Dimension of input is not valid");
+        return -1;
     }
-    //TUPLE
-    if (PyObject_TypeCheck(key, &PyTuple_Type)) {
-        if (!PyObject_TypeCheck(PyTuple_GET_ITEM(key, 0), &PyLong_Type) && !PyObject_TypeCheck(PyTuple_GET_ITEM(key, 0), &PySlice_Type)) {
-            PyErr_SetString(PyExc_ValueError, "First Entry is not a slice or integer");
-            return -1;
-        }
-        if (!PyObject_TypeCheck(PyTuple_GET_ITEM(key, 1), &PyLong_Type) && !PyObject_TypeCheck(PyTuple_GET_ITEM(key, 1), &PySlice_Type)) {
-            PyErr_SetString(PyExc_ValueError, "Second Entry is not a slice or integer");
-            return -1;
-        }
-        if (rowDim == 1 || colDim == 1) {
-            PyErr_SetString(PyExc_TypeError, "1D matrices only support single slice!\n");
+    for (Py_ssize_t i = 0; i < n; i++) {
+        PyObject *row = PyList_GET_ITEM(v, i);
+        if (!flat && (!PyList_Check(row) || PyList_GET_SIZE(row) != out->cols)) {
+            PyErr_SetString(PyExc_ValueError, "Dimension of cols is not valid");
             return -1;
         }
-        //LONG LONG
-        if (PyObject_TypeCheck(PyTuple_GET_ITEM(key, 0), &PyLong_Type) && PyObject_TypeCheck(PyTuple_GET_ITEM(key, 1), &PyLong_Type)){
-            if (rowDim == 1 || colDim == 1) {
-                PyErr_SetString(PyExc_TypeError, "1D matrices only support single slice!\n");
+        Py_ssize_t cols = flat ? 1 : out->cols;
+        for (Py_ssize_t j = 0; j < cols; j++) {
+            PyObject *item = flat ? row : PyList_GET_ITEM(row, j);
+            if (!PyFloat_Check(item) && !PyLong_Check(item)) {
+                PyErr_SetString(PyExc_ValueError, "Value is not valid");
                 return -1;
             }
-            int givenRow = PyFloat_AsDouble(PyTuple_GET_ITEM(key, 0));
-            int givenCol = PyFloat_AsDouble(PyTuple_GET_ITEM(key, 1));
-            if (givenRow >= rowDim || givenCol >= colDim || givenRow < 0 || givenCol < 0) {
-                PyErr_SetString(PyExc_IndexError, "Index out of range\n");
+            double value = PyFloat_AsDouble(item);
+            if (value == -1 && PyErr_Occurred()) {
                 return -1;
             }
-            if (!PyObject_TypeCheck(v, &PyFloat_Type) && !PyObject_TypeCheck(v, &PyLong_Type)) {
-                PyErr_SetString(PyExc_TypeError, "Value is not valid\n");
-                return -1;
-            } 
-            set(self->mat, givenRow, givenCol, PyFloat_AsDouble(v));
-            return 0;
-
+            out->data[0][flat ? i : i * cols + j] = value;
         }
-        //SLICE SLICE
-        if (PyObject_TypeCheck(PyTuple_GET_ITEM(key, 0), &PySlice_Type) && PyObject_TypeCheck(PyTuple_GET_ITEM(key, 1), &PySlice_Type)){
-            PyObject* slice0 = PyTuple_GET_ITEM(key, 0);
-            Py_ssize_t length0 = rowDim;
-            Py_ssize_t begin0 = 0; Py_ssize_t stop0 = 0; Py_ssize_t step0 = 0; Py_ssize_t sliceLength0 = 0;
-            int ret = PySlice_GetIndicesEx(slice0, length0, &begin0, &stop0, &step0, &sliceLength0);
-            if (ret == -1) {
-                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into first slice\n");
-                return -1;
-            }
-
-            if (sliceLength0 == 0 || step0 != 1) {
-                PyErr_SetString(PyExc_ValueError, "Incorrect Slicing format or bounds or step size not 1\n");
-                return -1;
-            }
-
-            PyObject* slice1 = PyTuple_GET_ITEM(key, 1);
-            Py_ssize_t length1 = colDim;
-            Py_ssize_t begin1 = 0; Py_ssize_t stop1 = 0; Py_ssize_t step1 = 0; Py_ssize_t sliceLength1 = 0;
-            ret = PySlice_GetIndicesEx(slice1, length1, &begin1, &stop1, &step1, &sliceLength1);
-            if (ret == -1) {
-                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into second slice\n");
-                return -1;
-            }
-
-            if (sliceLength1 == 0 || step1 != 1) {
-                PyErr_SetString(PyExc_ValueError, "Incorrect Slicing format or bounds or step size not 1\n");
-                return -1;
-            }
-
-            if (sliceLength0 == 1 && sliceLength1 == 1) {
-                if (!PyObject_TypeCheck(v, &PyFloat_Type) && !PyObject_TypeCheck(v, &PyLong_Type)) {
-                    PyErr_SetString(PyExc_TypeError, "Value type is not valid\n");
-                    return -1;
-                }
-                set(self->mat, begin0, begin1, PyFloat_AsDouble(v));
-                return 0;
-            }
-            if (!PyObject_TypeCheck(v, &PyList_Type)) {
-                PyErr_SetString(PyExc_TypeError, "Type is not valid\n");
-                return -1;
-            }
-            if (sliceLength0 == 1) {
-                if (PyList_GET_SIZE(v) != sliceLength1) {
-                    PyErr_SetString(PyExc_ValueError, "Dimension of input is not valid\n");
-                    return -1;
-                }
-                for(int j = begin1; j < stop1; j++) {
-                    PyObject* item = PyList_GET_ITEM(v, j);
-                    if (!PyObject_TypeCheck(item, &PyFloat_Type) && !PyObject_TypeCheck(item, &PyLong_Type)) {
-                        PyErr_SetString(PyExc_ValueError, "Value is not valid\n");
-                        return -1;
-                    }
-                    double value = PyFloat_AsDouble(PyList_GET_ITEM(v, j));
-                    set(self->mat, begin0, j, value);
-                }
-                return 0;
-            }
-
-            if (sliceLength1 == 1) {
-                if (PyList_GET_SIZE(v) != sliceLength0) {
-                    PyErr_SetString(PyExc_ValueError, "Dimension of input is not valid\n");
-                    return -1;
-                }
-                for(int j = begin0; j < stop0; j++) {
-                    PyObject* item = PyList_GetItem(v, j);
-                    if (!PyObject_TypeCheck(item, &PyFloat_Type) && !PyObject_TypeCheck(item, &PyLong_Type)) {
-                        PyErr_SetString(PyExc_ValueError, "Value is not valid\n");
-                        return -1;
-                    }
-                    double value = PyFloat_AsDouble(PyList_GetItem(v, j));
-                    set(self->mat,j, begin1, value);
-                }
-                return 0;
-            }
+    }
+    return 0;
+}
 
-            if (PyList_GET_SIZE(v) != sliceLength0) {
-                PyErr_SetString(PyExc_ValueError, "Value dimensions are not valid\n");
-                return -1;
+/*
+ * Copy the buffer-protocol object `v`, which must export doubles, into `view`: a 2D buffer of the
+ * same shape, or a 1D buffer of as many entries into a 1D view. The buffer's strides are kept,
+ * so a transposed or sliced array is read in place. Return 0, or -1 with an exception set.
+ */
+static int assign_buffer(matrix *view, PyObject *v) {
+    Py_buffer buf;
+    if (PyObject_GetBuffer(v, &buf, PyBUF_STRIDES | PyBUF_FORMAT) != 0) {
+        return -1;
+    }
+    const char *format = buf.format;
+    if (*format == '@' || *format == '=' || *format == '<') {
+        format++;
+    }
+    int ret = -1;
+    Py_ssize_t n = view->rows * view->cols;
+    int vector = view->rows == 1 || view->cols == 1;
+    if (strcmp(format, "d") != 0 || buf.itemsize != sizeof(double)) {
+        PyErr_SetString(PyExc_TypeError, "Buffer must hold doubles");
+    } else if (buf.ndim == 2 ? buf.shape[0] != view->rows || buf.shape[1] != view->cols
+                             : buf.ndim != 1 || buf.shape[0] != n || !vector) {
+        PyErr_SetString(PyExc_ValueError, "Dimension of input is not valid");
+    } else if (buf.strides[0] % sizeof(double) != 0 ||
+               buf.strides[buf.ndim - 1] % sizeof(double) != 0) {
+        PyErr_SetString(PyExc_ValueError, "Buffer strides must be whole doubles");
+    } else {
+        /* A 1D buffer is read as a column, and assigned to the view seen as one */
+        Py_ssize_t rows = buf.ndim == 2 ? view->rows : n;
+        double **data = malloc(rows * sizeof(double *));
+        double **columnRows = buf.ndim == 2 ? NULL : malloc(n * sizeof(double *));
+        if (data == NULL || (buf.ndim == 1 && columnRows == NULL)) {
+            PyErr_NoMemory();
+        } else {
+            for (Py_ssize_t i = 0; i < rows; i++) {
+                data[i] = (double *) ((char *) buf.buf + i * buf.strides[0]);
             }
-            int count = 0;
-            for(int i = begin0; i < stop0; i++){
-                PyObject* currList = PyList_GetItem(v, count);
-                if (PyList_GET_SIZE(currList) != sliceLength1) {
-                    PyErr_SetString(PyExc_ValueError, "Value dimensions are not valid\n");
-                    return -1;
-                }
-                int internalCount = 0;
-                for (int j = begin1; j < stop1; j++){
-                    double value = PyFloat_AsDouble(PyList_GetItem(currList, internalCount));
-                    set(self->mat, i, j, value);
-                    internalCount += 1;
-                }
-                count += 1;
+            Py_ssize_t stride = buf.ndim == 2 ? buf.strides[1] / (Py_ssize_t) sizeof(double) : 1;
+            matrix src = {rows, buf.ndim == 2 ? view->cols : 1, data, stride, 0, 0, NULL};
+            if (buf.ndim == 2) {
+                ret = assign_matrix(view, &src);
+            } else {
+                matrix column = column_view(view, columnRows);
+                ret = assign_matrix(&column, &src);
             }
-            return 0;
-
         }
-        //LONG SLICE
-        if (PyObject_TypeCheck(PyTuple_GET_ITEM(key, 0), &PyLong_Type) && PyObject_TypeCheck(PyTuple_GET_ITEM(key, 1), &PySlice_Type)){
-            int index = (int) PyLong_AsLong(PyTuple_GET_ITEM(key, 0));
-            if(index < 0 || index >= rowDim) {
-                PyErr_SetString(PyExc_IndexError, "Index out of Range!");
-                return -1;
-            }
-            PyObject* slice = PyTuple_GET_ITEM(key, 1);
-            Py_ssize_t length = colDim;
-            Py_ssize_t begin = 0; Py_ssize_t stop = 0; Py_ssize_t step = 0; Py_ssize_t sliceLength = 0;
-            int ret = PySlice_GetIndicesEx(slice, length, &begin, &stop, &step, &sliceLength);
-            if (ret == -1) {
-                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into slice");
-                return -1;
-            }
+        free(data);
+        free(columnRows);
+    }
+    PyBuffer_Release(&buf);
+    return ret;
+}
 
-            if (sliceLength == 0 || step != 1) {
-                PyErr_SetString(PyExc_ValueError, "Incorrect Slicing format or bounds or step size not 1\n");
-                return -1;
-            }
-            if (sliceLength == 1) {
-                if (!PyObject_TypeCheck(v, &PyFloat_Type) && !PyObject_TypeCheck(v, &PyLong_Type)) {
-                    PyErr_SetString(PyExc_TypeError, "this indexing combo requires a number not a list");
-                    return -1;
-                }
-                set(self->mat,index, begin, (double) PyFloat_AsDouble(v));
-                return 0;
-            }
-            if(!PyObject_TypeCheck(v, &PyList_Type)) {
-                PyErr_SetString(PyExc_TypeError, "Value should be list");
-                return -1;
-            }
-            if (PyList_GET_SIZE(v) != sliceLength) {
-                PyErr_SetString(PyExc_ValueError, "Value dimensions are not valid");
-                return -1;
-            }
-            int count = 0;
-            //printf("%d %d\n", begin, stop);
-            for(int j = begin; j < stop; j++) {
-                PyObject* item = PyList_GetItem(v, count);
-                if (!PyObject_TypeCheck(item, &PyFloat_Type) && !PyObject_TypeCheck(item, &PyLong_Type)) {
-                    PyErr_SetString(PyExc_ValueError, "Value is not valid");
-                    return -1;
-                }
-                double value = PyFloat_AsDouble(PyList_GetItem(v, count));
-                set(self->mat,index, j, value);
-                count++;
-            }
-            return 0;
+/*
+ * Given a numc.Matrix `self`, index into it with `key`, and set the indexed result to `v`: a
+ * number, a list, a numc.Matrix or an object exporting doubles through the buffer protocol. The
+ * region is written through a strided view of `self`, so every step is allowed, a number fills
+ * any region that key slices, and matrices and buffers are copied a row at a time. A source
+ * that overlaps the region, such as another view of `self`, is read in full before the write.
+ */
+static int set_subscript(Matrix61c* self, PyObject *key, PyObject *v) {
+    region r;
+    if (parse_region(self, key, &r) != 0) {
+        return -1;
+    }
+    int number = PyFloat_Check(v) || PyLong_Check(v);
+    if (number && r.rows * r.cols == 1) {
+        double value = PyFloat_AsDouble(v);
+        if (value == -1 && PyErr_Occurred()) {
+            return -1;
         }
-        //SLICE LONG
-        if (PyObject_TypeCheck(PyTuple_GET_ITEM(key, 0), &PySlice_Type) && PyObject_TypeCheck(PyTuple_GET_ITEM(key, 1), &PyLong_Type)){
-            int index = (int) PyLong_AsLong(PyTuple_GET_ITEM(key, 1));
-            if(index < 0 || index >= colDim) {
-                PyErr_SetString(PyExc_IndexError, "Index out of Range!");
-                return -1;
-            }
-            PyObject* slice = PyTuple_GET_ITEM(key,0);
-            Py_ssize_t length = rowDim;
-            Py_ssize_t begin = 0; Py_ssize_t stop = 0; Py_ssize_t step = 0; Py_ssize_t sliceLength = 0;
-            int ret = PySlice_GetIndicesEx(slice, length, &begin, &stop, &step, &sliceLength);
-            if (ret == -1) {
-                PyErr_SetString(PyExc_TypeError, "Incorrect type of stuff entered into slice");
-                return -1;
-            }
+        set(self->mat, r.row, r.col, value);
+        return 0;
+    }
+    if (number && !r.sliced) {
+        PyErr_SetString(PyExc_TypeError, "Value is not valid");
+        return -1;
+    }
+    int matrixSource = PyObject_TypeCheck(v, &Matrix61cType);
+    if (!number && !matrixSource && !PyList_Check(v) && !PyObject_CheckBuffer(v)) {
+        PyErr_SetString(PyExc_TypeError, "Value is not valid");
+        return -1;
+    }
 
-            if (sliceLength == 0 || step != 1) {
-                PyErr_SetString(PyExc_ValueError, "Incorrect Slicing format or bounds or step size not 1\n");
-                return -1;
-            }
-            if (sliceLength == 1) {
-                if (!PyObject_TypeCheck(v, &PyFloat_Type) && !PyObject_TypeCheck(v, &PyLong_Type)) {
-                    PyErr_SetString(PyExc_TypeError, "this indexing combo requires a number not a list");
-                    return -1;
-                }
-                set(self->mat,begin, index, (double) PyFloat_AsDouble(v));
-                return 0;
-            }
-            if(!PyObject_TypeCheck(v, &PyList_Type)) {
-                PyErr_SetString(PyExc_TypeError, "Value should be list");
-                return -1;
-            }
-            if (PyList_GET_SIZE(v) != sliceLength) {
-                PyErr_SetString(PyExc_ValueError, "Value dimensions are not valid");
-                return -1;
+    matrix *view;
+    if (allocate_matrix_strided(&view, self->mat, r.row, r.col, r.rows, r.cols, r.rowStep,
+                                r.colStep) != 0) {
+        return -1;
+    }
+    int ret = 0;
+    if (number) {
+        double value = PyFloat_AsDouble(v);
+        if (value == -1 && PyErr_Occurred()) {
+            ret = -1;
+        } else {
+            fill_matrix(view, value);
+        }
+    } else if (matrixSource) {
+        matrix *src = ((Matrix61c *) v)->mat;
+        Py_ssize_t n = view->rows * view->cols;
+        int vectors = (view->rows == 1 || view->cols == 1) && (src->rows == 1 || src->cols == 1);
+        if (vectors && src->rows * src->cols == n && src->rows != view->rows) {
+            /* A row into a column or the other way round: both are assigned as columns */
+            double **rows = malloc(2 * n * sizeof(double *));
+            if (rows == NULL) {
+                PyErr_NoMemory();
+                ret = -1;
+            } else {
+                matrix dstColumn = column_view(view, rows);
+                matrix srcColumn = column_view(src, rows + n);
+                ret = assign_matrix(&dstColumn, &srcColumn);
+                free(rows);
             }
-            int count = 0;
-            //printf("%d %d\n", begin, stop);
-            for(int j = begin; j < stop; j++) {
-                PyObject* item = PyList_GetItem(v, count);
-                if (!PyObject_TypeCheck(item, &PyFloat_Type) && !PyObject_TypeCheck(item, &PyLong_Type)) {
-                    PyErr_SetString(PyExc_ValueError, "Value is not valid");
-                    return -1;
-                }
-                double value = PyFloat_AsDouble(PyList_GetItem(v, count));
-                set(self->mat,j, index, value);
-                count++;
+        } else {
+            ret = assign_matrix(view, src);
+        }
+    } else if (PyList_Check(v)) {
+        matrix *values;
+        if (allocate_matrix(&values, view->rows, view->cols) != 0) {
+            ret = -1;
+        } else {
+            ret = list_values(v, values);
+            if (ret == 0) {
+                ret = assign_matrix(view, values);
             }
-            return 0;
+            deallocate_matrix(values);
         }
+    } else {
+        ret = assign_buffer(view, v);
     }
-    return -1;
+    deallocate_matrix(view);
+    return ret;
+}
+
+/*
+ * Subscript entry points: get_subscript and set_subscript bracketed with trace events.
+ */
+PyObject *Matrix61c_subscript(Matrix61c* self, PyObject* key) {
+    trace_begin("numc", "__getitem__", self->mat->rows, self->mat->cols, 0, 0);
+    PyObject *result = get_subscript(self, key);
+    trace_end("numc", "__getitem__", 0);
+    return result;
+}
 
+int Matrix61c_set_subscript(Matrix61c* self, PyObject *key, PyObject *v) {
+    trace_begin("numc", "__setitem__", self->mat->rows, self->mat->cols, 0, 0);
+    int result = unshare_matrix(self->mat) != 0 ? -1 : set_subscript(self, key, v);
+    trace_end("numc", "__setitem__", 0);
+    return result;
 }
 
 PyMappingMethods Matrix61c_mapping = {
@@ -1206,6 +3425,11 @@ PyMappingMethods Matrix61c_mapping = {
     (objobjargproc) Matrix61c_set_subscript,
 };
 
+PyBufferProcs Matrix61c_as_buffer = {
+    (getbufferproc) Matrix61c_getbuffer,
+    (releasebufferproc) Matrix61c_releasebuffer,
+};
+
 /* INSTANCE ATTRIBUTES*/
 PyMemberDef Matrix61c_members[] = {
     {
@@ -1222,12 +3446,14 @@ PyTypeObject Matrix61cType = {
     .tp_dealloc = (destructor)Matrix61c_dealloc,
     .tp_repr = (reprfunc)Matrix61c_repr,
     .tp_as_number = &Matrix61c_as_number,
+    .tp_richcompare = Matrix61c_richcompare,
     .tp_flags = Py_TPFLAGS_DEFAULT |
     Py_TPFLAGS_BASETYPE,
     .tp_doc = "numc.Matrix objects",
     .tp_methods = Matrix61c_methods,
     .tp_members = Matrix61c_members,
     .tp_as_mapping = &Matrix61c_mapping,
+    .tp_as_buffer = &Matrix61c_as_buffer,
     .tp_init = (initproc)Matrix61c_init,
     .tp_new = Matrix61c_new
 };
@@ -1247,6 +3473,8 @@ PyMODINIT_FUNC PyInit_numc(void) {
 
     if (PyType_Ready(&Matrix61cType) < 0)
         return NULL;
+    if (PyType_Ready(&FutureType) < 0)
+        return NULL;
 
     m = PyModule_Create(&numcmodule);
     if (m == NULL)
@@ -1254,6 +3482,42 @@ PyMODINIT_FUNC PyInit_numc(void) {
 
     Py_INCREF(&Matrix61cType);
     PyModule_AddObject(m, "Matrix", (PyObject *)&Matrix61cType);
+    Py_INCREF(&FutureType);
+    PyModule_AddObject(m, "Future", (PyObject *)&FutureType);
+
+    LinAlgError = PyErr_NewException("numc.LinAlgError", PyExc_ValueError, NULL);
+    if (LinAlgError == NULL) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    Py_INCREF(LinAlgError);
+    PyModule_AddObject(m, "LinAlgError", LinAlgError);
+
+    frombuffer = PyObject_GetAttrString(m, "frombuffer");
+    if (frombuffer == NULL) {
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    /* numc.random is a plain submodule; registering it in sys.modules makes `import numc.random` work */
+    PyObject *random = PyModule_Create(&numcrandommodule);
+    if (random == NULL || PyDict_SetItemString(PyImport_GetModuleDict(), "numc.random", random) < 0) {
+        Py_XDECREF(random);
+        Py_DECREF(m);
+        return NULL;
+    }
+    PyModule_AddObject(m, "random", random);
+
+    /* Host-tuned parameters from numc_autotune.py, if it has been run; a bad file only warns */
+    char path[4096];
+    if (tuning_path(path, sizeof(path)) == 0) {
+        int ret = load_tuning(path);
+        if (ret > 0 && PyErr_WarnFormat(PyExc_RuntimeWarning, 1,
+                                        "%s:%d: malformed or out-of-range setting", path, ret) < 0) {
+            Py_DECREF(m);
+            return NULL;
+        }
+    }
     printf("NumC Module Imported\n");
     fflush(stdout);
     return m;
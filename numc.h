@@ -1,4 +1,5 @@
 #include "matrix.h"
+#include <pthread.h>
 
 /*
  * Defines the struct that represents the object
@@ -12,16 +13,53 @@ typedef struct {
     PyObject *shape;
 } Matrix61c;
 
+/*
+ * A result of numc.submit or Matrix.matmul_async that a pool worker computes without the GIL.
+ * `value` is allocated at submit time and filled in by the kernel; the operands (Matrix or
+ * Future objects) are kept alive in `operands`. `pending` counts operand Futures that are not
+ * done yet, plus one while submitting; whoever takes it to zero queues the kernel. `lock` guards
+ * `done`, `dependents` (Futures waiting on this one) and `owner`, a reference to self held while
+ * `callbacks` wait to run. Workers never take the GIL, so they queue a done Future with callbacks
+ * through `next_callback` for numc's callback thread.
+ */
+typedef struct future_link {
+    struct Future *future;
+    struct future_link *next;
+} future_link;
+
+typedef struct Future {
+    PyObject_HEAD
+    int op;
+    int threads;
+    matrix *in1;
+    matrix *in2;
+    PyObject *operands;
+    Matrix61c *value;
+    int pending;
+    int done;
+    future_link *dependents;
+    PyObject *callbacks;
+    PyObject *owner;
+    struct Future *next_callback;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Future;
+
 /* Function definitions */
-int init_rand(PyObject *self, int rows, int cols, unsigned int seed, double low, double high);
-int init_fill(PyObject *self, int rows, int cols, double val);
-int init_1d(PyObject *self, int rows, int cols, PyObject *lst);
+int init_rand(PyObject *self, Py_ssize_t rows, Py_ssize_t cols, unsigned int seed, double low, double high);
+int init_fill(PyObject *self, Py_ssize_t rows, Py_ssize_t cols, double val);
+int init_1d(PyObject *self, Py_ssize_t rows, Py_ssize_t cols, PyObject *lst);
 int init_2d(PyObject *self, PyObject *lst);
 void Matrix61c_dealloc(Matrix61c *self);
 PyObject *Matrix61c_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
 int Matrix61c_init(PyObject *self, PyObject *args, PyObject *kwds);
 PyObject *Matrix61c_to_list(Matrix61c *self);
 PyObject *Matrix61c_repr(PyObject *self);
+PyObject *Matrix61c_copy(Matrix61c *self, PyObject *unused);
+PyObject *Matrix61c_reduce_ex(Matrix61c *self, PyObject *args);
+PyObject *Matrix61c_shared(PyObject *unused, PyObject *args, PyObject *kwargs);
+PyObject *Matrix61c_attach(PyObject *unused, PyObject *args);
+PyObject *Matrix61c_unlink(PyObject *unused, PyObject *args);
 PyObject *Matrix61c_set_value(Matrix61c *self, PyObject* args);
 PyObject *Matrix61c_get_value(Matrix61c *self, PyObject* args);
 PyObject *Matrix61c_add(Matrix61c* self, PyObject* args);
@@ -30,4 +68,6 @@ PyObject *Matrix61c_multiply(Matrix61c* self, PyObject *args);
 PyObject *Matrix61c_neg(Matrix61c* self);
 PyObject *Matrix61c_abs(Matrix61c *self);
 PyObject *Matrix61c_pow(Matrix61c *self, PyObject *pow, PyObject *optional);
+PyObject *Matrix61c_richcompare(PyObject *self, PyObject *other, int op);
+int Matrix61c_bool(Matrix61c *self);
 
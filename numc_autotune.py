@@ -0,0 +1,186 @@
+"""
+Host autotuner for numc.
+
+Benchmarks the tunable parameters of matrix.c on this machine and writes the winners to the tuning
+file that numc loads at import (numc.tuning_path(): $NUMC_TUNING, else
+$XDG_CONFIG_HOME/numc/tuning.conf, else ~/.config/numc/tuning.conf). In order, it picks:
+
+  1. the matrix product blocking (mul_tile_rows/depth/cols) and whether to pack blocks (mul_pack),
+  2. the default thread cap (num_threads), from matrix products on 1, 2, 4, ... threads,
+  3. the single-thread FLOP rate and memory bandwidth the cost model starts from,
+  4. plan_thread_ns, from where a threaded add starts beating a single-thread one, and
+  5. plan_simd_elements, from where the AVX loop starts beating the scalar one.
+
+Run it again after moving to a different host; the file is only read, never updated, by numc.
+
+Usage: python3 numc_autotune.py [--quick] [--out PATH] [--dry-run]
+       python3 -m numc_autotune ...   (once installed with `make install`)
+"""
+import argparse
+import datetime
+import os
+import platform
+import time
+
+import numc as nc
+
+TILE_ROWS = (16, 32, 64)
+TILE_DEPTH = (64, 128, 256)
+TILE_COLS = (128, 256, 512)
+QUICK_TILES = ((32, 128, 256), (64, 256, 512), (16, 256, 128))
+
+
+def best_ns(fn, repeats, loops=1):
+    """Nanoseconds per call of fn in the fastest of `repeats` runs of `loops` calls, after a warm-up."""
+    fn()
+    best = None
+    for _ in range(repeats):
+        start = time.perf_counter_ns()
+        for _ in range(loops):
+            fn()
+        elapsed = (time.perf_counter_ns() - start) / loops
+        best = elapsed if best is None else min(best, elapsed)
+    return max(best, 1)
+
+
+def square(n, seed):
+    return nc.Matrix(n, n, rand=True, seed=seed)
+
+
+def tune_tiles(args, log):
+    n = 256 if args.quick else 512
+    a, b = square(n, 1), square(n, 2)
+    candidates = [(0, 0, 0, 0)]
+    tiles = QUICK_TILES if args.quick else [(r, d, c) for r in TILE_ROWS for d in TILE_DEPTH for c in TILE_COLS]
+    candidates += [tile + (pack,) for tile in tiles for pack in (0, 1)]
+    results = []
+    for rows, depth, cols, pack in candidates:
+        nc.set_tuning(mul_tile_rows=rows, mul_tile_depth=depth, mul_tile_cols=cols, mul_pack=pack)
+        ns = best_ns(lambda: a * b, args.repeats)
+        results.append((ns, rows, depth, cols, pack))
+        log("  tiles %3d x %3d x %3d pack %d: %8.2f ms" % (rows, depth, cols, pack, ns / 1e6))
+    ns, rows, depth, cols, pack = min(results)
+    return {"mul_tile_rows": rows, "mul_tile_depth": depth, "mul_tile_cols": cols, "mul_pack": pack}
+
+
+def tune_threads(args, log):
+    n = 256 if args.quick else 512
+    a, b = square(n, 3), square(n, 4)
+    cores = os.cpu_count() or 1
+    counts = sorted({1 << i for i in range(cores.bit_length()) if 1 << i <= cores} | {cores})
+    results = []
+    for threads in counts:
+        ns = best_ns(lambda: a.mul(b, threads=threads), args.repeats)
+        results.append((ns, threads))
+        log("  %2d threads: %8.2f ms" % (threads, ns / 1e6))
+    ns, threads = min(results)
+    # 0 keeps following OMP_NUM_THREADS / the core count, which is what "all of them" should mean
+    return {"num_threads": 0 if threads == cores else threads}
+
+
+def tune_rates(args, log):
+    n = 256 if args.quick else 512
+    a, b = square(n, 5), square(n, 6)
+    flops = 2.0 * n * n * n / best_ns(lambda: a.mul(b, threads=1), args.repeats)
+    m = 1024 if args.quick else 2048
+    c, d = square(m, 7), square(m, 8)
+    bandwidth = 3.0 * 8 * m * m / best_ns(lambda: c.add(d, threads=1), args.repeats)
+    log("  %.2f GFLOP/s, %.2f GB/s on one thread" % (flops, bandwidth))
+    return {"plan_flops_per_ns": flops, "plan_bytes_per_ns": bandwidth}
+
+
+def tune_thread_ns(args, log, bandwidth):
+    cores = os.cpu_count() or 1
+    if cores < 2:
+        log("  one core, nothing to split")
+        return {}
+    # Force every add onto a full team so that it can be compared with one thread
+    nc.set_tuning(plan_thread_ns=1e-6)
+    for n in (16, 32, 64, 128, 256, 512, 1024):
+        a, b = square(n, 9), square(n, 10)
+        serial = best_ns(lambda: a.add(b, threads=1), args.repeats, 20)
+        team = best_ns(lambda: a.add(b, threads=cores), args.repeats, 20)
+        log("  %4d x %-4d add: %8.1f us alone, %8.1f us on %d threads" % (n, n, serial / 1e3, team / 1e3, cores))
+        if team < serial:
+            # plan_kernel starts a team once the work is worth two threads
+            return {"plan_thread_ns": 3.0 * 8 * n * n / bandwidth / 2}
+    return {}
+
+
+def tune_simd(args, log):
+    sizes = (1, 2, 4, 8, 16, 32, 64, 128, 256)
+    wins = []
+    for n in sizes:
+        a, b = nc.Matrix(1, n, rand=True, seed=11), nc.Matrix(1, n, rand=True, seed=12)
+        nc.set_tuning(plan_simd_elements=1 << 30)
+        scalar = best_ns(lambda: a.add(b, threads=1), args.repeats, 1000)
+        nc.set_tuning(plan_simd_elements=0)
+        simd = best_ns(lambda: a.add(b, threads=1), args.repeats, 1000)
+        log("  %3d elements: %6.0f ns scalar, %6.0f ns AVX" % (n, scalar, simd))
+        wins.append(simd <= scalar)
+    # The differences are tens of nanoseconds under a microsecond of call overhead, so only trust
+    # a cutoff that every larger size agrees with
+    cutoff = None
+    for n, win in reversed(list(zip(sizes, wins))):
+        if not win:
+            break
+        cutoff = n
+    return {} if cutoff is None else {"plan_simd_elements": cutoff}
+
+
+def write_config(path, settings):
+    os.makedirs(os.path.dirname(os.path.abspath(path)), exist_ok=True)
+    with open(path, "w") as f:
+        f.write("# numc tuning for %s (%s), written by numc_autotune.py on %s\n"
+                % (platform.node(), platform.processor() or platform.machine(),
+                   datetime.date.today().isoformat()))
+        for name in sorted(settings):
+            f.write("%s = %r\n" % (name, settings[name]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--quick", action="store_true", help="smaller matrices and fewer candidates")
+    parser.add_argument("--repeats", type=int, default=5, help="timed calls per candidate (default 5)")
+    parser.add_argument("--out", help="tuning file to write (default numc.tuning_path())")
+    parser.add_argument("--dry-run", action="store_true", help="print the settings instead of writing them")
+    args = parser.parse_args()
+    out = args.out or nc.tuning_path()
+    if out is None and not args.dry_run:
+        parser.error("no default tuning file (HOME is not set); pass --out")
+
+    def log(line):
+        print(line, flush=True)
+
+    original = nc.tuning()
+    settings = {}
+    try:
+        # Tune from the built-in defaults rather than whatever file was loaded at import
+        nc.set_tuning(num_threads=0, mul_tile_rows=0, mul_tile_depth=0, mul_tile_cols=0, mul_pack=0)
+        log("matrix product blocking")
+        settings.update(tune_tiles(args, log))
+        nc.set_tuning(**settings)
+        log("thread count")
+        settings.update(tune_threads(args, log))
+        log("single-thread rates")
+        settings.update(tune_rates(args, log))
+        log("threading cutoff")
+        settings.update(tune_thread_ns(args, log, settings["plan_bytes_per_ns"]))
+        log("vector cutoff")
+        settings.update(tune_simd(args, log))
+    finally:
+        nc.set_tuning(**original)
+
+    if args.dry_run:
+        for name in sorted(settings):
+            print("%s = %r" % (name, settings[name]))
+        return
+    write_config(out, settings)
+    # Make sure numc can read back what was written before declaring success
+    nc.load_tuning(out)
+    nc.set_tuning(**original)
+    print("wrote %s" % out)
+
+
+if __name__ == "__main__":
+    main()
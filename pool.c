@@ -0,0 +1,468 @@
+#include "pool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_MAX_WORKERS 256
+#define POOL_DEQUE 256          // tasks a worker can hold; a job needs about log2(splits) of them
+#define POOL_SPLITS 4           // a job's grain leaves this many tasks per thread, for balance
+#define POOL_SPIN 256           // empty scans of the deques before a worker goes to sleep
+
+/*
+ * One pool_for call. `remaining` counts the iterations not yet run; the task that takes it to
+ * zero finishes the job, and nothing may touch the job after that since it lives on the caller's
+ * stack. `active` counts the workers running its tasks, which thieves keep at or below `limit`.
+ * A job from pool_submit is instead `detached`: it lives on the heap and its one task frees it.
+ */
+typedef struct pool_job {
+    pool_fn fn;
+    void *args;
+    int64_t grain;
+    int limit;
+    int active;
+    int64_t remaining;
+    int detached;
+} pool_job;
+
+typedef struct detached_job {
+    pool_job job;
+    void (*fn)(void *args);
+    void *args;
+} detached_job;
+
+typedef struct pool_task {
+    pool_job *job;
+    int64_t begin;
+    int64_t end;
+} pool_task;
+
+/*
+ * A worker's deque holds tasks[top..bottom) modulo POOL_DEQUE. The owner pushes and pops at the
+ * bottom, thieves take from the top. `call` is a pending pool_broadcast function.
+ */
+typedef struct pool_worker {
+    pthread_mutex_t lock;
+    pool_task tasks[POOL_DEQUE];
+    unsigned top;
+    unsigned bottom;
+    void (*call)(void *args);
+    void *callArgs;
+    unsigned seed;
+    pthread_t thread;
+    pool_counters counters;
+} pool_worker;
+
+static pool_worker *workers[POOL_MAX_WORKERS];
+static int num_workers = 0;
+static int stopping = 0;
+static unsigned generation = 0; // bumped whenever there may be new work for a sleeper
+static int sleepers = 0;
+static int broadcast_pending = 0;
+static unsigned next_worker = 0;
+static uint64_t jobs = 0;
+
+/* pool_lock guards starting and stopping workers and the sleep and completion waits */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t broadcast_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+static __thread pool_worker *self = NULL;
+
+/*
+ * Wake a sleeping worker after making work visible. Together with the sleeper re-checking
+ * `generation` after counting itself in `sleepers`, this cannot miss a wakeup: both sides write
+ * their counter before reading the other's, with sequentially consistent atomics.
+ */
+static void wake_worker(void) {
+    __atomic_add_fetch(&generation, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool_lock);
+        pthread_cond_signal(&work_cond);
+        pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+static int push_task(pool_worker *w, pool_task task) {
+    pthread_mutex_lock(&w->lock);
+    if (w->bottom - w->top == POOL_DEQUE) {
+        pthread_mutex_unlock(&w->lock);
+        return -1;
+    }
+    w->tasks[w->bottom % POOL_DEQUE] = task;
+    __atomic_store_n(&w->bottom, w->bottom + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&w->lock);
+    wake_worker();
+    return 0;
+}
+
+static int is_empty(pool_worker *w) {
+    return __atomic_load_n(&w->top, __ATOMIC_RELAXED) ==
+           __atomic_load_n(&w->bottom, __ATOMIC_RELAXED);
+}
+
+static int pop_task(pool_worker *w, pool_task *task) {
+    if (is_empty(w)) {
+        return 0;
+    }
+    pthread_mutex_lock(&w->lock);
+    int found = w->bottom != w->top;
+    if (found) {
+        w->bottom--;
+        *task = w->tasks[w->bottom % POOL_DEQUE];
+    }
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+/*
+ * Take the oldest task of some other worker, starting from a random one. A task whose job
+ * already has `limit` workers on it is left for them.
+ */
+static int steal_task(pool_worker *thief, pool_task *task) {
+    int n = __atomic_load_n(&num_workers, __ATOMIC_ACQUIRE);
+    if (n < 2) {
+        // Also covers a new worker running before pool_start has counted it
+        return 0;
+    }
+    thief->seed = thief->seed * 1103515245u + 12345u;
+    int first = (int) ((thief->seed >> 16) % (unsigned) n);
+    for (int i = 0; i < n; i++) {
+        pool_worker *victim = workers[(first + i) % n];
+        if (victim == thief || is_empty(victim)) {
+            continue;
+        }
+        pthread_mutex_lock(&victim->lock);
+        int found = 0;
+        if (victim->top != victim->bottom) {
+            pool_task *oldest = &victim->tasks[victim->top % POOL_DEQUE];
+            if (__atomic_load_n(&oldest->job->active, __ATOMIC_RELAXED) < oldest->job->limit) {
+                *task = *oldest;
+                __atomic_store_n(&victim->top, victim->top + 1, __ATOMIC_RELAXED);
+                found = 1;
+            }
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (found) {
+            thief->counters.steals++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void finish_iterations(pool_job *job, int64_t count) {
+    if (__atomic_sub_fetch(&job->remaining, count, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&pool_lock);
+        pthread_cond_broadcast(&done_cond);
+        pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+/*
+ * Run a task on the calling worker, handing the upper half of its range to the deque until what
+ * is left fits the job's grain. If the deque is full the rest runs here unsplit.
+ */
+static void run_task(pool_task *task) {
+    pool_job *job = task->job;
+    int64_t begin = task->begin;
+    int64_t end = task->end;
+    __atomic_add_fetch(&job->active, 1, __ATOMIC_RELAXED);
+    while (end - begin > job->grain) {
+        int64_t mid = begin + (end - begin) / 2;
+        pool_task upper = {job, mid, end};
+        if (push_task(self, upper) != 0) {
+            break;
+        }
+        end = mid;
+    }
+    job->fn(job->args, begin, end);
+    self->counters.tasks++;
+    if (job->detached) {
+        free(job);
+        return;
+    }
+    // A task of this job that thieves skipped for being at its limit may now be taken
+    if (__atomic_sub_fetch(&job->active, 1, __ATOMIC_RELAXED) + 1 == job->limit) {
+        wake_worker();
+    }
+    finish_iterations(job, end - begin);
+}
+
+static int run_call(pool_worker *w) {
+    void (*call)(void *) = __atomic_load_n(&w->call, __ATOMIC_ACQUIRE);
+    if (call == NULL) {
+        return 0;
+    }
+    call(w->callArgs);
+    __atomic_store_n(&w->call, NULL, __ATOMIC_RELAXED);
+    if (__atomic_sub_fetch(&broadcast_pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&pool_lock);
+        pthread_cond_broadcast(&done_cond);
+        pthread_mutex_unlock(&pool_lock);
+    }
+    return 1;
+}
+
+/*
+ * Run one broadcast call or task if there is any work for the calling worker. Return 0 if there
+ * was nothing to do.
+ */
+static int work_once(void) {
+    pool_task task;
+    if (run_call(self)) {
+        return 1;
+    }
+    if (pop_task(self, &task) || steal_task(self, &task)) {
+        run_task(&task);
+        return 1;
+    }
+    return 0;
+}
+
+static void *worker_main(void *arg) {
+    self = arg;
+    int idle = 0;
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+        unsigned seen = __atomic_load_n(&generation, __ATOMIC_SEQ_CST);
+        if (work_once()) {
+            idle = 0;
+            continue;
+        }
+        if (++idle < POOL_SPIN) {
+            sched_yield();
+            continue;
+        }
+        idle = 0;
+        pthread_mutex_lock(&pool_lock);
+        __atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&generation, __ATOMIC_SEQ_CST) == seen && !stopping) {
+            self->counters.sleeps++;
+            pthread_cond_wait(&work_cond, &pool_lock);
+        }
+        __atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool_lock);
+    }
+    return NULL;
+}
+
+/*
+ * A forked child has none of the workers, and the locks may have been held by one of them at the
+ * fork. Start over with an empty pool; the old workers' memory is left behind.
+ */
+static void reset_after_fork(void) {
+    pthread_mutex_t freshLock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t freshCond = PTHREAD_COND_INITIALIZER;
+    pool_lock = freshLock;
+    broadcast_lock = freshLock;
+    work_cond = freshCond;
+    done_cond = freshCond;
+    num_workers = 0;
+    stopping = 0;
+    sleepers = 0;
+    broadcast_pending = 0;
+    self = NULL;
+}
+
+static void register_atfork(void) {
+    pthread_atfork(NULL, NULL, reset_after_fork);
+}
+
+/*
+ * Grow the pool to at least `count` workers (at most POOL_MAX_WORKERS). Workers block every
+ * signal so that they are delivered to the application's own threads. Return 0 upon success and
+ * -1 if no worker could be started; a pool that could only partly grow keeps what it got.
+ */
+int pool_start(int count) {
+    pthread_once(&atfork_once, register_atfork);
+    if (count > POOL_MAX_WORKERS) {
+        count = POOL_MAX_WORKERS;
+    }
+    pthread_mutex_lock(&pool_lock);
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    while (num_workers < count) {
+        pool_worker *w = calloc(1, sizeof(pool_worker));
+        if (w == NULL) {
+            break;
+        }
+        pthread_mutex_init(&w->lock, NULL);
+        w->seed = (unsigned) num_workers * 2654435761u + 1;
+        workers[num_workers] = w;
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            pthread_mutex_destroy(&w->lock);
+            free(w);
+            break;
+        }
+        __atomic_store_n(&num_workers, num_workers + 1, __ATOMIC_RELEASE);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    int ret = num_workers > 0 ? 0 : -1;
+    pthread_mutex_unlock(&pool_lock);
+    return ret;
+}
+
+/*
+ * Join and free every worker. No job may be running.
+ */
+void pool_stop(void) {
+    pthread_mutex_lock(&pool_lock);
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&work_cond);
+    int count = num_workers;
+    pthread_mutex_unlock(&pool_lock);
+    for (int i = 0; i < count; i++) {
+        pthread_join(workers[i]->thread, NULL);
+    }
+    pthread_mutex_lock(&pool_lock);
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_destroy(&workers[i]->lock);
+        free(workers[i]);
+        workers[i] = NULL;
+    }
+    num_workers = 0;
+    __atomic_store_n(&stopping, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+int pool_workers(void) {
+    return __atomic_load_n(&num_workers, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Whether the calling thread is one of the pool's workers.
+ */
+int pool_in_worker(void) {
+    return self != NULL;
+}
+
+/*
+ * Run fn(args, begin, end) over [0, count) on the pool, with at most `threads` workers on it at
+ * once (nested calls from a worker also use that worker), growing the pool to `threads` if it is
+ * smaller. Return 0 once every iteration has run, or -1 without running any if the pool has no
+ * workers and none could be started.
+ */
+int pool_for(int threads, int64_t count, pool_fn fn, void *args) {
+    if (count <= 0) {
+        return 0;
+    }
+    if (pool_workers() < threads && pool_start(threads) != 0) {
+        return -1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    int64_t splits = (int64_t) threads * POOL_SPLITS;
+    pool_job job = {fn, args, (count + splits - 1) / splits, threads, 0, count, 0};
+    __atomic_add_fetch(&jobs, 1, __ATOMIC_RELAXED);
+    pool_task root = {&job, 0, count};
+    if (self != NULL) {
+        run_task(&root);
+        while (__atomic_load_n(&job.remaining, __ATOMIC_ACQUIRE) > 0) {
+            if (!work_once()) {
+                sched_yield();
+            }
+        }
+        return 0;
+    }
+    int n = pool_workers();
+    unsigned first = __atomic_fetch_add(&next_worker, 1, __ATOMIC_RELAXED);
+    int pushed = 0;
+    for (int i = 0; i < n && !pushed; i++) {
+        pushed = push_task(workers[(first + i) % n], root) == 0;
+    }
+    if (!pushed) {
+        fn(args, 0, count);
+        return 0;
+    }
+    pthread_mutex_lock(&pool_lock);
+    while (__atomic_load_n(&job.remaining, __ATOMIC_ACQUIRE) > 0) {
+        pthread_cond_wait(&done_cond, &pool_lock);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return 0;
+}
+
+static void run_detached(void *args, int64_t begin, int64_t end) {
+    detached_job *detached = args;
+    detached->fn(detached->args);
+}
+
+/*
+ * Queue fn(args) to run once on some worker and return without waiting for it, starting
+ * `count` workers if there are fewer. From a worker the call goes on that worker's own deque.
+ * Return 0 upon success and -1 if it could not be queued.
+ */
+int pool_submit(int count, void (*fn)(void *args), void *args) {
+    if (pool_workers() < count && pool_start(count) != 0) {
+        return -1;
+    }
+    detached_job *detached = malloc(sizeof(detached_job));
+    if (detached == NULL) {
+        return -1;
+    }
+    pool_job job = {run_detached, detached, 1, 1, 0, 1, 1};
+    detached->job = job;
+    detached->fn = fn;
+    detached->args = args;
+    pool_task task = {&detached->job, 0, 1};
+    __atomic_add_fetch(&jobs, 1, __ATOMIC_RELAXED);
+    if (self != NULL && push_task(self, task) == 0) {
+        return 0;
+    }
+    int n = pool_workers();
+    unsigned first = __atomic_fetch_add(&next_worker, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < n; i++) {
+        if (push_task(workers[(first + i) % n], task) == 0) {
+            return 0;
+        }
+    }
+    free(detached);
+    return -1;
+}
+
+/*
+ * Run fn(args) once on every worker, for per-thread state such as hardware counters, and wait
+ * for all of them. Starts a one-worker pool if there is none. Return 0 upon success and -1 when
+ * called from a worker, which cannot wait for itself, or if no worker could be started.
+ */
+int pool_broadcast(void (*fn)(void *args), void *args) {
+    if (self != NULL || (pool_workers() == 0 && pool_start(1) != 0)) {
+        return -1;
+    }
+    pthread_mutex_lock(&broadcast_lock);
+    pthread_mutex_lock(&pool_lock);
+    int n = num_workers;
+    __atomic_store_n(&broadcast_pending, n, __ATOMIC_RELAXED);
+    for (int i = 0; i < n; i++) {
+        workers[i]->callArgs = args;
+        __atomic_store_n(&workers[i]->call, fn, __ATOMIC_RELEASE);
+    }
+    __atomic_add_fetch(&generation, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&work_cond);
+    while (__atomic_load_n(&broadcast_pending, __ATOMIC_ACQUIRE) > 0) {
+        pthread_cond_wait(&done_cond, &pool_lock);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    pthread_mutex_unlock(&broadcast_lock);
+    return 0;
+}
+
+/*
+ * Totals over every worker since the pool started. Workers update their own counters without
+ * synchronisation, so a read while they run may be slightly behind.
+ */
+void pool_get_counters(pool_counters *counters) {
+    memset(counters, 0, sizeof(pool_counters));
+    counters->jobs = __atomic_load_n(&jobs, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&pool_lock);
+    for (int i = 0; i < num_workers; i++) {
+        counters->tasks += workers[i]->counters.tasks;
+        counters->steals += workers[i]->counters.steals;
+        counters->sleeps += workers[i]->counters.sleeps;
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
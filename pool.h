@@ -0,0 +1,30 @@
+#include <stdint.h>
+
+/*
+ * A persistent work-stealing thread pool that parallel_for hands PLAN_THREADED kernels to instead
+ * of opening an OpenMP region per call. Every worker owns a deque of range tasks: it splits the
+ * range it is running in halves, pushes the upper half onto the bottom of its own deque and keeps
+ * the lower half, until what is left is no bigger than the job's grain. Idle workers steal from
+ * the top of other deques, where the biggest halves are. Callers from outside the pool block
+ * until their job is done, so however many threads call numc at once, only the pool's workers
+ * compute; a worker that calls back in (a kernel inside a kernel) runs tasks while it waits.
+ * pool_submit queues a whole call without waiting for it, for numc's futures.
+ */
+
+typedef void (*pool_fn)(void *args, int64_t begin, int64_t end);
+
+typedef struct pool_counters {
+    uint64_t jobs;          // pool_for and pool_submit calls that went to the pool
+    uint64_t tasks;         // ranges run, after splitting
+    uint64_t steals;        // tasks taken from another worker's deque
+    uint64_t sleeps;        // times a worker ran out of work and went to sleep
+} pool_counters;
+
+int pool_start(int workers);
+void pool_stop(void);
+int pool_workers(void);
+int pool_in_worker(void);
+int pool_for(int threads, int64_t count, pool_fn fn, void *args);
+int pool_submit(int count, void (*fn)(void *args), void *args);
+int pool_broadcast(void (*fn)(void *args), void *args);
+void pool_get_counters(pool_counters *counters);
@@ -0,0 +1,687 @@
+#include "matrix.h"
+#include "profile.h"
+#include "pool.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <omp.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+const char *kernel_names[NUM_KERNELS] = {
+    "allocate_matrix",
+    "fill_matrix",
+    "add_matrix",
+    "sub_matrix",
+    "mul_matrix",
+    "pow_matrix",
+    "neg_matrix",
+    "abs_matrix",
+    "assign_matrix",
+    "exp_matrix",
+    "log_matrix",
+    "sqrt_matrix",
+    "tanh_matrix",
+    "sigmoid_matrix",
+    "power_matrix",
+    "compare_matrix",
+    "where_matrix",
+    "allclose_matrix",
+    "random_matrix",
+    "matmul_ooc",
+    "lu_factor",
+    "lu_solve",
+    "cholesky",
+    "trsm",
+    "qr",
+    "eigh",
+    "svd",
+};
+
+const char *perf_counter_names[PERF_COUNTERS] = {
+    "cycles",
+    "instructions",
+    "llc_misses",
+    "fp_ops",
+};
+
+volatile int stats_enabled = 0;
+volatile int trace_enabled = 0;
+volatile int perf_enabled = 0;
+
+static void perf_begin(int kernel, int64_t rows, int64_t cols, int64_t inner);
+static void perf_finish(int kernel, uint64_t elapsed);
+
+/*
+ * A thread's counters. Slots are never freed: when a thread exits its slot is released for the
+ * next new thread to claim, which keeps accumulating into it, so totals survive thread churn.
+ * `epoch` implements reset without touching other threads' slots: a slot whose epoch is behind
+ * the global one counts as zero, and its owner clears it before the next write.
+ */
+typedef struct stats_slot {
+    kernel_stats kernels[NUM_KERNELS];
+    uint64_t epoch;
+    int owned;
+    struct stats_slot *next;
+} stats_slot;
+
+static stats_slot *slots = NULL;
+static pthread_mutex_t slots_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t slot_key;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+static volatile uint64_t stats_epoch = 1;
+static __thread stats_slot *my_slot = NULL;
+
+uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void release_slot(void *slot) {
+    pthread_mutex_lock(&slots_lock);
+    ((stats_slot *) slot)->owned = 0;
+    pthread_mutex_unlock(&slots_lock);
+}
+
+static void make_slot_key(void) {
+    pthread_key_create(&slot_key, release_slot);
+}
+
+/*
+ * Give the calling thread a slot, reusing one released by an exited thread if possible. This
+ * is the only place that locks, once per thread.
+ */
+static stats_slot *claim_slot(void) {
+    pthread_once(&slot_key_once, make_slot_key);
+    pthread_mutex_lock(&slots_lock);
+    stats_slot *slot = slots;
+    while (slot != NULL && slot->owned) {
+        slot = slot->next;
+    }
+    if (slot == NULL && (slot = calloc(1, sizeof(stats_slot))) != NULL) {
+        slot->epoch = stats_epoch;
+        slot->next = slots;
+        slots = slot;
+    }
+    if (slot != NULL) {
+        slot->owned = 1;
+    }
+    pthread_mutex_unlock(&slots_lock);
+    if (slot != NULL) {
+        pthread_setspecific(slot_key, slot);
+    }
+    my_slot = slot;
+    return slot;
+}
+
+/*
+ * Called by stats_begin when stats, tracing or counters are on: reads the counters, opens the
+ * kernel's trace event and returns the start time.
+ */
+uint64_t stats_start(int kernel, int64_t rows, int64_t cols, int64_t inner) {
+    if (perf_enabled) {
+        perf_begin(kernel, rows, cols, inner);
+    }
+    if (trace_enabled) {
+        trace_event("kernel", kernel_names[kernel], 'B', rows, cols, 0, 0, 0);
+    }
+    return stats_now();
+}
+
+/*
+ * Add one call of `kernel` that began at `start` and ran on `team` threads (0 for work outside
+ * any team) to the calling thread's counters, and close its trace event.
+ */
+void stats_record(int kernel, uint64_t start, uint64_t elements, uint64_t bytes, int team) {
+    uint64_t elapsed = stats_now() - start;
+    if (trace_enabled) {
+        trace_event("kernel", kernel_names[kernel], 'E', 0, 0, 0, 0, team);
+    }
+    perf_finish(kernel, elapsed);
+    if (!stats_enabled) {
+        return;
+    }
+    stats_slot *slot = my_slot != NULL ? my_slot : claim_slot();
+    if (slot == NULL) {
+        return;
+    }
+    uint64_t epoch = stats_epoch;
+    if (slot->epoch != epoch) {
+        memset(slot->kernels, 0, sizeof(slot->kernels));
+        slot->epoch = epoch;
+    }
+    kernel_stats *k = &slot->kernels[kernel];
+    k->calls++;
+    k->total_ns += elapsed;
+    if (elapsed > k->max_ns) {
+        k->max_ns = elapsed;
+    }
+    k->elements += elements;
+    k->bytes += bytes;
+    if (team > 1) {
+        k->parallel++;
+    } else {
+        k->serial++;
+    }
+}
+
+/*
+ * Sum every thread's counters into `totals`. Slots that are being written concurrently may be
+ * read mid-update; the counters are independent words, so at worst a call shows up late.
+ */
+void stats_snapshot(kernel_stats totals[NUM_KERNELS]) {
+    memset(totals, 0, NUM_KERNELS * sizeof(kernel_stats));
+    uint64_t epoch = stats_epoch;
+    pthread_mutex_lock(&slots_lock);
+    for (stats_slot *slot = slots; slot != NULL; slot = slot->next) {
+        if (slot->epoch != epoch) {
+            continue;
+        }
+        for (int i = 0; i < NUM_KERNELS; i++) {
+            kernel_stats *k = &slot->kernels[i];
+            totals[i].calls += k->calls;
+            totals[i].total_ns += k->total_ns;
+            totals[i].max_ns = k->max_ns > totals[i].max_ns ? k->max_ns : totals[i].max_ns;
+            totals[i].elements += k->elements;
+            totals[i].bytes += k->bytes;
+            totals[i].serial += k->serial;
+            totals[i].parallel += k->parallel;
+        }
+    }
+    pthread_mutex_unlock(&slots_lock);
+}
+
+void stats_reset(void) {
+    stats_epoch++;
+}
+
+/*
+ * Trace events live in a ring whose capacity is a power of two. Writers claim a sequence number
+ * with one atomic add and never wait; when the ring wraps the oldest events are overwritten.
+ * Each record's `seq` is cleared before it is rewritten and set to sequence number + 1 after, so
+ * the reader can tell a complete record from a torn or stale one, seqlock style.
+ */
+typedef struct trace_record {
+    uint64_t seq;
+    uint64_t ts;
+    const char *cat;
+    const char *name;
+    int64_t rows, cols;     // shape of the result
+    int64_t rows2, cols2;   // shape of the other operand, if any
+    int tid;
+    int team;
+    char phase;
+} trace_record;
+
+typedef struct trace_ring {
+    uint64_t mask;
+    uint64_t head;          // next sequence number to hand out
+    uint64_t tail;          // everything before this has been dumped
+    trace_record records[];
+} trace_ring;
+
+/*
+ * A writer may still hold the previous ring after trace_start replaces it, so replaced rings are
+ * never freed. They are only replaced when the capacity changes.
+ */
+static trace_ring *trace_buffer = NULL;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread int my_tid = 0;
+
+void trace_event(const char *cat, const char *name, char phase, int64_t rows, int64_t cols,
+    int64_t rows2, int64_t cols2, int team) {
+    trace_ring *ring = __atomic_load_n(&trace_buffer, __ATOMIC_ACQUIRE);
+    if (ring == NULL) {
+        return;
+    }
+    if (my_tid == 0) {
+        my_tid = (int) syscall(SYS_gettid);
+    }
+    uint64_t seq = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    trace_record *rec = &ring->records[seq & ring->mask];
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    rec->ts = stats_now();
+    rec->cat = cat;
+    rec->name = name;
+    rec->rows = rows;
+    rec->cols = cols;
+    rec->rows2 = rows2;
+    rec->cols2 = cols2;
+    rec->tid = my_tid;
+    rec->team = team;
+    rec->phase = phase;
+    __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Turn tracing on with room for at least `capacity` events, rounded up to a power of two.
+ * Return 0 upon success and -1 if the ring could not be allocated.
+ */
+int trace_start(size_t capacity) {
+    size_t size = 1024;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    pthread_mutex_lock(&trace_lock);
+    if (trace_buffer == NULL || trace_buffer->mask + 1 != size) {
+        trace_ring *ring = calloc(1, sizeof(trace_ring) + size * sizeof(trace_record));
+        if (ring == NULL) {
+            pthread_mutex_unlock(&trace_lock);
+            return -1;
+        }
+        ring->mask = size - 1;
+        __atomic_store_n(&trace_buffer, ring, __ATOMIC_RELEASE);
+    }
+    trace_enabled = 1;
+    pthread_mutex_unlock(&trace_lock);
+    return 0;
+}
+
+/*
+ * Turn tracing off. Events recorded so far stay in the ring for trace_dump.
+ */
+void trace_stop(void) {
+    trace_enabled = 0;
+}
+
+/*
+ * Write the events recorded since the last dump to `path` as Chrome trace JSON, oldest first, and
+ * drop them from the ring. Events still being written are skipped. Return the number of events
+ * written, or -1 with errno set if the file could not be written.
+ */
+long trace_dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    long count = 0;
+    int pid = (int) getpid();
+    fputs("{\"traceEvents\":[", f);
+    pthread_mutex_lock(&trace_lock);
+    trace_ring *ring = trace_buffer;
+    if (ring != NULL) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t first = head - ring->tail > ring->mask + 1 ? head - ring->mask - 1 : ring->tail;
+        for (uint64_t seq = first; seq < head; seq++) {
+            trace_record *slot = &ring->records[seq & ring->mask];
+            if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq + 1) {
+                continue;
+            }
+            trace_record rec = *slot;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq + 1) {
+                continue;
+            }
+            fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                "\"pid\":%d,\"tid\":%d,\"args\":{", count ? "," : "", rec.name, rec.cat,
+                rec.phase, rec.ts / 1000.0, pid, rec.tid);
+            if (rec.phase == 'B') {
+                fprintf(f, "\"shape\":[%" PRId64 ",%" PRId64 "]", rec.rows, rec.cols);
+                if (rec.rows2 != 0 || rec.cols2 != 0) {
+                    fprintf(f, ",\"other\":[%" PRId64 ",%" PRId64 "]", rec.rows2, rec.cols2);
+                }
+            } else if (rec.team != 0) {
+                fprintf(f, "\"team\":%d", rec.team);
+            }
+            fputs("}}", f);
+            count++;
+        }
+        ring->tail = head;
+    }
+    pthread_mutex_unlock(&trace_lock);
+    fputs("\n],\"displayTimeUnit\":\"ns\"}\n", f);
+    if (ferror(f)) {
+        fclose(f);
+        return -1;
+    }
+    if (fclose(f) != 0) {
+        return -1;
+    }
+    return count;
+}
+
+/*
+ * Hardware counters. Every thread opens its own events the first time it reads them, and a
+ * kernel's count is the sum over the OpenMP team, read in a parallel region of its own before
+ * and after the kernel. The FP events are Intel's FP_ARITH_INST_RETIRED (scalar, 128-bit and
+ * 256-bit packed double), which have no portable equivalent, so other CPUs go without.
+ */
+enum {
+    EVENT_CYCLES,
+    EVENT_INSTRUCTIONS,
+    EVENT_LLC_MISSES,
+    EVENT_FP_SCALAR,
+    EVENT_FP_128,
+    EVENT_FP_256,
+    NUM_EVENTS
+};
+
+typedef struct perf_thread {
+    int fds[NUM_EVENTS];
+} perf_thread;
+
+/* A kernel that has begun on this thread; kernels nest, e.g. pow_matrix calls allocate_matrix */
+typedef struct perf_frame {
+    int kernel;
+    int64_t rows, cols, inner;
+    uint64_t values[NUM_EVENTS];
+} perf_frame;
+
+#define PERF_DEPTH 8
+
+static __thread perf_thread *my_events = NULL;
+static __thread perf_frame perf_stack[PERF_DEPTH];
+static __thread int perf_depth = 0;
+static pthread_key_t events_key;
+static pthread_once_t events_key_once = PTHREAD_ONCE_INIT;
+
+static perf_entry perf_table[PERF_BUCKETS];
+static int perf_used = 0;
+static pthread_mutex_t perf_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int open_event(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static int has_intel_fp_events(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    /* "GenuineIntel" */
+    return ebx == 0x756e6547 && edx == 0x49656e69 && ecx == 0x6c65746e;
+#else
+    return 0;
+#endif
+}
+
+static void close_events(void *events) {
+    perf_thread *t = events;
+    for (int e = 0; e < NUM_EVENTS; e++) {
+        if (t->fds[e] >= 0) {
+            close(t->fds[e]);
+        }
+    }
+    free(t);
+}
+
+static void make_events_key(void) {
+    pthread_key_create(&events_key, close_events);
+}
+
+/*
+ * Open the calling thread's events. Any that fail stay -1 and read as zero. Return NULL only if
+ * out of memory.
+ */
+static perf_thread *open_events(void) {
+    static const uint64_t fp_configs[3] = {0x01c7, 0x04c7, 0x10c7};
+    pthread_once(&events_key_once, make_events_key);
+    perf_thread *t = malloc(sizeof(perf_thread));
+    if (t == NULL) {
+        return NULL;
+    }
+    t->fds[EVENT_CYCLES] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    t->fds[EVENT_INSTRUCTIONS] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    t->fds[EVENT_LLC_MISSES] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    int fp = has_intel_fp_events();
+    for (int i = 0; i < 3; i++) {
+        t->fds[EVENT_FP_SCALAR + i] = fp ? open_event(PERF_TYPE_RAW, fp_configs[i]) : -1;
+    }
+    pthread_setspecific(events_key, t);
+    my_events = t;
+    return t;
+}
+
+static void read_thread_events(uint64_t values[NUM_EVENTS]) {
+    perf_thread *t = my_events != NULL ? my_events : open_events();
+    if (t == NULL) {
+        return;
+    }
+    for (int e = 0; e < NUM_EVENTS; e++) {
+        uint64_t value;
+        if (t->fds[e] >= 0 && read(t->fds[e], &value, sizeof(value)) == sizeof(value)) {
+            values[e] += value;
+        }
+    }
+}
+
+typedef struct worker_read {
+    uint64_t *values;
+    pthread_mutex_t lock;
+} worker_read;
+
+static void read_worker_events(void *argsPtr) {
+    worker_read *args = argsPtr;
+    uint64_t mine[NUM_EVENTS] = {0};
+    read_thread_events(mine);
+    pthread_mutex_lock(&args->lock);
+    for (int e = 0; e < NUM_EVENTS; e++) {
+        args->values[e] += mine[e];
+    }
+    pthread_mutex_unlock(&args->lock);
+}
+
+/*
+ * Sum the events over every thread a kernel called from here could run on: the calling thread
+ * and the pool's workers, or the OpenMP team with thread_pool off. Inside a parallel region or a
+ * pool task only the calling thread is read.
+ */
+static void read_events(uint64_t values[NUM_EVENTS]) {
+    memset(values, 0, NUM_EVENTS * sizeof(uint64_t));
+    if (omp_in_parallel() || pool_in_worker()) {
+        read_thread_events(values);
+        return;
+    }
+    if (thread_pool) {
+        worker_read args = {values, PTHREAD_MUTEX_INITIALIZER};
+        read_thread_events(values);
+        if (pool_workers() < get_num_threads()) {
+            pool_start(get_num_threads());
+        }
+        pool_broadcast(read_worker_events, &args);
+        return;
+    }
+    #pragma omp parallel
+    {
+        uint64_t mine[NUM_EVENTS] = {0};
+        read_thread_events(mine);
+        #pragma omp critical(perf_read)
+        for (int e = 0; e < NUM_EVENTS; e++) {
+            values[e] += mine[e];
+        }
+    }
+}
+
+static void perf_begin(int kernel, int64_t rows, int64_t cols, int64_t inner) {
+    if (perf_depth >= PERF_DEPTH) {
+        return;
+    }
+    perf_frame *frame = &perf_stack[perf_depth++];
+    frame->kernel = kernel;
+    frame->rows = rows;
+    frame->cols = cols;
+    frame->inner = inner;
+    read_events(frame->values);
+}
+
+static int64_t bucket(int64_t n) {
+    int64_t b = 1;
+    while (b < n) {
+        b <<= 1;
+    }
+    return n > 0 ? b : 0;
+}
+
+/*
+ * Operation count and compulsory memory traffic of one call. pow_matrix's `inner` is rows times
+ * the number of products, each of which reads two operands and writes and copies its result.
+ */
+static void perf_model(perf_frame *frame, double *flops, double *bytes) {
+    double rows = frame->rows, cols = frame->cols, inner = frame->inner;
+    double n = rows * cols;
+    switch (frame->kernel) {
+        case KERNEL_ADD:
+        case KERNEL_SUB:
+        case KERNEL_COMPARE:
+        case KERNEL_WHERE:
+            *flops = n;
+            *bytes = 3 * n * sizeof(double);
+            break;
+        case KERNEL_NEG:
+        case KERNEL_ABS:
+        case KERNEL_EXP:
+        case KERNEL_LOG:
+        case KERNEL_SQRT:
+        case KERNEL_TANH:
+        case KERNEL_SIGMOID:
+        case KERNEL_POWER:
+        case KERNEL_ALLCLOSE:
+            *flops = n;
+            *bytes = 2 * n * sizeof(double);
+            break;
+        case KERNEL_ASSIGN:
+            *flops = 0;
+            *bytes = 2 * n * sizeof(double);
+            break;
+        case KERNEL_MUL:
+            *flops = 2 * n * inner;
+            *bytes = (rows * inner + inner * cols + 2 * n) * sizeof(double);
+            break;
+        case KERNEL_POW:
+            *flops = 2 * n * inner;
+            *bytes = rows > 0 ? 4 * n * (inner / rows) * sizeof(double) : 0;
+            break;
+        case KERNEL_LU:
+            *flops = 2.0 / 3 * n * rows;
+            *bytes = 2 * n * sizeof(double);
+            break;
+        case KERNEL_LU_SOLVE:
+            *flops = 2 * n * inner;
+            *bytes = (inner * inner + 2 * n) * sizeof(double);
+            break;
+        case KERNEL_CHOLESKY:
+            *flops = 1.0 / 3 * n * rows;
+            *bytes = n * sizeof(double);
+            break;
+        case KERNEL_TRSM:
+            *flops = n * inner;
+            *bytes = (inner * inner / 2 + 2 * n) * sizeof(double);
+            break;
+        case KERNEL_QR:
+            *flops = 2 * n * inner - 2.0 / 3 * inner * inner * inner;
+            *bytes = 2 * n * sizeof(double);
+            break;
+        case KERNEL_EIGH:
+            *flops = 9 * n * inner;
+            *bytes = 2 * n * sizeof(double);
+            break;
+        default:
+            *flops = 0;
+            *bytes = n * sizeof(double);
+    }
+}
+
+/*
+ * Close the frame perf_begin opened for `kernel`, if any, and add it to its bucket.
+ */
+static void perf_finish(int kernel, uint64_t elapsed) {
+    if (perf_depth == 0 || perf_stack[perf_depth - 1].kernel != kernel) {
+        return;
+    }
+    perf_frame *frame = &perf_stack[--perf_depth];
+    uint64_t now[NUM_EVENTS];
+    read_events(now);
+    uint64_t delta[NUM_EVENTS];
+    for (int e = 0; e < NUM_EVENTS; e++) {
+        delta[e] = now[e] - frame->values[e];
+    }
+    double flops, bytes;
+    perf_model(frame, &flops, &bytes);
+    int64_t rows = bucket(frame->rows);
+    int64_t cols = bucket(frame->cols);
+
+    pthread_mutex_lock(&perf_lock);
+    perf_entry *entry = NULL;
+    for (int i = 0; i < perf_used; i++) {
+        if (perf_table[i].kernel == kernel && perf_table[i].rows == rows &&
+                perf_table[i].cols == cols) {
+            entry = &perf_table[i];
+            break;
+        }
+    }
+    if (entry == NULL && perf_used < PERF_BUCKETS) {
+        entry = &perf_table[perf_used++];
+        memset(entry, 0, sizeof(perf_entry));
+        entry->kernel = kernel;
+        entry->rows = rows;
+        entry->cols = cols;
+    }
+    if (entry != NULL) {
+        entry->calls++;
+        entry->total_ns += elapsed;
+        entry->flops += flops;
+        entry->bytes += bytes;
+        entry->counters[PERF_CYCLES] += delta[EVENT_CYCLES];
+        entry->counters[PERF_INSTRUCTIONS] += delta[EVENT_INSTRUCTIONS];
+        entry->counters[PERF_LLC_MISSES] += delta[EVENT_LLC_MISSES];
+        entry->counters[PERF_FP_OPS] += delta[EVENT_FP_SCALAR] + 2 * delta[EVENT_FP_128] +
+            4 * delta[EVENT_FP_256];
+    }
+    pthread_mutex_unlock(&perf_lock);
+}
+
+/*
+ * Turn the counters on. Return a mask with bit PERF_X set for each counter the calling thread
+ * could open; 0 means only times and modelled work will be reported.
+ */
+int perf_start(void) {
+    perf_thread *t = my_events != NULL ? my_events : open_events();
+    perf_enabled = 1;
+    if (t == NULL) {
+        return 0;
+    }
+    int mask = 0;
+    mask |= t->fds[EVENT_CYCLES] >= 0 ? 1 << PERF_CYCLES : 0;
+    mask |= t->fds[EVENT_INSTRUCTIONS] >= 0 ? 1 << PERF_INSTRUCTIONS : 0;
+    mask |= t->fds[EVENT_LLC_MISSES] >= 0 ? 1 << PERF_LLC_MISSES : 0;
+    mask |= t->fds[EVENT_FP_SCALAR] >= 0 && t->fds[EVENT_FP_128] >= 0 &&
+        t->fds[EVENT_FP_256] >= 0 ? 1 << PERF_FP_OPS : 0;
+    return mask;
+}
+
+void perf_stop(void) {
+    perf_enabled = 0;
+}
+
+/*
+ * Copy up to `max` buckets into `entries`, in the order they were first hit. Return how many.
+ */
+int perf_snapshot(perf_entry *entries, int max) {
+    pthread_mutex_lock(&perf_lock);
+    int count = perf_used < max ? perf_used : max;
+    memcpy(entries, perf_table, count * sizeof(perf_entry));
+    pthread_mutex_unlock(&perf_lock);
+    return count;
+}
+
+void perf_reset(void) {
+    pthread_mutex_lock(&perf_lock);
+    perf_used = 0;
+    pthread_mutex_unlock(&perf_lock);
+}
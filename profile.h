@@ -0,0 +1,145 @@
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Per-kernel profiling counters. Each thread that calls into matrix.c owns a slot of counters that
+ * only it writes to, so recording never takes a lock or touches a contended cache line; readers
+ * add the slots up. Recording is off until stats_enabled is set, and then costs two clock reads
+ * per kernel call.
+ *
+ * Tracing is the timeline counterpart: while trace_enabled is set, every kernel (and every
+ * operator in numc.c) appends a begin and an end event to a ring buffer that trace_dump writes out
+ * in Chrome trace format, for chrome://tracing or ui.perfetto.dev.
+ *
+ * Hardware counters (perf_enabled) read cycles, instructions, last-level cache misses and FP
+ * operations via perf_event_open around each kernel, summed over the worker threads, and
+ * aggregate them per kernel and shape bucket for a roofline report. Where the counters cannot be
+ * opened the report still has times and the modelled FLOPs and bytes.
+ */
+
+/* Kernels with their own counters; kernel_names has the matching names */
+enum {
+    KERNEL_ALLOCATE,
+    KERNEL_FILL,
+    KERNEL_ADD,
+    KERNEL_SUB,
+    KERNEL_MUL,
+    KERNEL_POW,
+    KERNEL_NEG,
+    KERNEL_ABS,
+    KERNEL_ASSIGN,
+    KERNEL_EXP,
+    KERNEL_LOG,
+    KERNEL_SQRT,
+    KERNEL_TANH,
+    KERNEL_SIGMOID,
+    KERNEL_POWER,
+    KERNEL_COMPARE,
+    KERNEL_WHERE,
+    KERNEL_ALLCLOSE,
+    KERNEL_RANDOM,
+    KERNEL_MATMUL_OOC,
+    KERNEL_LU,
+    KERNEL_LU_SOLVE,
+    KERNEL_CHOLESKY,
+    KERNEL_TRSM,
+    KERNEL_QR,
+    KERNEL_EIGH,
+    KERNEL_SVD,
+    NUM_KERNELS
+};
+
+typedef struct kernel_stats {
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t elements;      // elements of the results produced
+    uint64_t bytes;         // bytes allocated (allocate_matrix only)
+    uint64_t serial;        // calls that ran on the calling thread alone
+    uint64_t parallel;      // calls split over two or more threads
+} kernel_stats;
+
+#define PERF_BUCKETS 256
+
+/* Hardware counters; a counter's bit is set in perf_start's result if it could be opened */
+enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_FP_OPS,
+    PERF_COUNTERS
+};
+
+/*
+ * One kernel and shape bucket: calls on results of at most rows x cols (both powers of two) and
+ * more than half that in each dimension.
+ */
+typedef struct perf_entry {
+    int kernel;
+    int64_t rows;
+    int64_t cols;
+    uint64_t calls;
+    uint64_t total_ns;
+    double flops;           // from the kernel's operation count
+    double bytes;           // compulsory traffic: every operand read and result written once
+    uint64_t counters[PERF_COUNTERS];
+} perf_entry;
+
+extern const char *kernel_names[NUM_KERNELS];
+extern const char *perf_counter_names[PERF_COUNTERS];
+extern volatile int stats_enabled;
+extern volatile int trace_enabled;
+extern volatile int perf_enabled;
+
+uint64_t stats_now(void);
+uint64_t stats_start(int kernel, int64_t rows, int64_t cols, int64_t inner);
+void stats_record(int kernel, uint64_t start, uint64_t elements, uint64_t bytes, int team);
+void stats_snapshot(kernel_stats totals[NUM_KERNELS]);
+void stats_reset(void);
+
+void trace_event(const char *cat, const char *name, char phase, int64_t rows, int64_t cols,
+    int64_t rows2, int64_t cols2, int team);
+int trace_start(size_t capacity);
+void trace_stop(void);
+long trace_dump(const char *path);
+
+int perf_start(void);
+void perf_stop(void);
+int perf_snapshot(perf_entry *entries, int max);
+void perf_reset(void);
+
+/*
+ * Bracket a kernel with these: `start` is 0 when stats, tracing and counters are all off, in
+ * which case nothing is recorded. `rows` and `cols` are the shape of the result and `inner` the
+ * summed dimension of a matrix product (0 for element-wise kernels), for the trace and the FLOP
+ * count.
+ */
+static inline uint64_t stats_begin(int kernel, int64_t rows, int64_t cols, int64_t inner) {
+    if (stats_enabled | trace_enabled | perf_enabled) {
+        return stats_start(kernel, rows, cols, inner);
+    }
+    return 0;
+}
+
+static inline void stats_end(int kernel, uint64_t start, uint64_t elements, int team) {
+    if (start != 0) {
+        stats_record(kernel, start, elements, 0, team);
+    }
+}
+
+/*
+ * Trace-only brackets for code that has no counters of its own: numc.c operators and the
+ * parallel regions inside a kernel. `team` is the number of threads the region ran on.
+ */
+static inline void trace_begin(const char *cat, const char *name, int64_t rows, int64_t cols,
+    int64_t rows2, int64_t cols2) {
+    if (trace_enabled) {
+        trace_event(cat, name, 'B', rows, cols, rows2, cols2, 0);
+    }
+}
+
+static inline void trace_end(const char *cat, const char *name, int team) {
+    if (trace_enabled) {
+        trace_event(cat, name, 'E', 0, 0, 0, 0, team);
+    }
+}
@@ -6,11 +6,12 @@ def main():
 	LDFLAGS = ['-fopenmp']
 	# Use the setup function we imported and set up the modules.
 	# You may find this reference helpful: https://docs.python.org/3.6/extending/building.html
-	module1 = Extension('numc',sources = ['matrix.c','numc.c'], extra_compile_args=CFLAGS, extra_link_args=LDFLAGS)
+	module1 = Extension('numc',sources = ['matrix.c','profile.c','pool.c','linalg.c','numc.c'], extra_compile_args=CFLAGS, extra_link_args=LDFLAGS, libraries=['m', 'rt'])
 	setup (name = 'numc',
        version = '1.0',
        description = 'This is a useless package',
-       ext_modules = [module1])
+       ext_modules = [module1],
+       py_modules = ['numc_autotune'])
 
 if __name__ == "__main__":
     main()
@@ -0,0 +1,50 @@
+"""
+Regression tests for numc.Future done callbacks. Run with `python3 -m unittest discover tests`
+after `make install`.
+"""
+import subprocess
+import sys
+import textwrap
+import unittest
+
+# Done callbacks used to run on the pool worker that completed the Future, which took the GIL
+# while the main thread held it in an element-wise operator waiting on that same pool.
+CALLBACKS_WITH_OPERATORS = textwrap.dedent("""
+    import threading
+    import numc as nc
+
+    nc.set_num_threads(2)
+    a = nc.Matrix(300, 300, rand=True, seed=1)
+    big = nc.Matrix(2000, 2000, rand=True, seed=2)
+    lock = threading.Lock()
+    hits = []
+    def done(future):
+        with lock:
+            hits.append(future)
+    futures = [a.matmul_async(a) for _ in range(4)]
+    for future in futures:
+        future.add_done_callback(done)
+    for _ in range(5):
+        big = abs(-(big + big) - big)
+    for future in futures:
+        future.result()
+    for _ in range(100):
+        if len(hits) == 4:
+            break
+        threading.Event().wait(0.05)
+    assert len(hits) == 4, hits
+""")
+
+
+class FutureCallbackTest(unittest.TestCase):
+    def test_callbacks_with_operators(self):
+        try:
+            proc = subprocess.run([sys.executable, "-c", CALLBACKS_WITH_OPERATORS],
+                                  capture_output=True, text=True, timeout=60)
+        except subprocess.TimeoutExpired:
+            self.fail("done callbacks deadlocked with element-wise operators")
+        self.assertEqual(proc.returncode, 0, proc.stderr)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,42 @@
+"""
+Regression tests for numc.Matrix subscripts. Run with `python3 -m unittest discover tests`
+after `make install`.
+"""
+import subprocess
+import sys
+import textwrap
+import unittest
+
+# Slicing a copy-on-write copy first gives it its own buffer. When that allocation failed,
+# __getitem__ returned a Matrix with an uninitialized pointer and an exception already set.
+SLICE_COPY_WITHOUT_MEMORY = textwrap.dedent("""
+    import resource
+    import numc as nc
+
+    b = nc.Matrix(3000, 3000, rand=True, seed=1)
+    c = b.copy()
+    with open("/proc/self/status") as status:
+        size = next(int(line.split()[1]) for line in status if line.startswith("VmSize:"))
+    # Room for anything small, but not for a second 72MB buffer
+    limit = (size + 32 * 1024) * 1024
+    resource.setrlimit(resource.RLIMIT_AS, (limit, limit))
+    for key in (slice(0, 3), 2, (slice(0, 3), slice(1, 4)), (slice(0, 3), 1), (1, slice(0, 3)),
+                (slice(0, 4, 2), slice(0, 4, 2))):
+        try:
+            c[key]
+        except RuntimeError:
+            continue
+        raise AssertionError("slicing %r allocated past the limit" % (key,))
+""")
+
+
+class SubscriptTest(unittest.TestCase):
+    @unittest.skipUnless(sys.platform.startswith("linux"), "reads /proc/self/status")
+    def test_slice_copy_without_memory(self):
+        proc = subprocess.run([sys.executable, "-c", SLICE_COPY_WITHOUT_MEMORY],
+                              capture_output=True, text=True, timeout=60)
+        self.assertEqual(proc.returncode, 0, proc.stderr)
+
+
+if __name__ == "__main__":
+    unittest.main()